@@ -185,6 +185,7 @@ typedef struct OptionsContext {
     int       nb_attachments;
 
     int chapters_input_file;
+    int split_programs;
 
     int64_t recording_time;
     int64_t stop_time;
@@ -289,6 +290,9 @@ typedef struct InputFilterOptions {
     unsigned            flags;
 
     AVFrame            *fallback;
+
+    // decoder feeding this input, if any
+    struct Decoder     *dec;
 } InputFilterOptions;
 
 enum OFilterFlags {
@@ -828,6 +832,12 @@ void dec_free(Decoder **pdec);
 int dec_filter_add(Decoder *dec, InputFilter *ifilter, InputFilterOptions *opts,
                    const ViewSpecifier *vs, SchedulerNode *src);
 
+/*
+ * Called by filters to request room around the decoded video frames, as
+ * left, top, right and bottom border in pixels. This is a hint only.
+ */
+void dec_set_frame_border(Decoder *dec, const int border[4]);
+
 /*
  * For multiview video, request output of the view(s) determined by vs.
  * May be called multiple times.
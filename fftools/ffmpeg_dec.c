@@ -98,6 +98,10 @@ typedef struct DecoderPriv {
     }                  *view_map;
     int              nb_view_map;
 
+    // room requested by the filtergraph around decoded video frames,
+    // as left, top, right, bottom; may be updated while decoding
+    atomic_int          frame_border[4];
+
     struct {
         AVDictionary       *opts;
         const AVCodec      *codec;
@@ -1354,6 +1358,52 @@ static enum AVPixelFormat get_format(AVCodecContext *s, const enum AVPixelFormat
     return *p;
 }
 
+/* Allocate the frame with the rows the filtergraph wants above and below
+ * the picture, so that e.g. letterboxing can be done without a copy.
+ * Only vertical borders are added, as decoders do not expect the linesize
+ * of their frames to change during decoding. */
+static int video_get_buffer(DecoderPriv *dp, AVCodecContext *dec_ctx,
+                            AVFrame *frame, int flags)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    int top, bottom, width, height, ret;
+
+    if (!desc || dec_ctx->hw_frames_ctx ||
+        !(dec_ctx->codec->capabilities & AV_CODEC_CAP_DR1) ||
+        (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL |
+                        AV_PIX_FMT_FLAG_BITSTREAM)) ||
+        atomic_load(&dp->frame_border[0]) || atomic_load(&dp->frame_border[2]))
+        return avcodec_default_get_buffer2(dec_ctx, frame, flags);
+
+    top    = FFALIGN(atomic_load(&dp->frame_border[1]), 1 << desc->log2_chroma_h);
+    bottom = FFALIGN(atomic_load(&dp->frame_border[3]), 1 << desc->log2_chroma_h);
+    if (!top && !bottom)
+        return avcodec_default_get_buffer2(dec_ctx, frame, flags);
+
+    /* decoders may write up to the aligned height, so the bottom border
+     * starts below that */
+    width  = frame->width;
+    height = frame->height;
+    avcodec_align_dimensions2(dec_ctx, &width, &height, linesize_align);
+    if (height > INT_MAX - top - bottom)
+        return AVERROR(EINVAL);
+    height += top + bottom;
+
+    FFSWAP(int, frame->height, height);
+    ret = avcodec_default_get_buffer2(dec_ctx, frame, flags);
+    frame->height = height;
+    if (ret < 0)
+        return ret;
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(frame->data) && frame->data[i]; i++) {
+        int vsub = (i == 1 || i == 2) ? desc->log2_chroma_h : 0;
+        frame->data[i] += (top >> vsub) * frame->linesize[i];
+    }
+
+    return 0;
+}
+
 static int get_buffer(AVCodecContext *dec_ctx, AVFrame *frame, int flags)
 {
     DecoderPriv *dp = dec_ctx->opaque;
@@ -1371,6 +1421,9 @@ static int get_buffer(AVCodecContext *dec_ctx, AVFrame *frame, int flags)
         }
     }
 
+    if (dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO)
+        return video_get_buffer(dp, dec_ctx, frame, flags);
+
     return avcodec_default_get_buffer2(dec_ctx, frame, flags);
 }
 
@@ -1750,6 +1803,14 @@ int dec_create(const OptionsContext *o, const char *arg, Scheduler *sch)
     return 0;
 }
 
+void dec_set_frame_border(Decoder *d, const int border[4])
+{
+    DecoderPriv *dp = dp_from_dec(d);
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(dp->frame_border); i++)
+        atomic_store(&dp->frame_border[i], border[i]);
+}
+
 int dec_filter_add(Decoder *d, InputFilter *ifilter, InputFilterOptions *opts,
                    const ViewSpecifier *vs, SchedulerNode *src)
 {
@@ -1761,5 +1822,7 @@ int dec_filter_add(Decoder *d, InputFilter *ifilter, InputFilterOptions *opts,
     if (!opts->name)
         return AVERROR(ENOMEM);
 
+    opts->dec = d;
+
     return dec_request_view(d, vs, src);
 }
@@ -2034,6 +2034,17 @@ static int configure_filtergraph(FilterGraph *fg, FilterGraphThread *fgt)
             }
     }
 
+    /* let the decoders allocate frames with the room the graph wants
+     * around them, e.g. for padding in place */
+    for (int i = 0; i < fg->nb_inputs; i++) {
+        InputFilterPriv *ifp = ifp_from_ifilter(fg->inputs[i]);
+        int border[4];
+
+        if (ifp->type_src == AVMEDIA_TYPE_VIDEO && ifp->opts.dec &&
+            av_buffersrc_get_video_border(ifp->filter, border) >= 0)
+            dec_set_frame_border(ifp->opts.dec, border);
+    }
+
     for (int i = 0; i < fg->nb_inputs; i++) {
         InputFilterPriv *ifp = ifp_from_ifilter(fg->inputs[i]);
         AVFrame *tmp;
@@ -141,6 +141,7 @@ static void init_options(OptionsContext *o)
     o->recording_time = INT64_MAX;
     o->limit_filesize = INT64_MAX;
     o->chapters_input_file = INT_MAX;
+    o->split_programs = -1;
     o->accurate_seek  = 1;
     o->thread_queue_size = 0;
     o->input_sync_ref = -1;
@@ -1372,6 +1373,64 @@ static int open_files(OptionGroupList *l, const char *inout, Scheduler *sch,
     return 0;
 }
 
+/* Open one output per program of input file o->split_programs, each
+ * mapping all streams of its program. */
+static int open_output_file(const OptionsContext *o, const char *filename,
+                            Scheduler *sch)
+{
+    const AVFormatContext *ic;
+
+    if (o->split_programs < 0)
+        return of_open(o, filename, sch);
+
+    if (o->split_programs >= nb_input_files) {
+        av_log(NULL, AV_LOG_FATAL, "Invalid input file index %d for -split_programs\n",
+               o->split_programs);
+        return AVERROR(EINVAL);
+    }
+    if (o->nb_stream_maps) {
+        av_log(NULL, AV_LOG_FATAL, "-split_programs cannot be combined with -map\n");
+        return AVERROR(EINVAL);
+    }
+    ic = input_files[o->split_programs]->ctx;
+    if (!ic->nb_programs) {
+        av_log(NULL, AV_LOG_FATAL, "Input file #%d has no programs to split\n",
+               o->split_programs);
+        return AVERROR(EINVAL);
+    }
+
+    for (unsigned i = 0; i < ic->nb_programs; i++) {
+        const AVProgram *p = ic->programs[i];
+        OptionsContext split = *o;
+        char url[1024], map[64];
+        int ret;
+
+        if (av_get_frame_filename2(url, sizeof(url), filename, p->id, 0) < 0) {
+            av_log(NULL, AV_LOG_FATAL, "The output URL %s must contain a %%d "
+                   "pattern for the program id with -split_programs\n", filename);
+            return AVERROR(EINVAL);
+        }
+        if (!p->nb_stream_indexes) {
+            av_log(NULL, AV_LOG_WARNING, "Program %d has no streams, skipping\n", p->id);
+            continue;
+        }
+
+        snprintf(map, sizeof(map), "%d:p:%d", o->split_programs, p->id);
+        split.stream_maps    = NULL;
+        split.nb_stream_maps = 0;
+        ret = opt_map(&split, "map", map);
+        if (ret >= 0)
+            ret = of_open(&split, url, sch);
+        for (int j = 0; j < split.nb_stream_maps; j++)
+            av_freep(&split.stream_maps[j].linklabel);
+        av_freep(&split.stream_maps);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
 int ffmpeg_parse_options(int argc, char **argv, Scheduler *sch)
 {
     GlobalOptionsContext go = { .sch = sch };
@@ -1415,7 +1474,7 @@ int ffmpeg_parse_options(int argc, char **argv, Scheduler *sch)
     }
 
     /* open output files */
-    ret = open_files(&octx.groups[GROUP_OUTFILE], "output", sch, of_open);
+    ret = open_files(&octx.groups[GROUP_OUTFILE], "output", sch, open_output_file);
     if (ret < 0) {
         errmsg = "opening output files";
         goto fail;
@@ -1560,6 +1619,10 @@ const OptionDef options[] = {
     { "map_chapters",           OPT_TYPE_INT, OPT_EXPERT | OPT_OFFSET | OPT_OUTPUT,
         { .off = OFFSET(chapters_input_file) },
         "set chapters mapping", "input_file_index" },
+    { "split_programs",         OPT_TYPE_INT, OPT_EXPERT | OPT_OFFSET | OPT_OUTPUT,
+        { .off = OFFSET(split_programs) },
+        "open one output per program of the input file, %d in the URL is replaced by the program id",
+        "input_file_index" },
     { "t",                      OPT_TYPE_TIME, OPT_OFFSET | OPT_INPUT | OPT_OUTPUT,
         { .off = OFFSET(recording_time) },
         "stop transcoding after specified duration",
@@ -47,6 +47,8 @@ typedef struct{
     int       return_code;
     int       finished;
     int       got_packet;
+    int       quality;     ///< lambda chosen by the delayed-feedback rate control
+    int       bits;        ///< size of the packet in bits, for the rate control
 } Task;
 
 typedef struct{
@@ -67,6 +69,17 @@ typedef struct{
 
     pthread_t worker[MAX_THREADS];
     atomic_int exit;
+
+    /* Delayed-feedback rate control for encoders whose own rate control
+     * cannot be shared between the frame threads (MJPEG). The workers run
+     * with a constant quantizer per frame, chosen here from the sizes of
+     * the packets that have already been returned. */
+    int    rc;
+    double rc_frame_bits;   ///< target size of one frame in bits
+    double rc_window;       ///< number of frames over which errors are spread
+    double rc_complexity;   ///< running average of bits * qscale
+    double rc_error;        ///< bits spent minus bits budgeted so far
+    unsigned rc_task_index; ///< oldest task whose size has not been accounted for
 } ThreadContext;
 
 #define OFF(member) offsetof(ThreadContext, member)
@@ -75,6 +88,75 @@ DEFINE_OFFSET_ARRAY(ThreadContext, thread_ctx, pthread_init_cnt,
                     (OFF(task_fifo_cond),  OFF(finished_task_cond)));
 #undef OFF
 
+static av_cold void rc_init(ThreadContext *c, const AVCodecContext *avctx)
+{
+    double fps = avctx->framerate.num > 0 && avctx->framerate.den > 0 ?
+                 av_q2d(avctx->framerate) : 1.0 / av_q2d(avctx->time_base);
+
+    c->rc            = 1;
+    c->rc_frame_bits = avctx->bit_rate / fps;
+    c->rc_window     = FFMAX(fps, 1.0);
+}
+
+static void rc_update(ThreadContext *c, const Task *task)
+{
+    double complexity = (double)task->bits * task->quality / FF_QP2LAMBDA;
+
+    if (!task->bits)
+        return;
+    c->rc_error     += task->bits - c->rc_frame_bits;
+    c->rc_complexity = c->rc_complexity ? 0.75 * c->rc_complexity + 0.25 * complexity
+                                        : complexity;
+}
+
+/**
+ * Account for the sizes of the tasks submitted before task_index, in
+ * order, up to the last delay ones, waiting for them to finish if needed.
+ * The feedback a frame gets thus depends only on the number of threads,
+ * not on how fast they run.
+ */
+static void rc_feedback(ThreadContext *c, unsigned delay)
+{
+    while ((c->task_index - c->rc_task_index + c->max_tasks) % c->max_tasks > delay) {
+        Task *task = &c->tasks[c->rc_task_index];
+
+        pthread_mutex_lock(&c->finished_task_mutex);
+        while (!task->finished)
+            pthread_cond_wait(&c->finished_task_cond, &c->finished_task_mutex);
+        pthread_mutex_unlock(&c->finished_task_mutex);
+
+        rc_update(c, task);
+        c->rc_task_index = (c->rc_task_index + 1) % c->max_tasks;
+    }
+}
+
+static int rc_get_quality(ThreadContext *c, const AVCodecContext *avctx)
+{
+    double target = c->rc_frame_bits;
+    double qscale, pending = 0;
+
+    /* Until the first frame has been encoded, there is nothing to base the
+     * quantizer on, so it is encoded alone. Afterwards, up to thread_count
+     * frames are in flight. */
+    rc_feedback(c, c->rc_complexity ? avctx->thread_count : 0);
+
+    if (!c->rc_complexity)
+        qscale = 4.0;
+    else {
+        /* Include the predicted sizes of the frames still being encoded in
+         * the error, as their quantizers were chosen without this feedback. */
+        for (unsigned i = c->rc_task_index; i != c->task_index; i = (i + 1) % c->max_tasks)
+            pending += c->rc_complexity * FF_QP2LAMBDA / c->tasks[i].quality - c->rc_frame_bits;
+
+        target -= (c->rc_error + pending) / c->rc_window;
+        target  = FFMAX(target, c->rc_frame_bits / 4);
+        qscale  = c->rc_complexity / target;
+    }
+
+    qscale = av_clipd(qscale, FFMAX(avctx->qmin, 1), FFMAX(avctx->qmax, 1));
+    return lrint(qscale * FF_QP2LAMBDA);
+}
+
 static void * attribute_align_arg worker(void *v){
     AVCodecContext *avctx = v;
     ThreadContext *c = avctx->internal->frame_thread_encoder;
@@ -106,6 +188,7 @@ static void * attribute_align_arg worker(void *v){
         pkt   = task->outdata;
 
         ret = ff_encode_encode_cb(avctx, pkt, frame, &task->got_packet);
+        task->bits = ret >= 0 && task->got_packet ? pkt->size * 8 : 0;
         pthread_mutex_lock(&c->finished_task_mutex);
         task->return_code = ret;
         task->finished    = 1;
@@ -123,26 +206,41 @@ av_cold int ff_frame_thread_encoder_init(AVCodecContext *avctx)
     ThreadContext *c;
     AVCodecContext *thread_avctx = NULL;
     AVCodecParameters *par = NULL;
+    int64_t threaded_rc = 0;
     int ret;
 
     if(   !(avctx->thread_type & FF_THREAD_FRAME)
        || !(avctx->codec->capabilities & AV_CODEC_CAP_FRAME_THREADS))
         return 0;
 
-    if(   !avctx->thread_count
-       && avctx->codec_id == AV_CODEC_ID_MJPEG
-       && !(avctx->flags & AV_CODEC_FLAG_QSCALE)) {
-        av_log(avctx, AV_LOG_DEBUG,
-               "Forcing thread count to 1 for MJPEG encoding, use -thread_type slice "
-               "or a constant quantizer if you want to use multiple cpu cores\n");
-        avctx->thread_count = 1;
+    if (avctx->codec_id == AV_CODEC_ID_MJPEG &&
+        !(avctx->flags & AV_CODEC_FLAG_QSCALE)) {
+        av_opt_get_int(avctx->priv_data, "threaded_rc", 0, &threaded_rc);
+        if (threaded_rc) {
+            uint8_t *rc_eq = NULL;
+            int custom_eq;
+
+            av_opt_get(avctx->priv_data, "rc_eq", AV_OPT_ALLOW_NULL, &rc_eq);
+            custom_eq = !!rc_eq;
+            av_free(rc_eq);
+            /* The delayed-feedback rate control only targets the bitrate. */
+            if (avctx->flags & (AV_CODEC_FLAG_PASS1 | AV_CODEC_FLAG_PASS2) ||
+                avctx->rc_max_rate || avctx->rc_buffer_size || custom_eq) {
+                av_log(avctx, AV_LOG_ERROR,
+                       "threaded_rc does not support two-pass encoding, rc_eq "
+                       "or a VBV constraint\n");
+                return AVERROR(EINVAL);
+            }
+        } else if (!avctx->thread_count) {
+            av_log(avctx, AV_LOG_DEBUG,
+                   "Forcing thread count to 1 for MJPEG encoding, use -thread_type slice, "
+                   "-threaded_rc 1 or a constant quantizer if you want to use multiple cpu cores\n");
+            avctx->thread_count = 1;
+        } else if (avctx->thread_count > 1)
+            av_log(avctx, AV_LOG_WARNING,
+                   "MJPEG CBR encoding works badly with frame multi-threading, consider "
+                   "using -threads 1, -thread_type slice, -threaded_rc 1 or a constant quantizer.\n");
     }
-    if(   avctx->thread_count > 1
-       && avctx->codec_id == AV_CODEC_ID_MJPEG
-       && !(avctx->flags & AV_CODEC_FLAG_QSCALE))
-        av_log(avctx, AV_LOG_WARNING,
-               "MJPEG CBR encoding works badly with frame multi-threading, consider "
-               "using -threads 1, -thread_type slice or a constant quantizer.\n");
 
     if (avctx->codec_id == AV_CODEC_ID_HUFFYUV ||
         avctx->codec_id == AV_CODEC_ID_FFVHUFF) {
@@ -182,6 +280,9 @@ av_cold int ff_frame_thread_encoder_init(AVCodecContext *avctx)
 
     c->parent_avctx = avctx;
 
+    if (threaded_rc)
+        rc_init(c, avctx);
+
     ret = ff_pthread_init(c, thread_ctx_offsets);
     if (ret < 0)
         goto fail;
@@ -227,6 +328,8 @@ av_cold int ff_frame_thread_encoder_init(AVCodecContext *avctx)
         }
         thread_avctx->thread_count = 1;
         thread_avctx->active_thread_type &= ~FF_THREAD_FRAME;
+        if (c->rc)
+            thread_avctx->flags |= AV_CODEC_FLAG_QSCALE;
 
 #define DUP_MATRIX(m)                                                       \
         if (avctx->m) {                                                     \
@@ -307,7 +410,11 @@ int ff_thread_video_encode_frame(AVCodecContext *avctx, AVPacket *pkt,
     av_assert1(!*got_packet_ptr);
 
     if(frame){
-        av_frame_move_ref(c->tasks[c->task_index].indata, frame);
+        Task *task = &c->tasks[c->task_index];
+
+        av_frame_move_ref(task->indata, frame);
+        if (c->rc)
+            task->quality = task->indata->quality = rc_get_quality(c, avctx);
 
         pthread_mutex_lock(&c->task_fifo_mutex);
         c->task_index = (c->task_index + 1) % c->max_tasks;
@@ -318,9 +425,13 @@ int ff_thread_video_encode_frame(AVCodecContext *avctx, AVPacket *pkt,
     outtask = &c->tasks[c->finished_task_index];
     pthread_mutex_lock(&c->finished_task_mutex);
     /* The access to task_index in the following code is ok,
-     * because it is only ever changed by the main thread. */
+     * because it is only ever changed by the main thread.
+     * With the delayed-feedback rate control, packets are not returned
+     * early before their size has been accounted for, so that the qscale
+     * of a frame does not depend on how fast the threads run. */
     if (c->task_index == c->finished_task_index ||
-        (frame && !outtask->finished &&
+        (frame && (!outtask->finished ||
+                   (c->rc && c->finished_task_index == c->rc_task_index)) &&
          (c->task_index - c->finished_task_index + c->max_tasks) % c->max_tasks <= avctx->thread_count)) {
             pthread_mutex_unlock(&c->finished_task_mutex);
             return 0;
@@ -332,6 +443,10 @@ int ff_thread_video_encode_frame(AVCodecContext *avctx, AVPacket *pkt,
     /* We now own outtask completely: No worker thread touches it any more,
      * because there is no outstanding task with this index. */
     outtask->finished = 0;
+    if (c->rc && c->finished_task_index == c->rc_task_index) {
+        rc_update(c, outtask);
+        c->rc_task_index = (c->rc_task_index + 1) % c->max_tasks;
+    }
     av_packet_move_ref(pkt, outtask->outdata);
     *got_packet_ptr = outtask->got_packet;
     c->finished_task_index = (c->finished_task_index + 1) % c->max_tasks;
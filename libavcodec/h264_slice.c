@@ -2434,6 +2434,16 @@ static void loop_filter(const H264Context *h, H264SliceContext *sl, int start_x,
     if (h->postpone_filter)
         return;
 
+    if (sl->deblock_pipelined) {
+        /* The rows are filtered by deblock_slice_rows() on another thread,
+         * only publish how far it may go. */
+        atomic_store_explicit(&sl->deblock_end, sl->mb_y * h->mb_width + end_x,
+                              memory_order_release);
+        if (end_x == h->mb_width)
+            ff_thread_progress_report(&sl->deblock_progress, sl->mb_y);
+        return;
+    }
+
     if (sl->deblocking_filter) {
         for (mb_x = start_x; mb_x < end_x; mb_x++)
             for (mb_y = end_mb_y - FRAME_MBAFF(h); mb_y <= end_mb_y; mb_y++) {
@@ -2512,6 +2522,10 @@ static void decode_finish_row(const H264Context *h, H264SliceContext *sl)
     int height         =  16      << FRAME_MBAFF(h);
     int deblock_border = (16 + 4) << FRAME_MBAFF(h);
 
+    /* done by deblock_slice_rows() once the row is filtered */
+    if (sl->deblock_pipelined)
+        return;
+
     if (sl->deblocking_filter) {
         if ((top + height) >= pic_height)
             height += deblock_border;
@@ -2567,7 +2581,7 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg)
 
     av_assert0(h->block_offset[15] == (4 * ((scan8[15] - scan8[0]) & 7) << h->pixel_shift) + 4 * sl->linesize * ((scan8[15] - scan8[0]) >> 3));
 
-    if (h->postpone_filter)
+    if (h->postpone_filter || sl->deblock_pipelined)
         sl->deblocking_filter = 0;
 
     sl->is_complex = FRAME_MBAFF(h) || h->picture_structure != PICT_FRAME ||
@@ -2755,6 +2769,100 @@ finish:
     return 0;
 }
 
+/**
+ * Deblock the rows of the slice being decoded in sl, using lf as the slice
+ * context of the loop filter. Row y is only filtered once row y + 1 has been
+ * decoded, since intra prediction of row y + 1 needs the unfiltered bottom
+ * line of row y and filtering row y modifies it.
+ */
+static void deblock_slice_rows(const H264Context *h, H264SliceContext *lf,
+                               H264SliceContext *sl)
+{
+    const int step = 1 + FIELD_PICTURE(h);
+    int start_x    = lf->mb_x;
+
+    for (int mb_y = lf->mb_y; mb_y < h->mb_height; mb_y += step) {
+        int end_x;
+
+        ff_thread_progress_await(&sl->deblock_progress, mb_y + step);
+        end_x = atomic_load_explicit(&sl->deblock_end, memory_order_acquire) -
+                mb_y * h->mb_width;
+        if (end_x <= start_x)
+            break;
+
+        lf->mb_y = mb_y;
+        loop_filter(h, lf, start_x, FFMIN(end_x, h->mb_width));
+        if (end_x < h->mb_width)
+            break;
+        decode_finish_row(h, lf);
+        start_x = 0;
+    }
+}
+
+static int decode_slice_deblock_pipelined(AVCodecContext *avctx, void *arg,
+                                          int jobnr, int threadnr)
+{
+    H264SliceContext *sl = arg;
+    int ret;
+
+    if (jobnr) {
+        deblock_slice_rows(sl->h264, &sl[1], &sl[0]);
+        return 0;
+    }
+
+    ret = decode_slice(avctx, &sl[0]);
+    ff_thread_progress_report(&sl[0].deblock_progress, INT_MAX);
+    return ret;
+}
+
+/**
+ * Check whether the loop filter of a single-slice picture can be run on a
+ * second slice thread trailing the entropy decoder, and set up lf for it if
+ * so. This gives such pictures some parallelism without the delay of frame
+ * threads.
+ *
+ * Only the first slice of a picture is pipelined: the decoder context does not
+ * exchange the unfiltered borders, so a slice following another one would
+ * intra predict from rows the filter has already modified. In chunked mode the
+ * first slice is usually followed by others, so it is not pipelined either.
+ */
+static int init_deblock_pipeline(const H264Context *h, H264SliceContext *sl,
+                                 H264SliceContext *lf)
+{
+    if (!(h->avctx->active_thread_type & FF_THREAD_SLICE) ||
+        h->nb_slice_ctx < 2 || !sl->deblocking_filter || FRAME_MBAFF(h) ||
+        h->current_slice != 1 || sl->first_mb_addr ||
+        (h->avctx->flags2 & AV_CODEC_FLAG2_CHUNKS))
+        return 0;
+
+    lf->linesize   = h->cur_pic_ptr->f->linesize[0];
+    lf->uvlinesize = h->cur_pic_ptr->f->linesize[1];
+    if (alloc_scratch_buffers(lf, lf->linesize) < 0)
+        return 0;
+
+    lf->slice_num              = sl->slice_num;
+    lf->slice_type             = sl->slice_type;
+    lf->slice_type_nos         = sl->slice_type_nos;
+    lf->qscale                 = sl->qscale;
+    lf->qp_thresh              = sl->qp_thresh;
+    lf->deblocking_filter      = sl->deblocking_filter;
+    lf->slice_alpha_c0_offset  = sl->slice_alpha_c0_offset;
+    lf->slice_beta_offset      = sl->slice_beta_offset;
+    lf->list_count             = sl->list_count;
+    lf->picture_structure      = sl->picture_structure;
+    lf->mb_field_decoding_flag = sl->mb_field_decoding_flag;
+    lf->mb_mbaff               = sl->mb_mbaff;
+    lf->mb_x                   = sl->mb_x;
+    lf->mb_y                   = sl->mb_y;
+    lf->deblock_pipelined      = 0;
+
+    ff_thread_progress_reset(&sl->deblock_progress);
+    atomic_init(&sl->deblock_end, sl->mb_y * h->mb_width + sl->mb_x);
+    sl->deblock_pipelined = 1;
+
+    return 1;
+}
+
 /**
  * Call decode_slice() for each context.
  *
@@ -2780,7 +2888,23 @@ int ff_h264_execute_decode_slices(H264Context *h)
         h->slice_ctx[0].next_slice_idx = h->mb_width * h->mb_height;
         h->postpone_filter = 0;
 
-        ret = decode_slice(avctx, &h->slice_ctx[0]);
+        if (init_deblock_pipeline(h, &h->slice_ctx[0], &h->slice_ctx[1])) {
+            int rets[2];
+
+            avctx->execute2(avctx, decode_slice_deblock_pipelined,
+                            h->slice_ctx, rets, 2);
+            h->slice_ctx[0].deblock_pipelined = 0;
+            ret = rets[0];
+
+            /* the picture continues in a later packet, hand the borders saved
+             * by the filter over to the context decoding the next slice */
+            if (h->slice_ctx[0].mb_y < h->mb_height)
+                for (i = 0; i < 2; i++)
+                    memcpy(h->slice_ctx[0].top_borders[i],
+                           h->slice_ctx[1].top_borders[i],
+                           h->mb_width * sizeof(*h->slice_ctx[0].top_borders[i]));
+        } else
+            ret = decode_slice(avctx, &h->slice_ctx[0]);
         h->mb_y = h->slice_ctx[0].mb_y;
         if (ret < 0)
             goto finish;
@@ -336,8 +336,14 @@ static int h264_init_context(AVCodecContext *avctx, H264Context *h)
     if ((ret = h264_init_pic(&h->last_pic_for_ec)) < 0)
         return ret;
 
-    for (i = 0; i < h->nb_slice_ctx; i++)
+    for (i = 0; i < h->nb_slice_ctx; i++) {
         h->slice_ctx[i].h264 = h;
+        if (h->nb_slice_ctx > 1) {
+            ret = ff_thread_progress_init(&h->slice_ctx[i].deblock_progress, 1);
+            if (ret < 0)
+                return ret;
+        }
+    }
 
     return 0;
 }
@@ -366,6 +372,8 @@ static av_cold int h264_decode_end(AVCodecContext *avctx)
 
     av_refstruct_pool_uninit(&h->decode_error_flags_pool);
 
+    for (i = 0; i < h->nb_slice_ctx; i++)
+        ff_thread_progress_destroy(&h->slice_ctx[i].deblock_progress);
     av_freep(&h->slice_ctx);
     h->nb_slice_ctx = 0;
 
@@ -44,6 +44,7 @@
 #include "h274.h"
 #include "mpegutils.h"
 #include "threadframe.h"
+#include "threadprogress.h"
 #include "videodsp.h"
 
 #define H264_MAX_PICTURE_COUNT 36
@@ -289,6 +290,20 @@ typedef struct H264SliceContext {
     int edge_emu_buffer_allocated;
     int top_borders_allocated[2];
 
+    /**
+     * Set while the loop filter of this slice runs on a second slice thread
+     * behind the entropy decoder, see ff_h264_execute_decode_slices().
+     */
+    int deblock_pipelined;
+    /**
+     * mb_y of the last MB row that has been completely decoded.
+     */
+    ThreadProgress deblock_progress;
+    /**
+     * mb_y * mb_width + mb_x of the end of the area that may be deblocked.
+     */
+    atomic_int deblock_end;
+
     /**
      * non zero coeff count cache.
      * is 64 if not available.
@@ -25,11 +25,19 @@
  * Discrete wavelet transform
  */
 
+#include <string.h>
+
 #include "libavutil/error.h"
 #include "libavutil/macros.h"
 #include "libavutil/mem.h"
 #include "jpeg2000dwt.h"
 
+/* The vertical synthesis passes work on blocks of DWT_COLS adjacent columns,
+ * stored row-interleaved in the line buffer as p[i * DWT_COLS + column].
+ * This turns the strided column gathers into contiguous row copies and makes
+ * every lifting step a data-parallel loop over the columns of the block. */
+#define DWT_COLS 16
+
 /* Defines for 9/7 DWT lifting parameters.
  * Parameters are in float. */
 #define F_LFTG_ALPHA  1.586134342059924f
@@ -324,12 +332,59 @@ static void sr_1d53(unsigned *p, int i0, int i1)
         p[2 * i + 1] += (int)(p[2 * i] + p[2 * i + 2]) >> 1;
 }
 
+/**
+ * Copy n 32-bit samples of one row into a column block, padding the block
+ * with zeros. Zero columns stay zero through all lifting steps.
+ */
+static void load_cols(void *dst, const void *src, int n)
+{
+    memcpy(dst, src, n * 4);
+    if (n < DWT_COLS)
+        memset((uint8_t *)dst + n * 4, 0, (DWT_COLS - n) * 4);
+}
+
+static void extend_cols(void *p, int i0, int i1, int n)
+{
+    uint8_t *b = p;
+    int i;
+
+    for (i = 1; i <= n; i++) {
+        memcpy(b + (i0 - i)     * DWT_COLS * 4, b + (i0 + i)     * DWT_COLS * 4, DWT_COLS * 4);
+        memcpy(b + (i1 + i - 1) * DWT_COLS * 4, b + (i1 - i - 1) * DWT_COLS * 4, DWT_COLS * 4);
+    }
+}
+
+static void sr_1d53_cols(unsigned *p, int i0, int i1)
+{
+    int i, c;
+
+    if (i1 <= i0 + 1) {
+        if (i0 == 1)
+            for (c = 0; c < DWT_COLS; c++)
+                p[DWT_COLS + c] = (int)p[DWT_COLS + c] >> 1;
+        return;
+    }
+
+    extend_cols(p, i0, i1, 2);
+
+    for (i = (i0 >> 1); i < (i1 >> 1) + 1; i++) {
+        unsigned *r = p + 2 * i * DWT_COLS;
+        for (c = 0; c < DWT_COLS; c++)
+            r[c] -= (int)(r[c - DWT_COLS] + r[c + DWT_COLS] + 2) >> 2;
+    }
+    for (i = (i0 >> 1); i < (i1 >> 1); i++) {
+        unsigned *r = p + (2 * i + 1) * DWT_COLS;
+        for (c = 0; c < DWT_COLS; c++)
+            r[c] += (int)(r[c - DWT_COLS] + r[c + DWT_COLS]) >> 1;
+    }
+}
+
 static void dwt_decode53(DWTContext *s, int *t)
 {
     int lev;
     int w     = s->linelen[s->ndeclevels - 1][0];
     int32_t *line = s->i_linebuf;
-    line += 3;
+    line += 3 * DWT_COLS;
 
     for (lev = 0; lev < s->ndeclevels; lev++) {
         int lh = s->linelen[lev][0],
@@ -356,19 +411,19 @@ static void dwt_decode53(DWTContext *s, int *t)
         }
 
         // VER_SD
-        l = line + mv;
-        for (lp = 0; lp < lh; lp++) {
-            int i, j = 0;
+        l = line + mv * DWT_COLS;
+        for (lp = 0; lp < lh; lp += DWT_COLS) {
+            int i, j = 0, n = FFMIN(DWT_COLS, lh - lp);
             // copy with interleaving
             for (i = mv; i < lv; i += 2, j++)
-                l[i] = t[w * j + lp];
+                load_cols(l + i * DWT_COLS, t + w * j + lp, n);
             for (i = 1 - mv; i < lv; i += 2, j++)
-                l[i] = t[w * j + lp];
+                load_cols(l + i * DWT_COLS, t + w * j + lp, n);
 
-            sr_1d53(line, mv, mv + lv);
+            sr_1d53_cols(line, mv, mv + lv);
 
             for (i = 0; i < lv; i++)
-                t[w * i + lp] = l[i];
+                memcpy(t + w * i + lp, l + i * DWT_COLS, n * sizeof(*t));
         }
     }
 }
@@ -400,14 +455,56 @@ static void sr_1d97_float(float *p, int i0, int i1)
         p[2 * i + 1] += F_LFTG_ALPHA * (p[2 * i]     + p[2 * i + 2]);
 }
 
+static void sr_1d97_float_cols(float *p, int i0, int i1)
+{
+    int i, c;
+
+    if (i1 <= i0 + 1) {
+        if (i0 == 1)
+            for (c = 0; c < DWT_COLS; c++)
+                p[DWT_COLS + c] *= F_LFTG_K/2;
+        else
+            for (c = 0; c < DWT_COLS; c++)
+                p[c] *= F_LFTG_X;
+        return;
+    }
+
+    extend_cols(p, i0, i1, 4);
+
+    for (i = (i0 >> 1) - 1; i < (i1 >> 1) + 2; i++) {
+        float *r = p + 2 * i * DWT_COLS;
+        for (c = 0; c < DWT_COLS; c++)
+            r[c] -= F_LFTG_DELTA * (r[c - DWT_COLS] + r[c + DWT_COLS]);
+    }
+    /* step 4 */
+    for (i = (i0 >> 1) - 1; i < (i1 >> 1) + 1; i++) {
+        float *r = p + (2 * i + 1) * DWT_COLS;
+        for (c = 0; c < DWT_COLS; c++)
+            r[c] -= F_LFTG_GAMMA * (r[c - DWT_COLS] + r[c + DWT_COLS]);
+    }
+    /*step 5*/
+    for (i = (i0 >> 1); i < (i1 >> 1) + 1; i++) {
+        float *r = p + 2 * i * DWT_COLS;
+        for (c = 0; c < DWT_COLS; c++)
+            r[c] += F_LFTG_BETA  * (r[c - DWT_COLS] + r[c + DWT_COLS]);
+    }
+    /* step 6 */
+    for (i = (i0 >> 1); i < (i1 >> 1); i++) {
+        float *r = p + (2 * i + 1) * DWT_COLS;
+        for (c = 0; c < DWT_COLS; c++)
+            r[c] += F_LFTG_ALPHA * (r[c - DWT_COLS] + r[c + DWT_COLS]);
+    }
+}
+
 static void dwt_decode97_float(DWTContext *s, float *t)
 {
     int lev;
     int w       = s->linelen[s->ndeclevels - 1][0];
     float *line = s->f_linebuf;
     float *data = t;
-    /* position at index O of line range [0-5,w+5] cf. extend function */
-    line += 5;
+    /* position at index O of line range [0-5,w+5] cf. extend function,
+     * in rows of DWT_COLS samples for the vertical pass */
+    line += 5 * DWT_COLS;
 
     for (lev = 0; lev < s->ndeclevels; lev++) {
         int lh = s->linelen[lev][0],
@@ -433,19 +530,19 @@ static void dwt_decode97_float(DWTContext *s, float *t)
         }
 
         // VER_SD
-        l = line + mv;
-        for (lp = 0; lp < lh; lp++) {
-            int i, j = 0;
+        l = line + mv * DWT_COLS;
+        for (lp = 0; lp < lh; lp += DWT_COLS) {
+            int i, j = 0, n = FFMIN(DWT_COLS, lh - lp);
             // copy with interleaving
             for (i = mv; i < lv; i += 2, j++)
-                l[i] = data[w * j + lp];
+                load_cols(l + i * DWT_COLS, data + w * j + lp, n);
             for (i = 1 - mv; i < lv; i += 2, j++)
-                l[i] = data[w * j + lp];
+                load_cols(l + i * DWT_COLS, data + w * j + lp, n);
 
-            sr_1d97_float(line, mv, mv + lv);
+            sr_1d97_float_cols(line, mv, mv + lv);
 
             for (i = 0; i < lv; i++)
-                data[w * i + lp] = l[i];
+                memcpy(data + w * i + lp, l + i * DWT_COLS, n * sizeof(*data));
         }
     }
 }
@@ -480,6 +577,50 @@ static void sr_1d97_int(int32_t *p, int i0, int i1)
     }
 }
 
+static void sr_1d97_int_cols(int32_t *p, int i0, int i1)
+{
+    int i, c;
+
+    if (i1 <= i0 + 1) {
+        if (i0 == 1)
+            for (c = 0; c < DWT_COLS; c++)
+                p[DWT_COLS + c] = (p[DWT_COLS + c] * I_LFTG_K + (1<<16)) >> 17;
+        else
+            for (c = 0; c < DWT_COLS; c++)
+                p[c] = (p[c] * I_LFTG_X + (1<<15)) >> 16;
+        return;
+    }
+
+    extend_cols(p, i0, i1, 4);
+
+    for (i = (i0 >> 1) - 1; i < (i1 >> 1) + 2; i++) {
+        int32_t *r = p + 2 * i * DWT_COLS;
+        for (c = 0; c < DWT_COLS; c++)
+            r[c] -= (I_LFTG_DELTA * (r[c - DWT_COLS] + (int64_t)r[c + DWT_COLS]) + (1 << 15)) >> 16;
+    }
+    /* step 4 */
+    for (i = (i0 >> 1) - 1; i < (i1 >> 1) + 1; i++) {
+        int32_t *r = p + (2 * i + 1) * DWT_COLS;
+        for (c = 0; c < DWT_COLS; c++)
+            r[c] -= (I_LFTG_GAMMA * (r[c - DWT_COLS] + (int64_t)r[c + DWT_COLS]) + (1 << 15)) >> 16;
+    }
+    /*step 5*/
+    for (i = (i0 >> 1); i < (i1 >> 1) + 1; i++) {
+        int32_t *r = p + 2 * i * DWT_COLS;
+        for (c = 0; c < DWT_COLS; c++)
+            r[c] += (I_LFTG_BETA  * (r[c - DWT_COLS] + (int64_t)r[c + DWT_COLS]) + (1 << 15)) >> 16;
+    }
+    /* step 6 */
+    for (i = (i0 >> 1); i < (i1 >> 1); i++) {
+        int32_t *r = p + (2 * i + 1) * DWT_COLS;
+        for (c = 0; c < DWT_COLS; c++) {
+            const int64_t sum = r[c - DWT_COLS] + (int64_t)r[c + DWT_COLS];
+            r[c] += sum;
+            r[c] += (I_LFTG_ALPHA_PRIME * sum + (1 << 15)) >> 16;
+        }
+    }
+}
+
 static void dwt_decode97_int(DWTContext *s, int32_t *t)
 {
     int lev;
@@ -488,8 +629,9 @@ static void dwt_decode97_int(DWTContext *s, int32_t *t)
     int i;
     int32_t *line = s->i_linebuf;
     int32_t *data = t;
-    /* position at index O of line range [0-5,w+5] cf. extend function */
-    line += 5;
+    /* position at index O of line range [0-5,w+5] cf. extend function,
+     * in rows of DWT_COLS samples for the vertical pass */
+    line += 5 * DWT_COLS;
 
     for (lev = 0; lev < s->ndeclevels; lev++) {
         int lh = s->linelen[lev][0],
@@ -515,19 +657,19 @@ static void dwt_decode97_int(DWTContext *s, int32_t *t)
         }
 
         // VER_SD
-        l = line + mv;
-        for (lp = 0; lp < lh; lp++) {
-            int i, j = 0;
+        l = line + mv * DWT_COLS;
+        for (lp = 0; lp < lh; lp += DWT_COLS) {
+            int i, j = 0, n = FFMIN(DWT_COLS, lh - lp);
             // interleaving
             for (i = mv; i < lv; i += 2, j++)
-                l[i] = data[w * j + lp];
+                load_cols(l + i * DWT_COLS, data + w * j + lp, n);
             for (i = 1 - mv; i < lv; i += 2, j++)
-                l[i] = data[w * j + lp];
+                load_cols(l + i * DWT_COLS, data + w * j + lp, n);
 
-            sr_1d97_int(line, mv, mv + lv);
+            sr_1d97_int_cols(line, mv, mv + lv);
 
             for (i = 0; i < lv; i++)
-                data[w * i + lp] = l[i];
+                memcpy(data + w * i + lp, l + i * DWT_COLS, n * sizeof(*data));
         }
     }
 
@@ -560,17 +702,17 @@ int ff_jpeg2000_dwt_init(DWTContext *s, int border[2][2],
         }
     switch (type) {
     case FF_DWT97:
-        s->f_linebuf = av_malloc_array((maxlen + 12), sizeof(*s->f_linebuf));
+        s->f_linebuf = av_malloc_array((maxlen + 12) * DWT_COLS, sizeof(*s->f_linebuf));
         if (!s->f_linebuf)
             return AVERROR(ENOMEM);
         break;
      case FF_DWT97_INT:
-        s->i_linebuf = av_malloc_array((maxlen + 12), sizeof(*s->i_linebuf));
+        s->i_linebuf = av_malloc_array((maxlen + 12) * DWT_COLS, sizeof(*s->i_linebuf));
         if (!s->i_linebuf)
             return AVERROR(ENOMEM);
         break;
     case FF_DWT53:
-        s->i_linebuf = av_malloc_array((maxlen +  6), sizeof(*s->i_linebuf));
+        s->i_linebuf = av_malloc_array((maxlen +  6) * DWT_COLS, sizeof(*s->i_linebuf));
         if (!s->i_linebuf)
             return AVERROR(ENOMEM);
         break;
@@ -51,7 +51,7 @@
 #include "libavutil/attributes.h"
 #include "libavutil/common.h"
 #include "libavutil/avassert.h"
-#include "libavutil/mem.h"
+#include "libavutil/intreadwrite.h"
 #include "jpeg2000htdec.h"
 #include "jpeg2000.h"
 #include "jpeg2000dec.h"
@@ -85,25 +85,6 @@ typedef struct MelDecoderState {
     uint8_t one;
 } MelDecoderState;
 
-/**
- *  Given a precomputed c, checks whether n % d == 0. c is precomputed from d
- *  using precompute_c().
- */
-av_always_inline
-static uint32_t is_divisible(uint32_t n, uint64_t c)
-{
-    return n * c <= c - 1;
-}
-
-/**
- *  Precompute the number c used by is_divisible().
- */
-av_always_inline
-static uint64_t precompute_c(uint32_t d)
-{
-    return 1 + (0xffffffffffffffffull / d);
-}
-
 static void jpeg2000_init_zero(StateVars *s)
 {
     s->bits_left = 0;
@@ -147,11 +128,11 @@ static int jpeg2000_bitbuf_refill_backwards(StateVars *buffer, const uint8_t *ar
     uint64_t tmp = 0;
     uint32_t new_bits = 32;
 
-    buffer->last = array[buffer->pos + 1];
-
     if (buffer->bits_left >= 32)
         return 0; // enough data, no need to pull in more bits
 
+    buffer->last = array[buffer->pos + 1];
+
     /**
      *  Unstuff bits. Load a temporary byte, which precedes the position we
      *  currently at, to ensure that we can also un-stuff if the stuffed bit is
@@ -208,6 +189,18 @@ static void jpeg2000_bitbuf_refill_forward(StateVars *buffer, const uint8_t *arr
                                            uint32_t length)
 {
     while (buffer->bits_left < 32) {
+        /* Common case; 4 bytes without a stuffed bit among them */
+        if (buffer->last != 0xFF && buffer->pos + 4 <= length) {
+            uint32_t word = AV_RL32(array + buffer->pos);
+            uint32_t inv  = ~word | 0xFF000000;
+            if (!((inv - 0x010101) & ~inv & 0x808080)) {
+                buffer->bit_buf   |= (uint64_t)word << buffer->bits_left;
+                buffer->bits_left += 32;
+                buffer->pos       += 4;
+                buffer->last       = word >> 24;
+                continue;
+            }
+        }
         buffer->tmp = 0xFF;
         buffer->bits = (buffer->last == 0xFF) ? 7 : 8;
         if (buffer->pos < length) {
@@ -330,25 +323,27 @@ static int  jpeg2000_decode_ctx_vlc(const Jpeg2000DecoderContext *s,
     return 0;
 }
 
+/**
+ * The u-vlc codes of a quad pair take at most 24 bits, so they are decoded
+ * from a single look ahead window of the bit buffer: bits holds the window
+ * and *len the number of bits consumed so far. The caller refills the buffer
+ * before and drops *len bits afterwards.
+ */
+
 /**
  * Decode variable length u-vlc prefix. See decodeUPrefix procedure at Rec.
  * ITU-T T.814, 7.3.6.
  */
 av_always_inline
-static uint8_t vlc_decode_u_prefix(StateVars *vlc_stream, const uint8_t *refill_array)
+static uint8_t vlc_decode_u_prefix(uint64_t bits, int *len)
 {
     static const uint8_t return_value[8] = { 5, 1, 2, 1, 3, 1, 2, 1 };
     static const uint8_t drop_bits[8]    = { 3, 1, 2, 1, 3, 1, 2, 1 };
 
-    uint8_t bits;
-
-    if (vlc_stream->bits_left < 3)
-        jpeg2000_bitbuf_refill_backwards(vlc_stream, refill_array);
+    int idx = (bits >> *len) & 7;
 
-    bits = jpeg2000_bitbuf_peek_bits_lsb(vlc_stream, 3);
-
-    jpeg2000_bitbuf_drop_bits_lsb(vlc_stream, drop_bits[bits]);
-    return return_value[bits];
+    *len += drop_bits[idx];
+    return return_value[idx];
 }
 
 /**
@@ -356,24 +351,15 @@ static uint8_t vlc_decode_u_prefix(StateVars *vlc_stream, const uint8_t *refill_
  * ITU-T T.814, 7.3.6.
  */
 av_always_inline
-static uint8_t vlc_decode_u_suffix(StateVars *vlc_stream, uint8_t suffix,
-                                   const uint8_t *refill_array)
+static uint8_t vlc_decode_u_suffix(uint64_t bits, int *len, uint8_t suffix)
 {
-    static const int mask[]      = { 1, 31 };
-    static const int drop_bits[] = { 1, 5  };
-
-    uint8_t bits;
-    int cond = suffix != 3;
-    if (suffix < 3)
-        return 0;
-
-    if (vlc_stream->bits_left < 5)
-        jpeg2000_bitbuf_refill_backwards(vlc_stream, refill_array);
+    static const uint8_t suffix_bits[6] = { 0, 0, 0, 1, 0, 5 };
 
-    bits = jpeg2000_bitbuf_peek_bits_lsb(vlc_stream, 5);
+    int n = suffix_bits[suffix];
+    int val = (bits >> *len) & ((1 << n) - 1);
 
-    jpeg2000_bitbuf_drop_bits_lsb(vlc_stream, drop_bits[cond]);
-    return bits & mask[cond];
+    *len += n;
+    return val;
 }
 
 /**
@@ -381,10 +367,15 @@ static uint8_t vlc_decode_u_suffix(StateVars *vlc_stream, uint8_t suffix,
  * T.814, 7.3.6.
  */
 av_always_inline
-static uint8_t vlc_decode_u_extension(StateVars *vlc_stream, uint8_t suffix,
-                                      const uint8_t *refill_array)
+static uint8_t vlc_decode_u_extension(uint64_t bits, int *len, uint8_t suffix)
 {
-    return jpeg2000_bitbuf_get_bits_lsb(vlc_stream, 4 * (suffix >= 28), refill_array);
+    int val;
+
+    if (suffix < 28)
+        return 0;
+    val = (bits >> *len) & 15;
+    *len += 4;
+    return val;
 }
 
 /**
@@ -404,39 +395,62 @@ static int32_t jpeg2000_decode_mag_sgn(StateVars *mag_sgn_stream, int32_t m_n,
 }
 
 av_always_inline
-static void recover_mag_sgn(StateVars *mag_sgn, uint8_t pos, uint16_t q, int32_t m_n[2],
+static void recover_mag_sgn(StateVars *mag_sgn, uint8_t pos, int32_t m_n[2],
                             int32_t known_1[2], const uint8_t emb_pat_1[2],
-                            int32_t v[2][4], int32_t m[2][4], uint8_t *E,
-                            uint32_t *mu_n, const uint8_t *Dcup, uint32_t Pcup,
+                            int32_t v[2][4], int32_t m[2][4], uint8_t E[2][4],
+                            uint32_t mu_n[2][4], const uint8_t *Dcup, uint32_t Pcup,
                             uint32_t pLSB)
 {
     for (int i = 0; i < 4; i++) {
-        int32_t n = 4 * q + i;
         m_n[pos] = m[pos][i];
         known_1[pos] = (emb_pat_1[pos] >> i) & 1;
         v[pos][i] = jpeg2000_decode_mag_sgn(mag_sgn, m_n[pos], known_1[pos], Dcup, Pcup);
 
+        E[pos][i]    = 0;
+        mu_n[pos][i] = 0;
         if (m_n[pos] != 0) {
-            E[n] = 32 - ff_clz(v[pos][i] | 1);
-            mu_n[n] = (v[pos][i] >> 1) + 1;
-            mu_n[n] <<= pLSB;
-            mu_n[n] |= (1 << (pLSB - 1)); // Add 0.5 (reconstruction parameter = 1/2)
-            mu_n[n] |= ((uint32_t) (v[pos][i] & 1)) << 31; // sign bit.
+            E[pos][i] = 32 - ff_clz(v[pos][i] | 1);
+            mu_n[pos][i] = (v[pos][i] >> 1) + 1;
+            mu_n[pos][i] <<= pLSB;
+            mu_n[pos][i] |= (1 << (pLSB - 1)); // Add 0.5 (reconstruction parameter = 1/2)
+            mu_n[pos][i] |= ((uint32_t) (v[pos][i] & 1)) << 31; // sign bit.
         }
     }
 }
 
-static int jpeg2000_import_bit(StateVars *stream, const uint8_t *array, uint32_t length)
+/**
+ * Refill the MEL bit buffer, most significant bit first, skipping the stuffed
+ * most significant bit of any byte that follows 0xFF.
+ */
+static void jpeg2000_mel_refill(StateVars *stream, const uint8_t *array, uint32_t length)
 {
-    int cond = stream->pos < length;
-    int pos = FFMIN(stream->pos, length - 1);
-    if (stream->bits == 0) {
-        stream->bits = (stream->tmp == 0xFF) ? 7 : 8;
-        stream->pos += cond;
-        stream->tmp = cond ? array[pos] : 0xFF;
+    while (stream->bits_left <= 56) {
+        uint32_t byte = 0xFF;
+        uint8_t bits  = (stream->last == 0xFF) ? 7 : 8;
+
+        if (stream->pos < length)
+            byte = array[stream->pos++];
+        stream->last = byte;
+        stream->bit_buf |= (uint64_t)(byte & ((1 << bits) - 1)) << (64 - bits - stream->bits_left);
+        stream->bits_left += bits;
     }
-    stream->bits -= 1;
-    return (stream->tmp >> stream->bits) & 1;
+}
+
+/**
+ * Get 1 to 5 MEL bits, most significant bit first.
+ */
+av_always_inline
+static uint32_t jpeg2000_mel_get_bits(StateVars *stream, uint8_t nbits,
+                                      const uint8_t *array, uint32_t length)
+{
+    uint32_t bits;
+
+    if (stream->bits_left < nbits)
+        jpeg2000_mel_refill(stream, array, length);
+    bits = stream->bit_buf >> (64 - nbits);
+    stream->bit_buf  <<= nbits;
+    stream->bits_left -= nbits;
+    return bits;
 }
 
 static int jpeg2000_peek_bit(StateVars *stream, const uint8_t *array, uint32_t length)
@@ -466,21 +480,14 @@ static int jpeg2000_decode_mel_sym(MelDecoderState *mel_state,
 {
 
     if (mel_state->run == 0 && mel_state->one == 0) {
-        uint8_t eval;
-        uint8_t bit;
+        uint8_t eval = mel_e[mel_state->k];
 
-        eval = mel_e[mel_state->k];
-        bit = jpeg2000_import_bit(mel_stream, Dcup, Lcup);
-        if (bit == 1) {
+        if (jpeg2000_mel_get_bits(mel_stream, 1, Dcup, Lcup)) {
             mel_state->run = 1 << eval;
             mel_state->k = FFMIN(12, mel_state->k + 1);
         } else {
-            mel_state->run = 0;
-            while (eval > 0) {
-                bit = jpeg2000_import_bit(mel_stream, Dcup, Lcup);
-                mel_state->run = (2 * (mel_state->run)) + bit;
-                eval -= 1;
-            }
+            /* the run length is sent in eval bits, most significant first */
+            mel_state->run = eval ? jpeg2000_mel_get_bits(mel_stream, eval, Dcup, Lcup) : 0;
             mel_state->k = FFMAX(0, mel_state->k - 1);
             mel_state->one = 1;
         }
@@ -532,18 +539,90 @@ static int jpeg2000_decode_sig_emb(const Jpeg2000DecoderContext *s, MelDecoderSt
 
 av_always_inline
 static int jpeg2000_get_state(int x1, int x2, int stride, int shift_by,
-                              const uint8_t *block_states)
+                              const uint16_t *block_states)
 {
     return (block_states[(x1 + 1) * stride + (x2 + 1)] >> shift_by) & 1;
 }
 
 av_always_inline
 static void jpeg2000_modify_state(int x1, int x2, int stride,
-                                  int value, uint8_t *block_states)
+                                  int value, uint16_t *block_states)
 {
     block_states[(x1 + 1) * stride + (x2 + 1)] |= value;
 }
 
+/**
+ * Store the samples and significance of a quad in raster order, and the
+ * exponents of its lower row for the context of the next quad row. Samples
+ * outside of an odd sized code-block are masked by x1 and x2.
+ */
+av_always_inline
+static void jpeg2000_store_quad(int x, int y, int x1, int x2, uint8_t sig_pat,
+                                const uint8_t E[4], const uint32_t mu_n[4],
+                                uint8_t *E_line, int32_t *sample_buf,
+                                uint16_t *block_states, const int stride)
+{
+    int32_t *sp = sample_buf + 2 * y * stride + 2 * x;
+    int x3 = x1 | x2;
+
+    sp[0]          = (int32_t)mu_n[0];
+    sp[stride]     = (int32_t)mu_n[1] * x1;
+    sp[1]          = (int32_t)mu_n[2] * x2;
+    sp[stride + 1] = (int32_t)mu_n[3] * x3;
+
+    jpeg2000_modify_state(2 * y,     2 * x,     stride, sig_pat & 1, block_states);
+    jpeg2000_modify_state(2 * y + 1, 2 * x,     stride, ((sig_pat >> 1) & 1) * x1, block_states);
+    jpeg2000_modify_state(2 * y,     2 * x + 1, stride, ((sig_pat >> 2) & 1) * x2, block_states);
+    jpeg2000_modify_state(2 * y + 1, 2 * x + 1, stride, ((sig_pat >> 3) & 1) * x3, block_states);
+
+    E_line[2 * x]     = E[1];
+    E_line[2 * x + 1] = E[3];
+}
+
+/**
+ * Context of a quad in a non-initial row, from the significance of the row
+ * above and of the quad to the left.
+ */
+av_always_inline
+static uint16_t jpeg2000_quad_context(int x, int y, int quad_width, uint8_t sig_left,
+                                      const uint16_t *block_states, const int stride)
+{
+    uint16_t context;
+
+    context  = jpeg2000_get_state(2 * y - 1, 2 * x, stride, HT_SHIFT_SIGMA, block_states);
+    context += jpeg2000_get_state(2 * y - 1, 2 * x + 1, stride, HT_SHIFT_SIGMA, block_states) << 2; // ne
+
+    if (x > 0) {
+        context |= jpeg2000_get_state(2 * y - 1, 2 * x - 1, stride, HT_SHIFT_SIGMA, block_states); // nw
+        context += (((sig_left >> 2) | (sig_left >> 3)) & 1) << 1;                                  // sw | q
+    }
+    if (x < quad_width - 1)
+        context |= jpeg2000_get_state(2 * y - 1, 2 * x + 2, stride, HT_SHIFT_SIGMA, block_states) << 2;
+    return context;
+}
+
+/**
+ * Exponent bound offset of a quad in a non-initial row, from the exponents of
+ * the samples above it. See Rec. ITU-T T.814, 7.3.7.
+ */
+av_always_inline
+static uint8_t jpeg2000_quad_kappa(int x, int quad_width, uint8_t sig_pat,
+                                   const uint8_t *E_prev)
+{
+    uint8_t max_e;
+
+    /* gamma is 0 when at most one sample is significant */
+    if (!(sig_pat & (sig_pat - 1)))
+        return 1;
+
+    max_e = FFMAX(E_prev[2 * x], E_prev[2 * x + 1]);
+    if (x > 0)
+        max_e = FFMAX(max_e, E_prev[2 * x - 1]);
+    if (x < quad_width - 1)
+        max_e = FFMAX(max_e, E_prev[2 * x + 2]);
+    return FFMAX(1, max_e - 1);
+}
+
 av_always_inline
 static int jpeg2000_decode_ht_cleanup_segment(const Jpeg2000DecoderContext *s,
                                               Jpeg2000Cblk *cblk, Jpeg2000T1Context *t1,
@@ -552,10 +631,8 @@ static int jpeg2000_decode_ht_cleanup_segment(const Jpeg2000DecoderContext *s,
                                               StateVars *mag_sgn_stream, const uint8_t *Dcup,
                                               uint32_t Lcup, uint32_t Pcup, uint8_t pLSB,
                                               int width, int height, const int stride,
-                                              int32_t *sample_buf, uint8_t *block_states)
+                                              int32_t *sample_buf, uint16_t *block_states)
 {
-    uint16_t q                      = 0;     // Represents current quad position
-    uint16_t q1, q2;
     uint16_t context1, context2;
     uint16_t context                = 0;
 
@@ -563,14 +640,7 @@ static int jpeg2000_decode_ht_cleanup_segment(const Jpeg2000DecoderContext *s,
     uint8_t res_off[2]              = { 0 }; // residual offset
     uint8_t emb_pat_k[2]            = { 0 }; // exponent Max Bound pattern K
     uint8_t emb_pat_1[2]            = { 0 }; // exponent Max Bound pattern 1
-    uint8_t gamma[2]                = { 0 };
 
-    uint8_t E_n[2]                  = { 0 };
-    uint8_t E_ne[2]                 = { 0 };
-    uint8_t E_nw[2]                 = { 0 };
-    uint8_t E_nf[2]                 = { 0 };
-
-    uint8_t max_e[2]                = { 0 };
     uint8_t u_pfx[2]                = { 0 };
     uint8_t u_sfx[2]                = { 0 };
     uint8_t u_ext[2]                = { 0 };
@@ -582,17 +652,14 @@ static int jpeg2000_decode_ht_cleanup_segment(const Jpeg2000DecoderContext *s,
 
     int32_t m[2][4]                 = { 0 };
     int32_t v[2][4]                 = { 0 };
+    uint8_t E[2][4]                 = { 0 }; // exponents
+    uint32_t mu_n[2][4]             = { 0 }; // reconstructed samples
 
     uint8_t kappa[2]                = { 1, 1 };
 
-    int ret                         = 0;
-
-    int sp;
-
-    uint64_t c;
-
-    uint8_t *sigma, *sigma_n, *E;
-    uint32_t *mu, *mu_n;
+    /* exponents of the lower sample row of the previous and current quad rows */
+    uint8_t E_line[2][1024];
+    uint8_t *E_prev = E_line[0], *E_cur = E_line[1];
 
     const uint8_t *vlc_buf = Dcup + Pcup;
 
@@ -604,99 +671,79 @@ static int jpeg2000_decode_ht_cleanup_segment(const Jpeg2000DecoderContext *s,
      */
     int maxbp = cblk->zbp + 2;
 
-    /* convert to raster-scan */
+    /* samples outside of an odd sized code-block are dropped */
     const uint16_t is_border_x = width % 2;
     const uint16_t is_border_y = height % 2;
 
     const uint16_t quad_width  = ff_jpeg2000_ceildivpow2(width, 1);
     const uint16_t quad_height = ff_jpeg2000_ceildivpow2(height, 1);
 
-    size_t buf_size = 4 * quad_width * quad_height;
+    int x1 = quad_height != 1 || is_border_y == 0;
+    int x2;
 
     /* do we have enough precision, assuming a 32-bit decoding path */
     if (maxbp >= 32)
         return AVERROR_INVALIDDATA;
 
-    sigma_n = av_calloc(buf_size, sizeof(uint8_t));
-    E       = av_calloc(buf_size, sizeof(uint8_t));
-    mu_n    = av_calloc(buf_size, sizeof(uint32_t));
-
-    if (!sigma_n || !E || !mu_n) {
-        ret = AVERROR(ENOMEM);
-        goto free;
-    }
+    for (int x = 0; x < quad_width - 1; x += 2) {
+        uint64_t bits;
+        int len = 0;
 
-    sigma = sigma_n;
-    mu = mu_n;
-
-    while (q < quad_width - 1) {
-        q1 = q;
-        q2 = q1 + 1;
-
-        if ((ret = jpeg2000_decode_sig_emb(s, mel_state, mel_stream, vlc_stream,
-                                           dec_cxt_vlc_table0, Dcup, sig_pat, res_off,
-                                           emb_pat_k, emb_pat_1, J2K_Q1, context, Lcup,
-                                           Pcup)) < 0)
-            goto free;
-
-        for (int i = 0; i < 4; i++)
-            sigma_n[4 * q1 + i] = (sig_pat[J2K_Q1] >> i) & 1;
+        jpeg2000_decode_sig_emb(s, mel_state, mel_stream, vlc_stream, dec_cxt_vlc_table0,
+                                Dcup, sig_pat, res_off, emb_pat_k, emb_pat_1, J2K_Q1,
+                                context, Lcup, Pcup);
 
         /* calculate context */
-        context  = sigma_n[4 * q1];           // f
-        context |= sigma_n[4 * q1 + 1];       // sf
-        context += sigma_n[4 * q1 + 2] << 1;  // w << 1
-        context += sigma_n[4 * q1 + 3] << 2;
+        context  = sig_pat[J2K_Q1] & 1;              // f
+        context |= (sig_pat[J2K_Q1] >> 1) & 1;       // sf
+        context += ((sig_pat[J2K_Q1] >> 2) & 1) << 1; // w << 1
+        context += ((sig_pat[J2K_Q1] >> 3) & 1) << 2;
 
-        if ((ret = jpeg2000_decode_sig_emb(s, mel_state, mel_stream, vlc_stream,
-                                           dec_cxt_vlc_table0, Dcup, sig_pat, res_off,
-                                           emb_pat_k, emb_pat_1, J2K_Q2, context, Lcup,
-                                           Pcup)) < 0)
-            goto free;
-
-        for (int i = 0; i < 4; i++)
-            sigma_n[4 * q2 + i] = (sig_pat[J2K_Q2] >> i) & 1;
+        jpeg2000_decode_sig_emb(s, mel_state, mel_stream, vlc_stream, dec_cxt_vlc_table0,
+                                Dcup, sig_pat, res_off, emb_pat_k, emb_pat_1, J2K_Q2,
+                                context, Lcup, Pcup);
 
         /* calculate context for the next quad */
-        context  = sigma_n[4 * q2];           // f
-        context |= sigma_n[4 * q2 + 1];       // sf
-        context += sigma_n[4 * q2 + 2] << 1;  // w << 1
-        context += sigma_n[4 * q2 + 3] << 2;  // sw << 2
+        context  = sig_pat[J2K_Q2] & 1;              // f
+        context |= (sig_pat[J2K_Q2] >> 1) & 1;       // sf
+        context += ((sig_pat[J2K_Q2] >> 2) & 1) << 1; // w << 1
+        context += ((sig_pat[J2K_Q2] >> 3) & 1) << 2; // sw << 2
 
         u[0] = 0;
         u[1] = 0;
 
         jpeg2000_bitbuf_refill_backwards(vlc_stream, vlc_buf);
+        bits = vlc_stream->bit_buf;
 
         if (res_off[J2K_Q1] == 1 && res_off[J2K_Q2] == 1) {
 
             if (jpeg2000_decode_mel_sym(mel_state, mel_stream, Dcup, Lcup) == 1) {
 
-                u_pfx[J2K_Q1] = vlc_decode_u_prefix(vlc_stream, vlc_buf);
-                u_pfx[J2K_Q2] = vlc_decode_u_prefix(vlc_stream, vlc_buf);
+                u_pfx[J2K_Q1] = vlc_decode_u_prefix(bits, &len);
+                u_pfx[J2K_Q2] = vlc_decode_u_prefix(bits, &len);
 
-                u_sfx[J2K_Q1] = vlc_decode_u_suffix(vlc_stream, u_pfx[J2K_Q1], vlc_buf);
-                u_sfx[J2K_Q2] = vlc_decode_u_suffix(vlc_stream, u_pfx[J2K_Q2], vlc_buf);
+                u_sfx[J2K_Q1] = vlc_decode_u_suffix(bits, &len, u_pfx[J2K_Q1]);
+                u_sfx[J2K_Q2] = vlc_decode_u_suffix(bits, &len, u_pfx[J2K_Q2]);
 
-                u_ext[J2K_Q1] = vlc_decode_u_extension(vlc_stream, u_sfx[J2K_Q1], vlc_buf);
-                u_ext[J2K_Q2] = vlc_decode_u_extension(vlc_stream, u_sfx[J2K_Q2], vlc_buf);
+                u_ext[J2K_Q1] = vlc_decode_u_extension(bits, &len, u_sfx[J2K_Q1]);
+                u_ext[J2K_Q2] = vlc_decode_u_extension(bits, &len, u_sfx[J2K_Q2]);
 
                 u[J2K_Q1] = 2 + u_pfx[J2K_Q1] + u_sfx[J2K_Q1] + (u_ext[J2K_Q1] * 4);
                 u[J2K_Q2] = 2 + u_pfx[J2K_Q2] + u_sfx[J2K_Q2] + (u_ext[J2K_Q2] * 4);
 
             } else {
-                u_pfx[J2K_Q1] = vlc_decode_u_prefix(vlc_stream, vlc_buf);
+                u_pfx[J2K_Q1] = vlc_decode_u_prefix(bits, &len);
 
                 if (u_pfx[J2K_Q1] > 2) {
-                    u[J2K_Q2] = jpeg2000_bitbuf_get_bits_lsb(vlc_stream, 1, vlc_buf) + 1;
-                    u_sfx[J2K_Q1] = vlc_decode_u_suffix(vlc_stream, u_pfx[J2K_Q1], vlc_buf);
-                    u_ext[J2K_Q1] = vlc_decode_u_extension(vlc_stream, u_sfx[J2K_Q1], vlc_buf);
+                    u[J2K_Q2] = ((bits >> len++) & 1) + 1;
+                    u_sfx[J2K_Q1] = vlc_decode_u_suffix(bits, &len, u_pfx[J2K_Q1]);
+                    u_ext[J2K_Q1] = vlc_decode_u_extension(bits, &len, u_sfx[J2K_Q1]);
                 } else {
-                    u_pfx[J2K_Q2] = vlc_decode_u_prefix(vlc_stream, vlc_buf);
-                    u_sfx[J2K_Q1] = vlc_decode_u_suffix(vlc_stream, u_pfx[J2K_Q1], vlc_buf);
-                    u_sfx[J2K_Q2] = vlc_decode_u_suffix(vlc_stream, u_pfx[J2K_Q2], vlc_buf);
-                    u_ext[J2K_Q1] = vlc_decode_u_extension(vlc_stream, u_sfx[J2K_Q1], vlc_buf);
-                    u_ext[J2K_Q2] = vlc_decode_u_extension(vlc_stream, u_sfx[J2K_Q2], vlc_buf);
+                    u_pfx[J2K_Q2] = vlc_decode_u_prefix(bits, &len);
+                    u_sfx[J2K_Q1] = vlc_decode_u_suffix(bits, &len, u_pfx[J2K_Q1]);
+                    u_sfx[J2K_Q2] = vlc_decode_u_suffix(bits, &len, u_pfx[J2K_Q2]);
+                    u_ext[J2K_Q1] = vlc_decode_u_extension(bits, &len, u_sfx[J2K_Q1]);
+                    u_ext[J2K_Q2] = vlc_decode_u_extension(bits, &len, u_sfx[J2K_Q2]);
                     u[J2K_Q2] = u_pfx[J2K_Q2] + u_sfx[J2K_Q2] + (u_ext[J2K_Q2] * 4);
                 }
                 /* See Rec. ITU-T T.814, 7.3.6(3) */
@@ -705,140 +752,111 @@ static int jpeg2000_decode_ht_cleanup_segment(const Jpeg2000DecoderContext *s,
 
         } else if (res_off[J2K_Q1] == 1 || res_off[J2K_Q2] == 1) {
             uint8_t pos = res_off[J2K_Q1] == 1 ? 0 : 1;
-            u_pfx[pos] = vlc_decode_u_prefix(vlc_stream, vlc_buf);
-            u_sfx[pos] = vlc_decode_u_suffix(vlc_stream, u_pfx[pos], vlc_buf);
-            u_ext[pos] = vlc_decode_u_extension(vlc_stream, u_sfx[pos], vlc_buf);
+            u_pfx[pos] = vlc_decode_u_prefix(bits, &len);
+            u_sfx[pos] = vlc_decode_u_suffix(bits, &len, u_pfx[pos]);
+            u_ext[pos] = vlc_decode_u_extension(bits, &len, u_sfx[pos]);
             u[pos] = u_pfx[pos] + u_sfx[pos] + (u_ext[pos] * 4);
         }
+        jpeg2000_bitbuf_drop_bits_lsb(vlc_stream, len);
+
         U[J2K_Q1] = kappa[J2K_Q1] + u[J2K_Q1];
         U[J2K_Q2] = kappa[J2K_Q2] + u[J2K_Q2];
-        if (U[J2K_Q1] > maxbp || U[J2K_Q2] > maxbp) {
-            ret = AVERROR_INVALIDDATA;
-            goto free;
-        }
+        if (U[J2K_Q1] > maxbp || U[J2K_Q2] > maxbp)
+            return AVERROR_INVALIDDATA;
 
         for (int i = 0; i < 4; i++) {
-            m[J2K_Q1][i] = sigma_n[4 * q1 + i] * U[J2K_Q1] - ((emb_pat_k[J2K_Q1] >> i) & 1);
-            m[J2K_Q2][i] = sigma_n[4 * q2 + i] * U[J2K_Q2] - ((emb_pat_k[J2K_Q2] >> i) & 1);
+            m[J2K_Q1][i] = ((sig_pat[J2K_Q1] >> i) & 1) * U[J2K_Q1] - ((emb_pat_k[J2K_Q1] >> i) & 1);
+            m[J2K_Q2][i] = ((sig_pat[J2K_Q2] >> i) & 1) * U[J2K_Q2] - ((emb_pat_k[J2K_Q2] >> i) & 1);
         }
 
-        recover_mag_sgn(mag_sgn_stream, J2K_Q1, q1, m_n, known_1, emb_pat_1, v, m,
+        recover_mag_sgn(mag_sgn_stream, J2K_Q1, m_n, known_1, emb_pat_1, v, m,
                         E, mu_n, Dcup, Pcup, pLSB);
 
-        recover_mag_sgn(mag_sgn_stream, J2K_Q2, q2, m_n, known_1, emb_pat_1, v, m,
+        recover_mag_sgn(mag_sgn_stream, J2K_Q2, m_n, known_1, emb_pat_1, v, m,
                         E, mu_n, Dcup, Pcup, pLSB);
 
-        q += 2; // Move to the next quad pair
+        x2 = x + 1 != quad_width - 1 || is_border_x == 0;
+        jpeg2000_store_quad(x, 0, x1, 1, sig_pat[J2K_Q1], E[J2K_Q1], mu_n[J2K_Q1],
+                            E_cur, sample_buf, block_states, stride);
+        jpeg2000_store_quad(x + 1, 0, x1, x2, sig_pat[J2K_Q2], E[J2K_Q2], mu_n[J2K_Q2],
+                            E_cur, sample_buf, block_states, stride);
+
     }
 
     if (quad_width % 2 == 1) {
-        q1 = q;
-
-        if ((ret = jpeg2000_decode_sig_emb(s, mel_state, mel_stream, vlc_stream,
-                                           dec_cxt_vlc_table0, Dcup, sig_pat, res_off,
-                                           emb_pat_k, emb_pat_1, J2K_Q1, context, Lcup,
-                                           Pcup)) < 0)
-            goto free;
+        uint64_t bits;
+        int len = 0;
 
-        for (int i = 0; i < 4; i++)
-            sigma_n[4 * q1 + i] = (sig_pat[J2K_Q1] >> i) & 1;
+        jpeg2000_decode_sig_emb(s, mel_state, mel_stream, vlc_stream, dec_cxt_vlc_table0,
+                                Dcup, sig_pat, res_off, emb_pat_k, emb_pat_1, J2K_Q1,
+                                context, Lcup, Pcup);
 
         u[J2K_Q1] = 0;
 
         if (res_off[J2K_Q1] == 1) {
-            u_pfx[J2K_Q1] = vlc_decode_u_prefix(vlc_stream, vlc_buf);
-            u_sfx[J2K_Q1] = vlc_decode_u_suffix(vlc_stream, u_pfx[J2K_Q1], vlc_buf);
-            u_ext[J2K_Q1] = vlc_decode_u_extension(vlc_stream, u_sfx[J2K_Q1], vlc_buf);
+            jpeg2000_bitbuf_refill_backwards(vlc_stream, vlc_buf);
+            bits = vlc_stream->bit_buf;
+            u_pfx[J2K_Q1] = vlc_decode_u_prefix(bits, &len);
+            u_sfx[J2K_Q1] = vlc_decode_u_suffix(bits, &len, u_pfx[J2K_Q1]);
+            u_ext[J2K_Q1] = vlc_decode_u_extension(bits, &len, u_sfx[J2K_Q1]);
             u[J2K_Q1] = u_pfx[J2K_Q1] + u_sfx[J2K_Q1] + (u_ext[J2K_Q1] * 4);
+            jpeg2000_bitbuf_drop_bits_lsb(vlc_stream, len);
         }
 
         U[J2K_Q1] = kappa[J2K_Q1] + u[J2K_Q1];
-        if (U[J2K_Q1] > maxbp) {
-            ret = AVERROR_INVALIDDATA;
-            goto free;
-        }
+        if (U[J2K_Q1] > maxbp)
+            return AVERROR_INVALIDDATA;
 
         for (int i = 0; i < 4; i++)
-            m[J2K_Q1][i] = sigma_n[4 * q1 + i] * U[J2K_Q1] - ((emb_pat_k[J2K_Q1] >> i) & 1);
+            m[J2K_Q1][i] = ((sig_pat[J2K_Q1] >> i) & 1) * U[J2K_Q1] - ((emb_pat_k[J2K_Q1] >> i) & 1);
 
-        recover_mag_sgn(mag_sgn_stream, J2K_Q1, q1, m_n, known_1, emb_pat_1, v, m,
+        recover_mag_sgn(mag_sgn_stream, J2K_Q1, m_n, known_1, emb_pat_1, v, m,
                         E, mu_n, Dcup, Pcup, pLSB);
 
-        q++; // move to next quad pair
+        jpeg2000_store_quad(quad_width - 1, 0, x1, is_border_x == 0, sig_pat[J2K_Q1],
+                            E[J2K_Q1], mu_n[J2K_Q1], E_cur, sample_buf, block_states, stride);
+
     }
 
-    /**
-     * Initial line pair end. As an optimization, we can replace modulo
-     * operations with checking if a number is divisible , since that's the only
-     * thing we need. This is paired with is_divisible. Credits to Daniel Lemire
-     * blog post [1].
-     *
-     * [1]
-     * https://lemire.me/blog/2019/02/08/faster-remainders-when-the-divisor-is-a-constant-beating-compilers-and-libdivide/
-     *
-     * It's UB on zero, but the spec doesn't allow a quad being zero, so we
-     * error out early in case that's the case.
-     */
-    c = precompute_c(quad_width);
+    /* Initial line pair end. */
 
     for (int row = 1; row < quad_height; row++) {
-        while ((q - (row * quad_width)) < quad_width - 1 && q < (quad_height * quad_width)) {
-            q1 = q;
-            q2 = q + 1;
-            context1  = sigma_n[4 * (q1 - quad_width) + 1];
-            context1 += sigma_n[4 * (q1 - quad_width) + 3] << 2;              // ne
-
-            if (!is_divisible(q1, c)) {
-                context1 |= sigma_n[4 * (q1 - quad_width) - 1];               // nw
-                context1 += (sigma_n[4 * q1 - 1] | sigma_n[4 * q1 - 2]) << 1; // sw | q
-            }
-            if (!is_divisible(q1 + 1, c))
-                context1 |= sigma_n[4 * (q1 - quad_width) + 5] << 2;
-
-            if ((ret = jpeg2000_decode_sig_emb(s, mel_state, mel_stream, vlc_stream,
-                                               dec_cxt_vlc_table1, Dcup, sig_pat, res_off,
-                                               emb_pat_k, emb_pat_1, J2K_Q1, context1, Lcup,
-                                               Pcup))
-                < 0)
-                goto free;
+        FFSWAP(uint8_t *, E_prev, E_cur);
+        x1 = row != quad_height - 1 || is_border_y == 0;
 
-            for (int i = 0; i < 4; i++)
-                sigma_n[4 * q1 + i] = (sig_pat[J2K_Q1] >> i) & 1;
+        for (int x = 0; x < quad_width - 1; x += 2) {
+            uint64_t bits;
+            int len = 0;
 
-            context2  = sigma_n[4 * (q2 - quad_width) + 1];
-            context2 += sigma_n[4 * (q2 - quad_width) + 3] << 2;
+            context1 = jpeg2000_quad_context(x, row, quad_width, sig_pat[J2K_Q2],
+                                             block_states, stride);
 
-            if (!is_divisible(q2, c)) {
-                context2 |= sigma_n[4 * (q2 - quad_width) - 1];
-                context2 += (sigma_n[4 * q2 - 1] | sigma_n[4 * q2 - 2]) << 1;
-            }
-            if (!is_divisible(q2 + 1, c))
-                context2 |= sigma_n[4 * (q2 - quad_width) + 5] << 2;
+            jpeg2000_decode_sig_emb(s, mel_state, mel_stream, vlc_stream, dec_cxt_vlc_table1,
+                                    Dcup, sig_pat, res_off, emb_pat_k, emb_pat_1, J2K_Q1,
+                                    context1, Lcup, Pcup);
 
-            if ((ret = jpeg2000_decode_sig_emb(s, mel_state, mel_stream, vlc_stream,
-                                               dec_cxt_vlc_table1, Dcup, sig_pat, res_off,
-                                               emb_pat_k, emb_pat_1, J2K_Q2, context2, Lcup,
-                                               Pcup))
-                < 0)
-                goto free;
+            context2 = jpeg2000_quad_context(x + 1, row, quad_width, sig_pat[J2K_Q1],
+                                             block_states, stride);
 
-            for (int i = 0; i < 4; i++)
-                sigma_n[4 * q2 + i] = (sig_pat[J2K_Q2] >> i) & 1;
+            jpeg2000_decode_sig_emb(s, mel_state, mel_stream, vlc_stream, dec_cxt_vlc_table1,
+                                    Dcup, sig_pat, res_off, emb_pat_k, emb_pat_1, J2K_Q2,
+                                    context2, Lcup, Pcup);
 
             u[J2K_Q1] = 0;
             u[J2K_Q2] = 0;
 
             jpeg2000_bitbuf_refill_backwards(vlc_stream, vlc_buf);
+            bits = vlc_stream->bit_buf;
 
             if (res_off[J2K_Q1] == 1 && res_off[J2K_Q2] == 1) {
-                u_pfx[J2K_Q1] = vlc_decode_u_prefix(vlc_stream, vlc_buf);
-                u_pfx[J2K_Q2] = vlc_decode_u_prefix(vlc_stream, vlc_buf);
+                u_pfx[J2K_Q1] = vlc_decode_u_prefix(bits, &len);
+                u_pfx[J2K_Q2] = vlc_decode_u_prefix(bits, &len);
 
-                u_sfx[J2K_Q1] = vlc_decode_u_suffix(vlc_stream, u_pfx[J2K_Q1], vlc_buf);
-                u_sfx[J2K_Q2] = vlc_decode_u_suffix(vlc_stream, u_pfx[J2K_Q2], vlc_buf);
+                u_sfx[J2K_Q1] = vlc_decode_u_suffix(bits, &len, u_pfx[J2K_Q1]);
+                u_sfx[J2K_Q2] = vlc_decode_u_suffix(bits, &len, u_pfx[J2K_Q2]);
 
-                u_ext[J2K_Q1] = vlc_decode_u_extension(vlc_stream, u_sfx[J2K_Q1], vlc_buf);
-                u_ext[J2K_Q2] = vlc_decode_u_extension(vlc_stream, u_sfx[J2K_Q2], vlc_buf);
+                u_ext[J2K_Q1] = vlc_decode_u_extension(bits, &len, u_sfx[J2K_Q1]);
+                u_ext[J2K_Q2] = vlc_decode_u_extension(bits, &len, u_sfx[J2K_Q2]);
 
                 u[J2K_Q1] = u_pfx[J2K_Q1] + u_sfx[J2K_Q1] + (u_ext[J2K_Q1] << 2);
                 u[J2K_Q2] = u_pfx[J2K_Q2] + u_sfx[J2K_Q2] + (u_ext[J2K_Q2] << 2);
@@ -846,180 +864,94 @@ static int jpeg2000_decode_ht_cleanup_segment(const Jpeg2000DecoderContext *s,
             } else if (res_off[J2K_Q1] == 1 || res_off[J2K_Q2] == 1) {
                 uint8_t pos = res_off[J2K_Q1] == 1 ? 0 : 1;
 
-                u_pfx[pos] = vlc_decode_u_prefix(vlc_stream, vlc_buf);
-                u_sfx[pos] = vlc_decode_u_suffix(vlc_stream, u_pfx[pos], vlc_buf);
-                u_ext[pos] = vlc_decode_u_extension(vlc_stream, u_sfx[pos], vlc_buf);
+                u_pfx[pos] = vlc_decode_u_prefix(bits, &len);
+                u_sfx[pos] = vlc_decode_u_suffix(bits, &len, u_pfx[pos]);
+                u_ext[pos] = vlc_decode_u_extension(bits, &len, u_sfx[pos]);
 
                 u[pos] = u_pfx[pos] + u_sfx[pos] + (u_ext[pos] << 2);
             }
-            sp = sig_pat[J2K_Q1];
-
-            gamma[J2K_Q1] = 1;
-
-            if (sp == 0 || sp == 1 || sp == 2 || sp == 4 || sp == 8)
-                gamma[J2K_Q1] = 0;
-
-            sp = sig_pat[J2K_Q2];
+            jpeg2000_bitbuf_drop_bits_lsb(vlc_stream, len);
 
-            gamma[J2K_Q2] = 1;
-
-            if (sp == 0 || sp == 1 || sp == 2 || sp == 4 || sp == 8)
-                gamma[J2K_Q2] = 0;
-
-            E_n[J2K_Q1] = E[4 * (q1 - quad_width) + 1];
-            E_n[J2K_Q2] = E[4 * (q2 - quad_width) + 1];
-
-            E_ne[J2K_Q1] = E[4 * (q1 - quad_width) + 3];
-            E_ne[J2K_Q2] = E[4 * (q2 - quad_width) + 3];
-
-            E_nw[J2K_Q1] = (!is_divisible(q1, c)) * E[FFMAX((4 * (q1 - quad_width) - 1), 0)];
-            E_nw[J2K_Q2] = (!is_divisible(q2, c)) * E[FFMAX((4 * (q2 - quad_width) - 1), 0)];
-
-            E_nf[J2K_Q1] = (!is_divisible(q1 + 1, c)) * E[4 * (q1 - quad_width) + 5];
-            E_nf[J2K_Q2] = (!is_divisible(q2 + 1, c)) * E[4 * (q2 - quad_width) + 5];
-
-            max_e[J2K_Q1] = FFMAX(E_nw[J2K_Q1], FFMAX3(E_n[J2K_Q1], E_ne[J2K_Q1], E_nf[J2K_Q1]));
-            max_e[J2K_Q2] = FFMAX(E_nw[J2K_Q2], FFMAX3(E_n[J2K_Q2], E_ne[J2K_Q2], E_nf[J2K_Q2]));
-
-            kappa[J2K_Q1] = FFMAX(1, gamma[J2K_Q1] * (max_e[J2K_Q1] - 1));
-            kappa[J2K_Q2] = FFMAX(1, gamma[J2K_Q2] * (max_e[J2K_Q2] - 1));
+            kappa[J2K_Q1] = jpeg2000_quad_kappa(x, quad_width, sig_pat[J2K_Q1], E_prev);
+            kappa[J2K_Q2] = jpeg2000_quad_kappa(x + 1, quad_width, sig_pat[J2K_Q2], E_prev);
 
             U[J2K_Q1] = kappa[J2K_Q1] + u[J2K_Q1];
             U[J2K_Q2] = kappa[J2K_Q2] + u[J2K_Q2];
-            if (U[J2K_Q1] > maxbp || U[J2K_Q2] > maxbp) {
-                ret = AVERROR_INVALIDDATA;
-                goto free;
-            }
+            if (U[J2K_Q1] > maxbp || U[J2K_Q2] > maxbp)
+                return AVERROR_INVALIDDATA;
 
             for (int i = 0; i < 4; i++) {
-                m[J2K_Q1][i] = sigma_n[4 * q1 + i] * U[J2K_Q1] - ((emb_pat_k[J2K_Q1] >> i) & 1);
-                m[J2K_Q2][i] = sigma_n[4 * q2 + i] * U[J2K_Q2] - ((emb_pat_k[J2K_Q2] >> i) & 1);
+                m[J2K_Q1][i] = ((sig_pat[J2K_Q1] >> i) & 1) * U[J2K_Q1] - ((emb_pat_k[J2K_Q1] >> i) & 1);
+                m[J2K_Q2][i] = ((sig_pat[J2K_Q2] >> i) & 1) * U[J2K_Q2] - ((emb_pat_k[J2K_Q2] >> i) & 1);
             }
-            recover_mag_sgn(mag_sgn_stream, J2K_Q1, q1, m_n, known_1, emb_pat_1, v, m,
+            recover_mag_sgn(mag_sgn_stream, J2K_Q1, m_n, known_1, emb_pat_1, v, m,
                             E, mu_n, Dcup, Pcup, pLSB);
 
-            recover_mag_sgn(mag_sgn_stream, J2K_Q2, q2, m_n, known_1, emb_pat_1, v, m,
+            recover_mag_sgn(mag_sgn_stream, J2K_Q2, m_n, known_1, emb_pat_1, v, m,
                             E, mu_n, Dcup, Pcup, pLSB);
 
-            q += 2; // Move to the next quad pair
+            x2 = x + 1 != quad_width - 1 || is_border_x == 0;
+            jpeg2000_store_quad(x, row, x1, 1, sig_pat[J2K_Q1], E[J2K_Q1], mu_n[J2K_Q1],
+                                E_cur, sample_buf, block_states, stride);
+            jpeg2000_store_quad(x + 1, row, x1, x2, sig_pat[J2K_Q2], E[J2K_Q2], mu_n[J2K_Q2],
+                                E_cur, sample_buf, block_states, stride);
+
         }
 
         if (quad_width % 2 == 1) {
-            q1 = q;
+            const int x = quad_width - 1;
+            uint64_t bits;
+            int len = 0;
 
             /* calculate context for current quad */
-            context1  = sigma_n[4 * (q1 - quad_width) + 1];
-            context1 += (sigma_n[4 * (q1 - quad_width) + 3] << 2);
+            context1 = jpeg2000_quad_context(x, row, quad_width, sig_pat[J2K_Q2],
+                                             block_states, stride);
 
-            if (!is_divisible(q1, c)) {
-                context1 |= sigma_n[4 * (q1 - quad_width) - 1];
-                context1 += (sigma_n[4 * q1 - 1] | sigma_n[4 * q1 - 2]) << 1;
-            }
-            if (!is_divisible(q1 + 1, c))
-                context1 |= sigma_n[4 * (q1 - quad_width) + 5] << 2;
-
-            if ((ret = jpeg2000_decode_sig_emb(s, mel_state, mel_stream, vlc_stream,
-                                               dec_cxt_vlc_table1, Dcup, sig_pat, res_off,
-                                               emb_pat_k, emb_pat_1, J2K_Q1, context1, Lcup,
-                                               Pcup)) < 0)
-                goto free;
-
-            for (int i = 0; i < 4; i++)
-                sigma_n[4 * q1 + i] = (sig_pat[J2K_Q1] >> i) & 1;
+            jpeg2000_decode_sig_emb(s, mel_state, mel_stream, vlc_stream, dec_cxt_vlc_table1,
+                                    Dcup, sig_pat, res_off, emb_pat_k, emb_pat_1, J2K_Q1,
+                                    context1, Lcup, Pcup);
 
             u[J2K_Q1] = 0;
 
             /* Recover mag_sgn value */
             if (res_off[J2K_Q1] == 1) {
-                u_pfx[J2K_Q1] = vlc_decode_u_prefix(vlc_stream, vlc_buf);
-                u_sfx[J2K_Q1] = vlc_decode_u_suffix(vlc_stream, u_pfx[J2K_Q1], vlc_buf);
-                u_ext[J2K_Q1] = vlc_decode_u_extension(vlc_stream, u_sfx[J2K_Q1], vlc_buf);
+                jpeg2000_bitbuf_refill_backwards(vlc_stream, vlc_buf);
+                bits = vlc_stream->bit_buf;
+                u_pfx[J2K_Q1] = vlc_decode_u_prefix(bits, &len);
+                u_sfx[J2K_Q1] = vlc_decode_u_suffix(bits, &len, u_pfx[J2K_Q1]);
+                u_ext[J2K_Q1] = vlc_decode_u_extension(bits, &len, u_sfx[J2K_Q1]);
 
                 u[J2K_Q1] = u_pfx[J2K_Q1] + u_sfx[J2K_Q1] + (u_ext[J2K_Q1] << 2);
+                jpeg2000_bitbuf_drop_bits_lsb(vlc_stream, len);
             }
 
-            sp = sig_pat[J2K_Q1];
-
-            gamma[J2K_Q1] = 1;
-
-            if (sp == 0 || sp == 1 || sp == 2 || sp == 4 || sp == 8)
-                gamma[J2K_Q1] = 0;
-
-            E_n[J2K_Q1] = E[4 * (q1 - quad_width) + 1];
-
-            E_ne[J2K_Q1] = E[4 * (q1 - quad_width) + 3];
-
-            E_nw[J2K_Q1] = (!is_divisible(q1, c)) * E[FFMAX((4 * (q1 - quad_width) - 1), 0)];
-
-            E_nf[J2K_Q1] = (!is_divisible(q1 + 1, c)) * E[4 * (q1 - quad_width) + 5];
-
-            max_e[J2K_Q1] = FFMAX(E_nw[J2K_Q1], FFMAX3(E_n[J2K_Q1], E_ne[J2K_Q1], E_nf[J2K_Q1]));
-
-            kappa[J2K_Q1] = FFMAX(1, gamma[J2K_Q1] * (max_e[J2K_Q1] - 1));
+            kappa[J2K_Q1] = jpeg2000_quad_kappa(x, quad_width, sig_pat[J2K_Q1], E_prev);
 
             U[J2K_Q1] = kappa[J2K_Q1] + u[J2K_Q1];
-            if (U[J2K_Q1] > maxbp) {
-                ret = AVERROR_INVALIDDATA;
-                goto free;
-            }
+            if (U[J2K_Q1] > maxbp)
+                return AVERROR_INVALIDDATA;
 
             for (int i = 0; i < 4; i++)
-                m[J2K_Q1][i] = sigma_n[4 * q1 + i] * U[J2K_Q1] - ((emb_pat_k[J2K_Q1] >> i) & 1);
+                m[J2K_Q1][i] = ((sig_pat[J2K_Q1] >> i) & 1) * U[J2K_Q1] - ((emb_pat_k[J2K_Q1] >> i) & 1);
 
-            recover_mag_sgn(mag_sgn_stream, J2K_Q1, q1, m_n, known_1, emb_pat_1, v, m,
+            recover_mag_sgn(mag_sgn_stream, J2K_Q1, m_n, known_1, emb_pat_1, v, m,
                             E, mu_n, Dcup, Pcup, pLSB);
-            q += 1;
-        }
-    }
 
-    // convert to raster-scan
-    for (int y = 0; y < quad_height; y++) {
-        for (int x = 0; x < quad_width; x++) {
-            int j1, j2;
-            int x1, x2 , x3;
-
-            j1 = 2 * y;
-            j2 = 2 * x;
-
-            sample_buf[j2 + (j1 * stride)] = (int32_t)*mu;
-            jpeg2000_modify_state(j1, j2, stride, *sigma, block_states);
-            sigma += 1;
-            mu += 1;
-
-            x1 = y != quad_height - 1 || is_border_y == 0;
-            sample_buf[j2 + ((j1 + 1) * stride)] = ((int32_t)*mu) * x1;
-            jpeg2000_modify_state(j1 + 1, j2, stride, (*sigma) * x1, block_states);
-            sigma += 1;
-            mu += 1;
-
-            x2 = x != quad_width - 1 || is_border_x == 0;
-            sample_buf[(j2 + 1) + (j1 * stride)] = ((int32_t)*mu) * x2;
-            jpeg2000_modify_state(j1, j2 + 1, stride, (*sigma) * x2, block_states);
-            sigma += 1;
-            mu += 1;
-
-            x3 = x1 | x2;
-            sample_buf[(j2 + 1) + (j1 + 1) * stride] = ((int32_t)*mu) * x3;
-            jpeg2000_modify_state(j1 + 1, j2 + 1, stride, (*sigma) * x3, block_states);
-            sigma += 1;
-            mu += 1;
+            jpeg2000_store_quad(x, row, x1, is_border_x == 0, sig_pat[J2K_Q1], E[J2K_Q1],
+                                mu_n[J2K_Q1], E_cur, sample_buf, block_states, stride);
         }
     }
-    ret = 1;
-free:
-    av_freep(&sigma_n);
-    av_freep(&E);
-    av_freep(&mu_n);
-    return ret;
+
+    return 1;
 }
 
 static void jpeg2000_calc_mbr(uint8_t *mbr, const uint16_t i, const uint16_t j,
                               const uint32_t mbr_info, uint8_t causal_cond,
-                              uint8_t *block_states, int stride)
+                              uint16_t *block_states, int stride)
 {
-    uint8_t *state_p0 = block_states + i * stride + j;
-    uint8_t *state_p1 = block_states + (i + 1) * stride + j;
-    uint8_t *state_p2 = block_states + (i + 2) * stride + j;
+    uint16_t *state_p0 = block_states + i * stride + j;
+    uint16_t *state_p1 = block_states + (i + 1) * stride + j;
+    uint16_t *state_p2 = block_states + (i + 2) * stride + j;
 
     uint8_t mbr0 = state_p0[0] | state_p0[1] | state_p0[2];
     uint8_t mbr1 = state_p1[0] | state_p1[2];
@@ -1033,7 +965,7 @@ static void jpeg2000_calc_mbr(uint8_t *mbr, const uint16_t i, const uint16_t j,
 
 static void jpeg2000_process_stripes_block(StateVars *sig_prop, int i_s, int j_s,
                                            int width, int height, int stride, int pLSB,
-                                           int32_t *sample_buf, uint8_t *block_states,
+                                           int32_t *sample_buf, uint16_t *block_states,
                                            uint8_t *magref_segment, uint32_t magref_length,
                                            uint8_t is_causal)
 {
@@ -1067,7 +999,7 @@ static void jpeg2000_process_stripes_block(StateVars *sig_prop, int i_s, int j_s
         for (int i = i_s; i < i_s + height; i++) {
             uint8_t bit;
             int32_t *sp = &sample_buf[j + (i * (stride))];
-            uint8_t *state_p = block_states + (i + 1) * stride + (j + 1);
+            uint16_t *state_p = block_states + (i + 1) * stride + (j + 1);
             if ((state_p[0] >> HT_SHIFT_REF) & 1) {
                 bit = jpeg2000_peek_bit(sig_prop, magref_segment, magref_length);
                 *sp |= (uint32_t)bit << 31;
@@ -1083,7 +1015,7 @@ av_noinline
 static void jpeg2000_decode_sigprop_segment(Jpeg2000Cblk *cblk, uint16_t width, uint16_t height,
                                             const int stride, uint8_t *magref_segment,
                                             uint32_t magref_length, uint8_t pLSB,
-                                            int32_t *sample_buf, uint8_t *block_states)
+                                            int32_t *sample_buf, uint16_t *block_states)
 {
     StateVars sp_dec;
 
@@ -1136,7 +1068,7 @@ static void jpeg2000_decode_sigprop_segment(Jpeg2000Cblk *cblk, uint16_t width,
 static void
 jpeg2000_decode_magref_segment( uint16_t width, uint16_t block_height, const int stride,
                                 uint8_t *magref_segment,uint32_t magref_length,
-                                uint8_t pLSB, int32_t *sample_buf, uint8_t *block_states)
+                                uint8_t pLSB, int32_t *sample_buf, uint16_t *block_states)
 {
 
     StateVars mag_ref           = { 0 };
@@ -1214,18 +1146,18 @@ ff_jpeg2000_decode_htj2k(const Jpeg2000DecoderContext *s, Jpeg2000CodingStyle *c
 
     int ret;
 
-    /* Temporary buffers */
-    int32_t *sample_buf = NULL;
-    uint8_t *block_states = NULL;
+    /**
+     * The samples are decoded in place and the flags hold the block states,
+     * with the same layout as for the MQ coder passes.
+     */
+    int32_t *sample_buf = t1->data;
+    uint16_t *block_states = t1->flags;
 
     int32_t n, val;             // Post-processing
     const uint32_t mask  = UINT32_MAX >> (M_b + 1); // bit mask for ROI detection
 
     uint8_t num_rempass;
 
-    const int quad_buf_width = width + 4;
-    const int quad_buf_height = height + 4;
-
     /* codeblock size as constrained by Rec. ITU-T T.800, Table A.18 */
     av_assert0(width <= 1024U && height <= 1024U);
     av_assert0(width * height <= 4096);
@@ -1268,8 +1200,7 @@ ff_jpeg2000_decode_htj2k(const Jpeg2000DecoderContext *s, Jpeg2000CodingStyle *c
     if (Scup < 2 || Scup > Lcup || Scup > 4079) {
         av_log(s->avctx, AV_LOG_ERROR, "Cleanup pass suffix length is invalid %d\n",
                Scup);
-        ret = AVERROR_INVALIDDATA;
-        goto free;
+        return AVERROR_INVALIDDATA;
     }
     Pcup = Lcup - Scup;
 
@@ -1292,46 +1223,37 @@ ff_jpeg2000_decode_htj2k(const Jpeg2000DecoderContext *s, Jpeg2000CodingStyle *c
 
     jpeg2000_init_mel_decoder(&mel_state);
 
-    sample_buf = av_calloc(quad_buf_width * quad_buf_height, sizeof(int32_t));
-    block_states = av_calloc(quad_buf_width * quad_buf_height, sizeof(uint8_t));
-
-    if (!sample_buf || !block_states) {
-        ret = AVERROR(ENOMEM);
-        goto free;
-    }
     if ((ret = jpeg2000_decode_ht_cleanup_segment(s, cblk, t1, &mel_state, &mel, &vlc,
                                                   &mag_sgn, Dcup, Lcup, Pcup, pLSB, width,
-                                                  height, quad_buf_width, sample_buf, block_states)) < 0) {
+                                                  height, t1->stride, sample_buf, block_states)) < 0) {
         av_log(s->avctx, AV_LOG_ERROR, "Bad HT cleanup segment\n");
-        goto free;
+        return ret;
     }
 
     if (z_blk > 1)
-        jpeg2000_decode_sigprop_segment(cblk, width, height, quad_buf_width, Dref, Lref,
+        jpeg2000_decode_sigprop_segment(cblk, width, height, t1->stride, Dref, Lref,
                                         pLSB - 1, sample_buf, block_states);
 
     if (z_blk > 2)
-        jpeg2000_decode_magref_segment(width, height, quad_buf_width, Dref, Lref,
+        jpeg2000_decode_magref_segment(width, height, t1->stride, Dref, Lref,
                                        pLSB - 1, sample_buf, block_states);
 
-    /* Reconstruct the sample values */
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int32_t sign;
-
-            n = x + (y * t1->stride);
-            val = sample_buf[x + (y * quad_buf_width)];
-            sign = val & INT32_MIN;
-            val &= INT32_MAX;
-            /* ROI shift, if necessary */
-            if (roi_shift && (((uint32_t)val & ~mask) == 0))
-                val <<= roi_shift;
-            t1->data[n] = val | sign; /* NOTE: Binary point for reconstruction value is located in 31 - M_b */
+    /* ROI shift, if necessary */
+    if (roi_shift) {
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                int32_t sign;
+
+                n = x + (y * t1->stride);
+                val = sample_buf[n];
+                sign = val & INT32_MIN;
+                val &= INT32_MAX;
+                if (((uint32_t)val & ~mask) == 0)
+                    val <<= roi_shift;
+                t1->data[n] = val | sign; /* NOTE: Binary point for reconstruction value is located in 31 - M_b */
+            }
         }
     }
-free:
-    av_freep(&sample_buf);
-    av_freep(&block_states);
     return ret;
 }
 
@@ -152,10 +152,10 @@ static void mjpeg_encode_picture_frame(MpegEncContext *s)
         code = m->huff_buffer[i].code;
         nbits = code & 0xf;
 
-        put_bits(&s->pb, huff_size[table_id][code], huff_code[table_id][code]);
-        if (nbits != 0) {
-            put_sbits(&s->pb, nbits, m->huff_buffer[i].mant);
-        }
+        /* nbits may be 0, in which case only the code is written */
+        put_bits(&s->pb, huff_size[table_id][code] + nbits,
+                 huff_code[table_id][code] << nbits |
+                 av_zero_extend(m->huff_buffer[i].mant, nbits));
     }
 
     m->huff_ncode = 0;
@@ -522,9 +522,8 @@ static void encode_block(MpegEncContext *s, int16_t *block, int n)
             nbits= av_log2_16bit(val) + 1;
             code = (run << 4) | nbits;
 
-            put_bits(&s->pb, huff_size_ac[code], huff_code_ac[code]);
-
-            put_sbits(&s->pb, nbits, mant);
+            put_bits(&s->pb, huff_size_ac[code] + nbits,
+                     huff_code_ac[code] << nbits | av_zero_extend(mant, nbits));
             run = 0;
         }
     }
@@ -638,10 +637,11 @@ static int amv_encode_picture(AVCodecContext *avctx, AVPacket *pkt,
 #define OFFSET(x) offsetof(MJPEGEncContext, mjpeg.x)
 #define VE AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_ENCODING_PARAM
 static const AVOption options[] = {
-#define AMV_OPTIONS_OFFSET 4
+#define AMV_OPTIONS_OFFSET 5
 { "huffman", "Huffman table strategy", OFFSET(huffman), AV_OPT_TYPE_INT, { .i64 = HUFFMAN_TABLE_OPTIMAL }, 0, NB_HUFFMAN_TABLE_OPTION - 1, VE, .unit = "huffman" },
     { "default", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = HUFFMAN_TABLE_DEFAULT }, INT_MIN, INT_MAX, VE, .unit = "huffman" },
     { "optimal", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = HUFFMAN_TABLE_OPTIMAL }, INT_MIN, INT_MAX, VE, .unit = "huffman" },
+{ "threaded_rc", "Share one rate control between the frame threads instead of limiting bitrate-targeted encoding to a single frame thread", OFFSET(threaded_rc), AV_OPT_TYPE_BOOL, {.i64 = 0 }, 0, 1, VE },
 { "force_duplicated_matrix", "Always write luma and chroma matrix for mjpeg, useful for rtp streaming.", OFFSET(force_duplicated_matrix), AV_OPT_TYPE_BOOL, {.i64 = 0 }, 0, 1, VE },
 FF_MPV_COMMON_OPTS
 { NULL},
@@ -480,9 +480,9 @@ void ff_mjpeg_encode_dc(PutBitContext *pb, int val,
 
         nbits= av_log2_16bit(val) + 1;
 
-        put_bits(pb, huff_size[nbits], huff_code[nbits]);
-
-        put_sbits(pb, nbits, mant);
+        /* code and mantissa fit in one call: at most 16 + 11 bits */
+        put_bits(pb, huff_size[nbits] + nbits,
+                 huff_code[nbits] << nbits | av_zero_extend(mant, nbits));
     }
 }
 
@@ -1451,23 +1451,115 @@ static int encode_frame(AVCodecContext *c, const AVFrame *frame, AVPacket *pkt)
     return size;
 }
 
-static int estimate_best_b_count(MpegEncContext *s)
+typedef struct BFrameCountTrial {
+    MpegEncContext *s;
+    int b_count;    ///< number of consecutive B-frames to try
+    int p_lambda, b_lambda, lambda2;
+    int64_t rd;
+    int ret;
+} BFrameCountTrial;
+
+/**
+ * Encode the downscaled lookahead frames with a fixed run of B-frames and
+ * store the resulting rate-distortion cost in the trial.
+ * The trials do not share any mutable state, so they can run concurrently.
+ */
+static int b_count_trial(AVCodecContext *avctx, void *arg)
 {
+    BFrameCountTrial *const t = arg;
+    MpegEncContext *const s = t->s;
+    AVCodecContext *c;
+    AVFrame *frame;
     AVPacket *pkt;
+    int i, out_size, ret;
+    int64_t rd = 0;
+
+    c     = avcodec_alloc_context3(NULL);
+    frame = av_frame_alloc();
+    pkt   = av_packet_alloc();
+    if (!c || !frame || !pkt) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    c->width        = s->width  >> s->brd_scale;
+    c->height       = s->height >> s->brd_scale;
+    c->flags        = AV_CODEC_FLAG_QSCALE | AV_CODEC_FLAG_PSNR;
+    c->flags       |= s->avctx->flags & AV_CODEC_FLAG_QPEL;
+    c->mb_decision  = s->avctx->mb_decision;
+    c->me_cmp       = s->avctx->me_cmp;
+    c->mb_cmp       = s->avctx->mb_cmp;
+    c->me_sub_cmp   = s->avctx->me_sub_cmp;
+    c->pix_fmt      = AV_PIX_FMT_YUV420P;
+    c->time_base    = s->avctx->time_base;
+    c->max_b_frames = s->max_b_frames;
+
+    ret = avcodec_open2(c, s->avctx->codec, NULL);
+    if (ret < 0)
+        goto fail;
+
+    for (i = 0; i < s->max_b_frames + 2; i++) {
+        /* The temporary frames are shared by all trials, so the picture type
+         * and quality are set on a reference of our own. */
+        ret = av_frame_ref(frame, s->tmp_frames[i]);
+        if (ret < 0)
+            goto fail;
+
+        if (!i) {
+            frame->pict_type = AV_PICTURE_TYPE_I;
+            frame->quality   = 1 * FF_QP2LAMBDA;
+        } else {
+            int is_p = (i - 1) % (t->b_count + 1) == t->b_count ||
+                       i - 1 == s->max_b_frames;
+
+            frame->pict_type = is_p ? AV_PICTURE_TYPE_P : AV_PICTURE_TYPE_B;
+            frame->quality   = is_p ? t->p_lambda : t->b_lambda;
+        }
+
+        out_size = encode_frame(c, frame, pkt);
+        av_frame_unref(frame);
+        if (out_size < 0) {
+            ret = out_size;
+            goto fail;
+        }
+
+        /* the leading I-frame is the same for all trials */
+        if (i)
+            rd += (out_size * (uint64_t)t->lambda2) >> (FF_LAMBDA_SHIFT - 3);
+    }
+
+    /* get the delayed frames */
+    out_size = encode_frame(c, NULL, pkt);
+    if (out_size < 0) {
+        ret = out_size;
+        goto fail;
+    }
+    rd += (out_size * (uint64_t)t->lambda2) >> (FF_LAMBDA_SHIFT - 3);
+
+    rd += c->error[0] + c->error[1] + c->error[2];
+
+    t->rd = rd;
+    ret   = 0;
+fail:
+    avcodec_free_context(&c);
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    t->ret = ret;
+    return ret;
+}
+
+static int estimate_best_b_count(MpegEncContext *s)
+{
+    BFrameCountTrial trials[MAX_B_FRAMES + 1];
     const int scale = s->brd_scale;
     int width  = s->width  >> scale;
     int height = s->height >> scale;
-    int i, j, out_size, p_lambda, b_lambda, lambda2;
+    int i, j, nb_trials, p_lambda, b_lambda, lambda2;
     int64_t best_rd  = INT64_MAX;
     int best_b_count = -1;
-    int ret = 0;
 
     av_assert0(scale >= 0 && scale <= 3);
 
-    pkt = av_packet_alloc();
-    if (!pkt)
-        return AVERROR(ENOMEM);
-
     //emms_c();
     p_lambda = s->last_lambda_for[AV_PICTURE_TYPE_P];
     //p_lambda * FFABS(s->avctx->b_quant_factor) + s->avctx->b_quant_offset;
@@ -1510,88 +1602,34 @@ static int estimate_best_b_count(MpegEncContext *s)
     }
 
     for (j = 0; j < s->max_b_frames + 1; j++) {
-        AVCodecContext *c;
-        int64_t rd = 0;
-
         if (!s->input_picture[j])
             break;
 
-        c = avcodec_alloc_context3(NULL);
-        if (!c) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
-        }
-
-        c->width        = width;
-        c->height       = height;
-        c->flags        = AV_CODEC_FLAG_QSCALE | AV_CODEC_FLAG_PSNR;
-        c->flags       |= s->avctx->flags & AV_CODEC_FLAG_QPEL;
-        c->mb_decision  = s->avctx->mb_decision;
-        c->me_cmp       = s->avctx->me_cmp;
-        c->mb_cmp       = s->avctx->mb_cmp;
-        c->me_sub_cmp   = s->avctx->me_sub_cmp;
-        c->pix_fmt      = AV_PIX_FMT_YUV420P;
-        c->time_base    = s->avctx->time_base;
-        c->max_b_frames = s->max_b_frames;
-
-        ret = avcodec_open2(c, s->avctx->codec, NULL);
-        if (ret < 0)
-            goto fail;
-
-
-        s->tmp_frames[0]->pict_type = AV_PICTURE_TYPE_I;
-        s->tmp_frames[0]->quality   = 1 * FF_QP2LAMBDA;
-
-        out_size = encode_frame(c, s->tmp_frames[0], pkt);
-        if (out_size < 0) {
-            ret = out_size;
-            goto fail;
-        }
-
-        //rd += (out_size * lambda2) >> FF_LAMBDA_SHIFT;
-
-        for (i = 0; i < s->max_b_frames + 1; i++) {
-            int is_p = i % (j + 1) == j || i == s->max_b_frames;
-
-            s->tmp_frames[i + 1]->pict_type = is_p ?
-                                     AV_PICTURE_TYPE_P : AV_PICTURE_TYPE_B;
-            s->tmp_frames[i + 1]->quality   = is_p ? p_lambda : b_lambda;
-
-            out_size = encode_frame(c, s->tmp_frames[i + 1], pkt);
-            if (out_size < 0) {
-                ret = out_size;
-                goto fail;
-            }
-
-            rd += (out_size * (uint64_t)lambda2) >> (FF_LAMBDA_SHIFT - 3);
-        }
+        trials[j] = (BFrameCountTrial) {
+            .s        = s,
+            .b_count  = j,
+            .p_lambda = p_lambda,
+            .b_lambda = b_lambda,
+            .lambda2  = lambda2,
+        };
+    }
+    nb_trials = j;
 
-        /* get the delayed frames */
-        out_size = encode_frame(c, NULL, pkt);
-        if (out_size < 0) {
-            ret = out_size;
-            goto fail;
-        }
-        rd += (out_size * (uint64_t)lambda2) >> (FF_LAMBDA_SHIFT - 3);
+    /* Each candidate B-frame count is tried with its own encoder, so they can
+     * all be run at once on the slice threads. */
+    s->avctx->execute(s->avctx, b_count_trial, trials, NULL,
+                      nb_trials, sizeof(*trials));
 
-        rd += c->error[0] + c->error[1] + c->error[2];
+    for (j = 0; j < nb_trials; j++) {
+        if (trials[j].ret < 0)
+            return trials[j].ret;
 
-        if (rd < best_rd) {
-            best_rd = rd;
+        if (trials[j].rd < best_rd) {
+            best_rd = trials[j].rd;
             best_b_count = j;
         }
-
-fail:
-        avcodec_free_context(&c);
-        av_packet_unref(pkt);
-        if (ret < 0) {
-            best_b_count = ret;
-            break;
-        }
     }
 
-    av_packet_free(&pkt);
-
     return best_b_count;
 }
 
@@ -0,0 +1,567 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * HT block decoder test: code-blocks are coded with a minimal HT cleanup
+ * pass encoder (Rec. ITU-T T.814, clause 7.3 run backwards) and must decode
+ * to the original coefficients. Blocks with refinement passes are filled
+ * with random refinement bytes and only checksummed.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/crc.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/lfg.h"
+
+#include "libavcodec/jpeg2000htdec.c"
+
+#define MAX_QUADS   2048
+#define MAX_SEG_LEN 16384
+
+typedef struct HTCodeword {
+    uint8_t cwd, len, e_k;
+} HTCodeword;
+
+/* [non-initial row][context][rho][u_off][emb] */
+static HTCodeword enc_cxt_vlc[2][8][16][2][16];
+
+typedef struct HTEncoder {
+    uint8_t ms[MAX_SEG_LEN];
+    int ms_len, ms_used, ms_max;
+    uint32_t ms_tmp;
+
+    uint8_t mel[MAX_SEG_LEN];
+    int mel_len, mel_rem, mel_k, mel_run, mel_threshold;
+    uint32_t mel_tmp;
+
+    /* VLC bytes in the order they are written, i.e. from the segment end */
+    uint8_t vlc[MAX_SEG_LEN];
+    int vlc_len, vlc_used, vlc_gt_8f;
+    uint32_t vlc_tmp;
+} HTEncoder;
+
+/* invert the decoder CxtVLC tables */
+static void init_enc_tables(void)
+{
+    for (int t = 0; t < 2; t++) {
+        const uint16_t *table = t ? dec_cxt_vlc_table1 : dec_cxt_vlc_table0;
+        for (int c = 0; c < 8; c++) {
+            for (int w = 0; w < 128; w++) {
+                int val   = table[(c << 7) | w];
+                int len   = (val & 0xF) >> 1;
+                int u_off = val & 1;
+                int rho   = (val >> 4) & 0xF;
+                int e_k   = (val >> 8) & 0xF;
+                int e_1   = val >> 12;
+
+                if (!len || (e_k & ~rho) || (!u_off && e_k))
+                    continue;
+                for (int emb = 0; emb < 16; emb++) {
+                    HTCodeword *cw = &enc_cxt_vlc[t][c][rho][u_off][emb];
+                    int ones = av_popcount(e_k), best = av_popcount(cw->e_k);
+
+                    if (u_off ? (emb & e_k) != e_1 : emb)
+                        continue;
+                    if (cw->len && (ones < best || (ones == best && len >= cw->len)))
+                        continue;
+                    cw->cwd = w & ((1 << len) - 1);
+                    cw->len = len;
+                    cw->e_k = e_k;
+                }
+            }
+        }
+    }
+}
+
+static void ms_put(HTEncoder *e, uint32_t cwd, int len)
+{
+    while (len > 0) {
+        int t = FFMIN(e->ms_max - e->ms_used, len);
+        e->ms_tmp  |= (cwd & ((1U << t) - 1)) << e->ms_used;
+        e->ms_used += t;
+        cwd       >>= t;
+        len        -= t;
+        if (e->ms_used >= e->ms_max) {
+            e->ms[e->ms_len++] = e->ms_tmp;
+            e->ms_max  = e->ms_tmp == 0xFF ? 7 : 8;
+            e->ms_tmp  = 0;
+            e->ms_used = 0;
+        }
+    }
+}
+
+static void ms_terminate(HTEncoder *e)
+{
+    if (e->ms_used) {
+        int t = e->ms_max - e->ms_used;
+        e->ms_tmp |= ((1U << t) - 1) << e->ms_used;
+        if (e->ms_tmp != 0xFF)
+            e->ms[e->ms_len++] = e->ms_tmp;
+    } else if (e->ms_max == 7) {
+        e->ms_len--;
+    }
+}
+
+static void mel_put_bit(HTEncoder *e, int bit)
+{
+    e->mel_tmp = (e->mel_tmp << 1) | bit;
+    if (!--e->mel_rem) {
+        e->mel[e->mel_len++] = e->mel_tmp;
+        e->mel_rem = e->mel_tmp == 0xFF ? 7 : 8;
+        e->mel_tmp = 0;
+    }
+}
+
+static void mel_put(HTEncoder *e, int sym)
+{
+    if (!sym) {
+        if (++e->mel_run >= e->mel_threshold) {
+            mel_put_bit(e, 1);
+            e->mel_run = 0;
+            e->mel_k   = FFMIN(12, e->mel_k + 1);
+            e->mel_threshold = 1 << mel_e[e->mel_k];
+        }
+    } else {
+        int t = mel_e[e->mel_k];
+        mel_put_bit(e, 0);
+        while (t > 0)
+            mel_put_bit(e, (e->mel_run >> --t) & 1);
+        e->mel_run = 0;
+        e->mel_k   = FFMAX(0, e->mel_k - 1);
+        e->mel_threshold = 1 << mel_e[e->mel_k];
+    }
+}
+
+static void vlc_put(HTEncoder *e, uint32_t cwd, int len)
+{
+    while (len > 0) {
+        int avail = 8 - e->vlc_gt_8f - e->vlc_used;
+        int t = FFMIN(avail, len);
+        e->vlc_tmp  |= (cwd & ((1U << t) - 1)) << e->vlc_used;
+        e->vlc_used += t;
+        avail       -= t;
+        len         -= t;
+        cwd        >>= t;
+        if (!avail) {
+            /* a stuffing bit is only needed after 0x7F */
+            if (e->vlc_gt_8f && e->vlc_tmp != 0x7F) {
+                e->vlc_gt_8f = 0;
+                continue;
+            }
+            e->vlc[e->vlc_len++] = e->vlc_tmp;
+            e->vlc_gt_8f = e->vlc_tmp > 0x8F;
+            e->vlc_tmp   = 0;
+            e->vlc_used  = 0;
+        }
+    }
+}
+
+static void mel_vlc_terminate(HTEncoder *e)
+{
+    int mel_mask, vlc_mask, fuse;
+
+    if (e->mel_run > 0)
+        mel_put_bit(e, 1);
+
+    e->mel_tmp <<= e->mel_rem;
+    mel_mask = (0xFF << e->mel_rem) & 0xFF;
+    vlc_mask = 0xFF >> (8 - e->vlc_used);
+    if (!(mel_mask | vlc_mask))
+        return;
+
+    fuse = e->mel_tmp | e->vlc_tmp;
+    if (!(((fuse ^ e->mel_tmp) & mel_mask) | ((fuse ^ e->vlc_tmp) & vlc_mask)) &&
+        fuse != 0xFF && e->vlc_len > 1) {
+        e->mel[e->mel_len++] = fuse;
+    } else {
+        e->mel[e->mel_len++] = e->mel_tmp;
+        e->vlc[e->vlc_len++] = e->vlc_tmp;
+    }
+}
+
+static void put_u_prefix(HTEncoder *e, int u)
+{
+    if (u == 1)
+        vlc_put(e, 1, 1);
+    else if (u == 2)
+        vlc_put(e, 2, 2);
+    else if (u <= 4)
+        vlc_put(e, 4, 3);
+    else
+        vlc_put(e, 0, 3);
+}
+
+static void put_u_suffix(HTEncoder *e, int u)
+{
+    if (u >= 33)
+        vlc_put(e, 28 + ((u - 33) & 3), 5);
+    else if (u >= 5)
+        vlc_put(e, u - 5, 5);
+    else if (u >= 3)
+        vlc_put(e, u - 3, 1);
+}
+
+static void put_u_extension(HTEncoder *e, int u)
+{
+    if (u >= 33)
+        vlc_put(e, (u - 33) >> 2, 4);
+}
+
+static int quad_context(const uint8_t *sigma, int q, int x, int qw, int row)
+{
+    int n = 4 * (q - qw), context;
+
+    if (!row)
+        return x ? (sigma[4 * q - 4] | sigma[4 * q - 3]) +
+                   (sigma[4 * q - 2] << 1) + (sigma[4 * q - 1] << 2) : 0;
+
+    context = sigma[n + 1] + (sigma[n + 3] << 2);
+    if (x) {
+        context |= sigma[n - 1];
+        context += (sigma[4 * q - 1] | sigma[4 * q - 2]) << 1;
+    }
+    if (x < qw - 1)
+        context |= sigma[n + 5] << 2;
+    return context;
+}
+
+static int quad_kappa(const uint8_t *E, int rho, int q, int x, int qw)
+{
+    int n = 4 * (q - qw);
+    int max_e = FFMAX(E[n + 1], E[n + 3]);
+
+    if (x)
+        max_e = FFMAX(max_e, E[n - 1]);
+    if (x < qw - 1)
+        max_e = FFMAX(max_e, E[n + 5]);
+    return av_popcount(rho) > 1 ? FFMAX(1, max_e - 1) : 1;
+}
+
+/**
+ * Code coefficients (sign and magnitude, raster order) as a single HT
+ * cleanup segment. Returns the segment length or a negative value if the
+ * suffix does not fit.
+ */
+static int encode_cleanup(HTEncoder *e, const int32_t *coeffs, int width, int height,
+                          uint8_t *out)
+{
+    static uint8_t  sigma[4 * MAX_QUADS], E[4 * MAX_QUADS];
+    static uint32_t v[4 * MAX_QUADS];
+    const int qw = (width + 1) >> 1, qh = (height + 1) >> 1;
+    int Scup, len;
+
+    e->ms_len = e->ms_used = e->ms_tmp = 0;
+    e->ms_max = 8;
+    e->mel_len = e->mel_k = e->mel_run = e->mel_tmp = 0;
+    e->mel_rem = 8;
+    e->mel_threshold = 1;
+    e->vlc[0]    = 0xFF;
+    e->vlc_len   = 1;
+    e->vlc_used  = 4;
+    e->vlc_tmp   = 0xF;
+    e->vlc_gt_8f = 1;
+
+    for (int q = 0; q < qw * qh; q++) {
+        for (int i = 0; i < 4; i++) {
+            int x = 2 * (q % qw) + (i >> 1);
+            int y = 2 * (q / qw) + (i & 1);
+            int32_t c = x < width && y < height ? coeffs[y * width + x] : 0;
+            int n = 4 * q + i;
+
+            sigma[n] = c != 0;
+            v[n]     = c ? 2 * (FFABS(c) - 1) + (c < 0) : 0;
+            E[n]     = c ? 32 - ff_clz(v[n] | 1) : 0;
+        }
+    }
+
+    for (int row = 0; row < qh; row++) {
+        for (int x = 0; x < qw; x += 2) {
+            int nq = FFMIN(2, qw - x);
+            int U[2], u[2], u_off[2], e_k[2];
+
+            for (int k = 0; k < nq; k++) {
+                int q = row * qw + x + k;
+                int context = quad_context(sigma, q, x + k, qw, row);
+                int rho = 0, emax = 0, emb = 0, kappa;
+
+                for (int i = 0; i < 4; i++) {
+                    rho |= sigma[4 * q + i] << i;
+                    emax = FFMAX(emax, E[4 * q + i]);
+                }
+                kappa    = row ? quad_kappa(E, rho, q, x + k, qw) : 1;
+                U[k]     = FFMAX(emax, kappa);
+                u[k]     = U[k] - kappa;
+                u_off[k] = u[k] > 0;
+                for (int i = 0; u_off[k] && i < 4; i++)
+                    emb |= (E[4 * q + i] == U[k]) << i;
+
+                e_k[k] = 0;
+                if (!context)
+                    mel_put(e, rho != 0);
+                if (context || rho) {
+                    const HTCodeword *cw = &enc_cxt_vlc[row > 0][context][rho][u_off[k]][emb];
+                    av_assert0(cw->len);
+                    vlc_put(e, cw->cwd, cw->len);
+                    e_k[k] = cw->e_k;
+                }
+            }
+
+            if (nq == 2 && u_off[0] && u_off[1]) {
+                if (!row) {
+                    if (u[0] > 2 && u[1] > 2) {
+                        mel_put(e, 1);
+                        put_u_prefix(e, u[0] - 2);
+                        put_u_prefix(e, u[1] - 2);
+                        put_u_suffix(e, u[0] - 2);
+                        put_u_suffix(e, u[1] - 2);
+                        put_u_extension(e, u[0] - 2);
+                        put_u_extension(e, u[1] - 2);
+                    } else {
+                        mel_put(e, 0);
+                        put_u_prefix(e, u[0]);
+                        if (u[0] > 2) {
+                            vlc_put(e, u[1] - 1, 1);
+                            put_u_suffix(e, u[0]);
+                            put_u_extension(e, u[0]);
+                        } else {
+                            put_u_prefix(e, u[1]);
+                            put_u_suffix(e, u[0]);
+                            put_u_suffix(e, u[1]);
+                            put_u_extension(e, u[0]);
+                            put_u_extension(e, u[1]);
+                        }
+                    }
+                } else {
+                    put_u_prefix(e, u[0]);
+                    put_u_prefix(e, u[1]);
+                    put_u_suffix(e, u[0]);
+                    put_u_suffix(e, u[1]);
+                    put_u_extension(e, u[0]);
+                    put_u_extension(e, u[1]);
+                }
+            } else {
+                for (int k = 0; k < nq; k++) {
+                    if (!u_off[k])
+                        continue;
+                    put_u_prefix(e, u[k]);
+                    put_u_suffix(e, u[k]);
+                    put_u_extension(e, u[k]);
+                }
+            }
+
+            for (int k = 0; k < nq; k++) {
+                int q = row * qw + x + k;
+                for (int i = 0; i < 4; i++) {
+                    int m = U[k] - ((e_k[k] >> i) & 1);
+                    if (sigma[4 * q + i])
+                        ms_put(e, v[4 * q + i] & ((1U << m) - 1), m);
+                }
+            }
+        }
+    }
+
+    ms_terminate(e);
+    mel_vlc_terminate(e);
+
+    Scup = e->mel_len + e->vlc_len;
+    if (Scup > 4079)
+        return -1;
+
+    memcpy(out, e->ms, e->ms_len);
+    len = e->ms_len;
+    memcpy(out + len, e->mel, e->mel_len);
+    len += e->mel_len;
+    for (int i = e->vlc_len - 1; i >= 0; i--)
+        out[len++] = e->vlc[i];
+
+    out[len - 1] = Scup >> 4;
+    out[len - 2] = (out[len - 2] & 0xF0) | (Scup & 0x0F);
+    return len;
+}
+
+typedef struct TestBlock {
+    int width, height;
+    int zbp;
+    int npasses;
+    int Lcup, Lref;
+    int32_t coeffs[4096];
+    uint8_t data[MAX_SEG_LEN + 256];
+} TestBlock;
+
+/**
+ * Fill a block with coefficients, a fraction sig/100 of them significant
+ * with magnitudes of lo to hi bits.
+ */
+static int gen_block(AVLFG *prng, HTEncoder *e, TestBlock *b, int width, int height,
+                     int sig, int lo, int hi, int npasses)
+{
+    b->width   = width;
+    b->height  = height;
+    b->zbp     = hi;
+    b->npasses = npasses;
+
+    for (int i = 0; i < width * height; i++) {
+        int bits = lo + av_lfg_get(prng) % (hi - lo + 1);
+        int32_t mag = 1 + (av_lfg_get(prng) & ((1U << bits) - 1));
+
+        if (av_lfg_get(prng) % 100 >= sig)
+            mag = 0;
+        b->coeffs[i] = av_lfg_get(prng) & 1 ? -mag : mag;
+    }
+
+    b->Lcup = encode_cleanup(e, b->coeffs, width, height, b->data);
+    if (b->Lcup < 0)
+        return AVERROR(EINVAL);
+
+    b->Lref = 0;
+    if (npasses > 1) {
+        b->Lref = 1 + av_lfg_get(prng) % 64;
+        for (int i = 0; i < b->Lref; i++)
+            b->data[b->Lcup + i] = av_lfg_get(prng);
+    }
+    return 0;
+}
+
+static Jpeg2000DecoderContext dec_ctx;
+static Jpeg2000T1Context t1;
+
+static int decode_block(const TestBlock *b, uint8_t *buf)
+{
+    Jpeg2000CodingStyle codsty = { 0 };
+    Jpeg2000Cblk cblk = { 0 };
+
+    /* the decoder unstuffs the cleanup segment suffix in place */
+    memcpy(buf, b->data, b->Lcup + b->Lref);
+    cblk.data            = buf;
+    cblk.length          = b->Lcup + b->Lref;
+    cblk.npasses         = b->npasses;
+    cblk.pass_lengths[0] = b->Lcup;
+    cblk.pass_lengths[1] = b->Lref;
+    cblk.zbp             = b->zbp;
+    cblk.modes           = JPEG2000_CTSY_HTJ2K_F;
+
+    t1.stride = b->width + 2;
+    return ff_jpeg2000_decode_htj2k(&dec_ctx, &codsty, &t1, &cblk, b->width, b->height,
+                                    b->zbp, 0);
+}
+
+static int check_block(const TestBlock *b)
+{
+    int pLSB = 30 - b->zbp;
+
+    for (int y = 0; y < b->height; y++) {
+        for (int x = 0; x < b->width; x++) {
+            int32_t c = b->coeffs[y * b->width + x];
+            uint32_t ref = 0;
+
+            if (c)
+                ref = (uint32_t)(c < 0) << 31 | (uint32_t)FFABS(c) << pLSB |
+                      1U << (pLSB - 1);
+            if ((uint32_t)t1.data[y * t1.stride + x] != ref) {
+                fprintf(stderr, "mismatch at %d,%d (%08"PRIx32" != %08"PRIx32")\n",
+                        x, y, (uint32_t)t1.data[y * t1.stride + x], ref);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static uint32_t block_crc(const TestBlock *b)
+{
+    const AVCRC *table = av_crc_get_table(AV_CRC_32_IEEE_LE);
+    uint32_t crc = 0;
+
+    for (int y = 0; y < b->height; y++) {
+        for (int x = 0; x < b->width; x++) {
+            uint8_t buf[4];
+            AV_WL32(buf, t1.data[y * t1.stride + x]);
+            crc = av_crc(table, crc, buf, 4);
+        }
+    }
+    return crc;
+}
+
+static const struct {
+    int width, height, sig, lo, hi, npasses;
+} tests[] = {
+    {   1,    1, 100,  0,  0, 1 },
+    {   2,    1, 100,  0,  3, 1 },
+    {   1,    2, 100,  0,  3, 1 },
+    {   3,    3,  50,  0,  5, 1 },
+    {   4,    4,  80,  2,  8, 1 },
+    {   5,    7,  60,  0, 10, 1 },
+    {   7,    5,  60,  0, 10, 1 },
+    {  16,   16,   0,  0,  4, 1 },
+    {  16,   16,   5,  0,  4, 1 },
+    {  32,   32,  30,  0, 12, 1 },
+    {  33,   17,  40,  0,  6, 1 },
+    {  64,   64,   2,  0,  8, 1 },
+    {  64,   64,  25,  0,  6, 1 },
+    {  64,   64,  90,  6, 12, 1 },
+    {  64,   64, 100, 14, 16, 1 },
+    {  64,   64, 100,  0, 24, 1 },
+    {  63,   65,  70,  0,  9, 1 },
+    { 128,   32,  50,  0, 10, 1 },
+    {1024,    4,  50,  0,  8, 1 },
+    {   4, 1024,  50,  0,  8, 1 },
+    {  16,  256,  35,  3,  7, 1 },
+    {  64,   64,  20,  0,  8, 2 },
+    {  64,   64,  40,  0,  8, 3 },
+    {  33,   31,  60,  0, 10, 3 },
+    {   4,   64,  30,  0,  6, 3 },
+};
+
+int main(void)
+{
+    static HTEncoder enc;
+    static TestBlock block;
+    static uint8_t buf[MAX_SEG_LEN + 256];
+    AVLFG prng;
+    int ret;
+
+    av_lfg_init(&prng, 1);
+    init_enc_tables();
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(tests); i++) {
+        ret = gen_block(&prng, &enc, &block, tests[i].width, tests[i].height,
+                        tests[i].sig, tests[i].lo, tests[i].hi, tests[i].npasses);
+        if (ret < 0) {
+            fprintf(stderr, "test %d: block could not be coded\n", i);
+            return 1;
+        }
+        ret = decode_block(&block, buf);
+        if (ret < 0) {
+            fprintf(stderr, "test %d: decoding failed\n", i);
+            return 1;
+        }
+        if (block.npasses == 1 && check_block(&block)) {
+            fprintf(stderr, "test %d: %dx%d decoded incorrectly\n",
+                    i, block.width, block.height);
+            return 1;
+        }
+        printf("%4dx%-4d sig:%3d%% bits:%2d-%2d passes:%d Lcup:%5d Lref:%3d crc:%08"PRIx32"\n",
+               block.width, block.height, tests[i].sig, tests[i].lo, tests[i].hi,
+               block.npasses, block.Lcup, block.Lref, block_crc(&block));
+    }
+
+    return 0;
+}
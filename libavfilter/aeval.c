@@ -72,6 +72,9 @@ typedef struct EvalContext {
     uint64_t n;
     double var_values[VAR_VARS_NB];
     double *channel_values;
+    double *sample_values;      ///< n and t of each sample of a frame
+    unsigned int sample_values_size;
+    uint8_t *reads_input;       ///< per output channel, if its expression calls val()
 } EvalContext;
 
 static double val(void *priv, double ch)
@@ -219,9 +222,28 @@ static av_cold void uninit(AVFilterContext *ctx)
     }
     av_freep(&eval->expr);
     av_freep(&eval->channel_values);
+    av_freep(&eval->sample_values);
+    av_freep(&eval->reads_input);
     av_channel_layout_uninit(&eval->chlayout);
 }
 
+/**
+ * Allocate the arrays of n and t for each sample of a frame, the samples
+ * being evaluated all at once.
+ */
+static int alloc_sample_values(EvalContext *eval, const double *arrays[VAR_VARS_NB],
+                               int nb_samples)
+{
+    av_fast_malloc(&eval->sample_values, &eval->sample_values_size,
+                   2 * nb_samples * sizeof(*eval->sample_values));
+    if (!eval->sample_values)
+        return AVERROR(ENOMEM);
+
+    arrays[VAR_N] = eval->sample_values;
+    arrays[VAR_T] = eval->sample_values + nb_samples;
+    return 0;
+}
+
 static int config_props(AVFilterLink *outlink)
 {
     EvalContext *eval = outlink->src->priv;
@@ -269,7 +291,9 @@ static int activate(AVFilterContext *ctx)
     AVFilterLink *outlink = ctx->outputs[0];
     EvalContext *eval = outlink->src->priv;
     AVFrame *samplesref;
-    int i, j;
+    const double *arrays[VAR_VARS_NB] = { NULL };
+    double *ns, *ts;
+    int i, j, ret;
     int64_t t = av_rescale(eval->n, AV_TIME_BASE, eval->sample_rate);
     int nb_samples;
 
@@ -294,16 +318,26 @@ static int activate(AVFilterContext *ctx)
     if (!samplesref)
         return AVERROR(ENOMEM);
 
-    /* evaluate expression for each single sample and for each channel */
-    for (i = 0; i < nb_samples; i++, eval->n++) {
-        eval->var_values[VAR_N] = eval->n;
-        eval->var_values[VAR_T] = eval->var_values[VAR_N] * (double)1/eval->sample_rate;
+    if ((ret = alloc_sample_values(eval, arrays, nb_samples)) < 0) {
+        av_frame_free(&samplesref);
+        return ret;
+    }
+    ns = eval->sample_values;
+    ts = ns + nb_samples;
+    for (i = 0; i < nb_samples; i++) {
+        ns[i] = eval->n + i;
+        ts[i] = ns[i] * (double)1/eval->sample_rate;
+    }
 
-        for (j = 0; j < eval->nb_channels; j++) {
-            *((double *) samplesref->extended_data[j] + i) =
-                av_expr_eval(eval->expr[j], eval->var_values, NULL);
-        }
+    /* evaluate expression for all the samples of each channel */
+    for (j = 0; ret >= 0 && j < eval->nb_channels; j++)
+        ret = av_expr_eval_batch(eval->expr[j], (double *)samplesref->extended_data[j],
+                                 nb_samples, eval->var_values, arrays, NULL);
+    if (ret < 0) {
+        av_frame_free(&samplesref);
+        return ret;
     }
+    eval->n += nb_samples;
 
     samplesref->pts = eval->pts;
     samplesref->sample_rate = eval->sample_rate;
@@ -404,6 +438,15 @@ static int aeval_config_output(AVFilterLink *outlink)
     if (!eval->channel_values)
         return AVERROR(ENOMEM);
 
+    eval->reads_input = av_realloc_f(eval->reads_input, eval->nb_channels, sizeof(*eval->reads_input));
+    if (!eval->reads_input)
+        return AVERROR(ENOMEM);
+    for (int i = 0; i < eval->nb_channels; i++) {
+        unsigned counter = 0;
+        av_expr_count_func(eval->expr[i], &counter, 1, 1);
+        eval->reads_input[i] = counter > 0;
+    }
+
     return 0;
 }
 
@@ -412,9 +455,11 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     EvalContext *eval     = inlink->dst->priv;
     AVFilterLink *outlink = inlink->dst->outputs[0];
     int nb_samples        = in->nb_samples;
+    const double *arrays[VAR_VARS_NB] = { NULL };
+    int reads_input = 0;
     AVFrame *out;
-    double t0;
-    int i, j;
+    double t0, *ns, *ts;
+    int i, j, ret;
 
     out = ff_get_audio_buffer(outlink, nb_samples);
     if (!out) {
@@ -425,23 +470,53 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 
     t0 = TS2T(in->pts, inlink->time_base);
 
-    /* evaluate expression for each single sample and for each channel */
-    for (i = 0; i < nb_samples; i++, eval->n++) {
-        eval->var_values[VAR_N] = eval->n;
-        eval->var_values[VAR_T] = t0 + i * (double)1/inlink->sample_rate;
+    if ((ret = alloc_sample_values(eval, arrays, nb_samples)) < 0)
+        goto fail;
+    ns = eval->sample_values;
+    ts = ns + nb_samples;
+    for (i = 0; i < nb_samples; i++) {
+        ns[i] = eval->n + i;
+        ts[i] = t0 + i * (double)1/inlink->sample_rate;
+    }
+
+    /* the expressions which do not read the input samples are evaluated
+     * for all the samples of their channel at once */
+    for (j = 0; j < outlink->ch_layout.nb_channels; j++) {
+        if (eval->reads_input[j]) {
+            reads_input = 1;
+            continue;
+        }
+        eval->var_values[VAR_CH] = j;
+        ret = av_expr_eval_batch(eval->expr[j], (double *)out->extended_data[j],
+                                 nb_samples, eval->var_values, arrays, eval);
+        if (ret < 0)
+            goto fail;
+    }
+
+    /* evaluate the other ones for each single sample */
+    for (i = 0; reads_input && i < nb_samples; i++) {
+        eval->var_values[VAR_N] = ns[i];
+        eval->var_values[VAR_T] = ts[i];
 
         for (j = 0; j < inlink->ch_layout.nb_channels; j++)
             eval->channel_values[j] = *((double *) in->extended_data[j] + i);
 
         for (j = 0; j < outlink->ch_layout.nb_channels; j++) {
+            if (!eval->reads_input[j])
+                continue;
             eval->var_values[VAR_CH] = j;
             *((double *) out->extended_data[j] + i) =
                 av_expr_eval(eval->expr[j], eval->var_values, eval);
         }
     }
+    eval->n += nb_samples;
 
     av_frame_free(&in);
     return ff_filter_frame(outlink, out);
+fail:
+    av_frame_free(&in);
+    av_frame_free(&out);
+    return ret;
 }
 
 #if CONFIG_AEVAL_FILTER
@@ -414,7 +414,9 @@ extern const FFFilter ff_vf_program_opencl;
 extern const FFFilter ff_vf_pseudocolor;
 extern const FFFilter ff_vf_psnr;
 extern const FFFilter ff_vf_pullup;
+extern const FFFilter ff_vf_qcdetect;
 extern const FFFilter ff_vf_qp;
+extern const FFFilter ff_vf_qualitymetrics;
 extern const FFFilter ff_vf_qrencode;
 extern const FFFilter ff_vf_quirc;
 extern const FFFilter ff_vf_random;
@@ -24,6 +24,7 @@
  */
 
 #include <float.h>
+#include <string.h>
 
 #include "libavutil/channel_layout.h"
 #include "libavutil/frame.h"
@@ -333,6 +334,29 @@ unsigned av_buffersrc_get_nb_failed_requests(AVFilterContext *buffer_src)
     return ((BufferSourceContext *)buffer_src->priv)->nb_failed_requests;
 }
 
+int av_buffersrc_get_video_border(AVFilterContext *ctx, int border[4])
+{
+    AVFilterLink *link;
+
+    if (ctx->nb_outputs != 1 || ctx->outputs[0]->type != AVMEDIA_TYPE_VIDEO ||
+        !ctx->outputs[0]->dst)
+        return AVERROR(EINVAL);
+
+    /* frames pass unchanged through metadata-only filters, so look past them */
+    link = ctx->outputs[0];
+    while (link->dst->nb_inputs == 1 && link->dst->nb_outputs == 1 &&
+           (link->dst->filter->flags & AVFILTER_FLAG_METADATA_ONLY)) {
+        AVFilterLink *next = link->dst->outputs[0];
+        if (!next->dst || next->w != link->w || next->h != link->h ||
+            next->format != link->format)
+            break;
+        link = next;
+    }
+
+    memcpy(border, ff_filter_link(link)->border, sizeof(ff_filter_link(link)->border));
+    return 0;
+}
+
 #define OFFSET(x) offsetof(BufferSourceContext, x)
 #define A AV_OPT_FLAG_FILTERING_PARAM|AV_OPT_FLAG_AUDIO_PARAM
 #define V AV_OPT_FLAG_FILTERING_PARAM|AV_OPT_FLAG_VIDEO_PARAM
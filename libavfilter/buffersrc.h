@@ -211,6 +211,21 @@ int av_buffersrc_add_frame_flags(AVFilterContext *buffer_src,
  */
 int av_buffersrc_close(AVFilterContext *ctx, int64_t pts, unsigned flags);
 
+/**
+ * Get the room a video buffer source's consumers would like to have around
+ * the picture of the frames it is fed, e.g. for padding them in place.
+ *
+ * Frames added to the buffer source with at least that much room between
+ * their data pointers and the start and end of their buffers may be
+ * processed without a copy. This is only a hint, frames without the room
+ * are processed as well.
+ *
+ * @param ctx    an instance of the buffersrc filter, in a configured graph
+ * @param border left, top, right and bottom border in pixels
+ * @return 0 on success, a negative AVERROR on error
+ */
+int av_buffersrc_get_video_border(AVFilterContext *ctx, int border[4]);
+
 /**
  * @}
  */
@@ -332,9 +332,16 @@ static void blend_line(uint8_t *dst, unsigned src, unsigned alpha,
         *dst = (*dst * (0x1010101 - suba) + src * suba) >> 24;
         dst += dx;
     }
-    for (x = 0; x < w; x++) {
-        *dst = (*dst * tau + asrc) >> 24;
-        dst += dx;
+    if (dx == 1) {
+        /* contiguous samples, let the compiler vectorize */
+        for (x = 0; x < w; x++)
+            dst[x] = (dst[x] * tau + asrc) >> 24;
+        dst += w;
+    } else {
+        for (x = 0; x < w; x++) {
+            *dst = (*dst * tau + asrc) >> 24;
+            dst += dx;
+        }
     }
     if (right) {
         unsigned suba = (right * alpha) >> hsub;
@@ -523,6 +530,25 @@ static void blend_line_hv16(uint8_t *dst, int dst_delta,
                       right, hband, hsub + vsub, xm);
 }
 
+/* Same as blend_pixel() for whole pixels of an 8-bit mask, without
+   subsampling or with 2x2 subsampling. */
+static av_always_inline void blend_line_mask8(uint8_t *dst, int dst_delta,
+                                              unsigned src, unsigned alpha,
+                                              const uint8_t *mask, int mask_linesize,
+                                              int w, int sub)
+{
+    for (int x = 0; x < w; x++) {
+        unsigned a;
+
+        if (sub)
+            a = ((mask[2 * x] + mask[2 * x + 1] +
+                  mask[2 * x + mask_linesize] + mask[2 * x + 1 + mask_linesize]) >> 2) * alpha;
+        else
+            a = mask[x] * alpha;
+        dst[x * dst_delta] = ((0x1010101 - a) * dst[x * dst_delta] + a * src) >> 24;
+    }
+}
+
 static void blend_line_hv(uint8_t *dst, int dst_delta,
                           unsigned src, unsigned alpha,
                           const uint8_t *mask, int mask_linesize, int l2depth, int w,
@@ -537,11 +563,24 @@ static void blend_line_hv(uint8_t *dst, int dst_delta,
         dst += dst_delta;
         xm += left;
     }
-    for (x = 0; x < w; x++) {
-        blend_pixel(dst, src, alpha, mask, mask_linesize, l2depth,
-                    1 << hsub, hband, hsub + vsub, xm);
-        dst += dst_delta;
-        xm += 1 << hsub;
+    if (l2depth == 3 && !hsub && !vsub) {
+        if (dst_delta == 1)
+            blend_line_mask8(dst, 1, src, alpha, mask + xm, mask_linesize, w, 0);
+        else
+            blend_line_mask8(dst, dst_delta, src, alpha, mask + xm, mask_linesize, w, 0);
+        dst += w * dst_delta;
+        xm += w;
+    } else if (l2depth == 3 && hsub == 1 && vsub == 1 && hband == 2) {
+        blend_line_mask8(dst, dst_delta, src, alpha, mask + xm, mask_linesize, w, 1);
+        dst += w * dst_delta;
+        xm += w << 1;
+    } else {
+        for (x = 0; x < w; x++) {
+            blend_pixel(dst, src, alpha, mask, mask_linesize, l2depth,
+                        1 << hsub, hband, hsub + vsub, xm);
+            dst += dst_delta;
+            xm += 1 << hsub;
+        }
     }
     if (right)
         blend_pixel(dst, src, alpha, mask, mask_linesize, l2depth,
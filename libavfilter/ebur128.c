@@ -319,6 +319,9 @@ static void ebur128_filter_##type(FFEBUR128State* st, const type** srcs,
                                   size_t src_index, size_t frames,                 \
                                   int stride) {                                    \
     double* audio_data = st->d->audio_data + st->d->audio_data_index;              \
+    const double a1 = st->d->a[1], a2 = st->d->a[2], a3 = st->d->a[3], a4 = st->d->a[4]; \
+    const double b0 = st->d->b[0], b1 = st->d->b[1], b2 = st->d->b[2];             \
+    const double b3 = st->d->b[3], b4 = st->d->b[4];                               \
     size_t i, c;                                                                   \
                                                                                    \
     if ((st->mode & FF_EBUR128_MODE_SAMPLE_PEAK) == FF_EBUR128_MODE_SAMPLE_PEAK) { \
@@ -337,30 +340,31 @@ static void ebur128_filter_##type(FFEBUR128State* st, const type** srcs,
         }                                                                          \
     }                                                                              \
     for (c = 0; c < st->channels; ++c) {                                           \
+        const type *src = srcs[c] + src_index;                                     \
         int ci = st->d->channel_map[c] - 1;                                        \
+        double v1, v2, v3, v4;                                                     \
         if (ci < 0) continue;                                                      \
         else if (ci == FF_EBUR128_DUAL_MONO - 1) ci = 0; /*dual mono */            \
+        /* keep the filter state in registers, it may alias audio_data */          \
+        v1 = st->d->v[ci][1];                                                      \
+        v2 = st->d->v[ci][2];                                                      \
+        v3 = st->d->v[ci][3];                                                      \
+        v4 = st->d->v[ci][4];                                                      \
         for (i = 0; i < frames; ++i) {                                             \
-            st->d->v[ci][0] = (double) (srcs[c][src_index + i * stride] / scaling_factor) \
-                         - st->d->a[1] * st->d->v[ci][1]                           \
-                         - st->d->a[2] * st->d->v[ci][2]                           \
-                         - st->d->a[3] * st->d->v[ci][3]                           \
-                         - st->d->a[4] * st->d->v[ci][4];                          \
+            double v0 = (double) (src[i * stride] / scaling_factor)               \
+                      - a1 * v1 - a2 * v2 - a3 * v3 - a4 * v4;                     \
             audio_data[i * st->channels + c] =                                     \
-                           st->d->b[0] * st->d->v[ci][0]                           \
-                         + st->d->b[1] * st->d->v[ci][1]                           \
-                         + st->d->b[2] * st->d->v[ci][2]                           \
-                         + st->d->b[3] * st->d->v[ci][3]                           \
-                         + st->d->b[4] * st->d->v[ci][4];                          \
-            st->d->v[ci][4] = st->d->v[ci][3];                                     \
-            st->d->v[ci][3] = st->d->v[ci][2];                                     \
-            st->d->v[ci][2] = st->d->v[ci][1];                                     \
-            st->d->v[ci][1] = st->d->v[ci][0];                                     \
+                b0 * v0 + b1 * v1 + b2 * v2 + b3 * v3 + b4 * v4;                   \
+            v4 = v3;                                                               \
+            v3 = v2;                                                               \
+            v2 = v1;                                                               \
+            v1 = v0;                                                               \
         }                                                                          \
-        st->d->v[ci][4] = fabs(st->d->v[ci][4]) < DBL_MIN ? 0.0 : st->d->v[ci][4]; \
-        st->d->v[ci][3] = fabs(st->d->v[ci][3]) < DBL_MIN ? 0.0 : st->d->v[ci][3]; \
-        st->d->v[ci][2] = fabs(st->d->v[ci][2]) < DBL_MIN ? 0.0 : st->d->v[ci][2]; \
-        st->d->v[ci][1] = fabs(st->d->v[ci][1]) < DBL_MIN ? 0.0 : st->d->v[ci][1]; \
+        st->d->v[ci][0] = v1;                                                      \
+        st->d->v[ci][4] = fabs(v4) < DBL_MIN ? 0.0 : v4;                           \
+        st->d->v[ci][3] = fabs(v3) < DBL_MIN ? 0.0 : v3;                           \
+        st->d->v[ci][2] = fabs(v2) < DBL_MIN ? 0.0 : v2;                           \
+        st->d->v[ci][1] = fabs(v1) < DBL_MIN ? 0.0 : v1;                           \
     }                                                                              \
 }
 EBUR128_FILTER(double, 1.0)
@@ -88,6 +88,7 @@ typedef struct EBUR128Context {
 #if CONFIG_SWRESAMPLE
     SwrContext *swr_ctx;            ///< over-sampling context for true peak metering
     double *swr_buf;                ///< resampled audio data for true peak metering
+    uint8_t **swr_data;             ///< per channel planes of swr_buf
     int swr_linesize;
 #endif
 
@@ -492,20 +493,25 @@ static int config_audio_output(AVFilterLink *outlink)
         int ret;
 
         ebur128->swr_buf    = av_malloc_array(nb_channels, 19200 * sizeof(double));
+        ebur128->swr_data   = av_calloc(nb_channels, sizeof(*ebur128->swr_data));
         ebur128->true_peaks = av_calloc(nb_channels, sizeof(*ebur128->true_peaks));
         ebur128->true_peaks_per_frame = av_calloc(nb_channels, sizeof(*ebur128->true_peaks_per_frame));
         ebur128->swr_ctx    = swr_alloc();
-        if (!ebur128->swr_buf || !ebur128->true_peaks ||
+        if (!ebur128->swr_buf || !ebur128->swr_data || !ebur128->true_peaks ||
             !ebur128->true_peaks_per_frame || !ebur128->swr_ctx)
             return AVERROR(ENOMEM);
 
+        /* planar output, so that each channel is scanned contiguously */
+        for (i = 0; i < nb_channels; i++)
+            ebur128->swr_data[i] = (uint8_t *)(ebur128->swr_buf + i * 19200);
+
         av_opt_set_chlayout(ebur128->swr_ctx, "in_chlayout",    &outlink->ch_layout, 0);
         av_opt_set_int(ebur128->swr_ctx, "in_sample_rate",       outlink->sample_rate, 0);
         av_opt_set_sample_fmt(ebur128->swr_ctx, "in_sample_fmt", outlink->format, 0);
 
         av_opt_set_chlayout(ebur128->swr_ctx, "out_chlayout",    &outlink->ch_layout, 0);
         av_opt_set_int(ebur128->swr_ctx, "out_sample_rate",       192000, 0);
-        av_opt_set_sample_fmt(ebur128->swr_ctx, "out_sample_fmt", outlink->format, 0);
+        av_opt_set_sample_fmt(ebur128->swr_ctx, "out_sample_fmt", av_get_planar_sample_fmt(outlink->format), 0);
 
         ret = swr_init(ebur128->swr_ctx);
         if (ret < 0)
@@ -626,91 +632,160 @@ static int gate_update(struct integrator *integ, double power,
     return gate_hist_pos;
 }
 
-static int filter_frame(AVFilterLink *inlink, AVFrame *insamples)
+typedef struct ThreadData {
+    const double *samples;          ///< first interleaved sample to filter
+    int nb_samples;                 ///< number of samples to filter
+    int tp_samples;                 ///< number of over-sampled samples to scan for true peaks
+} ThreadData;
+
+static int filter_channels(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    int i, ch, idx_insample, ret;
-    AVFilterContext *ctx = inlink->dst;
     EBUR128Context *ebur128 = ctx->priv;
+    const ThreadData *td = arg;
     const int nb_channels = ebur128->nb_channels;
-    const int nb_samples  = insamples->nb_samples;
-    const double *samples = (double *)insamples->data[0];
-    AVFrame *pic;
+    const int nb_samples  = td->nb_samples;
+    const int ch_start = (nb_channels *  jobnr     ) / nb_jobs;
+    const int ch_end   = (nb_channels * (jobnr + 1)) / nb_jobs;
+    const double pb0 = ebur128->pre_b[0], pb1 = ebur128->pre_b[1], pb2 = ebur128->pre_b[2];
+    const double pa1 = ebur128->pre_a[1], pa2 = ebur128->pre_a[2];
+    const double rb0 = ebur128->rlb_b[0], rb1 = ebur128->rlb_b[1], rb2 = ebur128->rlb_b[2];
+    const double ra1 = ebur128->rlb_a[1], ra2 = ebur128->rlb_a[2];
+
+    for (int ch = ch_start; ch < ch_end; ch++) {
+        const double *src = td->samples + ch;
+        double *cache_400  = ebur128->i400.cache[ch];
+        double *cache_3000 = ebur128->i3000.cache[ch];
+        int pos_400  = ebur128->i400.cache_pos;
+        int pos_3000 = ebur128->i3000.cache_pos;
+        double sum_400, sum_3000;
+        double x1, x2, y1, y2, z1, z2;
 
 #if CONFIG_SWRESAMPLE
-    if (ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS && ebur128->idx_insample == 0) {
-        const double *swr_samples = ebur128->swr_buf;
-        int ret = swr_convert(ebur128->swr_ctx, (uint8_t**)&ebur128->swr_buf, 19200,
-                              (const uint8_t **)insamples->data, nb_samples);
-        if (ret < 0)
-            return ret;
-        for (ch = 0; ch < nb_channels; ch++)
-            ebur128->true_peaks_per_frame[ch] = 0.0;
-        for (idx_insample = 0; idx_insample < ret; idx_insample++) {
-            for (ch = 0; ch < nb_channels; ch++) {
-                ebur128->true_peaks[ch] = FFMAX(ebur128->true_peaks[ch], fabs(*swr_samples));
-                ebur128->true_peaks_per_frame[ch] = FFMAX(ebur128->true_peaks_per_frame[ch],
-                                                          fabs(*swr_samples));
-                swr_samples++;
-            }
+        if (td->tp_samples > 0) {
+            const double *tp = (const double *)ebur128->swr_data[ch];
+            double peak = 0.0;
+
+            for (int i = 0; i < td->tp_samples; i++)
+                peak = FFMAX(peak, fabs(tp[i]));
+            ebur128->true_peaks_per_frame[ch] = peak;
+            ebur128->true_peaks[ch] = FFMAX(ebur128->true_peaks[ch], peak);
         }
-    }
 #endif
 
-    for (idx_insample = ebur128->idx_insample; idx_insample < nb_samples; idx_insample++) {
-        const int bin_id_400  = ebur128->i400.cache_pos;
-        const int bin_id_3000 = ebur128->i3000.cache_pos;
+        if (ebur128->peak_mode & PEAK_MODE_SAMPLES_PEAKS) {
+            double peak = ebur128->sample_peaks[ch];
 
-#define MOVE_TO_NEXT_CACHED_ENTRY(time) do {                \
-    ebur128->i##time.cache_pos++;                           \
-    if (ebur128->i##time.cache_pos ==                       \
-        ebur128->i##time.cache_size) {                      \
-        ebur128->i##time.filled    = 1;                     \
-        ebur128->i##time.cache_pos = 0;                     \
-    }                                                       \
-} while (0)
-
-        MOVE_TO_NEXT_CACHED_ENTRY(400);
-        MOVE_TO_NEXT_CACHED_ENTRY(3000);
-
-        for (ch = 0; ch < nb_channels; ch++) {
-            double bin;
+            for (int i = 0; i < nb_samples; i++)
+                peak = FFMAX(peak, fabs(src[i * nb_channels]));
+            ebur128->sample_peaks[ch] = peak;
+        }
 
-            if (ebur128->peak_mode & PEAK_MODE_SAMPLES_PEAKS)
-                ebur128->sample_peaks[ch] = FFMAX(ebur128->sample_peaks[ch], fabs(samples[idx_insample * nb_channels + ch]));
+        if (!ebur128->ch_weighting[ch])
+            continue;
 
-            ebur128->x[ch * 3] = samples[idx_insample * nb_channels + ch]; // set X[i]
+        /* X[i-1], X[i-2], and the last two pre-filter and RLB-filter outputs */
+        x1 = ebur128->x[ch * 3 + 1];
+        x2 = ebur128->x[ch * 3 + 2];
+        y1 = ebur128->y[ch * 3    ];
+        y2 = ebur128->y[ch * 3 + 1];
+        z1 = ebur128->z[ch * 3    ];
+        z2 = ebur128->z[ch * 3 + 1];
+        sum_400  = ebur128->i400.sum[ch];
+        sum_3000 = ebur128->i3000.sum[ch];
 
-            if (!ebur128->ch_weighting[ch])
-                continue;
+        for (int i = 0; i < nb_samples; i++) {
+            const double x0 = src[i * nb_channels];
+            double y0, z0, bin;
 
             /* Y[i] = X[i]*b0 + X[i-1]*b1 + X[i-2]*b2 - Y[i-1]*a1 - Y[i-2]*a2 */
-#define FILTER(Y, X, NUM, DEN) do {                                             \
-            double *dst = ebur128->Y + ch*3;                                    \
-            double *src = ebur128->X + ch*3;                                    \
-            dst[2] = dst[1];                                                    \
-            dst[1] = dst[0];                                                    \
-            dst[0] = src[0]*NUM[0] + src[1]*NUM[1] + src[2]*NUM[2]              \
-                                   - dst[1]*DEN[1] - dst[2]*DEN[2];             \
-} while (0)
-
-            // TODO: merge both filters in one?
-            FILTER(y, x, ebur128->pre_b, ebur128->pre_a);  // apply pre-filter
-            ebur128->x[ch * 3 + 2] = ebur128->x[ch * 3 + 1];
-            ebur128->x[ch * 3 + 1] = ebur128->x[ch * 3    ];
-            FILTER(z, y, ebur128->rlb_b, ebur128->rlb_a);  // apply RLB-filter
+            y0 = x0*pb0 + x1*pb1 + x2*pb2 - y1*pa1 - y2*pa2;    // apply pre-filter
+            z0 = y0*rb0 + y1*rb1 + y2*rb2 - z1*ra1 - z2*ra2;    // apply RLB-filter
+            x2 = x1;
+            x1 = x0;
+            y2 = y1;
+            y1 = y0;
+            z2 = z1;
+            z1 = z0;
 
-            bin = ebur128->z[ch * 3] * ebur128->z[ch * 3];
+            bin = z0 * z0;
 
             /* add the new value, and limit the sum to the cache size (400ms or 3s)
              * by removing the oldest one */
-            ebur128->i400.sum [ch] = ebur128->i400.sum [ch] + bin - ebur128->i400.cache [ch][bin_id_400];
-            ebur128->i3000.sum[ch] = ebur128->i3000.sum[ch] + bin - ebur128->i3000.cache[ch][bin_id_3000];
+            sum_400  = sum_400  + bin - cache_400 [pos_400 ];
+            sum_3000 = sum_3000 + bin - cache_3000[pos_3000];
 
             /* override old cache entry with the new value */
-            ebur128->i400.cache [ch][bin_id_400 ] = bin;
-            ebur128->i3000.cache[ch][bin_id_3000] = bin;
+            cache_400 [pos_400 ] = bin;
+            cache_3000[pos_3000] = bin;
+            if (++pos_400 == ebur128->i400.cache_size)
+                pos_400 = 0;
+            if (++pos_3000 == ebur128->i3000.cache_size)
+                pos_3000 = 0;
         }
 
+        ebur128->x[ch * 3    ] = x1;
+        ebur128->x[ch * 3 + 1] = x1;
+        ebur128->x[ch * 3 + 2] = x2;
+        ebur128->y[ch * 3    ] = y1;
+        ebur128->y[ch * 3 + 1] = y2;
+        ebur128->z[ch * 3    ] = z1;
+        ebur128->z[ch * 3 + 1] = z2;
+        ebur128->i400.sum[ch]  = sum_400;
+        ebur128->i3000.sum[ch] = sum_3000;
+    }
+
+    return 0;
+}
+
+static int filter_frame(AVFilterLink *inlink, AVFrame *insamples)
+{
+    int i, ch, idx_insample, ret;
+    AVFilterContext *ctx = inlink->dst;
+    EBUR128Context *ebur128 = ctx->priv;
+    const int nb_channels = ebur128->nb_channels;
+    const int nb_samples  = insamples->nb_samples;
+    const double *samples = (double *)insamples->data[0];
+    AVFrame *pic;
+
+    int tp_samples = 0;
+
+#if CONFIG_SWRESAMPLE
+    if (ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS && ebur128->idx_insample == 0) {
+        tp_samples = swr_convert(ebur128->swr_ctx, ebur128->swr_data, 19200,
+                                 (const uint8_t **)insamples->data, nb_samples);
+        if (tp_samples < 0)
+            return tp_samples;
+    }
+#endif
+
+    for (idx_insample = ebur128->idx_insample; idx_insample < nb_samples; idx_insample++) {
+        const int period = inlink->sample_rate / 10;
+        ThreadData td;
+
+        /* filter everything up to the next 100ms boundary at once */
+        td.samples    = samples + idx_insample * nb_channels;
+        td.nb_samples = nb_samples - idx_insample;
+        if (period > 0)
+            td.nb_samples = FFMIN(td.nb_samples, period - ebur128->sample_count);
+        td.tp_samples = tp_samples;
+        tp_samples = 0;
+
+        ff_filter_execute(ctx, filter_channels, &td, NULL,
+                          nb_channels > 2 ? FFMIN(nb_channels, ff_filter_get_nb_threads(ctx)) : 1);
+
+#define MOVE_CACHE_POS(time, n) do {                        \
+    ebur128->i##time.cache_pos += n;                        \
+    if (ebur128->i##time.cache_pos >=                       \
+        ebur128->i##time.cache_size) {                      \
+        ebur128->i##time.filled     = 1;                    \
+        ebur128->i##time.cache_pos -=                       \
+            ebur128->i##time.cache_size;                    \
+    }                                                       \
+} while (0)
+
+        MOVE_CACHE_POS(400,  td.nb_samples);
+        MOVE_CACHE_POS(3000, td.nb_samples);
+
 #define FIND_PEAK(global, sp, ptype) do {                        \
     int ch;                                                      \
     double maxpeak;                                              \
@@ -725,6 +800,10 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *insamples)
         FIND_PEAK(ebur128->sample_peak, ebur128->sample_peaks, SAMPLES);
         FIND_PEAK(ebur128->true_peak,   ebur128->true_peaks,   TRUE);
 
+        /* continue from the last filtered sample */
+        idx_insample          += td.nb_samples - 1;
+        ebur128->sample_count += td.nb_samples - 1;
+
         /* For integrated loudness, gating blocks are 400ms long with 75%
          * overlap (see BS.1770-2 p5), so a re-computation is needed each 100ms
          * (4800 samples at 48kHz). */
@@ -1097,6 +1176,7 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_frame_free(&ebur128->outpicref);
 #if CONFIG_SWRESAMPLE
     av_freep(&ebur128->swr_buf);
+    av_freep(&ebur128->swr_data);
     swr_free(&ebur128->swr_ctx);
 #endif
 }
@@ -1114,7 +1194,7 @@ const FFFilter ff_af_ebur128 = {
     .p.description = NULL_IF_CONFIG_SMALL("EBU R128 scanner."),
     .p.outputs     = NULL,
     .p.priv_class  = &ebur128_class,
-    .p.flags       = AVFILTER_FLAG_DYNAMIC_OUTPUTS,
+    .p.flags       = AVFILTER_FLAG_DYNAMIC_OUTPUTS | AVFILTER_FLAG_SLICE_THREADS,
     .priv_size     = sizeof(EBUR128Context),
     .init          = init,
     .uninit        = uninit,
@@ -160,6 +160,17 @@ typedef struct FilterLink {
      */
     int max_samples;
 
+    /**
+     * Room, in pixels, that the link destination would like to have around
+     * the picture of incoming video frames, as left, top, right and bottom.
+     * Frames allocated with at least that much room around their data can
+     * be extended in place, e.g. by padding, instead of being copied.
+     *
+     * May be set by the link destination filter in its config_props().
+     * This is only a hint, frames without the room must still be accepted.
+     */
+    int border[4];
+
     /**
      * Number of past frames sent through the link.
      */
@@ -31,6 +31,16 @@ typedef struct SSIMDSPContext {
     double (*ssim_end_line)(const int (*sum0)[4], const int (*sum1)[4], int w);
 } SSIMDSPContext;
 
+/* number of 4x4 block sums a line of w pixels needs, including padding */
+#define SSIM_SUM_LEN(w) (((w) >> 2) + 3)
+
+void ff_ssim_4x4xn_16bit(const uint8_t *main, ptrdiff_t main_stride,
+                         const uint8_t *ref, ptrdiff_t ref_stride,
+                         int64_t (*sums)[4], int width);
+float ff_ssim_endn_16bit(const int64_t (*sum0)[4], const int64_t (*sum1)[4],
+                         int width, int max);
+
+void ff_ssim_init(SSIMDSPContext *dsp);
 void ff_ssim_init_x86(SSIMDSPContext *dsp);
 
 #endif /* AVFILTER_SSIM_H */
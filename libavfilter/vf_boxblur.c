@@ -26,6 +26,7 @@
  */
 
 #include "libavutil/common.h"
+#include "libavutil/imgutils.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "avfilter.h"
@@ -34,6 +35,87 @@
 #include "video.h"
 #include "boxblur.h"
 
+/* Naive boxblur would sum source pixels from x-radius .. x+radius
+ * for destination pixel x. That would be O(radius*width).
+ * If you now look at what source pixels represent 2 consecutive
+ * output pixels, then you see they are almost identical and only
+ * differ by 2 pixels, like:
+ * src0       111111111
+ * dst0           1
+ * src1        111111111
+ * dst1            1
+ * src0-src1  1       -1
+ * so when you know one output pixel you can find the next by just adding
+ * and subtracting 1 input pixel.
+ * The following code adopts this faster variant.
+ * The sums are unsigned so that they may wrap for 16-bit samples, only
+ * their low bits are stored.
+ */
+#define BLUR_LINE(type, depth)                                              \
+static void blur_line ## depth(uint8_t *_dst, const uint8_t *_src,         \
+                               int len, int radius)                         \
+{                                                                           \
+    type *dst = (type *)_dst;                                               \
+    const type *src = (const type *)_src;                                   \
+    const int length = radius*2 + 1;                                        \
+    const unsigned inv = ((1<<16) + length/2)/length;                       \
+    unsigned sum = src[radius];                                             \
+    int x;                                                                  \
+                                                                            \
+    for (x = 0; x < radius; x++)                                            \
+        sum += src[x]<<1;                                                   \
+                                                                            \
+    sum = sum*inv + (1<<15);                                                \
+                                                                            \
+    for (x = 0; x <= radius; x++) {                                         \
+        const int add = radius+x < len ? radius+x : 2*len-radius-x-1;       \
+        sum += (src[add] - src[radius-x])*inv;                              \
+        dst[x] = sum>>16;                                                   \
+    }                                                                       \
+                                                                            \
+    for (; x < len-radius; x++) {                                           \
+        sum += (src[radius+x] - src[x-radius-1])*inv;                       \
+        dst[x] = sum>>16;                                                   \
+    }                                                                       \
+                                                                            \
+    for (; x < len; x++) {                                                  \
+        sum += (src[2*len-radius-x-1] - src[x-radius-1])*inv;               \
+        dst[x] = sum>>16;                                                   \
+    }                                                                       \
+}                                                                           \
+                                                                            \
+static void vblur_row ## depth(uint8_t *_dst, unsigned *sum,               \
+                               const uint8_t *_add, const uint8_t *_sub,    \
+                               unsigned inv, int w)                         \
+{                                                                           \
+    type *dst = (type *)_dst;                                               \
+    const type *add = (const type *)_add;                                   \
+    const type *sub = (const type *)_sub;                                   \
+                                                                            \
+    for (int x = 0; x < w; x++) {                                           \
+        sum[x] += (add[x] - sub[x])*inv;                                    \
+        dst[x] = sum[x]>>16;                                                \
+    }                                                                       \
+}
+
+BLUR_LINE(uint8_t,   8)
+BLUR_LINE(uint16_t, 16)
+
+#undef BLUR_LINE
+
+static inline void blur_line(uint8_t *dst, const uint8_t *src, int len,
+                             int radius, int pixsize)
+{
+    if (pixsize == 1) blur_line8 (dst, src, len, radius);
+    else              blur_line16(dst, src, len, radius);
+}
+
+static inline void vblur_row(uint8_t *dst, unsigned *sum, const uint8_t *add,
+                             const uint8_t *sub, unsigned inv, int w, int pixsize)
+{
+    if (pixsize == 1) vblur_row8 (dst, sum, add, sub, inv, w);
+    else              vblur_row16(dst, sum, add, sub, inv, w);
+}
 
 typedef struct BoxBlurContext {
     const AVClass *class;
@@ -44,15 +126,27 @@ typedef struct BoxBlurContext {
     int hsub, vsub;
     int radius[4];
     int power[4];
-    uint8_t *temp[2]; ///< temporary buffer used in blur_power()
+    int pixsize;
+    int nb_threads;
+    int strip_w;        ///< maximum width of the columns blurred by one job
+    uint8_t *temp;      ///< per job line buffers used in blur_power()
+    uint8_t *strips;    ///< per job column strips for the vertical passes
+    unsigned *sums;     ///< per job running sums of the vertical passes
+
 } BoxBlurContext;
 
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int w[4], h[4];
+} ThreadData;
+
 static av_cold void uninit(AVFilterContext *ctx)
 {
     BoxBlurContext *s = ctx->priv;
 
-    av_freep(&s->temp[0]);
-    av_freep(&s->temp[1]);
+    av_freep(&s->temp);
+    av_freep(&s->strips);
+    av_freep(&s->sums);
 }
 
 static int query_formats(const AVFilterContext *ctx,
@@ -82,12 +176,20 @@ static int config_input(AVFilterLink *inlink)
     int w = inlink->w, h = inlink->h;
     int ret;
 
-    if (!(s->temp[0] = av_malloc(2*FFMAX(w, h))) ||
-        !(s->temp[1] = av_malloc(2*FFMAX(w, h))))
-        return AVERROR(ENOMEM);
-
     s->hsub = desc->log2_chroma_w;
     s->vsub = desc->log2_chroma_h;
+    s->pixsize = (desc->comp[0].depth + 7) / 8;
+
+    /* the horizontal passes are split in rows and the vertical ones in
+     * columns, each job has its own buffers */
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    s->strip_w    = (w + s->nb_threads - 1) / s->nb_threads;
+
+    uninit(ctx);
+    if (!(s->temp   = av_malloc_array(s->nb_threads, 2 * w * s->pixsize)) ||
+        !(s->strips = av_malloc_array(s->nb_threads, 2 * (size_t)s->strip_w * h * s->pixsize)) ||
+        !(s->sums   = av_malloc_array(s->nb_threads, s->strip_w * sizeof(*s->sums))))
+        return AVERROR(ENOMEM);
 
     ret = ff_boxblur_eval_filter_params(inlink,
                                         &s->luma_param,
@@ -111,119 +213,121 @@ static int config_input(AVFilterLink *inlink)
     return 0;
 }
 
-/* Naive boxblur would sum source pixels from x-radius .. x+radius
- * for destination pixel x. That would be O(radius*width).
- * If you now look at what source pixels represent 2 consecutive
- * output pixels, then you see they are almost identical and only
- * differ by 2 pixels, like:
- * src0       111111111
- * dst0           1
- * src1        111111111
- * dst1            1
- * src0-src1  1       -1
- * so when you know one output pixel you can find the next by just adding
- * and subtracting 1 input pixel.
- * The following code adopts this faster variant.
- */
-#define BLUR(type, depth)                                                   \
-static inline void blur ## depth(type *dst, int dst_step, const type *src,  \
-                                 int src_step, int len, int radius)         \
-{                                                                           \
-    const int length = radius*2 + 1;                                        \
-    const int inv = ((1<<16) + length/2)/length;                            \
-    int x, sum = src[radius*src_step];                                      \
-                                                                            \
-    for (x = 0; x < radius; x++)                                            \
-        sum += src[x*src_step]<<1;                                          \
-                                                                            \
-    sum = sum*inv + (1<<15);                                                \
-                                                                            \
-    for (x = 0; x <= radius; x++) {                                         \
-        sum += (src[(radius+x)*src_step] - src[(radius-x)*src_step])*inv;   \
-        dst[x*dst_step] = sum>>16;                                          \
-    }                                                                       \
-                                                                            \
-    for (; x < len-radius; x++) {                                           \
-        sum += (src[(radius+x)*src_step] - src[(x-radius-1)*src_step])*inv; \
-        dst[x*dst_step] = sum >>16;                                         \
-    }                                                                       \
-                                                                            \
-    for (; x < len; x++) {                                                  \
-        sum += (src[(2*len-radius-x-1)*src_step] - src[(x-radius-1)*src_step])*inv; \
-        dst[x*dst_step] = sum>>16;                                          \
-    }                                                                       \
-}
-
-BLUR(uint8_t,   8)
-BLUR(uint16_t, 16)
-
-#undef BLUR
-
-static inline void blur(uint8_t *dst, int dst_step, const uint8_t *src, int src_step,
-                        int len, int radius, int pixsize)
-{
-    if (pixsize == 1) blur8 (dst, dst_step   , src, src_step   , len, radius);
-    else              blur16((uint16_t*)dst, dst_step>>1, (const uint16_t*)src, src_step>>1, len, radius);
-}
-
-static inline void blur_power(uint8_t *dst, int dst_step, const uint8_t *src, int src_step,
-                              int len, int radius, int power, uint8_t *temp[2], int pixsize)
+static void blur_power(uint8_t *dst, const uint8_t *src, int len, int radius,
+                       int power, uint8_t *temp[2], int pixsize)
 {
     uint8_t *a = temp[0], *b = temp[1];
 
     if (radius && power) {
-        blur(a, pixsize, src, src_step, len, radius, pixsize);
+        blur_line(a, src, len, radius, pixsize);
         for (; power > 2; power--) {
             uint8_t *c;
-            blur(b, pixsize, a, pixsize, len, radius, pixsize);
+            blur_line(b, a, len, radius, pixsize);
             c = a; a = b; b = c;
         }
-        if (power > 1) {
-            blur(dst, dst_step, a, pixsize, len, radius, pixsize);
-        } else {
-            int i;
-            if (pixsize == 1) {
-                for (i = 0; i < len; i++)
-                    dst[i*dst_step] = a[i];
-            } else
-                for (i = 0; i < len; i++)
-                    *(uint16_t*)(dst + i*dst_step) = ((uint16_t*)a)[i];
-        }
+        if (power > 1)
+            blur_line(dst, a, len, radius, pixsize);
+        else
+            memcpy(dst, a, len * pixsize);
     } else {
-        int i;
-        if (pixsize == 1) {
-            for (i = 0; i < len; i++)
-                dst[i*dst_step] = src[i*src_step];
-        } else
-            for (i = 0; i < len; i++)
-                *(uint16_t*)(dst + i*dst_step) = *(uint16_t*)(src + i*src_step);
+        memcpy(dst, src, len * pixsize);
     }
 }
 
-static void hblur(uint8_t *dst, int dst_linesize, const uint8_t *src, int src_linesize,
-                  int w, int h, int radius, int power, uint8_t *temp[2], int pixsize)
+static int hblur_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    int y;
+    BoxBlurContext *s = ctx->priv;
+    ThreadData *td = arg;
+    uint8_t *temp[2] = { s->temp + jobnr * 2 * td->w[0] * s->pixsize };
 
-    if (radius == 0 && dst == src)
-        return;
+    temp[1] = temp[0] + td->w[0] * s->pixsize;
+
+    for (int plane = 0; plane < 4 && td->in->data[plane] && td->in->linesize[plane]; plane++) {
+        const int slice_start = (td->h[plane] *  jobnr   ) / nb_jobs;
+        const int slice_end   = (td->h[plane] * (jobnr+1)) / nb_jobs;
+
+        for (int y = slice_start; y < slice_end; y++)
+            blur_power(td->out->data[plane] + y * td->out->linesize[plane],
+                       td->in->data[plane] + y * td->in->linesize[plane],
+                       td->w[plane], s->radius[plane], s->power[plane], temp, s->pixsize);
+    }
 
-    for (y = 0; y < h; y++)
-        blur_power(dst + y*dst_linesize, pixsize, src + y*src_linesize, pixsize,
-                   w, radius, power, temp, pixsize);
+    return 0;
 }
 
-static void vblur(uint8_t *dst, int dst_linesize, const uint8_t *src, int src_linesize,
-                  int w, int h, int radius, int power, uint8_t *temp[2], int pixsize)
+/* Blur w columns of h samples with running sums over whole rows, so that
+ * the samples are accessed in memory order. dst must not overlap src. */
+static void vblur(uint8_t *dst, ptrdiff_t dst_linesize,
+                  const uint8_t *src, ptrdiff_t src_linesize,
+                  int w, int h, int radius, unsigned *sum, int pixsize)
 {
-    int x;
+    const int length = radius*2 + 1;
+    const unsigned inv = ((1<<16) + length/2)/length;
+
+#define INIT_SUMS(type)                                                     \
+    for (int x = 0; x < w; x++)                                             \
+        sum[x] = ((const type *)(src + radius * src_linesize))[x];          \
+    for (int y = 0; y < radius; y++) {                                      \
+        const type *row = (const type *)(src + y * src_linesize);           \
+        for (int x = 0; x < w; x++)                                         \
+            sum[x] += row[x]<<1;                                            \
+    }
 
-    if (radius == 0 && dst == src)
-        return;
+    if (pixsize == 1) {
+        INIT_SUMS(uint8_t)
+    } else {
+        INIT_SUMS(uint16_t)
+    }
+#undef INIT_SUMS
 
-    for (x = 0; x < w; x++)
-        blur_power(dst + x*pixsize, dst_linesize, src + x*pixsize, src_linesize,
-                   h, radius, power, temp, pixsize);
+    for (int x = 0; x < w; x++)
+        sum[x] = sum[x]*inv + (1<<15);
+
+    for (int y = 0; y < h; y++) {
+        const int add = radius+y < h ? radius+y : 2*h-radius-y-1;
+        const int sub = y <= radius ? radius-y : y-radius-1;
+
+        vblur_row(dst + y * dst_linesize, sum,
+                  src + add * src_linesize, src + sub * src_linesize, inv, w, pixsize);
+    }
+}
+
+static int vblur_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    BoxBlurContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int pixsize = s->pixsize;
+    uint8_t *strips = s->strips + jobnr * 2 * (size_t)s->strip_w * td->h[0] * pixsize;
+    unsigned *sum = s->sums + jobnr * s->strip_w;
+
+    for (int plane = 0; plane < 4 && td->out->data[plane] && td->out->linesize[plane]; plane++) {
+        const int slice_start = (td->w[plane] *  jobnr   ) / nb_jobs;
+        const int slice_end   = (td->w[plane] * (jobnr+1)) / nb_jobs;
+        const int w = slice_end - slice_start, h = td->h[plane];
+        const ptrdiff_t linesize = td->out->linesize[plane];
+        uint8_t *dst = td->out->data[plane] + slice_start * pixsize;
+        uint8_t *a = strips, *b = strips + (size_t)s->strip_w * h * pixsize;
+        const ptrdiff_t strip_linesize = w * pixsize;
+        int power = s->power[plane];
+
+        if (!w || !s->radius[plane] || !power)
+            continue;
+
+        /* the frame is blurred in place, so the first pass reads it and
+         * the last one writes it back */
+        vblur(a, strip_linesize, dst, linesize, w, h, s->radius[plane], sum, pixsize);
+        for (; power > 2; power--) {
+            uint8_t *c;
+            vblur(b, strip_linesize, a, strip_linesize, w, h, s->radius[plane], sum, pixsize);
+            c = a; a = b; b = c;
+        }
+        if (power > 1)
+            vblur(dst, linesize, a, strip_linesize, w, h, s->radius[plane], sum, pixsize);
+        else
+            av_image_copy_plane(dst, linesize, a, strip_linesize, strip_linesize, h);
+    }
+
+    return 0;
 }
 
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
@@ -232,13 +336,11 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     BoxBlurContext *s = ctx->priv;
     AVFilterLink *outlink = inlink->dst->outputs[0];
     AVFrame *out;
-    int plane;
     int cw = AV_CEIL_RSHIFT(inlink->w, s->hsub), ch = AV_CEIL_RSHIFT(in->height, s->vsub);
-    int w[4] = { inlink->w, cw, cw, inlink->w };
-    int h[4] = { in->height, ch, ch, in->height };
-    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
-    const int depth = desc->comp[0].depth;
-    const int pixsize = (depth+7)/8;
+    ThreadData td = {
+        .w = { inlink->w, cw, cw, inlink->w },
+        .h = { in->height, ch, ch, in->height },
+    };
 
     out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
     if (!out) {
@@ -247,17 +349,11 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     }
     av_frame_copy_props(out, in);
 
-    for (plane = 0; plane < 4 && in->data[plane] && in->linesize[plane]; plane++)
-        hblur(out->data[plane], out->linesize[plane],
-              in ->data[plane], in ->linesize[plane],
-              w[plane], h[plane], s->radius[plane], s->power[plane],
-              s->temp, pixsize);
-
-    for (plane = 0; plane < 4 && in->data[plane] && in->linesize[plane]; plane++)
-        vblur(out->data[plane], out->linesize[plane],
-              out->data[plane], out->linesize[plane],
-              w[plane], h[plane], s->radius[plane], s->power[plane],
-              s->temp, pixsize);
+    td.in  = in;
+    td.out = out;
+    /* the column strips are sized for nb_threads jobs, empty ones are skipped */
+    ff_filter_execute(ctx, hblur_slice, &td, NULL, s->nb_threads);
+    ff_filter_execute(ctx, vblur_slice, &td, NULL, s->nb_threads);
 
     av_frame_free(&in);
 
@@ -301,7 +397,7 @@ const FFFilter ff_vf_boxblur = {
     .p.name        = "boxblur",
     .p.description = NULL_IF_CONFIG_SMALL("Blur the input."),
     .p.priv_class  = &boxblur_class,
-    .p.flags       = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .p.flags       = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
     .priv_size     = sizeof(BoxBlurContext),
     .uninit        = uninit,
     FILTER_INPUTS(avfilter_vf_boxblur_inputs),
@@ -91,6 +91,8 @@ typedef struct DeshakeContext {
     int counts[2*MAX_R+1][2*MAX_R+1]; ///< Scratch buffer for motion search
     double *angles;            ///< Scratch buffer for block angles
     unsigned angles_size;
+    IntMotionVector *block_mvs; ///< Scratch buffer for block motion, -1 if skipped
+    unsigned block_mvs_size;
     AVFrame *ref;              ///< Previous frame
     int rx;                    ///< Maximum horizontal shift
     int ry;                    ///< Maximum vertical shift
@@ -114,6 +116,12 @@ typedef struct DeshakeContext {
                       enum FillMethod fill, AVFrame *in, AVFrame *out);
 } DeshakeContext;
 
+typedef struct ThreadData {
+    uint8_t *src1, *src2;
+    int stride;
+    int nb_rows, nb_cols;
+} ThreadData;
+
 #define OFFSET(x) offsetof(DeshakeContext, x)
 #define FLAGS AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM
 
@@ -277,6 +285,34 @@ static double block_angle(int x, int y, int cx, int cy, IntMotionVector *shift)
            diff;
 }
 
+static int find_block_motion_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    DeshakeContext *deshake = ctx->priv;
+    const ThreadData *td = arg;
+    const int slice_start = (td->nb_rows *  jobnr     ) / nb_jobs;
+    const int slice_end   = (td->nb_rows * (jobnr + 1)) / nb_jobs;
+    IntMotionVector mv = {0, 0};
+
+    for (int row = slice_start; row < slice_end; row++) {
+        const int y = deshake->ry + row * deshake->blocksize * 2;
+
+        for (int col = 0; col < td->nb_cols; col++) {
+            const int x = deshake->rx + col * 16;
+            IntMotionVector *block_mv = &deshake->block_mvs[row * td->nb_cols + col];
+
+            // If the contrast is too low, just skip this block as it probably
+            // won't be very useful to us.
+            if (block_contrast(td->src2, x, y, td->stride, deshake->blocksize) > deshake->contrast) {
+                find_block_motion(deshake, td->src1, td->src2, x, y, td->stride, &mv);
+                *block_mv = mv;
+            } else {
+                block_mv->x = block_mv->y = -1;
+            }
+        }
+    }
+    return 0;
+}
+
 /**
  * Find the estimated global motion for a scene given the most likely shift
  * for each block in the frame. The global motion is estimated to be the
@@ -284,19 +320,29 @@ static double block_angle(int x, int y, int cx, int cy, IntMotionVector *shift)
  * move one pixel to the right and two pixels down, this would yield a
  * motion vector (1, -2).
  */
-static void find_motion(DeshakeContext *deshake, uint8_t *src1, uint8_t *src2,
-                        int width, int height, int stride, Transform *t)
+static int find_motion(AVFilterContext *ctx, uint8_t *src1, uint8_t *src2,
+                       int width, int height, int stride, Transform *t)
 {
-    int x, y;
-    IntMotionVector mv = {0, 0};
+    DeshakeContext *deshake = ctx->priv;
+    ThreadData td = { .src1 = src1, .src2 = src2, .stride = stride };
+    const int end_x = width  - deshake->rx - 16;
+    const int end_y = height - deshake->ry - deshake->blocksize * 2;
+    int x, y, nb_jobs;
     int count_max_value = 0;
-    int contrast;
 
     int pos;
     int center_x = 0, center_y = 0;
     double p_x, p_y;
 
+    td.nb_cols = end_x > deshake->rx ? (end_x - deshake->rx + 15) / 16 : 0;
+    td.nb_rows = end_y > deshake->ry ? (end_y - deshake->ry + deshake->blocksize * 2 - 1) /
+                                       (deshake->blocksize * 2) : 0;
+
     av_fast_malloc(&deshake->angles, &deshake->angles_size, width * height / (16 * deshake->blocksize) * sizeof(*deshake->angles));
+    av_fast_malloc(&deshake->block_mvs, &deshake->block_mvs_size,
+                   td.nb_rows * td.nb_cols * sizeof(*deshake->block_mvs));
+    if (td.nb_rows && td.nb_cols && (!deshake->angles || !deshake->block_mvs))
+        return AVERROR(ENOMEM);
 
     // Reset counts to zero
     for (x = 0; x < deshake->rx * 2 + 1; x++) {
@@ -305,25 +351,32 @@ static void find_motion(DeshakeContext *deshake, uint8_t *src1, uint8_t *src2,
         }
     }
 
+    // Find motion for every block. Without a search range on one axis the
+    // less exhaustive search starts from the motion of the previous block,
+    // so the blocks must then be searched in order.
+    if (deshake->search == SMART_EXHAUSTIVE && (!deshake->rx || !deshake->ry))
+        nb_jobs = 1;
+    else
+        nb_jobs = FFMIN(td.nb_rows, ff_filter_get_nb_threads(ctx));
+    if (td.nb_rows && td.nb_cols)
+        ff_filter_execute(ctx, find_block_motion_slice, &td, NULL, nb_jobs);
+
     pos = 0;
-    // Find motion for every block and store the motion vector in the counts
-    for (y = deshake->ry; y < height - deshake->ry - (deshake->blocksize * 2); y += deshake->blocksize * 2) {
+    // Store the motion vectors in the counts
+    for (int row = 0; row < td.nb_rows; row++) {
         // We use a width of 16 here to match the sad function
-        for (x = deshake->rx; x < width - deshake->rx - 16; x += 16) {
-            // If the contrast is too low, just skip this block as it probably
-            // won't be very useful to us.
-            contrast = block_contrast(src2, x, y, stride, deshake->blocksize);
-            if (contrast > deshake->contrast) {
-                //av_log(NULL, AV_LOG_ERROR, "%d\n", contrast);
-                find_block_motion(deshake, src1, src2, x, y, stride, &mv);
-                if (mv.x != -1 && mv.y != -1) {
-                    deshake->counts[mv.x + deshake->rx][mv.y + deshake->ry] += 1;
-                    if (x > deshake->rx && y > deshake->ry)
-                        deshake->angles[pos++] = block_angle(x, y, 0, 0, &mv);
-
-                    center_x += mv.x;
-                    center_y += mv.y;
-                }
+        for (int col = 0; col < td.nb_cols; col++) {
+            IntMotionVector mv = deshake->block_mvs[row * td.nb_cols + col];
+
+            x = deshake->rx + col * 16;
+            y = deshake->ry + row * deshake->blocksize * 2;
+            if (mv.x != -1 && mv.y != -1) {
+                deshake->counts[mv.x + deshake->rx][mv.y + deshake->ry] += 1;
+                if (x > deshake->rx && y > deshake->ry)
+                    deshake->angles[pos++] = block_angle(x, y, 0, 0, &mv);
+
+                center_x += mv.x;
+                center_y += mv.y;
             }
         }
     }
@@ -362,6 +415,7 @@ static void find_motion(DeshakeContext *deshake, uint8_t *src1, uint8_t *src2,
     t->angle = av_clipf(t->angle, -0.1, 0.1);
 
     //av_log(NULL, AV_LOG_ERROR, "%d x %d\n", avg->x, avg->y);
+    return 0;
 }
 
 static int deshake_transform_c(AVFilterContext *ctx,
@@ -449,6 +503,8 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_frame_free(&deshake->ref);
     av_freep(&deshake->angles);
     deshake->angles_size = 0;
+    av_freep(&deshake->block_mvs);
+    deshake->block_mvs_size = 0;
     if (deshake->fp)
         fclose(deshake->fp);
 }
@@ -485,7 +541,7 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
 
     if (deshake->cx < 0 || deshake->cy < 0 || deshake->cw < 0 || deshake->ch < 0) {
         // Find the most likely global motion for the current frame
-        find_motion(deshake, (deshake->ref == NULL) ? in->data[0] : deshake->ref->data[0], in->data[0], link->w, link->h, in->linesize[0], &t);
+        ret = find_motion(link->dst, (deshake->ref == NULL) ? in->data[0] : deshake->ref->data[0], in->data[0], link->w, link->h, in->linesize[0], &t);
     } else {
         uint8_t *src1 = (deshake->ref == NULL) ? in->data[0] : deshake->ref->data[0];
         uint8_t *src2 = in->data[0];
@@ -502,8 +558,10 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
         src1 += deshake->cy * in->linesize[0] + deshake->cx;
         src2 += deshake->cy * in->linesize[0] + deshake->cx;
 
-        find_motion(deshake, src1, src2, deshake->cw, deshake->ch, in->linesize[0], &t);
+        ret = find_motion(link->dst, src1, src2, deshake->cw, deshake->ch, in->linesize[0], &t);
     }
+    if (ret < 0)
+        goto fail;
 
 
     // Copy transform so we can output it later to compare to the smoothed value
@@ -576,6 +634,7 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
 
     return ff_filter_frame(outlink, out);
 fail:
+    av_frame_free(&in);
     av_frame_free(&out);
     return ret;
 }
@@ -593,6 +652,7 @@ const FFFilter ff_vf_deshake = {
     .p.name        = "deshake",
     .p.description = NULL_IF_CONFIG_SMALL("Stabilize shaky video."),
     .p.priv_class  = &deshake_class,
+    .p.flags       = AVFILTER_FLAG_SLICE_THREADS,
     .priv_size     = sizeof(DeshakeContext),
     .init          = init,
     .uninit        = uninit,
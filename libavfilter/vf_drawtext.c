@@ -194,6 +194,7 @@ typedef struct GlyphInfo {
     int y;                          ///< the y position of the glyph
     int shift_x64;                  ///< the horizontal shift of the glyph in 26.6 units
     int shift_y64;                  ///< the vertical shift of the glyph in 26.6 units
+    struct Glyph *glyph;            ///< the cached glyph, with the bitmaps for this shift
 } GlyphInfo;
 
 /** Information about a single line of text */
@@ -327,6 +328,12 @@ typedef struct DrawTextContext {
     int tab_count;                  ///< the number of tab characters
     int blank_advance64;            ///< the size of the space character
     int tab_warning_printed;        ///< ensure the tab warning to be printed only once
+
+    char *layout_text;              ///< the expanded text the lines were measured for
+    unsigned int layout_fontsize;   ///< the font size the lines were measured for
+    TextMetrics layout_metrics;     ///< the metrics of the measured lines
+    int layout_x64, layout_y64;     ///< the origin the glyph positions were computed for
+    int layout_positioned;          ///< tells if the glyph positions are valid
 } DrawTextContext;
 
 #define OFFSET(x) offsetof(DrawTextContext, x)
@@ -1126,6 +1133,31 @@ static int glyph_enu_free(void *opaque, void *elem)
     return 0;
 }
 
+static void hb_destroy(HarfbuzzData *hb)
+{
+    hb_font_destroy(hb->font);
+    hb_buffer_destroy(hb->buf);
+    hb->buf = NULL;
+    hb->font = NULL;
+    hb->glyph_info = NULL;
+    hb->glyph_pos = NULL;
+}
+
+// Drop the measured lines, they are kept across frames while the text stays the same
+static void free_text_layout(DrawTextContext *s)
+{
+    for (int l = 0; l < s->line_count; ++l) {
+        TextLine *line = &s->lines[l];
+        av_freep(&line->glyphs);
+        hb_destroy(&line->hb_data);
+    }
+    av_freep(&s->lines);
+    av_freep(&s->tab_clusters);
+    av_freep(&s->layout_text);
+    s->line_count = 0;
+    s->layout_positioned = 0;
+}
+
 static av_cold void uninit(AVFilterContext *ctx)
 {
     DrawTextContext *s = ctx->priv;
@@ -1137,6 +1169,8 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     s->x_pexpr = s->y_pexpr = s->a_pexpr = s->fontsize_pexpr = NULL;
 
+    free_text_layout(s);
+
     av_tree_enumerate(s->glyphs, NULL, NULL, glyph_enu_free);
     av_tree_destroy(s->glyphs);
     s->glyphs = NULL;
@@ -1240,6 +1274,7 @@ static int command(AVFilterContext *ctx, const char *cmd, const char *arg, char
         if ((ret = ff_filter_process_command(ctx, cmd, arg, res, res_len, flags)) < 0) {
             return ret;
         }
+        free_text_layout(old);
         if (old->borderw != old_borderw) {
             FT_Stroker_Set(old->stroker, old->borderw << 6, FT_STROKER_LINECAP_ROUND,
                         FT_STROKER_LINEJOIN_ROUND, 0);
@@ -1281,15 +1316,20 @@ static void update_alpha(DrawTextContext *s)
         s->alpha = 256 * alpha;
 }
 
-static int draw_glyphs(DrawTextContext *s, AVFrame *frame,
-                       FFDrawColor *color,
-                       TextMetrics *metrics,
-                       int x, int y, int borderw)
+/**
+ * Draw the glyphs of all lines, restricted to the frame rows
+ * [slice_start, slice_end). dst points to row slice_start of the frame.
+ */
+static void draw_glyphs(DrawTextContext *s, uint8_t *dst[], int dst_linesize[],
+                        int width, int slice_start, int slice_end,
+                        FFDrawColor *color,
+                        const TextMetrics *metrics,
+                        int x, int y, int borderw)
 {
     int g, l, x1, y1, w1, h1, idx;
     int dx = 0, dy = 0, pdx = 0;
     GlyphInfo *info;
-    Glyph dummy = { 0 }, *glyph;
+    Glyph *glyph;
     FT_Bitmap bitmap;
     FT_BitmapGlyph b_glyph;
     uint8_t j_left = 0, j_right = 0, j_top = 0, j_bottom = 0;
@@ -1307,25 +1347,15 @@ static int draw_glyphs(DrawTextContext *s, AVFrame *frame,
         offset_y = s->box_height - metrics->height;
     }
 
-    if ((!j_left || j_right) && !s->tab_warning_printed && s->tab_count > 0) {
-        s->tab_warning_printed = 1;
-        av_log(s, AV_LOG_WARNING, "Tab characters are only supported with left horizontal alignment\n");
-    }
-
-    clip_x = FFMIN(metrics->rect_x + s->box_width + s->bb_right, frame->width);
-    clip_y = FFMIN(metrics->rect_y + s->box_height + s->bb_bottom, frame->height);
+    clip_x = FFMIN(metrics->rect_x + s->box_width + s->bb_right, width);
+    clip_y = FFMIN(metrics->rect_y + s->box_height + s->bb_bottom, slice_end);
 
     for (l = 0; l < s->line_count; ++l) {
         TextLine *line = &s->lines[l];
         line_w = POS_CEIL(line->width64, 64);
         for (g = 0; g < line->hb_data.glyph_count; ++g) {
             info = &line->glyphs[g];
-            dummy.fontsize = s->fontsize;
-            dummy.code = info->code;
-            glyph = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
-            if (!glyph) {
-                return AVERROR(EINVAL);
-            }
+            glyph = info->glyph;
 
             idx = get_subpixel_idx(info->shift_x64, info->shift_y64);
             b_glyph = borderw ? glyph->border_bglyph[idx] : glyph->bglyph[idx];
@@ -1353,7 +1383,8 @@ static int draw_glyphs(DrawTextContext *s, AVFrame *frame,
             }
 
             // check if the glyph is empty or out of the clipping region
-            if (dx >= w1 || dy >= h1 || x1 >= clip_x || y1 >= clip_y) {
+            if (dx >= w1 || dy >= h1 || x1 >= clip_x || y1 >= clip_y ||
+                y1 + h1 - dy <= slice_start) {
                 continue;
             }
 
@@ -1361,10 +1392,61 @@ static int draw_glyphs(DrawTextContext *s, AVFrame *frame,
             w1 = FFMIN(clip_x - x1, w1 - dx);
             h1 = FFMIN(clip_y - y1, h1 - dy);
 
-            ff_blend_mask(&s->dc, color, frame->data, frame->linesize, clip_x, clip_y,
-                bitmap.buffer + pdx, bitmap.pitch, w1, h1, 3, 0, x1, y1);
+            ff_blend_mask(&s->dc, color, dst, dst_linesize, clip_x, clip_y - slice_start,
+                bitmap.buffer + pdx, bitmap.pitch, w1, h1, 3, 0, x1, y1 - slice_start);
         }
     }
+}
+
+typedef struct ThreadData {
+    AVFrame *frame;
+    const TextMetrics *metrics;
+    FFDrawColor *fontcolor;
+    FFDrawColor *shadowcolor;
+    FFDrawColor *bordercolor;
+    FFDrawColor *boxcolor;
+    int y_start, y_end;             ///< the rows covered by the box, y_start is chroma aligned
+} ThreadData;
+
+static int draw_text_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    DrawTextContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *frame = td->frame;
+    const TextMetrics *metrics = td->metrics;
+    const int align = 1 << s->dc.vsub_max;
+    const int nb_rows = (td->y_end - td->y_start + align - 1) / align;
+    const int slice_start = td->y_start + nb_rows *  jobnr      / nb_jobs * align;
+    const int slice_end   = FFMIN(td->y_start + nb_rows * (jobnr + 1) / nb_jobs * align, td->y_end);
+    uint8_t *dst[4] = { NULL };
+
+    if (slice_start >= slice_end)
+        return 0;
+
+    // Slices are aligned to the chroma rows, so each one blends whole chroma rows
+    for (int p = 0; p < s->dc.nb_planes; p++)
+        dst[p] = frame->data[p] + (slice_start >> s->dc.vsub[p]) * frame->linesize[p];
+
+    if (s->draw_box) {
+        ff_blend_rectangle(&s->dc, td->boxcolor,
+            dst, frame->linesize, frame->width, slice_end - slice_start,
+            metrics->rect_x - s->bb_left, metrics->rect_y - s->bb_top - slice_start,
+            s->box_width + s->bb_right + s->bb_left,
+            s->box_height + s->bb_bottom + s->bb_top);
+    }
+
+    if (s->shadowx || s->shadowy) {
+        draw_glyphs(s, dst, frame->linesize, frame->width, slice_start, slice_end,
+                    td->shadowcolor, metrics, s->shadowx, s->shadowy, s->borderw);
+    }
+
+    if (s->borderw) {
+        draw_glyphs(s, dst, frame->linesize, frame->width, slice_start, slice_end,
+                    td->bordercolor, metrics, 0, 0, s->borderw);
+    }
+
+    draw_glyphs(s, dst, frame->linesize, frame->width, slice_start, slice_end,
+                td->fontcolor, metrics, 0, 0, 0);
 
     return 0;
 }
@@ -1392,16 +1474,6 @@ static int shape_text_hb(DrawTextContext *s, HarfbuzzData* hb, const char* text,
     return 0;
 }
 
-static void hb_destroy(HarfbuzzData *hb)
-{
-    hb_font_destroy(hb->font);
-    hb_buffer_destroy(hb->buf);
-    hb->buf = NULL;
-    hb->font = NULL;
-    hb->glyph_info = NULL;
-    hb->glyph_pos = NULL;
-}
-
 static int measure_text(AVFilterContext *ctx, TextMetrics *metrics)
 {
     DrawTextContext *s = ctx->priv;
@@ -1583,7 +1655,6 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame)
 
     int width = frame->width;
     int height = frame->height;
-    int rec_x = 0, rec_y = 0, rec_width = 0, rec_height = 0;
     int is_outside = 0;
     int last_tab_idx = 0;
 
@@ -1636,9 +1707,22 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame)
         return ret;
     }
 
-    if ((ret = measure_text(ctx, &metrics)) < 0) {
-        return ret;
+    // Shaping and measuring only depend on the text and the font size
+    if (!s->layout_text || s->layout_fontsize != s->fontsize ||
+        strcmp(s->layout_text, bp->str)) {
+        free_text_layout(s);
+        if ((ret = measure_text(ctx, &s->layout_metrics)) < 0) {
+            free_text_layout(s);
+            return ret;
+        }
+        s->layout_text = av_strdup(bp->str);
+        if (!s->layout_text) {
+            free_text_layout(s);
+            return AVERROR(ENOMEM);
+        }
+        s->layout_fontsize = s->fontsize;
     }
+    metrics = s->layout_metrics;
 
     s->max_glyph_h = POS_CEIL(metrics.max_y64 - metrics.min_y64, 64);
     s->max_glyph_w = POS_CEIL(metrics.max_x64 - metrics.min_x64, 64);
@@ -1729,45 +1813,58 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame)
         y64 = (int)(s->y * 64. + metrics.offset_top64);
     }
 
-    for (int l = 0; l < s->line_count; ++l) {
-        TextLine *line = &s->lines[l];
-        HarfbuzzData *hb = &line->hb_data;
-        line->glyphs = av_mallocz(hb->glyph_count * sizeof(GlyphInfo));
-
-        for (int t = 0; t < hb->glyph_count; ++t) {
-            GlyphInfo *g_info = &line->glyphs[t];
-            uint8_t is_tab = last_tab_idx < s->tab_count &&
-                hb->glyph_info[t].cluster == s->tab_clusters[last_tab_idx] - line->cluster_offset;
-            int true_x, true_y;
-            if (is_tab) {
-                ++last_tab_idx;
+    // The glyph positions only need to be updated when the text moves
+    if (!s->layout_positioned || x64 != s->layout_x64 || y64 != s->layout_y64) {
+        s->layout_positioned = 0;
+        for (int l = 0; l < s->line_count; ++l) {
+            TextLine *line = &s->lines[l];
+            HarfbuzzData *hb = &line->hb_data;
+            if (!line->glyphs) {
+                line->glyphs = av_mallocz(hb->glyph_count * sizeof(GlyphInfo));
+                if (!line->glyphs)
+                    return AVERROR(ENOMEM);
             }
-            true_x = x + hb->glyph_pos[t].x_offset;
-            true_y = y + hb->glyph_pos[t].y_offset;
-            shift_x64 = (((x64 + true_x) >> 4) & 0b0011) << 4;
-            shift_y64 = ((4 - (((y64 + true_y) >> 4) & 0b0011)) & 0b0011) << 4;
 
-            ret = load_glyph(ctx, &glyph, hb->glyph_info[t].codepoint, shift_x64, shift_y64);
-            if (ret != 0) {
-                return ret;
-            }
-            g_info->code = hb->glyph_info[t].codepoint;
-            g_info->x = (x64 + true_x) >> 6;
-            g_info->y = ((y64 + true_y) >> 6) + (shift_y64 > 0 ? 1 : 0);
-            g_info->shift_x64 = shift_x64;
-            g_info->shift_y64 = shift_y64;
-
-            if (!is_tab) {
-                x += hb->glyph_pos[t].x_advance;
-            } else {
-                int size = s->blank_advance64 * s->tabsize;
-                x = (x / size + 1) * size;
+            for (int t = 0; t < hb->glyph_count; ++t) {
+                GlyphInfo *g_info = &line->glyphs[t];
+                uint8_t is_tab = last_tab_idx < s->tab_count &&
+                    hb->glyph_info[t].cluster == s->tab_clusters[last_tab_idx] - line->cluster_offset;
+                int true_x, true_y;
+                if (is_tab) {
+                    ++last_tab_idx;
+                }
+                true_x = x + hb->glyph_pos[t].x_offset;
+                true_y = y + hb->glyph_pos[t].y_offset;
+                shift_x64 = (((x64 + true_x) >> 4) & 0b0011) << 4;
+                shift_y64 = ((4 - (((y64 + true_y) >> 4) & 0b0011)) & 0b0011) << 4;
+
+                ret = load_glyph(ctx, &glyph, hb->glyph_info[t].codepoint, shift_x64, shift_y64);
+                if (ret != 0) {
+                    return ret;
+                }
+                g_info->code = hb->glyph_info[t].codepoint;
+                g_info->x = (x64 + true_x) >> 6;
+                g_info->y = ((y64 + true_y) >> 6) + (shift_y64 > 0 ? 1 : 0);
+                g_info->shift_x64 = shift_x64;
+                g_info->shift_y64 = shift_y64;
+                g_info->glyph = glyph;
+
+                if (!is_tab) {
+                    x += hb->glyph_pos[t].x_advance;
+                } else {
+                    int size = s->blank_advance64 * s->tabsize;
+                    x = (x / size + 1) * size;
+                }
+                y += hb->glyph_pos[t].y_advance;
             }
-            y += hb->glyph_pos[t].y_advance;
+
+            y += metrics.line_height64 + s->line_spacing * 64;
+            x = 0;
         }
 
-        y += metrics.line_height64 + s->line_spacing * 64;
-        x = 0;
+        s->layout_x64 = x64;
+        s->layout_y64 = y64;
+        s->layout_positioned = 1;
     }
 
     metrics.rect_x = s->x;
@@ -1797,46 +1894,31 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame)
                     metrics.rect_y + s->box_height + s->bb_bottom <= 0;
 
     if (!is_outside) {
-        /* draw box */
-        if (s->draw_box) {
-            rec_x = metrics.rect_x - s->bb_left;
-            rec_y = metrics.rect_y - s->bb_top;
-            rec_width = s->box_width + s->bb_right + s->bb_left;
-            rec_height = s->box_height + s->bb_bottom + s->bb_top;
-            ff_blend_rectangle(&s->dc, &boxcolor,
-                frame->data, frame->linesize, width, height,
-                rec_x, rec_y, rec_width, rec_height);
-        }
-
-        if (s->shadowx || s->shadowy) {
-            if ((ret = draw_glyphs(s, frame, &shadowcolor, &metrics,
-                    s->shadowx, s->shadowy, s->borderw)) < 0) {
-                return ret;
-            }
+        ThreadData td = {
+            .frame       = frame,
+            .metrics     = &metrics,
+            .fontcolor   = &fontcolor,
+            .shadowcolor = &shadowcolor,
+            .bordercolor = &bordercolor,
+            .boxcolor    = &boxcolor,
+        };
+        int nb_rows;
+
+        if ((!(s->text_align & TA_LEFT) || (s->text_align & TA_RIGHT)) &&
+            !s->tab_warning_printed && s->tab_count > 0) {
+            s->tab_warning_printed = 1;
+            av_log(s, AV_LOG_WARNING, "Tab characters are only supported with left horizontal alignment\n");
         }
 
-        if (s->borderw) {
-            if ((ret = draw_glyphs(s, frame, &bordercolor, &metrics,
-                    0, 0, s->borderw)) < 0) {
-                return ret;
-            }
-        }
-
-        if ((ret = draw_glyphs(s, frame, &fontcolor, &metrics, 0,
-                0, 0)) < 0) {
-            return ret;
-        }
+        // Everything is drawn within the box, including the clipped glyphs
+        td.y_start = FFMAX(metrics.rect_y - s->bb_top, 0) >> s->dc.vsub_max << s->dc.vsub_max;
+        td.y_end   = FFMIN(metrics.rect_y + s->box_height + s->bb_bottom, height);
+        nb_rows    = (td.y_end - td.y_start + (1 << s->dc.vsub_max) - 1) >> s->dc.vsub_max;
+        if (nb_rows > 0)
+            ff_filter_execute(ctx, draw_text_slice, &td, NULL,
+                              FFMIN(nb_rows, ff_filter_get_nb_threads(ctx)));
     }
 
-    // FREE data structures
-    for (int l = 0; l < s->line_count; ++l) {
-        TextLine *line = &s->lines[l];
-        av_freep(&line->glyphs);
-        hb_destroy(&line->hb_data);
-    }
-    av_freep(&s->lines);
-    av_freep(&s->tab_clusters);
-
     return 0;
 }
 
@@ -1923,7 +2005,8 @@ const FFFilter ff_vf_drawtext = {
     .p.name        = "drawtext",
     .p.description = NULL_IF_CONFIG_SMALL("Draw text on top of video frames using libfreetype library."),
     .p.priv_class  = &drawtext_class,
-    .p.flags       = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .p.flags       = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC |
+                     AVFILTER_FLAG_SLICE_THREADS,
     .priv_size     = sizeof(DrawTextContext),
     .init          = init,
     .uninit        = uninit,
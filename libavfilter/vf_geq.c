@@ -66,6 +66,9 @@ typedef struct GEQContext {
 
     double *pixel_sums[NB_PLANES];
     int needs_sum[NB_PLANES];
+
+    double *xs;                 ///< X of each pixel of a line
+    double *lines;              ///< per thread results of the expression for a line
 } GEQContext;
 
 enum { Y = 0, U, V, A, G, B, R };
@@ -326,6 +329,10 @@ static av_cold int geq_init(AVFilterContext *ctx)
                                 NULL, NULL, func2_names, func2, 0, ctx);
             if (ret < 0)
                 goto end;
+            /* compile it for evaluating whole lines */
+            ret = av_expr_eval_batch(geq->e[plane][i], NULL, 0, NULL, NULL, NULL);
+            if (ret < 0)
+                goto end;
         }
 
         av_expr_count_func(geq->e[plane][0], counter, FF_ARRAY_ELEMS(counter), 2);
@@ -378,8 +385,10 @@ static int geq_query_formats(const AVFilterContext *ctx,
 
 static int geq_config_props(AVFilterLink *inlink)
 {
-    GEQContext *geq = inlink->dst->priv;
+    AVFilterContext *ctx = inlink->dst;
+    GEQContext *geq = ctx->priv;
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
+    const int nb_threads = FFMIN(MAX_NB_THREADS, ff_filter_get_nb_threads(ctx));
 
     av_assert0(desc);
 
@@ -387,6 +396,16 @@ static int geq_config_props(AVFilterLink *inlink)
     geq->vsub = desc->log2_chroma_h;
     geq->bps = desc->comp[0].depth;
     geq->planes = desc->nb_components;
+
+    av_freep(&geq->xs);
+    av_freep(&geq->lines);
+    geq->xs    = av_malloc_array(inlink->w, sizeof(*geq->xs));
+    geq->lines = av_malloc_array(inlink->w, nb_threads * sizeof(*geq->lines));
+    if (!geq->xs || !geq->lines)
+        return AVERROR(ENOMEM);
+    for (int x = 0; x < inlink->w; x++)
+        geq->xs[x] = x;
+
     return 0;
 }
 
@@ -407,6 +426,8 @@ static int slice_geq_filter(AVFilterContext *ctx, void *arg, int jobnr, int nb_j
     const int linesize = td->linesize;
     const int slice_start = (height *  jobnr) / nb_jobs;
     const int slice_end = (height * (jobnr+1)) / nb_jobs;
+    double *line = geq->lines + jobnr * ctx->inputs[0]->w;
+    const double *lines[VAR_VARS_NB] = { [VAR_X] = geq->xs };
     int x, y;
 
     double values[VAR_VARS_NB];
@@ -417,36 +438,28 @@ static int slice_geq_filter(AVFilterContext *ctx, void *arg, int jobnr, int nb_j
     values[VAR_SH] = geq->values[VAR_SH];
     values[VAR_T] = geq->values[VAR_T];
 
-    if (geq->bps == 8) {
-        uint8_t *ptr = geq->dst + linesize * slice_start;
-        for (y = slice_start; y < slice_end; y++) {
-            values[VAR_Y] = y;
-
+    /* the expression is evaluated for all the pixels of a line at once */
+    for (y = slice_start; y < slice_end; y++) {
+        values[VAR_Y] = y;
+        if (av_expr_eval_batch(geq->e[plane][jobnr], line, width, values, lines, geq) < 0) {
             for (x = 0; x < width; x++) {
                 values[VAR_X] = x;
-                ptr[x] = av_expr_eval(geq->e[plane][jobnr], values, geq);
+                line[x] = av_expr_eval(geq->e[plane][jobnr], values, geq);
             }
-            ptr += linesize;
         }
-    } else if (geq->bps <= 16) {
-        uint16_t *ptr16 = geq->dst16 + (linesize/2) * slice_start;
-        for (y = slice_start; y < slice_end; y++) {
-            values[VAR_Y] = y;
-            for (x = 0; x < width; x++) {
-                values[VAR_X] = x;
-                ptr16[x] = av_expr_eval(geq->e[plane][jobnr], values, geq);
-            }
-            ptr16 += linesize/2;
-        }
-    } else {
-        float *ptr32 = geq->dst32 + (linesize/4) * slice_start;
-        for (y = slice_start; y < slice_end; y++) {
-            values[VAR_Y] = y;
-            for (x = 0; x < width; x++) {
-                values[VAR_X] = x;
-                ptr32[x] = av_expr_eval(geq->e[plane][jobnr], values, geq);
-            }
-            ptr32 += linesize/4;
+
+        if (geq->bps == 8) {
+            uint8_t *ptr = geq->dst + linesize * y;
+            for (x = 0; x < width; x++)
+                ptr[x] = line[x];
+        } else if (geq->bps <= 16) {
+            uint16_t *ptr16 = geq->dst16 + (linesize/2) * y;
+            for (x = 0; x < width; x++)
+                ptr16[x] = line[x];
+        } else {
+            float *ptr32 = geq->dst32 + (linesize/4) * y;
+            for (x = 0; x < width; x++)
+                ptr32[x] = line[x];
         }
     }
 
@@ -515,6 +528,8 @@ static av_cold void geq_uninit(AVFilterContext *ctx)
             av_expr_free(geq->e[i][j]);
     for (i = 0; i < NB_PLANES; i++)
         av_freep(&geq->pixel_sums);
+    av_freep(&geq->xs);
+    av_freep(&geq->lines);
 }
 
 static const AVFilterPad geq_inputs[] = {
@@ -297,7 +297,11 @@ static int config_props(AVFilterLink *inlink)
     }
 
     for (color = 0; color < desc->nb_components; color++) {
-        double res;
+        double res[256], vals[256], clipvals[256], negvals[256];
+        const double *arrays[VAR_VARS_NB] = {
+            [VAR_VAL] = vals, [VAR_CLIPVAL] = clipvals, [VAR_NEGVAL] = negvals,
+        };
+        unsigned counter[3] = { 0 };
         int comp = s->is_rgb ? rgba_map[color] : color;
 
         /* create the parsed expression */
@@ -316,22 +320,40 @@ static int config_props(AVFilterLink *inlink)
         s->var_values[VAR_MAXVAL] = max[color];
         s->var_values[VAR_MINVAL] = min[color];
 
-        for (val = 0; val < FF_ARRAY_ELEMS(s->lut[comp]); val++) {
-            s->var_values[VAR_VAL] = val;
-            s->var_values[VAR_CLIPVAL] = av_clip(val, min[color], max[color]);
-            s->var_values[VAR_NEGVAL] =
-                av_clip(min[color] + max[color] - s->var_values[VAR_VAL],
-                        min[color], max[color]);
-
-            res = av_expr_eval(s->comp_expr[color], s->var_values, s);
-            if (isnan(res)) {
-                av_log(ctx, AV_LOG_ERROR,
-                       "Error when evaluating the expression '%s' for the value %d for the component %d.\n",
-                       s->comp_expr_str[color], val, comp);
-                return AVERROR(EINVAL);
+        /* gammaval() and gammaval709() read the current value from the
+         * context, so they require evaluating the values one by one */
+        av_expr_count_func(s->comp_expr[color], counter, FF_ARRAY_ELEMS(counter), 1);
+
+        for (val = 0; val < FF_ARRAY_ELEMS(s->lut[comp]); val += FF_ARRAY_ELEMS(res)) {
+            for (int i = 0; i < FF_ARRAY_ELEMS(res); i++) {
+                vals[i]     = val + i;
+                clipvals[i] = av_clip(val + i, min[color], max[color]);
+                negvals[i]  = av_clip(min[color] + max[color] - vals[i],
+                                      min[color], max[color]);
+                if (counter[1] || counter[2]) {
+                    s->var_values[VAR_VAL]     = vals[i];
+                    s->var_values[VAR_CLIPVAL] = clipvals[i];
+                    s->var_values[VAR_NEGVAL]  = negvals[i];
+                    res[i] = av_expr_eval(s->comp_expr[color], s->var_values, s);
+                }
+            }
+            if (!counter[1] && !counter[2]) {
+                ret = av_expr_eval_batch(s->comp_expr[color], res, FF_ARRAY_ELEMS(res),
+                                         s->var_values, arrays, s);
+                if (ret < 0)
+                    return ret;
+            }
+
+            for (int i = 0; i < FF_ARRAY_ELEMS(res); i++) {
+                if (isnan(res[i])) {
+                    av_log(ctx, AV_LOG_ERROR,
+                           "Error when evaluating the expression '%s' for the value %d for the component %d.\n",
+                           s->comp_expr_str[color], val + i, comp);
+                    return AVERROR(EINVAL);
+                }
+                s->lut[comp][val + i] = av_clip((int)res[i], 0, max[A]);
+                av_log(ctx, AV_LOG_DEBUG, "val[%d][%d] = %d\n", comp, val + i, s->lut[comp][val + i]);
             }
-            s->lut[comp][val] = av_clip((int)res, 0, max[A]);
-            av_log(ctx, AV_LOG_DEBUG, "val[%d][%d] = %d\n", comp, val, s->lut[comp][val]);
         }
     }
 
@@ -109,6 +109,7 @@ static int config_input(AVFilterLink *inlink)
 {
     AVFilterContext *ctx = inlink->dst;
     PadContext *s = ctx->priv;
+    FilterLink *l;
     AVRational adjusted_aspect = s->aspect;
     int ret;
     double var_values[VARS_NB], res;
@@ -214,6 +215,13 @@ static int config_input(AVFilterLink *inlink)
         return AVERROR(EINVAL);
     }
 
+    /* let upstream allocate frames that can be padded in place */
+    l = ff_filter_link(inlink);
+    l->border[0] = s->x;
+    l->border[1] = s->y;
+    l->border[2] = s->w - s->x - inlink->w;
+    l->border[3] = s->h - s->y - inlink->h;
+
     return 0;
 
 eval_fail:
@@ -67,6 +67,7 @@ enum {
 };
 
 #define HIST_SIZE (1<<15)
+#define HASH_SKIP 0xFFFF
 
 typedef struct PaletteGenContext {
     const AVClass *class;
@@ -83,6 +84,8 @@ typedef struct PaletteGenContext {
     int nb_boxes;                           // number of boxes (increase will segmenting them)
     int palette_pushed;                     // if the palette frame is pushed into the outlink or not
     uint8_t transparency_color[4];          // background color for transparency
+    uint16_t *hashes;                       // histogram entry of each pixel, for the threaded update
+    unsigned hashes_size;
 } PaletteGenContext;
 
 #define OFFSET(x) offsetof(PaletteGenContext, x)
@@ -392,12 +395,10 @@ static AVFrame *get_palette_frame(AVFilterContext *ctx)
 }
 
 /**
- * Locate the color in the hash table and increment its counter.
+ * Locate the color in its hash table entry and increment its counter.
  */
-static int color_inc(struct hist_node *hist, uint32_t color)
+static av_always_inline int color_inc_node(struct hist_node *node, uint32_t color)
 {
-    const uint32_t hash = ff_lowbias32(color) & (HIST_SIZE - 1);
-    struct hist_node *node = &hist[hash];
     struct color_ref *e;
 
     for (int i = 0; i < node->nb_entries; i++) {
@@ -418,6 +419,12 @@ static int color_inc(struct hist_node *hist, uint32_t color)
     return 1;
 }
 
+static int color_inc(struct hist_node *hist, uint32_t color)
+{
+    const uint32_t hash = ff_lowbias32(color) & (HIST_SIZE - 1);
+    return color_inc_node(&hist[hash], color);
+}
+
 /**
  * Update histogram when pixels differ from previous frame.
  */
@@ -462,6 +469,108 @@ static int update_histogram_frame(struct hist_node *hist, const AVFrame *f)
     return nb_diff_colors;
 }
 
+typedef struct ThreadData {
+    const AVFrame *f, *cmp;
+    int nb_diff_colors[];
+} ThreadData;
+
+/**
+ * Compute the histogram entry of each pixel of a slice, or HASH_SKIP if it
+ * is the same in the compared frame.
+ */
+static int hash_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteGenContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const AVFrame *f = td->f;
+    const int slice_start = (f->height *  jobnr   ) / nb_jobs;
+    const int slice_end   = (f->height * (jobnr+1)) / nb_jobs;
+
+    for (int y = slice_start; y < slice_end; y++) {
+        const uint32_t *p = (const uint32_t *)(f->data[0] + y*f->linesize[0]);
+        uint16_t *hash = s->hashes + y * f->width;
+
+        if (td->cmp) {
+            const uint32_t *q = (const uint32_t *)(td->cmp->data[0] + y*td->cmp->linesize[0]);
+            for (int x = 0; x < f->width; x++)
+                hash[x] = p[x] == q[x] ? HASH_SKIP : ff_lowbias32(p[x]) & (HIST_SIZE - 1);
+        } else {
+            for (int x = 0; x < f->width; x++)
+                hash[x] = ff_lowbias32(p[x]) & (HIST_SIZE - 1);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Count the pixels falling into one range of histogram entries. The pixels
+ * are visited in the same order as by update_histogram_frame() and
+ * update_histogram_diff(), so that the entries end up identical.
+ */
+static int count_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteGenContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const AVFrame *f = td->f;
+    const unsigned start = (HIST_SIZE *  jobnr   ) / nb_jobs;
+    const unsigned len   = (HIST_SIZE * (jobnr+1)) / nb_jobs - start;
+    int ret, nb_diff_colors = 0;
+
+    for (int y = 0; y < f->height; y++) {
+        const uint32_t *p    = (const uint32_t *)(f->data[0] + y*f->linesize[0]);
+        const uint16_t *hash = s->hashes + y * f->width;
+
+        for (int x = 0; x < f->width; x++) {
+            if (hash[x] - start >= len)
+                continue;
+            ret = color_inc_node(&s->histogram[hash[x]], p[x]);
+            if (ret < 0)
+                return ret;
+            nb_diff_colors += ret;
+        }
+    }
+    td->nb_diff_colors[jobnr] = nb_diff_colors;
+    return 0;
+}
+
+/**
+ * Update the histogram with the pixels of f, or only those differing from cmp
+ * if it is set, using all threads, each of them owning a range of the
+ * histogram entries.
+ */
+static int update_histogram_threaded(AVFilterContext *ctx, const AVFrame *f,
+                                     const AVFrame *cmp, int nb_jobs)
+{
+    PaletteGenContext *s = ctx->priv;
+    ThreadData *td;
+    int *rets, ret = 0;
+
+    av_fast_malloc(&s->hashes, &s->hashes_size, f->width * f->height * sizeof(*s->hashes));
+    td   = av_mallocz(sizeof(*td) + nb_jobs * sizeof(*td->nb_diff_colors));
+    rets = av_calloc(nb_jobs, sizeof(*rets));
+    if (!s->hashes || !td || !rets) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    td->f   = f;
+    td->cmp = cmp;
+
+    ff_filter_execute(ctx, hash_slice, td, NULL, FFMIN(f->height, nb_jobs));
+    ff_filter_execute(ctx, count_slice, td, rets, nb_jobs);
+
+    for (int i = 0; i < nb_jobs; i++) {
+        if (rets[i] < 0) {
+            ret = rets[i];
+            break;
+        }
+        ret += td->nb_diff_colors[i];
+    }
+end:
+    av_free(td);
+    av_free(rets);
+    return ret;
+}
+
 /**
  * Update the histogram for each passing frame. No frame will be pushed here.
  */
@@ -474,8 +583,12 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     if (in->color_trc != AVCOL_TRC_UNSPECIFIED && in->color_trc != AVCOL_TRC_IEC61966_2_1)
         av_log(ctx, AV_LOG_WARNING, "The input frame is not in sRGB, colors may be off\n");
 
-    ret = s->prev_frame ? update_histogram_diff(s->histogram, s->prev_frame, in)
-                        : update_histogram_frame(s->histogram, in);
+    if (ff_filter_get_nb_threads(ctx) > 1)
+        ret = s->prev_frame ? update_histogram_threaded(ctx, s->prev_frame, in, ff_filter_get_nb_threads(ctx))
+                            : update_histogram_threaded(ctx, in, NULL, ff_filter_get_nb_threads(ctx));
+    else
+        ret = s->prev_frame ? update_histogram_diff(s->histogram, s->prev_frame, in)
+                            : update_histogram_frame(s->histogram, in);
     if (ret > 0)
         s->nb_refs += ret;
 
@@ -553,6 +666,7 @@ static av_cold void uninit(AVFilterContext *ctx)
     for (i = 0; i < HIST_SIZE; i++)
         av_freep(&s->histogram[i].entries);
     av_freep(&s->refs);
+    av_freep(&s->hashes);
     av_frame_free(&s->prev_frame);
 }
 
@@ -580,6 +694,7 @@ const FFFilter ff_vf_palettegen = {
     .priv_size     = sizeof(PaletteGenContext),
     .init          = init,
     .uninit        = uninit,
+    .p.flags       = AVFILTER_FLAG_SLICE_THREADS,
     FILTER_INPUTS(palettegen_inputs),
     FILTER_OUTPUTS(palettegen_outputs),
     FILTER_QUERY_FUNC2(query_formats),
@@ -24,12 +24,15 @@
  * Use a palette to downsample an input video stream.
  */
 
+#include <stdatomic.h>
+
 #include "libavutil/bprint.h"
 #include "libavutil/file_open.h"
 #include "libavutil/internal.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "libavutil/qsort.h"
+#include "libavutil/thread.h"
 #include "avfilter.h"
 #include "filters.h"
 #include "formats.h"
@@ -82,13 +85,15 @@ struct cache_node {
 
 struct PaletteUseContext;
 
-typedef int (*set_frame_func)(struct PaletteUseContext *s, AVFrame *out, AVFrame *in,
-                              int x_start, int y_start, int width, int height);
+typedef int (*set_frame_func)(struct PaletteUseContext *s, struct cache_node *cache,
+                              AVFrame *out, AVFrame *in, int x_start, int x_end,
+                              int y_end, int y, int x0, int x1);
 
 typedef struct PaletteUseContext {
     const AVClass *class;
     FFFrameSync fs;
-    struct cache_node cache[CACHE_SIZE];    /* lookup cache */
+    struct cache_node *cache;               /* lookup caches, CACHE_SIZE nodes per job */
+    int nb_caches;
     struct color_node map[AVPALETTE_COUNT]; /* 3D-Tree (KD-Tree with K=3) for reverse colormap */
     uint32_t palette[AVPALETTE_COUNT];
     int transparency_index; /* index in the palette of transparency. -1 if there is no transparency in the palette. */
@@ -103,6 +108,14 @@ typedef struct PaletteUseContext {
     AVFrame *last_in;
     AVFrame *last_out;
 
+    /* error diffusion wavefront: each row trails the previous one */
+    atomic_int *row_progress;               /* pixels done in each row of the window */
+    atomic_int next_row;
+    atomic_int nb_waiting;
+    AVMutex progress_lock;
+    AVCond progress_cond;
+    int progress_init;
+
     /* debug options */
     char *dot_filename;
     int calc_mean_err;
@@ -239,11 +252,12 @@ struct stack_node {
  * Check if the requested color is in the cache already. If not, find it in the
  * color tree and cache it.
  */
-static av_always_inline int color_get(PaletteUseContext *s, uint32_t color)
+static av_always_inline int color_get(PaletteUseContext *s, struct cache_node *cache,
+                                      uint32_t color)
 {
     struct color_info clrinfo;
     const uint32_t hash = ff_lowbias32(color) & (CACHE_SIZE - 1);
-    struct cache_node *node = &s->cache[hash];
+    struct cache_node *node = &cache[hash];
     struct cached_color *e;
 
     // first, check for transparency
@@ -268,11 +282,11 @@ static av_always_inline int color_get(PaletteUseContext *s, uint32_t color)
     return e->pal_entry;
 }
 
-static av_always_inline int get_dst_color_err(PaletteUseContext *s,
+static av_always_inline int get_dst_color_err(PaletteUseContext *s, struct cache_node *cache,
                                               uint32_t c, int *er, int *eg, int *eb)
 {
     uint32_t dstc;
-    const int dstx = color_get(s, c);
+    const int dstx = color_get(s, cache, c);
     if (dstx < 0)
         return dstx;
     dstc = s->palette[dstx];
@@ -289,170 +303,167 @@ static av_always_inline int get_dst_color_err(PaletteUseContext *s,
     return dstx;
 }
 
-static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFrame *in,
-                                      int x_start, int y_start, int w, int h,
+/**
+ * Map the pixels x0..x1-1 of row y, within a processing window spanning
+ * x_start..w-1 horizontally and ending before row h.
+ */
+static av_always_inline int set_frame(PaletteUseContext *s, struct cache_node *cache,
+                                      AVFrame *out, AVFrame *in,
+                                      int x_start, int w, int h, int y, int x0, int x1,
                                       enum dithering_mode dither)
 {
     const int src_linesize = in ->linesize[0] >> 2;
-    const int dst_linesize = out->linesize[0];
-    uint32_t *src = ((uint32_t *)in ->data[0]) + y_start*src_linesize;
-    uint8_t  *dst =              out->data[0]  + y_start*dst_linesize;
-
-    w += x_start;
-    h += y_start;
-
-    for (int y = y_start; y < h; y++) {
-        for (int x = x_start; x < w; x++) {
-            int er, eg, eb;
-
-            if (dither == DITHERING_BAYER) {
-                const int d = s->ordered_dither[(y & 7)<<3 | (x & 7)];
-                const uint8_t a8 = src[x] >> 24;
-                const uint8_t r8 = src[x] >> 16 & 0xff;
-                const uint8_t g8 = src[x] >>  8 & 0xff;
-                const uint8_t b8 = src[x]       & 0xff;
-                const uint8_t r = av_clip_uint8(r8 + d);
-                const uint8_t g = av_clip_uint8(g8 + d);
-                const uint8_t b = av_clip_uint8(b8 + d);
-                const uint32_t color_new = (unsigned)(a8) << 24 | r << 16 | g << 8 | b;
-                const int color = color_get(s, color_new);
-
-                if (color < 0)
-                    return color;
-                dst[x] = color;
-
-            } else if (dither == DITHERING_HECKBERT) {
-                const int right = x < w - 1, down = y < h - 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
-
-                if (color < 0)
-                    return color;
-                dst[x] = color;
-
-                if (right)         src[               x + 1] = dither_color(src[               x + 1], er, eg, eb, 3, 3);
-                if (         down) src[src_linesize + x    ] = dither_color(src[src_linesize + x    ], er, eg, eb, 3, 3);
-                if (right && down) src[src_linesize + x + 1] = dither_color(src[src_linesize + x + 1], er, eg, eb, 2, 3);
-
-            } else if (dither == DITHERING_FLOYD_STEINBERG) {
-                const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
-
-                if (color < 0)
-                    return color;
-                dst[x] = color;
-
-                if (right)         src[               x + 1] = dither_color(src[               x + 1], er, eg, eb, 7, 4);
-                if (left  && down) src[src_linesize + x - 1] = dither_color(src[src_linesize + x - 1], er, eg, eb, 3, 4);
-                if (         down) src[src_linesize + x    ] = dither_color(src[src_linesize + x    ], er, eg, eb, 5, 4);
-                if (right && down) src[src_linesize + x + 1] = dither_color(src[src_linesize + x + 1], er, eg, eb, 1, 4);
-
-            } else if (dither == DITHERING_SIERRA2) {
-                const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
-                const int right2 = x < w - 2,                    left2 = x > x_start + 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
-
-                if (color < 0)
-                    return color;
-                dst[x] = color;
-
-                if (right)          src[                 x + 1] = dither_color(src[                 x + 1], er, eg, eb, 4, 4);
-                if (right2)         src[                 x + 2] = dither_color(src[                 x + 2], er, eg, eb, 3, 4);
-
-                if (down) {
-                    if (left2)      src[  src_linesize + x - 2] = dither_color(src[  src_linesize + x - 2], er, eg, eb, 1, 4);
-                    if (left)       src[  src_linesize + x - 1] = dither_color(src[  src_linesize + x - 1], er, eg, eb, 2, 4);
-                    if (1)          src[  src_linesize + x    ] = dither_color(src[  src_linesize + x    ], er, eg, eb, 3, 4);
-                    if (right)      src[  src_linesize + x + 1] = dither_color(src[  src_linesize + x + 1], er, eg, eb, 2, 4);
-                    if (right2)     src[  src_linesize + x + 2] = dither_color(src[  src_linesize + x + 2], er, eg, eb, 1, 4);
-                }
+    uint32_t *src = ((uint32_t *)in ->data[0]) + y*src_linesize;
+    uint8_t  *dst =              out->data[0]  + y*out->linesize[0];
+
+    for (int x = x0; x < x1; x++) {
+        int er, eg, eb;
+
+        if (dither == DITHERING_BAYER) {
+            const int d = s->ordered_dither[(y & 7)<<3 | (x & 7)];
+            const uint8_t a8 = src[x] >> 24;
+            const uint8_t r8 = src[x] >> 16 & 0xff;
+            const uint8_t g8 = src[x] >>  8 & 0xff;
+            const uint8_t b8 = src[x]       & 0xff;
+            const uint8_t r = av_clip_uint8(r8 + d);
+            const uint8_t g = av_clip_uint8(g8 + d);
+            const uint8_t b = av_clip_uint8(b8 + d);
+            const uint32_t color_new = (unsigned)(a8) << 24 | r << 16 | g << 8 | b;
+            const int color = color_get(s, cache, color_new);
+
+            if (color < 0)
+                return color;
+            dst[x] = color;
+
+        } else if (dither == DITHERING_HECKBERT) {
+            const int right = x < w - 1, down = y < h - 1;
+            const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
+
+            if (color < 0)
+                return color;
+            dst[x] = color;
+
+            if (right)         src[               x + 1] = dither_color(src[               x + 1], er, eg, eb, 3, 3);
+            if (         down) src[src_linesize + x    ] = dither_color(src[src_linesize + x    ], er, eg, eb, 3, 3);
+            if (right && down) src[src_linesize + x + 1] = dither_color(src[src_linesize + x + 1], er, eg, eb, 2, 3);
+
+        } else if (dither == DITHERING_FLOYD_STEINBERG) {
+            const int right = x < w - 1, down = y < h - 1, left = x > x_start;
+            const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
+
+            if (color < 0)
+                return color;
+            dst[x] = color;
+
+            if (right)         src[               x + 1] = dither_color(src[               x + 1], er, eg, eb, 7, 4);
+            if (left  && down) src[src_linesize + x - 1] = dither_color(src[src_linesize + x - 1], er, eg, eb, 3, 4);
+            if (         down) src[src_linesize + x    ] = dither_color(src[src_linesize + x    ], er, eg, eb, 5, 4);
+            if (right && down) src[src_linesize + x + 1] = dither_color(src[src_linesize + x + 1], er, eg, eb, 1, 4);
+
+        } else if (dither == DITHERING_SIERRA2) {
+            const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
+            const int right2 = x < w - 2,                    left2 = x > x_start + 1;
+            const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
+
+            if (color < 0)
+                return color;
+            dst[x] = color;
+
+            if (right)          src[                 x + 1] = dither_color(src[                 x + 1], er, eg, eb, 4, 4);
+            if (right2)         src[                 x + 2] = dither_color(src[                 x + 2], er, eg, eb, 3, 4);
+
+            if (down) {
+                if (left2)      src[  src_linesize + x - 2] = dither_color(src[  src_linesize + x - 2], er, eg, eb, 1, 4);
+                if (left)       src[  src_linesize + x - 1] = dither_color(src[  src_linesize + x - 1], er, eg, eb, 2, 4);
+                if (1)          src[  src_linesize + x    ] = dither_color(src[  src_linesize + x    ], er, eg, eb, 3, 4);
+                if (right)      src[  src_linesize + x + 1] = dither_color(src[  src_linesize + x + 1], er, eg, eb, 2, 4);
+                if (right2)     src[  src_linesize + x + 2] = dither_color(src[  src_linesize + x + 2], er, eg, eb, 1, 4);
+            }
 
-            } else if (dither == DITHERING_SIERRA2_4A) {
-                const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
-
-                if (color < 0)
-                    return color;
-                dst[x] = color;
-
-                if (right)         src[               x + 1] = dither_color(src[               x + 1], er, eg, eb, 2, 2);
-                if (left  && down) src[src_linesize + x - 1] = dither_color(src[src_linesize + x - 1], er, eg, eb, 1, 2);
-                if (         down) src[src_linesize + x    ] = dither_color(src[src_linesize + x    ], er, eg, eb, 1, 2);
-
-            } else if (dither == DITHERING_SIERRA3) {
-                const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
-                const int right2 = x < w - 2, down2 = y < h - 2, left2 = x > x_start + 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
-
-                if (color < 0)
-                    return color;
-                dst[x] = color;
-
-                if (right)         src[                 x + 1] = dither_color(src[                 x + 1], er, eg, eb, 5, 5);
-                if (right2)        src[                 x + 2] = dither_color(src[                 x + 2], er, eg, eb, 3, 5);
-
-                if (down) {
-                    if (left2)     src[src_linesize   + x - 2] = dither_color(src[src_linesize   + x - 2], er, eg, eb, 2, 5);
-                    if (left)      src[src_linesize   + x - 1] = dither_color(src[src_linesize   + x - 1], er, eg, eb, 4, 5);
-                    if (1)         src[src_linesize   + x    ] = dither_color(src[src_linesize   + x    ], er, eg, eb, 5, 5);
-                    if (right)     src[src_linesize   + x + 1] = dither_color(src[src_linesize   + x + 1], er, eg, eb, 4, 5);
-                    if (right2)    src[src_linesize   + x + 2] = dither_color(src[src_linesize   + x + 2], er, eg, eb, 2, 5);
-
-                    if (down2) {
-                        if (left)  src[src_linesize*2 + x - 1] = dither_color(src[src_linesize*2 + x - 1], er, eg, eb, 2, 5);
-                        if (1)     src[src_linesize*2 + x    ] = dither_color(src[src_linesize*2 + x    ], er, eg, eb, 3, 5);
-                        if (right) src[src_linesize*2 + x + 1] = dither_color(src[src_linesize*2 + x + 1], er, eg, eb, 2, 5);
-                    }
+        } else if (dither == DITHERING_SIERRA2_4A) {
+            const int right = x < w - 1, down = y < h - 1, left = x > x_start;
+            const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
+
+            if (color < 0)
+                return color;
+            dst[x] = color;
+
+            if (right)         src[               x + 1] = dither_color(src[               x + 1], er, eg, eb, 2, 2);
+            if (left  && down) src[src_linesize + x - 1] = dither_color(src[src_linesize + x - 1], er, eg, eb, 1, 2);
+            if (         down) src[src_linesize + x    ] = dither_color(src[src_linesize + x    ], er, eg, eb, 1, 2);
+
+        } else if (dither == DITHERING_SIERRA3) {
+            const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
+            const int right2 = x < w - 2, down2 = y < h - 2, left2 = x > x_start + 1;
+            const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
+
+            if (color < 0)
+                return color;
+            dst[x] = color;
+
+            if (right)         src[                 x + 1] = dither_color(src[                 x + 1], er, eg, eb, 5, 5);
+            if (right2)        src[                 x + 2] = dither_color(src[                 x + 2], er, eg, eb, 3, 5);
+
+            if (down) {
+                if (left2)     src[src_linesize   + x - 2] = dither_color(src[src_linesize   + x - 2], er, eg, eb, 2, 5);
+                if (left)      src[src_linesize   + x - 1] = dither_color(src[src_linesize   + x - 1], er, eg, eb, 4, 5);
+                if (1)         src[src_linesize   + x    ] = dither_color(src[src_linesize   + x    ], er, eg, eb, 5, 5);
+                if (right)     src[src_linesize   + x + 1] = dither_color(src[src_linesize   + x + 1], er, eg, eb, 4, 5);
+                if (right2)    src[src_linesize   + x + 2] = dither_color(src[src_linesize   + x + 2], er, eg, eb, 2, 5);
+
+                if (down2) {
+                    if (left)  src[src_linesize*2 + x - 1] = dither_color(src[src_linesize*2 + x - 1], er, eg, eb, 2, 5);
+                    if (1)     src[src_linesize*2 + x    ] = dither_color(src[src_linesize*2 + x    ], er, eg, eb, 3, 5);
+                    if (right) src[src_linesize*2 + x + 1] = dither_color(src[src_linesize*2 + x + 1], er, eg, eb, 2, 5);
                 }
+            }
 
-            } else if (dither == DITHERING_BURKES) {
-                const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
-                const int right2 = x < w - 2,                    left2 = x > x_start + 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
+        } else if (dither == DITHERING_BURKES) {
+            const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
+            const int right2 = x < w - 2,                    left2 = x > x_start + 1;
+            const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
 
-                if (color < 0)
-                    return color;
-                dst[x] = color;
+            if (color < 0)
+                return color;
+            dst[x] = color;
 
-                if (right)      src[                 x + 1] = dither_color(src[                 x + 1], er, eg, eb, 8, 5);
-                if (right2)     src[                 x + 2] = dither_color(src[                 x + 2], er, eg, eb, 4, 5);
+            if (right)      src[                 x + 1] = dither_color(src[                 x + 1], er, eg, eb, 8, 5);
+            if (right2)     src[                 x + 2] = dither_color(src[                 x + 2], er, eg, eb, 4, 5);
 
-                if (down) {
-                    if (left2)  src[src_linesize   + x - 2] = dither_color(src[src_linesize   + x - 2], er, eg, eb, 2, 5);
-                    if (left)   src[src_linesize   + x - 1] = dither_color(src[src_linesize   + x - 1], er, eg, eb, 4, 5);
-                    if (1)      src[src_linesize   + x    ] = dither_color(src[src_linesize   + x    ], er, eg, eb, 8, 5);
-                    if (right)  src[src_linesize   + x + 1] = dither_color(src[src_linesize   + x + 1], er, eg, eb, 4, 5);
-                    if (right2) src[src_linesize   + x + 2] = dither_color(src[src_linesize   + x + 2], er, eg, eb, 2, 5);
-                }
+            if (down) {
+                if (left2)  src[src_linesize   + x - 2] = dither_color(src[src_linesize   + x - 2], er, eg, eb, 2, 5);
+                if (left)   src[src_linesize   + x - 1] = dither_color(src[src_linesize   + x - 1], er, eg, eb, 4, 5);
+                if (1)      src[src_linesize   + x    ] = dither_color(src[src_linesize   + x    ], er, eg, eb, 8, 5);
+                if (right)  src[src_linesize   + x + 1] = dither_color(src[src_linesize   + x + 1], er, eg, eb, 4, 5);
+                if (right2) src[src_linesize   + x + 2] = dither_color(src[src_linesize   + x + 2], er, eg, eb, 2, 5);
+            }
 
-            } else if (dither == DITHERING_ATKINSON) {
-                const int right  = x < w - 1, down  = y < h - 1, left = x > x_start;
-                const int right2 = x < w - 2, down2 = y < h - 2;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
+        } else if (dither == DITHERING_ATKINSON) {
+            const int right  = x < w - 1, down  = y < h - 1, left = x > x_start;
+            const int right2 = x < w - 2, down2 = y < h - 2;
+            const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
 
-                if (color < 0)
-                    return color;
-                dst[x] = color;
+            if (color < 0)
+                return color;
+            dst[x] = color;
 
-                if (right)     src[                 x + 1] = dither_color(src[                 x + 1], er, eg, eb, 1, 3);
-                if (right2)    src[                 x + 2] = dither_color(src[                 x + 2], er, eg, eb, 1, 3);
+            if (right)     src[                 x + 1] = dither_color(src[                 x + 1], er, eg, eb, 1, 3);
+            if (right2)    src[                 x + 2] = dither_color(src[                 x + 2], er, eg, eb, 1, 3);
 
-                if (down) {
-                    if (left)  src[src_linesize   + x - 1] = dither_color(src[src_linesize   + x - 1], er, eg, eb, 1, 3);
-                    if (1)     src[src_linesize   + x    ] = dither_color(src[src_linesize   + x    ], er, eg, eb, 1, 3);
-                    if (right) src[src_linesize   + x + 1] = dither_color(src[src_linesize   + x + 1], er, eg, eb, 1, 3);
-                    if (down2) src[src_linesize*2 + x    ] = dither_color(src[src_linesize*2 + x    ], er, eg, eb, 1, 3);
-                }
+            if (down) {
+                if (left)  src[src_linesize   + x - 1] = dither_color(src[src_linesize   + x - 1], er, eg, eb, 1, 3);
+                if (1)     src[src_linesize   + x    ] = dither_color(src[src_linesize   + x    ], er, eg, eb, 1, 3);
+                if (right) src[src_linesize   + x + 1] = dither_color(src[src_linesize   + x + 1], er, eg, eb, 1, 3);
+                if (down2) src[src_linesize*2 + x    ] = dither_color(src[src_linesize*2 + x    ], er, eg, eb, 1, 3);
+            }
 
-            } else {
-                const int color = color_get(s, src[x]);
+        } else {
+            const int color = color_get(s, cache, src[x]);
 
-                if (color < 0)
-                    return color;
-                dst[x] = color;
-            }
+            if (color < 0)
+                return color;
+            dst[x] = color;
         }
-        src += src_linesize;
-        dst += dst_linesize;
     }
     return 0;
 }
@@ -767,6 +778,124 @@ static void set_processing_window(enum diff_mode diff_mode,
     *hp = height;
 }
 
+typedef struct ThreadData {
+    AVFrame *out, *in;
+    int x, y, w, h;
+} ThreadData;
+
+/* Ordered and no dithering: rows are independent of each other. */
+static int set_frame_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteUseContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    struct cache_node *cache = s->cache + jobnr * CACHE_SIZE;
+    const int slice_start = td->y + (td->h *  jobnr   ) / nb_jobs;
+    const int slice_end   = td->y + (td->h * (jobnr+1)) / nb_jobs;
+
+    for (int y = slice_start; y < slice_end; y++) {
+        int ret = s->set_frame(s, cache, td->out, td->in, td->x, td->x + td->w,
+                               td->y + td->h, y, td->x, td->x + td->w);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+#define WAVEFRONT_STEP 32
+/* Distance a row must stay behind the previous one: the errors spread up to
+ * 2 pixels ahead on the current row and up to 2 pixels back on the rows
+ * below, so the rows must not get closer than that to never touch the same
+ * pixels at the same time. */
+#define WAVEFRONT_LAG  5
+
+static void report_row(PaletteUseContext *s, int row, int n)
+{
+    atomic_store(&s->row_progress[row], n);
+    if (atomic_load(&s->nb_waiting)) {
+        ff_mutex_lock(&s->progress_lock);
+        ff_cond_broadcast(&s->progress_cond);
+        ff_mutex_unlock(&s->progress_lock);
+    }
+}
+
+static void await_row(PaletteUseContext *s, int row, int n)
+{
+    if (atomic_load_explicit(&s->row_progress[row], memory_order_acquire) >= n)
+        return;
+
+    ff_mutex_lock(&s->progress_lock);
+    atomic_fetch_add(&s->nb_waiting, 1);
+    while (atomic_load(&s->row_progress[row]) < n)
+        ff_cond_wait(&s->progress_cond, &s->progress_lock);
+    atomic_fetch_sub(&s->nb_waiting, 1);
+    ff_mutex_unlock(&s->progress_lock);
+}
+
+/**
+ * Error diffusion: the rows are handed out in order to whichever job asks
+ * next, and every row only runs WAVEFRONT_LAG pixels behind the one above,
+ * so that the errors are added in the same order as when done serially.
+ * Since a row is only waited for once it has been handed out, this cannot
+ * deadlock however the jobs get scheduled.
+ */
+static int set_frame_wavefront(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteUseContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    struct cache_node *cache = s->cache + jobnr * CACHE_SIZE;
+    int ret = 0;
+
+    for (;;) {
+        const int row = atomic_fetch_add(&s->next_row, 1);
+        const int y = td->y + row;
+
+        if (row >= td->h)
+            break;
+
+        for (int x0 = 0; x0 < td->w; x0 += WAVEFRONT_STEP) {
+            const int x1 = FFMIN(x0 + WAVEFRONT_STEP, td->w);
+
+            if (row > 0)
+                await_row(s, row - 1, FFMIN(x1 + WAVEFRONT_LAG, td->w));
+            if (ret >= 0)
+                ret = s->set_frame(s, cache, td->out, td->in, td->x, td->x + td->w,
+                                   td->y + td->h, y, td->x + x0, td->x + x1);
+            report_row(s, row, x1);
+        }
+    }
+    return ret;
+}
+
+static int set_frame_threaded(AVFilterContext *ctx, AVFrame *out, AVFrame *in,
+                              int x, int y, int w, int h)
+{
+    PaletteUseContext *s = ctx->priv;
+    ThreadData td = { .out = out, .in = in, .x = x, .y = y, .w = w, .h = h };
+    const int nb_jobs = FFMIN(h, s->nb_caches);
+    int *rets, ret = 0;
+
+    if (nb_jobs <= 1)
+        return set_frame_slice(ctx, &td, 0, 1);
+
+    rets = av_calloc(nb_jobs, sizeof(*rets));
+    if (!rets)
+        return AVERROR(ENOMEM);
+
+    if (s->dither <= DITHERING_BAYER) {
+        ff_filter_execute(ctx, set_frame_slice, &td, rets, nb_jobs);
+    } else {
+        for (int i = 0; i < h; i++)
+            atomic_init(&s->row_progress[i], 0);
+        atomic_init(&s->next_row, 0);
+        ff_filter_execute(ctx, set_frame_wavefront, &td, rets, nb_jobs);
+    }
+
+    for (int i = 0; i < nb_jobs && ret >= 0; i++)
+        ret = rets[i];
+    av_free(rets);
+    return ret;
+}
+
 static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
 {
     int x, y, w, h, ret;
@@ -795,7 +924,7 @@ static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
     ff_dlog(ctx, "%dx%d rect: (%d;%d) -> (%d,%d) [area:%dx%d]\n",
             w, h, x, y, x+w, y+h, in->width, in->height);
 
-    ret = s->set_frame(s, out, in, x, y, w, h);
+    ret = set_frame_threaded(ctx, out, in, x, y, w, h);
     if (ret < 0) {
         av_frame_free(&out);
         *outf = NULL;
@@ -822,6 +951,12 @@ static int config_output(AVFilterLink *outlink)
     outlink->w = ctx->inputs[0]->w;
     outlink->h = ctx->inputs[0]->h;
 
+    s->nb_caches = ff_filter_get_nb_threads(ctx);
+    s->cache = av_calloc(s->nb_caches * CACHE_SIZE, sizeof(*s->cache));
+    s->row_progress = av_calloc(outlink->h, sizeof(*s->row_progress));
+    if (!s->cache || !s->row_progress)
+        return AVERROR(ENOMEM);
+
     outlink->time_base = ctx->inputs[0]->time_base;
     if ((ret = ff_framesync_configure(&s->fs)) < 0)
         return ret;
@@ -854,9 +989,9 @@ static void load_palette(PaletteUseContext *s, const AVFrame *palette_frame)
     if (s->new) {
         memset(s->palette, 0, sizeof(s->palette));
         memset(s->map, 0, sizeof(s->map));
-        for (i = 0; i < CACHE_SIZE; i++)
+        for (i = 0; i < s->nb_caches * CACHE_SIZE; i++)
             av_freep(&s->cache[i].entries);
-        memset(s->cache, 0, sizeof(s->cache));
+        memset(s->cache, 0, s->nb_caches * CACHE_SIZE * sizeof(*s->cache));
     }
 
     i = 0;
@@ -904,10 +1039,11 @@ static int load_apply_palette(FFFrameSync *fs)
 }
 
 #define DEFINE_SET_FRAME(name, value)                                           \
-static int set_frame_##name(PaletteUseContext *s, AVFrame *out, AVFrame *in,    \
-                            int x_start, int y_start, int w, int h)             \
+static int set_frame_##name(PaletteUseContext *s, struct cache_node *cache,     \
+                            AVFrame *out, AVFrame *in, int x_start, int w,      \
+                            int h, int y, int x0, int x1)                       \
 {                                                                               \
-    return set_frame(s, out, in, x_start, y_start, w, h, value);                \
+    return set_frame(s, cache, out, in, x_start, w, h, y, x0, x1, value);       \
 }
 
 DEFINE_SET_FRAME(none,            DITHERING_NONE)
@@ -943,6 +1079,7 @@ static int dither_value(int p)
 static av_cold int init(AVFilterContext *ctx)
 {
     PaletteUseContext *s = ctx->priv;
+    int ret;
 
     s->last_in  = av_frame_alloc();
     s->last_out = av_frame_alloc();
@@ -951,6 +1088,14 @@ static av_cold int init(AVFilterContext *ctx)
 
     s->set_frame = set_frame_lut[s->dither];
 
+    if ((ret = ff_mutex_init(&s->progress_lock, NULL)))
+        return AVERROR(ret);
+    if ((ret = ff_cond_init(&s->progress_cond, NULL))) {
+        ff_mutex_destroy(&s->progress_lock);
+        return AVERROR(ret);
+    }
+    s->progress_init = 1;
+
     if (s->dither == DITHERING_BAYER) {
         const int delta = 1 << (5 - s->bayer_scale); // to avoid too much luma
 
@@ -972,10 +1117,16 @@ static av_cold void uninit(AVFilterContext *ctx)
     PaletteUseContext *s = ctx->priv;
 
     ff_framesync_uninit(&s->fs);
-    for (int i = 0; i < CACHE_SIZE; i++)
+    for (int i = 0; i < s->nb_caches * CACHE_SIZE; i++)
         av_freep(&s->cache[i].entries);
+    av_freep(&s->cache);
+    av_freep(&s->row_progress);
     av_frame_free(&s->last_in);
     av_frame_free(&s->last_out);
+    if (s->progress_init) {
+        ff_mutex_destroy(&s->progress_lock);
+        ff_cond_destroy(&s->progress_cond);
+    }
 }
 
 static const AVFilterPad paletteuse_inputs[] = {
@@ -1005,6 +1156,7 @@ const FFFilter ff_vf_paletteuse = {
     .init          = init,
     .uninit        = uninit,
     .activate      = activate,
+    .p.flags       = AVFILTER_FLAG_SLICE_THREADS,
     FILTER_INPUTS(paletteuse_inputs),
     FILTER_OUTPUTS(paletteuse_outputs),
     FILTER_QUERY_FUNC2(query_formats),
@@ -0,0 +1,658 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Combined black, freeze, crop and scene change detection filter
+ *
+ * Gathers the statistics of blackdetect, freezedetect, cropdetect (black
+ * mode) and scdet in a single slice threaded pass over the frame and
+ * exports the same metadata as those filters.
+ */
+
+#include <float.h>
+
+#include "libavutil/imgutils.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+#include "libavutil/timestamp.h"
+
+#include "avfilter.h"
+#include "filters.h"
+#include "scene_sad.h"
+#include "video.h"
+
+enum QCDetect {
+    DETECT_BLACK  = 1 << 0,
+    DETECT_FREEZE = 1 << 1,
+    DETECT_CROP   = 1 << 2,
+    DETECT_SCENE  = 1 << 3,
+};
+
+typedef struct QCDetectSlice {
+    unsigned nb_black_pixels;
+    uint64_t freeze_sad;
+    uint64_t scene_sad;
+} QCDetectSlice;
+
+typedef struct QCDetectContext {
+    const AVClass *class;
+    int detect;
+    int step;
+
+    /* blackdetect */
+    double  black_min_duration_time;
+    int64_t black_min_duration;
+    int64_t black_start;
+    int64_t black_end;
+    int64_t last_picref_pts;
+    int black_started;
+    double picture_black_ratio_th;
+    double pixel_black_th;
+    unsigned pixel_black_th_i;
+
+    /* freezedetect */
+    double  noise;
+    int64_t freeze_duration;
+    AVFrame *reference_frame;
+    int64_t n;
+    int64_t reference_n;
+    int frozen;
+
+    /* cropdetect */
+    float limit;
+    int limit_upscaled;
+    int round;
+    int skip;
+    int reset_count;
+    int max_outliers;
+    int frame_nb;
+    int x1, y1, x2, y2;
+
+    /* scdet */
+    double threshold;
+    double prev_mafd;
+    AVFrame *prev_picref;
+
+    AVRational time_base;
+    int depth;
+    int nb_planes;
+    ptrdiff_t width[4];
+    ptrdiff_t height[4];
+    int sw, sh;                 ///< dimensions of the analyzed luma grid
+    ff_scene_sad_fn sad;
+
+    int nb_threads;
+    QCDetectSlice *slices;
+    int *row_avg;
+    int *col_avg;
+    int64_t *col_sum;           ///< nb_threads rows of sw column sums
+} QCDetectContext;
+
+typedef struct ThreadData {
+    AVFrame *in;
+    AVFrame *ref;               ///< freeze reference, NULL if not compared
+    AVFrame *prev;              ///< previous frame, NULL if not compared
+    int crop;
+} ThreadData;
+
+#define OFFSET(x) offsetof(QCDetectContext, x)
+#define FLAGS AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM
+
+static const AVOption qcdetect_options[] = {
+    { "detect", "set the detections to run", OFFSET(detect), AV_OPT_TYPE_FLAGS, {.i64=DETECT_BLACK|DETECT_FREEZE|DETECT_CROP|DETECT_SCENE}, 0, 15, FLAGS, .unit = "detect" },
+        { "black",  "detect black intervals",     0, AV_OPT_TYPE_CONST, {.i64=DETECT_BLACK},  0, 0, FLAGS, .unit = "detect" },
+        { "freeze", "detect frozen intervals",    0, AV_OPT_TYPE_CONST, {.i64=DETECT_FREEZE}, 0, 0, FLAGS, .unit = "detect" },
+        { "crop",   "detect the crop area",       0, AV_OPT_TYPE_CONST, {.i64=DETECT_CROP},   0, 0, FLAGS, .unit = "detect" },
+        { "scene",  "detect scene changes",       0, AV_OPT_TYPE_CONST, {.i64=DETECT_SCENE},  0, 0, FLAGS, .unit = "detect" },
+    { "step", "analyze every step-th luma sample of every step-th row", OFFSET(step), AV_OPT_TYPE_INT, {.i64=1}, 1, 16, FLAGS },
+    { "black_min_duration",     "set minimum detected black duration in seconds", OFFSET(black_min_duration_time), AV_OPT_TYPE_DOUBLE, {.dbl=2}, 0, DBL_MAX, FLAGS },
+    { "picture_black_ratio_th", "set the picture black ratio threshold", OFFSET(picture_black_ratio_th), AV_OPT_TYPE_DOUBLE, {.dbl=.98}, 0, 1, FLAGS },
+    { "pixel_black_th",         "set the pixel black threshold",         OFFSET(pixel_black_th),         AV_OPT_TYPE_DOUBLE, {.dbl=.10}, 0, 1, FLAGS },
+    { "freeze_noise",    "set freeze noise tolerance",                OFFSET(noise),           AV_OPT_TYPE_DOUBLE,   {.dbl=0.001},   0,       1.0, FLAGS },
+    { "freeze_duration", "set minimum freeze duration in seconds",    OFFSET(freeze_duration), AV_OPT_TYPE_DURATION, {.i64=2000000}, 0, INT64_MAX, FLAGS },
+    { "crop_limit",        "threshold below which the pixel is considered black", OFFSET(limit),        AV_OPT_TYPE_FLOAT, {.dbl=24.0/255}, 0, 65535, FLAGS },
+    { "crop_round",        "value by which the width/height should be divisible", OFFSET(round),        AV_OPT_TYPE_INT,   {.i64=16}, 0, INT_MAX, FLAGS },
+    { "crop_reset",        "recalculate the crop area after this many frames",    OFFSET(reset_count),  AV_OPT_TYPE_INT,   {.i64=0},  0, INT_MAX, FLAGS },
+    { "crop_skip",         "number of initial frames to skip",                    OFFSET(skip),         AV_OPT_TYPE_INT,   {.i64=2},  0, INT_MAX, FLAGS },
+    { "crop_max_outliers", "threshold count of outliers",                         OFFSET(max_outliers), AV_OPT_TYPE_INT,   {.i64=0},  0, INT_MAX, FLAGS },
+    { "scene_threshold", "set scene change detect threshold", OFFSET(threshold), AV_OPT_TYPE_DOUBLE, {.dbl=10.}, 0, 100., FLAGS },
+    { NULL }
+};
+
+AVFILTER_DEFINE_CLASS(qcdetect);
+
+#define YUVJ_FORMATS \
+    AV_PIX_FMT_YUVJ411P, AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_YUVJ422P, AV_PIX_FMT_YUVJ444P, AV_PIX_FMT_YUVJ440P
+
+static const enum AVPixelFormat yuvj_formats[] = {
+    YUVJ_FORMATS, AV_PIX_FMT_NONE
+};
+
+static const enum AVPixelFormat pix_fmts[] = {
+    AV_PIX_FMT_GRAY8,
+    AV_PIX_FMT_YUV410P, AV_PIX_FMT_YUV411P,
+    AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV422P,
+    AV_PIX_FMT_YUV440P, AV_PIX_FMT_YUV444P,
+    YUVJ_FORMATS,
+    AV_PIX_FMT_GRAY9, AV_PIX_FMT_GRAY10, AV_PIX_FMT_GRAY12, AV_PIX_FMT_GRAY14,
+    AV_PIX_FMT_GRAY16,
+    AV_PIX_FMT_YUV420P9, AV_PIX_FMT_YUV422P9, AV_PIX_FMT_YUV444P9,
+    AV_PIX_FMT_YUV420P10, AV_PIX_FMT_YUV422P10, AV_PIX_FMT_YUV444P10,
+    AV_PIX_FMT_YUV440P10,
+    AV_PIX_FMT_YUV444P12, AV_PIX_FMT_YUV422P12, AV_PIX_FMT_YUV420P12,
+    AV_PIX_FMT_YUV440P12,
+    AV_PIX_FMT_YUV444P14, AV_PIX_FMT_YUV422P14, AV_PIX_FMT_YUV420P14,
+    AV_PIX_FMT_YUV420P16, AV_PIX_FMT_YUV422P16, AV_PIX_FMT_YUV444P16,
+    AV_PIX_FMT_YUVA420P,  AV_PIX_FMT_YUVA422P,   AV_PIX_FMT_YUVA444P,
+    AV_PIX_FMT_YUVA444P9, AV_PIX_FMT_YUVA444P10, AV_PIX_FMT_YUVA444P12, AV_PIX_FMT_YUVA444P16,
+    AV_PIX_FMT_YUVA422P9, AV_PIX_FMT_YUVA422P10, AV_PIX_FMT_YUVA422P12, AV_PIX_FMT_YUVA422P16,
+    AV_PIX_FMT_YUVA420P9, AV_PIX_FMT_YUVA420P10, AV_PIX_FMT_YUVA420P16,
+    AV_PIX_FMT_NONE
+};
+
+static int config_input(AVFilterLink *inlink)
+{
+    AVFilterContext *ctx = inlink->dst;
+    QCDetectContext *s = ctx->priv;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
+
+    s->depth = desc->comp[0].depth;
+    s->nb_planes = av_pix_fmt_count_planes(inlink->format);
+    s->time_base = inlink->time_base;
+    s->black_min_duration = s->black_min_duration_time / av_q2d(s->time_base);
+
+    for (int plane = 0; plane < 4; plane++) {
+        ptrdiff_t line_size = av_image_get_linesize(inlink->format, inlink->w, plane);
+        s->width[plane] = line_size >> (s->depth > 8);
+        s->height[plane] = inlink->h >> ((plane == 1 || plane == 2) ? desc->log2_chroma_h : 0);
+    }
+    s->sw = (inlink->w + s->step - 1) / s->step;
+    s->sh = (inlink->h + s->step - 1) / s->step;
+
+    s->sad = ff_scene_sad_get_fn(s->depth == 8 ? 8 : 16);
+    if (!s->sad)
+        return AVERROR(EINVAL);
+
+    if (s->limit < 1.0)
+        s->limit_upscaled = lrint(s->limit * ((1 << s->depth) - 1));
+    else
+        s->limit_upscaled = lrint(s->limit);
+    s->frame_nb = -1 * s->skip;
+    s->x1 = inlink->w - 1;
+    s->y1 = inlink->h - 1;
+    s->x2 = 0;
+    s->y2 = 0;
+
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    s->slices  = av_calloc(s->nb_threads, sizeof(*s->slices));
+    s->row_avg = av_calloc(s->sh, sizeof(*s->row_avg));
+    s->col_avg = av_calloc(s->sw, sizeof(*s->col_avg));
+    s->col_sum = av_calloc(s->sw, s->nb_threads * sizeof(*s->col_sum));
+    if (!s->slices || !s->row_avg || !s->col_avg || !s->col_sum)
+        return AVERROR(ENOMEM);
+
+    av_log(ctx, AV_LOG_VERBOSE,
+           "step:%d black_min_duration:%s pixel_black_th:%f picture_black_ratio_th:%f "
+           "crop_limit:%f crop_round:%d crop_skip:%d crop_reset:%d\n",
+           s->step, av_ts2timestr(s->black_min_duration, &s->time_base),
+           s->pixel_black_th, s->picture_black_ratio_th,
+           s->limit, s->round, s->skip, s->reset_count);
+
+    return 0;
+}
+
+#define DEFINE_ANALYZE_LINE(depth, type)                                        \
+static av_always_inline unsigned analyze_line_##depth(const uint8_t *src,       \
+                                                      int sw, int step,         \
+                                                      unsigned threshold,       \
+                                                      int64_t *col_sum,         \
+                                                      int *row_avg)             \
+{                                                                               \
+    const type *p = (const type *)src;                                          \
+    unsigned black = 0;                                                         \
+                                                                                \
+    if (col_sum) {                                                              \
+        int total = 0;                                                          \
+                                                                                \
+        for (int x = 0; x < sw; x++) {                                          \
+            const int v = p[x * step];                                          \
+            black += v <= threshold;                                            \
+            total += v;                                                         \
+            col_sum[x] += v;                                                    \
+        }                                                                       \
+        *row_avg = total / sw;                                                  \
+    } else {                                                                    \
+        for (int x = 0; x < sw; x++)                                            \
+            black += p[x * step] <= threshold;                                  \
+    }                                                                           \
+                                                                                \
+    return black;                                                               \
+}                                                                               \
+                                                                                \
+static uint64_t sad_line_##depth(const uint8_t *src1, const uint8_t *src2,      \
+                                 int sw, int step)                              \
+{                                                                               \
+    const type *p1 = (const type *)src1;                                        \
+    const type *p2 = (const type *)src2;                                        \
+    uint64_t sad = 0;                                                           \
+                                                                                \
+    for (int x = 0; x < sw; x++)                                                \
+        sad += FFABS(p1[x * step] - p2[x * step]);                              \
+                                                                                \
+    return sad;                                                                 \
+}
+
+DEFINE_ANALYZE_LINE(8, uint8_t)
+DEFINE_ANALYZE_LINE(16, uint16_t)
+
+static int analyze_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    QCDetectContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const AVFrame *in = td->in, *ref = td->ref, *prev = td->prev;
+    QCDetectSlice *slice = &s->slices[jobnr];
+    int64_t *col_sum = td->crop ? s->col_sum + jobnr * s->sw : NULL;
+    const int start = (s->sh *  jobnr   ) / nb_jobs;
+    const int end   = (s->sh * (jobnr+1)) / nb_jobs;
+    const int step  = s->step;
+    const unsigned threshold = s->pixel_black_th_i;
+    const ptrdiff_t linesize = in->linesize[0];
+    unsigned black = 0;
+    /* the luma SAD is shared when the reference is also the previous frame */
+    const int shared = ref && prev && ref->data[0] == prev->data[0];
+
+    if (shared)
+        prev = NULL;
+
+    slice->freeze_sad = 0;
+    slice->scene_sad  = 0;
+    if (col_sum)
+        memset(col_sum, 0, s->sw * sizeof(*col_sum));
+
+    for (int i = start; i < end; i++) {
+        const uint8_t *src = in->data[0] + i * step * linesize;
+        int *row_avg = &s->row_avg[i];
+
+        if (s->depth == 8) {
+            if (step == 1)
+                black += analyze_line_8(src, s->sw, 1, threshold, col_sum, row_avg);
+            else
+                black += analyze_line_8(src, s->sw, step, threshold, col_sum, row_avg);
+        } else {
+            if (step == 1)
+                black += analyze_line_16(src, s->sw, 1, threshold, col_sum, row_avg);
+            else
+                black += analyze_line_16(src, s->sw, step, threshold, col_sum, row_avg);
+        }
+
+        if (step > 1) {
+            uint64_t (*sad_line)(const uint8_t *, const uint8_t *, int, int) =
+                s->depth == 8 ? sad_line_8 : sad_line_16;
+
+            if (ref) {
+                const uint64_t sad = sad_line(src, ref->data[0] + i * step * ref->linesize[0],
+                                              s->sw, step);
+                slice->freeze_sad += sad;
+                if (shared)
+                    slice->scene_sad += sad;
+            }
+            if (prev)
+                slice->scene_sad  += sad_line(prev->data[0] + i * step * prev->linesize[0], src,
+                                              s->sw, step);
+        }
+    }
+    slice->nb_black_pixels = black;
+
+    if (step == 1) {
+        uint64_t sad;
+
+        if (ref) {
+            for (int plane = 0; plane < s->nb_planes; plane++) {
+                const int pstart = (s->height[plane] *  jobnr   ) / nb_jobs;
+                const int pend   = (s->height[plane] * (jobnr+1)) / nb_jobs;
+
+                s->sad(in->data[plane]  + pstart * in->linesize[plane],  in->linesize[plane],
+                       ref->data[plane] + pstart * ref->linesize[plane], ref->linesize[plane],
+                       s->width[plane], pend - pstart, &sad);
+                slice->freeze_sad += sad;
+                if (!plane && shared)
+                    slice->scene_sad = sad;
+            }
+        }
+        if (prev) {
+            s->sad(prev->data[0] + start * prev->linesize[0], prev->linesize[0],
+                   in->data[0]   + start * linesize, linesize,
+                   s->width[0], end - start, &sad);
+            slice->scene_sad = sad;
+        }
+    }
+
+    return 0;
+}
+
+static void check_black_end(AVFilterContext *ctx)
+{
+    QCDetectContext *s = ctx->priv;
+
+    if ((s->black_end - s->black_start) >= s->black_min_duration) {
+        av_log(ctx, AV_LOG_INFO,
+               "black_start:%s black_end:%s black_duration:%s\n",
+               av_ts2timestr(s->black_start, &s->time_base),
+               av_ts2timestr(s->black_end,   &s->time_base),
+               av_ts2timestr(s->black_end - s->black_start, &s->time_base));
+    }
+}
+
+static void detect_black(AVFilterContext *ctx, AVFrame *frame, unsigned nb_black_pixels)
+{
+    QCDetectContext *s = ctx->priv;
+    const double picture_black_ratio = (double)nb_black_pixels / (s->sw * s->sh);
+
+    av_log(ctx, AV_LOG_DEBUG, "picture_black_ratio:%f pts:%s t:%s type:%c\n",
+           picture_black_ratio, av_ts2str(frame->pts),
+           av_ts2timestr(frame->pts, &s->time_base),
+           av_get_picture_type_char(frame->pict_type));
+
+    if (picture_black_ratio >= s->picture_black_ratio_th) {
+        if (!s->black_started) {
+            /* black starts here */
+            s->black_started = 1;
+            s->black_start = frame->pts;
+            av_dict_set(&frame->metadata, "lavfi.black_start",
+                        av_ts2timestr(s->black_start, &s->time_base), 0);
+        }
+    } else if (s->black_started) {
+        /* black ends here */
+        s->black_started = 0;
+        s->black_end = frame->pts;
+        check_black_end(ctx);
+        av_dict_set(&frame->metadata, "lavfi.black_end",
+                    av_ts2timestr(s->black_end, &s->time_base), 0);
+    }
+    s->last_picref_pts = frame->pts;
+}
+
+static int set_meta(AVFilterContext *ctx, AVFrame *frame, const char *key, const char *value)
+{
+    av_log(ctx, AV_LOG_INFO, "%s: %s\n", key, value);
+    return av_dict_set(&frame->metadata, key, value, 0);
+}
+
+static int detect_freeze(AVFilterContext *ctx, AVFrame *frame, uint64_t sad)
+{
+    QCDetectContext *s = ctx->priv;
+    AVFilterLink *inlink = ctx->inputs[0];
+    FilterLink *l = ff_filter_link(inlink);
+    int frozen = 0;
+
+    s->n++;
+
+    if (s->reference_frame) {
+        uint64_t count = 0;
+        int64_t duration;
+        double mafd;
+
+        if (s->step == 1) {
+            for (int plane = 0; plane < s->nb_planes; plane++)
+                count += s->width[plane] * s->height[plane];
+        } else {
+            count = (uint64_t)s->sw * s->sh;
+        }
+        mafd = (double)sad / count / (1ULL << s->depth);
+        frozen = mafd <= s->noise;
+
+        if (s->reference_frame->pts == AV_NOPTS_VALUE || frame->pts == AV_NOPTS_VALUE || frame->pts < s->reference_frame->pts)     // Discontinuity?
+            duration = l->frame_rate.num > 0 ? av_rescale_q(s->n - s->reference_n, av_inv_q(l->frame_rate), AV_TIME_BASE_Q) : 0;
+        else
+            duration = av_rescale_q(frame->pts - s->reference_frame->pts, inlink->time_base, AV_TIME_BASE_Q);
+
+        if (duration >= s->freeze_duration) {
+            if (!s->frozen)
+                set_meta(ctx, frame, "lavfi.freezedetect.freeze_start", av_ts2timestr(s->reference_frame->pts, &inlink->time_base));
+            if (!frozen) {
+                set_meta(ctx, frame, "lavfi.freezedetect.freeze_duration", av_ts2timestr(duration, &AV_TIME_BASE_Q));
+                set_meta(ctx, frame, "lavfi.freezedetect.freeze_end", av_ts2timestr(frame->pts, &inlink->time_base));
+            }
+            s->frozen = frozen;
+        }
+    }
+
+    if (!frozen) {
+        av_frame_free(&s->reference_frame);
+        s->reference_frame = av_frame_clone(frame);
+        s->reference_n = s->n;
+        if (!s->reference_frame)
+            return AVERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
+/* Same scan as cropdetect, on the averages of the analyzed rows and columns.
+ * A far border found between two analyzed lines is placed on the last line
+ * before the next analyzed one. */
+#define FIND(DST, FROM, NOEND, INC, AVG, FAR, MAX)                              \
+    outliers = 0;                                                               \
+    for (last = i = FROM; NOEND; i = i INC) {                                   \
+        if (AVG[i] > s->limit_upscaled) {                                       \
+            if (++outliers > s->max_outliers) {                                 \
+                DST = FFMIN(last * s->step + FAR, MAX);                         \
+                break;                                                          \
+            }                                                                   \
+        } else                                                                  \
+            last = i INC;                                                       \
+    }
+
+#define SET_META(key, value) \
+    av_dict_set_int(&frame->metadata, key, value, 0)
+
+static void detect_crop(AVFilterContext *ctx, AVFrame *frame, int nb_jobs)
+{
+    QCDetectContext *s = ctx->priv;
+    AVFilterLink *inlink = ctx->inputs[0];
+    int w, h, x, y, shrink_by, i, last, outliers;
+    char limit_str[22];
+
+    for (x = 0; x < s->sw; x++) {
+        int64_t total = 0;
+
+        for (int j = 0; j < nb_jobs; j++)
+            total += s->col_sum[j * s->sw + x];
+        s->col_avg[x] = total / s->sh;
+    }
+
+    /* Reset the crop area every reset_count frames, if reset_count is > 0 */
+    if (s->reset_count > 0 && s->frame_nb > s->reset_count) {
+        s->x1 = frame->width  - 1;
+        s->y1 = frame->height - 1;
+        s->x2 = 0;
+        s->y2 = 0;
+        s->frame_nb = 1;
+    }
+
+    FIND(s->y1,         0,             i * s->step < s->y1, +1, s->row_avg,           0, frame->height - 1);
+    FIND(s->y2, s->sh - 1, i * s->step > FFMAX(s->y2, s->y1), -1, s->row_avg, s->step - 1, frame->height - 1);
+    FIND(s->x1,         0,             i * s->step < s->x1, +1, s->col_avg,           0, frame->width  - 1);
+    FIND(s->x2, s->sw - 1, i * s->step > FFMAX(s->x2, s->x1), -1, s->col_avg, s->step - 1, frame->width  - 1);
+
+    /* round x and y (up), important for yuv colorspaces */
+    x = (s->x1+1) & ~1;
+    y = (s->y1+1) & ~1;
+
+    w = s->x2 - x + 1;
+    h = s->y2 - y + 1;
+
+    if (s->round <= 1)
+        s->round = 16;
+    if (s->round % 2)
+        s->round *= 2;
+
+    shrink_by = w % s->round;
+    w -= shrink_by;
+    x += (shrink_by/2 + 1) & ~1;
+
+    shrink_by = h % s->round;
+    h -= shrink_by;
+    y += (shrink_by/2 + 1) & ~1;
+
+    SET_META("lavfi.cropdetect.x1", s->x1);
+    SET_META("lavfi.cropdetect.x2", s->x2);
+    SET_META("lavfi.cropdetect.y1", s->y1);
+    SET_META("lavfi.cropdetect.y2", s->y2);
+    SET_META("lavfi.cropdetect.w",  w);
+    SET_META("lavfi.cropdetect.h",  h);
+    SET_META("lavfi.cropdetect.x",  x);
+    SET_META("lavfi.cropdetect.y",  y);
+
+    snprintf(limit_str, sizeof(limit_str), "%f", s->limit);
+    av_dict_set(&frame->metadata, "lavfi.cropdetect.limit", limit_str, 0);
+
+    av_log(ctx, AV_LOG_INFO,
+           "x1:%d x2:%d y1:%d y2:%d w:%d h:%d x:%d y:%d pts:%"PRId64" t:%f limit:%f crop=%d:%d:%d:%d\n",
+           s->x1, s->x2, s->y1, s->y2, w, h, x, y, frame->pts,
+           frame->pts == AV_NOPTS_VALUE ? -1 : frame->pts * av_q2d(inlink->time_base),
+           s->limit, w, h, x, y);
+}
+
+static int detect_scene(AVFilterContext *ctx, AVFrame *frame, uint64_t sad)
+{
+    QCDetectContext *s = ctx->priv;
+    double score = 0;
+    char buf[64];
+
+    if (s->prev_picref) {
+        const uint64_t count = s->step == 1 ? s->width[0] * s->height[0] :
+                                              (uint64_t)s->sw * s->sh;
+        const double mafd = (double)sad * 100. / count / (1ULL << s->depth);
+        const double diff = fabs(mafd - s->prev_mafd);
+
+        score = av_clipf(FFMIN(mafd, diff), 0, 100.);
+        s->prev_mafd = mafd;
+        av_frame_free(&s->prev_picref);
+    }
+    s->prev_picref = av_frame_clone(frame);
+    if (!s->prev_picref)
+        return AVERROR(ENOMEM);
+
+    snprintf(buf, sizeof(buf), "%0.3f", s->prev_mafd);
+    av_dict_set(&frame->metadata, "lavfi.scd.mafd", buf, 0);
+    snprintf(buf, sizeof(buf), "%0.3f", score);
+    av_dict_set(&frame->metadata, "lavfi.scd.score", buf, 0);
+
+    if (score >= s->threshold) {
+        av_log(ctx, AV_LOG_INFO, "lavfi.scd.score: %.3f, lavfi.scd.time: %s\n",
+               score, av_ts2timestr(frame->pts, &s->time_base));
+        av_dict_set(&frame->metadata, "lavfi.scd.time",
+                    av_ts2timestr(frame->pts, &s->time_base), 0);
+    }
+
+    return 0;
+}
+
+static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
+{
+    AVFilterContext *ctx = inlink->dst;
+    QCDetectContext *s = ctx->priv;
+    const int max = (1 << s->depth) - 1;
+    const int factor = (1 << (s->depth - 8));
+    const int full = frame->color_range == AVCOL_RANGE_JPEG ||
+                     ff_fmt_is_in(frame->format, yuvj_formats);
+    const int nb_jobs = FFMIN(s->sh, s->nb_threads);
+    unsigned nb_black_pixels = 0;
+    uint64_t freeze_sad = 0, scene_sad = 0;
+    ThreadData td;
+    int ret;
+
+    s->pixel_black_th_i = full ? s->pixel_black_th * max :
+        // luminance_minimum_value + pixel_black_th * luminance_range_size
+        16 * factor + s->pixel_black_th * (235 - 16) * factor;
+
+    td.in   = frame;
+    td.ref  = s->detect & DETECT_FREEZE ? s->reference_frame : NULL;
+    td.prev = s->detect & DETECT_SCENE  ? s->prev_picref     : NULL;
+    /* ignore the first skip frames */
+    td.crop = s->detect & DETECT_CROP && ++s->frame_nb > 0;
+
+    ff_filter_execute(ctx, analyze_slice, &td, NULL, nb_jobs);
+
+    for (int i = 0; i < nb_jobs; i++) {
+        nb_black_pixels += s->slices[i].nb_black_pixels;
+        freeze_sad      += s->slices[i].freeze_sad;
+        scene_sad       += s->slices[i].scene_sad;
+    }
+
+    if (s->detect & DETECT_BLACK)
+        detect_black(ctx, frame, nb_black_pixels);
+    if (s->detect & DETECT_FREEZE) {
+        ret = detect_freeze(ctx, frame, freeze_sad);
+        if (ret < 0)
+            goto fail;
+    }
+    if (td.crop)
+        detect_crop(ctx, frame, nb_jobs);
+    if (s->detect & DETECT_SCENE) {
+        ret = detect_scene(ctx, frame, scene_sad);
+        if (ret < 0)
+            goto fail;
+    }
+
+    return ff_filter_frame(ctx->outputs[0], frame);
+fail:
+    av_frame_free(&frame);
+    return ret;
+}
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    QCDetectContext *s = ctx->priv;
+
+    if (s->black_started) {
+        s->black_end = s->last_picref_pts;
+        check_black_end(ctx);
+    }
+
+    av_frame_free(&s->reference_frame);
+    av_frame_free(&s->prev_picref);
+    av_freep(&s->slices);
+    av_freep(&s->row_avg);
+    av_freep(&s->col_avg);
+    av_freep(&s->col_sum);
+}
+
+static const AVFilterPad qcdetect_inputs[] = {
+    {
+        .name         = "default",
+        .type         = AVMEDIA_TYPE_VIDEO,
+        .config_props = config_input,
+        .filter_frame = filter_frame,
+    },
+};
+
+const FFFilter ff_vf_qcdetect = {
+    .p.name        = "qcdetect",
+    .p.description = NULL_IF_CONFIG_SMALL("Detect black, frozen and cropped video and scene changes in one pass."),
+    .p.priv_class  = &qcdetect_class,
+    .p.flags       = AVFILTER_FLAG_SLICE_THREADS | AVFILTER_FLAG_METADATA_ONLY,
+    .priv_size     = sizeof(QCDetectContext),
+    .uninit        = uninit,
+    FILTER_INPUTS(qcdetect_inputs),
+    FILTER_OUTPUTS(ff_video_default_filterpad),
+    FILTER_PIXFMTS_ARRAY(pix_fmts),
+};
@@ -0,0 +1,855 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Calculate several quality metrics between two input videos in one pass.
+ *
+ * Each slice job walks its part of every plane in bands of 4 lines, the
+ * granularity of the SSIM block sums, and runs all enabled metrics on a band
+ * while it is still in cache. XPSNR and VMAF motion then run on the luma
+ * block rows and lines of the slice, keeping the previous originals and
+ * the previous blurred frame in the context. The per-frame and average
+ * values are the same as the ones of the psnr, ssim, xpsnr and vmafmotion
+ * filters, and are exported under the same metadata keys.
+ */
+
+#include "libavutil/avstring.h"
+#include "libavutil/file_open.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+#include "avfilter.h"
+#include "drawutils.h"
+#include "filters.h"
+#include "framesync.h"
+#include "psnr.h"
+#include "ssim.h"
+#include "vmaf_motion.h"
+#include "xpsnr.h"
+
+enum QualityMetric {
+    METRIC_PSNR = 1 << 0,
+    METRIC_SSIM = 1 << 1,
+    METRIC_XPSNR = 1 << 2,
+    METRIC_VMAFMOTION = 1 << 3,
+};
+
+/* lines blurred at once by a VMAF motion slice job */
+#define MOTION_LINES 32
+
+typedef struct MetricsScore {
+    uint64_t sse[4];
+    double ssim[4];
+    uint64_t motion_sad;
+} MetricsScore;
+
+typedef struct QualityMetricsContext {
+    const AVClass *class;
+    FFFrameSync fs;
+    int metrics;
+    FILE *stats_file;
+    char *stats_file_str;
+    int nb_components;
+    int nb_threads;
+    int depth;
+    int max[4], average_max;
+    int is_rgb;
+    uint8_t rgba_map[4];
+    char comps[4];
+    int planewidth[4];
+    int planeheight[4];
+    double planeweight[4];
+    uint64_t nb_frames;
+    double mse, min_mse, max_mse, mse_comp[4];
+    double ssim[4], ssim_total;
+    MetricsScore *score;
+    void **temp;
+    PSNRDSPContext psnr_dsp;
+    SSIMDSPContext ssim_dsp;
+
+    unsigned frame_rate;
+    uint64_t max_error;
+    uint32_t blk_size;
+    uint32_t w_blk, h_blk;
+    uint32_t blk_width_c, blk_height_c;
+    uint32_t w_blk_c, h_blk_c;
+    double *xpsnr_sse;
+    double *xpsnr_weights;
+    uint64_t *xpsnr_sse_c;
+    int16_t *org_m1, *org_m2;
+    int16_t **org;
+    double xpsnr_wdist[3], xpsnr_sum[3];
+    XPSNRDSPContext xpsnr_dsp;
+
+    VMAFMotionData motion;
+    uint16_t **blur_temp;
+} QualityMetricsContext;
+
+#define OFFSET(x) offsetof(QualityMetricsContext, x)
+#define FLAGS AV_OPT_FLAG_FILTERING_PARAM|AV_OPT_FLAG_VIDEO_PARAM
+
+static const AVOption qualitymetrics_options[] = {
+    { "metrics", "set the metrics to compute", OFFSET(metrics), AV_OPT_TYPE_FLAGS, {.i64=METRIC_PSNR|METRIC_SSIM}, 0, INT_MAX, FLAGS, .unit = "metrics" },
+        { "psnr", "peak signal-to-noise ratio",  0, AV_OPT_TYPE_CONST, {.i64=METRIC_PSNR}, 0, 0, FLAGS, .unit = "metrics" },
+        { "ssim", "structural similarity index", 0, AV_OPT_TYPE_CONST, {.i64=METRIC_SSIM}, 0, 0, FLAGS, .unit = "metrics" },
+        { "xpsnr", "extended perceptually weighted PSNR", 0, AV_OPT_TYPE_CONST, {.i64=METRIC_XPSNR}, 0, 0, FLAGS, .unit = "metrics" },
+        { "vmafmotion", "VMAF motion score of the reference", 0, AV_OPT_TYPE_CONST, {.i64=METRIC_VMAFMOTION}, 0, 0, FLAGS, .unit = "metrics" },
+    { "stats_file", "Set file where to store per-frame difference information", OFFSET(stats_file_str), AV_OPT_TYPE_STRING, {.str=NULL}, 0, 0, FLAGS },
+    { "f",          "Set file where to store per-frame difference information", OFFSET(stats_file_str), AV_OPT_TYPE_STRING, {.str=NULL}, 0, 0, FLAGS },
+    { NULL }
+};
+
+FRAMESYNC_DEFINE_CLASS(qualitymetrics, QualityMetricsContext, fs);
+
+static inline double get_psnr(double mse, uint64_t nb_frames, int max)
+{
+    return 10.0 * log10((double)max * max / (mse / nb_frames));
+}
+
+static double ssim_db(double ssim, double weight)
+{
+    return (fabs(weight - ssim) > 1e-9) ? 10.0 * log10(weight / (weight - ssim)) : INFINITY;
+}
+
+typedef struct ThreadData {
+    const uint8_t *main_data[4];
+    const uint8_t *ref_data[4];
+    int main_linesize[4];
+    int ref_linesize[4];
+} ThreadData;
+
+static uint64_t sse_lines(const PSNRDSPContext *dsp,
+                          const uint8_t *main_line, int main_linesize,
+                          const uint8_t *ref_line, int ref_linesize,
+                          int w, int h)
+{
+    uint64_t m = 0;
+
+    for (int i = 0; i < h; i++) {
+        m += dsp->sse_line(main_line, ref_line, w);
+        main_line += main_linesize;
+        ref_line  += ref_linesize;
+    }
+
+    return m;
+}
+
+/* convert the original luma lines a block row at y and its filters read */
+static void xpsnr_load_org(const QualityMetricsContext *s, const ThreadData *td,
+                           int16_t *org, int y, int block_height)
+{
+    const int width = s->planewidth[0];
+    const int start = FFMAX(y - 2, 0);
+    const int end   = FFMIN(y + block_height + 2, s->planeheight[0]);
+
+    for (int i = start; i < end; i++) {
+        const uint8_t *src = td->main_data[0] + i * td->main_linesize[0];
+        int16_t *dst = org + (i - y + 2) * width;
+
+        if (s->depth > 8) {
+            memcpy(dst, src, width * sizeof(*dst));
+        } else {
+            for (int x = 0; x < width; x++)
+                dst[x] = src[x];
+        }
+    }
+}
+
+/* block SSEs, and luma block weights, of the block rows starting in [y0, y1) */
+static void xpsnr_block_rows(QualityMetricsContext *s, const ThreadData *td,
+                             int c, int y0, int y1, int16_t *org)
+{
+    const int width  = s->planewidth[c];
+    const int height = s->planeheight[c];
+    const int bx     = c ? s->blk_width_c  : s->blk_size;
+    const int by     = c ? s->blk_height_c : s->blk_size;
+    const int w_blk  = c ? s->w_blk_c : s->w_blk;
+    const int bytes  = s->depth > 8 ? 2 : 1;
+    const int main_stride = td->main_linesize[c];
+    const int ref_stride  = td->ref_linesize[c];
+    uint64_t *sse_c = c ? s->xpsnr_sse_c + (c - 1) * s->w_blk_c * s->h_blk_c : NULL;
+
+    for (int y = (y0 + by - 1) / by * by; y < y1; y += by) {
+        const int block_height = FFMIN(by, height - y);
+        int idx = y / by * w_blk;
+
+        if (!c)
+            xpsnr_load_org(s, td, org, y, block_height);
+
+        for (int x = 0; x < width; x += bx, idx++) {
+            const int block_width = FFMIN(bx, width - x);
+            const uint64_t sse = sse_lines(&s->psnr_dsp,
+                                           td->main_data[c] + y * main_stride + x * bytes, main_stride,
+                                           td->ref_data[c] + y * ref_stride + x * bytes, ref_stride,
+                                           block_width, block_height);
+
+            if (c) {
+                sse_c[idx] = sse;
+            } else {
+                const double ms_act = ff_xpsnr_block_weight(&s->xpsnr_dsp, org + 2 * width + x,
+                                                            s->org_m1 + y * width + x,
+                                                            s->org_m2 + y * width + x, width,
+                                                            x, y, block_width, block_height,
+                                                            width, height, s->depth, s->frame_rate);
+                s->xpsnr_sse[idx]     = sse;
+                s->xpsnr_weights[idx] = 1.0 / sqrt(ms_act);
+            }
+        }
+    }
+}
+
+/* blur the reference lines [y0, y1) and return their SAD to the previous frame */
+static uint64_t motion_lines(QualityMetricsContext *s, const ThreadData *td,
+                             int y0, int y1, uint16_t *temp)
+{
+    VMAFMotionData *m = &s->motion;
+    const ptrdiff_t stride = m->stride / sizeof(*temp);
+    uint64_t sad = 0;
+
+    for (int y = y0; y < y1; y += MOTION_LINES) {
+        const int h = FFMIN(MOTION_LINES, y1 - y);
+        /* The vertical filter mirrors at the edges of the lines it gets, so
+         * give it 2 more on each side except at the picture edges. */
+        const int start = FFMAX(y - 2, 0);
+        const int end   = FFMIN(y + h + 2, m->height);
+        uint16_t *blur = m->blur_data[0] + y * stride;
+
+        m->vmafdsp.convolution_y(m->filter, 5, td->ref_data[0] + start * td->ref_linesize[0],
+                                 temp, m->width, end - start, td->ref_linesize[0], m->stride);
+        m->vmafdsp.convolution_x(m->filter, 5, temp + (y - start) * stride, blur,
+                                 m->width, h, m->stride, m->stride);
+        if (m->nb_frames)
+            sad += m->vmafdsp.sad(m->blur_data[1] + y * stride, blur,
+                                  m->width, h, m->stride, m->stride);
+    }
+
+    return sad;
+}
+
+static int compute_metrics(AVFilterContext *ctx, void *arg,
+                           int jobnr, int nb_jobs)
+{
+    QualityMetricsContext *s = ctx->priv;
+    ThreadData *td = arg;
+    MetricsScore *score = &s->score[jobnr];
+    const int do_psnr = s->metrics & METRIC_PSNR;
+    const int do_ssim = s->metrics & METRIC_SSIM;
+    const int do_xpsnr = (s->metrics & METRIC_XPSNR) && s->blk_size >= 4;
+    /* XPSNR falls back to the PSNR for pictures too small for its blocks */
+    const int do_sse = do_psnr || ((s->metrics & METRIC_XPSNR) && s->blk_size < 4);
+    const size_t sum_size = s->depth > 8 ? sizeof(int64_t[4]) : sizeof(int[4]);
+
+    for (int c = 0; c < s->nb_components; c++) {
+        const uint8_t *main_data = td->main_data[c];
+        const uint8_t *ref_data = td->ref_data[c];
+        const int main_stride = td->main_linesize[c];
+        const int ref_stride = td->ref_linesize[c];
+        const int width = s->planewidth[c];
+        const int height = s->planeheight[c];
+        const int slice_start = ((height >> 2) * jobnr) / nb_jobs;
+        const int slice_end = ((height >> 2) * (jobnr+1)) / nb_jobs;
+        /* The first band of a slice only provides the sums the SSIM
+         * of the second one overlaps with. */
+        const int zstart = FFMAX(slice_start - 1, 0);
+        void *sum0 = s->temp ? s->temp[jobnr] : NULL;
+        void *sum1 = s->temp ? (uint8_t *)sum0 + SSIM_SUM_LEN(width) * sum_size : NULL;
+        uint64_t sse = 0;
+        double ssim = 0.0;
+
+        for (int z = zstart; z < slice_end; z++) {
+            const uint8_t *main_band = main_data + 4 * z * main_stride;
+            const uint8_t *ref_band = ref_data + 4 * z * ref_stride;
+
+            if (do_ssim) {
+                FFSWAP(void *, sum0, sum1);
+                if (s->depth > 8) {
+                    ff_ssim_4x4xn_16bit(main_band, main_stride, ref_band, ref_stride,
+                                        sum0, width >> 2);
+                    if (z > zstart)
+                        ssim += ff_ssim_endn_16bit(sum0, sum1, (width >> 2) - 1, s->max[0]);
+                } else {
+                    s->ssim_dsp.ssim_4x4_line(main_band, main_stride, ref_band, ref_stride,
+                                              sum0, width >> 2);
+                    if (z > zstart)
+                        ssim += s->ssim_dsp.ssim_end_line(sum0, sum1, (width >> 2) - 1);
+                }
+            }
+            if (do_sse && z >= slice_start)
+                sse += sse_lines(&s->psnr_dsp, main_band, main_stride,
+                                 ref_band, ref_stride, width, 4);
+        }
+
+        /* lines below the last full band */
+        if (do_sse && jobnr == nb_jobs - 1)
+            sse += sse_lines(&s->psnr_dsp,
+                             main_data + 4 * slice_end * main_stride, main_stride,
+                             ref_data + 4 * slice_end * ref_stride, ref_stride,
+                             width, height - 4 * slice_end);
+
+        if (do_xpsnr)
+            xpsnr_block_rows(s, td, c, 4 * slice_start,
+                             jobnr == nb_jobs - 1 ? height : 4 * slice_end,
+                             s->org ? s->org[jobnr] : NULL);
+
+        score->sse[c]  = sse;
+        score->ssim[c] = ssim;
+    }
+
+    if (s->metrics & METRIC_VMAFMOTION) {
+        const int height = s->planeheight[0];
+
+        score->motion_sad = motion_lines(s, td, 4 * (((height >> 2) * jobnr) / nb_jobs),
+                                         jobnr == nb_jobs - 1 ? height :
+                                         4 * (((height >> 2) * (jobnr+1)) / nb_jobs),
+                                         s->blur_temp[jobnr]);
+    }
+
+    return 0;
+}
+
+static void set_meta(AVDictionary **metadata, const char *key, char comp, float d)
+{
+    char value[128];
+    snprintf(value, sizeof(value), "%f", d);
+    if (comp) {
+        char key2[128];
+        snprintf(key2, sizeof(key2), "%s%c", key, comp);
+        av_dict_set(metadata, key2, value, 0);
+    } else {
+        av_dict_set(metadata, key, value, 0);
+    }
+}
+
+/* weighted SSE of each component from the block SSEs and weights */
+static void xpsnr_wsse(QualityMetricsContext *s, const uint64_t *sse, uint64_t *wsse)
+{
+    const uint32_t w = s->planewidth[0];
+    const uint32_t h = s->planeheight[0];
+    const double   r = (double)(w * h) / (3840.0 * 2160.0);
+    const double avg_act = sqrt(16.0 * (double) (1 << (2 * s->depth - 9)) / sqrt(FFMAX(0.00001, r)));
+
+    if (s->blk_size < 4) {
+        for (int c = 0; c < s->nb_components; c++)
+            wsse[c] = sse[c];
+        return;
+    }
+
+    ff_xpsnr_smooth_weights(s->xpsnr_weights, w, h, s->blk_size, s->w_blk);
+
+    for (int c = 0; c < s->nb_components; c++) {
+        const uint32_t nb_blocks = c ? s->w_blk_c * s->h_blk_c : s->w_blk * s->h_blk;
+        const uint64_t *sse_c = c ? s->xpsnr_sse_c + (c - 1) * nb_blocks : NULL;
+        double sum = 0.0;
+
+        for (uint32_t i = 0; i < nb_blocks; i++)
+            sum += (c ? (double) sse_c[i] : s->xpsnr_sse[i]) * s->xpsnr_weights[i];
+        wsse[c] = sum <= 0.0 ? 0 : (uint64_t) (sum * avg_act + 0.5);
+    }
+}
+
+static int do_qualitymetrics(FFFrameSync *fs)
+{
+    AVFilterContext *ctx = fs->parent;
+    QualityMetricsContext *s = ctx->priv;
+    AVFrame *master, *ref;
+    AVDictionary **metadata;
+    double comp_mse[4] = { 0 }, mse = 0.;
+    double comp_ssim[4] = { 0 }, ssimv = 0.;
+    double comp_xpsnr[4] = { 0 }, motion = 0.;
+    uint64_t comp_sse[4] = { 0 }, motion_sad = 0;
+    ThreadData td;
+    int nb_jobs, ret;
+
+    ret = ff_framesync_dualinput_get(fs, &master, &ref);
+    if (ret < 0)
+        return ret;
+    if (ctx->is_disabled || !ref)
+        return ff_filter_frame(ctx->outputs[0], master);
+    metadata = &master->metadata;
+
+    for (int c = 0; c < s->nb_components; c++) {
+        td.main_data[c] = master->data[c];
+        td.ref_data[c] = ref->data[c];
+        td.main_linesize[c] = master->linesize[c];
+        td.ref_linesize[c] = ref->linesize[c];
+    }
+
+    if (master->color_range != ref->color_range) {
+        av_log(ctx, AV_LOG_WARNING, "master and reference "
+               "frames use different color ranges (%s != %s)\n",
+               av_color_range_name(master->color_range),
+               av_color_range_name(ref->color_range));
+    }
+
+    nb_jobs = FFMIN((s->planeheight[1] + 3) >> 2, s->nb_threads);
+    ff_filter_execute(ctx, compute_metrics, &td, NULL, nb_jobs);
+
+    for (int c = 0; c < s->nb_components; c++) {
+        for (int j = 0; j < nb_jobs; j++) {
+            comp_sse[c]  += s->score[j].sse[c];
+            comp_ssim[c] += s->score[j].ssim[c];
+        }
+    }
+    for (int j = 0; j < nb_jobs; j++)
+        motion_sad += s->score[j].motion_sad;
+
+    s->nb_frames++;
+
+    if (s->metrics & METRIC_PSNR) {
+        for (int c = 0; c < s->nb_components; c++) {
+            comp_mse[c] = comp_sse[c] / ((double)s->planewidth[c] * s->planeheight[c]);
+            mse += comp_mse[c] * s->planeweight[c];
+            s->mse_comp[c] += comp_mse[c];
+        }
+        s->min_mse = FFMIN(s->min_mse, mse);
+        s->max_mse = FFMAX(s->max_mse, mse);
+        s->mse += mse;
+
+        for (int j = 0; j < s->nb_components; j++) {
+            int c = s->is_rgb ? s->rgba_map[j] : j;
+            set_meta(metadata, "lavfi.psnr.mse.", s->comps[j], comp_mse[c]);
+            set_meta(metadata, "lavfi.psnr.psnr.", s->comps[j], get_psnr(comp_mse[c], 1, s->max[c]));
+        }
+        set_meta(metadata, "lavfi.psnr.mse_avg", 0, mse);
+        set_meta(metadata, "lavfi.psnr.psnr_avg", 0, get_psnr(mse, 1, s->average_max));
+    }
+
+    if (s->metrics & METRIC_SSIM) {
+        for (int c = 0; c < s->nb_components; c++) {
+            comp_ssim[c] /= ((s->planewidth[c] >> 2) - 1) * ((s->planeheight[c] >> 2) - 1);
+            ssimv += s->planeweight[c] * comp_ssim[c];
+            s->ssim[c] += comp_ssim[c];
+        }
+        s->ssim_total += ssimv;
+
+        for (int j = 0; j < s->nb_components; j++) {
+            int c = s->is_rgb ? s->rgba_map[j] : j;
+            set_meta(metadata, "lavfi.ssim.", av_toupper(s->comps[j]), comp_ssim[c]);
+        }
+        set_meta(metadata, "lavfi.ssim.All", 0, ssimv);
+        set_meta(metadata, "lavfi.ssim.dB", 0, ssim_db(ssimv, 1.0));
+    }
+
+    if (s->metrics & METRIC_XPSNR) {
+        uint64_t wsse[4];
+
+        xpsnr_wsse(s, comp_sse, wsse);
+        for (int c = 0; c < s->nb_components; c++) {
+            const double sqrt_wsse = sqrt((double) wsse[c]);
+
+            comp_xpsnr[c] = ff_xpsnr_get_avg(sqrt_wsse, INFINITY,
+                                             s->planewidth[c], s->planeheight[c],
+                                             s->max_error, 1);
+            s->xpsnr_wdist[c] += sqrt_wsse;
+            s->xpsnr_sum[c]   += comp_xpsnr[c];
+        }
+
+        for (int j = 0; j < s->nb_components; j++) {
+            int c = s->is_rgb ? s->rgba_map[j] : j;
+            set_meta(metadata, "lavfi.xpsnr.xpsnr.", s->comps[j], comp_xpsnr[c]);
+        }
+    }
+
+    if (s->metrics & METRIC_VMAFMOTION) {
+        VMAFMotionData *m = &s->motion;
+
+        /* the score is always normalized to 8 bits */
+        if (m->nb_frames)
+            motion = motion_sad / (double) ((uint64_t) m->width * m->height << (15 - 8));
+        FFSWAP(uint16_t *, m->blur_data[0], m->blur_data[1]);
+        m->nb_frames++;
+        m->motion_sum += motion;
+
+        set_meta(metadata, "lavfi.vmafmotion.score", 0, motion);
+    }
+
+    if (s->stats_file) {
+        fprintf(s->stats_file, "n:%"PRId64, s->nb_frames);
+        if (s->metrics & METRIC_PSNR) {
+            fprintf(s->stats_file, " mse_avg:%0.2f", mse);
+            for (int j = 0; j < s->nb_components; j++) {
+                int c = s->is_rgb ? s->rgba_map[j] : j;
+                fprintf(s->stats_file, " mse_%c:%0.2f", s->comps[j], comp_mse[c]);
+            }
+            fprintf(s->stats_file, " psnr_avg:%0.2f", get_psnr(mse, 1, s->average_max));
+            for (int j = 0; j < s->nb_components; j++) {
+                int c = s->is_rgb ? s->rgba_map[j] : j;
+                fprintf(s->stats_file, " psnr_%c:%0.2f", s->comps[j],
+                        get_psnr(comp_mse[c], 1, s->max[c]));
+            }
+        }
+        if (s->metrics & METRIC_SSIM) {
+            for (int j = 0; j < s->nb_components; j++) {
+                int c = s->is_rgb ? s->rgba_map[j] : j;
+                fprintf(s->stats_file, " ssim_%c:%f", s->comps[j], comp_ssim[c]);
+            }
+            fprintf(s->stats_file, " ssim_all:%f ssim_db:%f", ssimv, ssim_db(ssimv, 1.0));
+        }
+        if (s->metrics & METRIC_XPSNR) {
+            for (int j = 0; j < s->nb_components; j++) {
+                int c = s->is_rgb ? s->rgba_map[j] : j;
+                fprintf(s->stats_file, " xpsnr_%c:%f", s->comps[j], comp_xpsnr[c]);
+            }
+        }
+        if (s->metrics & METRIC_VMAFMOTION)
+            fprintf(s->stats_file, " motion:%f", motion);
+        fprintf(s->stats_file, "\n");
+    }
+
+    return ff_filter_frame(ctx->outputs[0], master);
+}
+
+static av_cold int init(AVFilterContext *ctx)
+{
+    QualityMetricsContext *s = ctx->priv;
+
+    if (!s->metrics) {
+        av_log(ctx, AV_LOG_ERROR, "No metrics selected.\n");
+        return AVERROR(EINVAL);
+    }
+
+    s->min_mse = +INFINITY;
+    s->max_mse = -INFINITY;
+
+    if (s->stats_file_str) {
+        if (!strcmp(s->stats_file_str, "-")) {
+            s->stats_file = stdout;
+        } else {
+            s->stats_file = avpriv_fopen_utf8(s->stats_file_str, "w");
+            if (!s->stats_file) {
+                int err = AVERROR(errno);
+                av_log(ctx, AV_LOG_ERROR, "Could not open stats file %s: %s\n",
+                       s->stats_file_str, av_err2str(err));
+                return err;
+            }
+        }
+    }
+
+    s->fs.on_event = do_qualitymetrics;
+    return 0;
+}
+
+static const enum AVPixelFormat pix_fmts[] = {
+    AV_PIX_FMT_GRAY8, AV_PIX_FMT_GRAY9, AV_PIX_FMT_GRAY10,
+    AV_PIX_FMT_GRAY12, AV_PIX_FMT_GRAY14, AV_PIX_FMT_GRAY16,
+    AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV422P, AV_PIX_FMT_YUV444P,
+    AV_PIX_FMT_YUV440P, AV_PIX_FMT_YUV411P, AV_PIX_FMT_YUV410P,
+    AV_PIX_FMT_YUVJ411P, AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_YUVJ422P,
+    AV_PIX_FMT_YUVJ440P, AV_PIX_FMT_YUVJ444P,
+    AV_PIX_FMT_GBRP,
+#define PF(suf) AV_PIX_FMT_YUV420##suf,  AV_PIX_FMT_YUV422##suf,  AV_PIX_FMT_YUV444##suf, AV_PIX_FMT_GBR##suf
+    PF(P9), PF(P10), PF(P12), PF(P14), PF(P16),
+    AV_PIX_FMT_NONE
+};
+
+static int config_input_ref(AVFilterLink *inlink)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
+    AVFilterContext *ctx  = inlink->dst;
+    QualityMetricsContext *s = ctx->priv;
+    FilterLink *il = ff_filter_link(inlink);
+    FilterLink *ml = ff_filter_link(ctx->inputs[0]);
+    double average_max = 0;
+    unsigned sum = 0;
+    int ret;
+
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    s->nb_components = desc->nb_components;
+    s->depth = desc->comp[0].depth;
+
+    if (ctx->inputs[0]->w != ctx->inputs[1]->w ||
+        ctx->inputs[0]->h != ctx->inputs[1]->h) {
+        av_log(ctx, AV_LOG_ERROR, "Width and height of input videos must be same.\n");
+        return AVERROR(EINVAL);
+    }
+
+    for (int j = 0; j < 4; j++)
+        s->max[j] = (1 << desc->comp[j].depth) - 1;
+
+    s->is_rgb = ff_fill_rgba_map(s->rgba_map, inlink->format) >= 0;
+    s->comps[0] = s->is_rgb ? 'r' : 'y' ;
+    s->comps[1] = s->is_rgb ? 'g' : 'u' ;
+    s->comps[2] = s->is_rgb ? 'b' : 'v' ;
+    s->comps[3] = 'a';
+
+    s->planeheight[1] = s->planeheight[2] = AV_CEIL_RSHIFT(inlink->h, desc->log2_chroma_h);
+    s->planeheight[0] = s->planeheight[3] = inlink->h;
+    s->planewidth[1]  = s->planewidth[2]  = AV_CEIL_RSHIFT(inlink->w, desc->log2_chroma_w);
+    s->planewidth[0]  = s->planewidth[3]  = inlink->w;
+    for (int j = 0; j < s->nb_components; j++)
+        sum += s->planeheight[j] * s->planewidth[j];
+    for (int j = 0; j < s->nb_components; j++) {
+        s->planeweight[j] = (double) s->planeheight[j] * s->planewidth[j] / sum;
+        average_max += s->max[j] * s->planeweight[j];
+    }
+    s->average_max = lrint(average_max);
+
+    ff_psnr_init(&s->psnr_dsp, s->depth);
+    ff_ssim_init(&s->ssim_dsp);
+
+    s->score = av_calloc(s->nb_threads, sizeof(*s->score));
+    if (!s->score)
+        return AVERROR(ENOMEM);
+
+    if (s->metrics & METRIC_SSIM) {
+        s->temp = av_calloc(s->nb_threads, sizeof(*s->temp));
+        if (!s->temp)
+            return AVERROR(ENOMEM);
+
+        for (int t = 0; t < s->nb_threads; t++) {
+            s->temp[t] = av_calloc(2 * SSIM_SUM_LEN(inlink->w), s->depth > 8 ? sizeof(int64_t[4]) : sizeof(int[4]));
+            if (!s->temp[t])
+                return AVERROR(ENOMEM);
+        }
+    }
+
+    if (s->metrics & METRIC_XPSNR) {
+        s->max_error = (1 << s->depth) - 1;
+        s->max_error *= s->max_error;
+        s->frame_rate = il->frame_rate.den ? (il->frame_rate.num / il->frame_rate.den) :
+                        ml->frame_rate.den ? (ml->frame_rate.num / ml->frame_rate.den) : 0;
+
+        /* block size, integer multiple of 4, as in the xpsnr filter */
+        s->blk_size = FFMAX(0, 4 * (int32_t) (32.0 * sqrt((double) ((uint32_t) inlink->w * inlink->h) / (3840.0 * 2160.0)) + 0.5));
+        if (s->blk_size >= 4) {
+            size_t nb_blocks, nb_blocks_c = 0;
+
+            s->w_blk = (s->planewidth [0] + s->blk_size - 1) / s->blk_size;
+            s->h_blk = (s->planeheight[0] + s->blk_size - 1) / s->blk_size;
+            nb_blocks = s->w_blk * s->h_blk;
+            if (s->nb_components > 1) {
+                s->blk_width_c  = (s->blk_size * s->planewidth [1]) / s->planewidth [0];
+                s->blk_height_c = (s->blk_size * s->planeheight[1]) / s->planeheight[0];
+                s->w_blk_c = (s->planewidth [1] + s->blk_width_c  - 1) / s->blk_width_c;
+                s->h_blk_c = (s->planeheight[1] + s->blk_height_c - 1) / s->blk_height_c;
+                nb_blocks_c = s->w_blk_c * s->h_blk_c;
+                s->xpsnr_sse_c = av_calloc(2 * nb_blocks_c, sizeof(*s->xpsnr_sse_c));
+                if (!s->xpsnr_sse_c)
+                    return AVERROR(ENOMEM);
+            }
+
+            s->xpsnr_sse = av_calloc(nb_blocks, sizeof(*s->xpsnr_sse));
+            /* the chroma blocks use the weights of the luma blocks */
+            s->xpsnr_weights = av_calloc(FFMAX(nb_blocks, nb_blocks_c), sizeof(*s->xpsnr_weights));
+            s->org_m1 = av_calloc(s->planewidth[0] * s->planeheight[0], sizeof(*s->org_m1));
+            s->org_m2 = av_calloc(s->planewidth[0] * s->planeheight[0], sizeof(*s->org_m2));
+            s->org = av_calloc(s->nb_threads, sizeof(*s->org));
+            if (!s->xpsnr_sse || !s->xpsnr_weights || !s->org_m1 || !s->org_m2 || !s->org)
+                return AVERROR(ENOMEM);
+
+            for (int t = 0; t < s->nb_threads; t++) {
+                /* the filters read up to 2 lines around a block row, and 1 pixel
+                 * past the end of the last one */
+                s->org[t] = av_malloc_array((s->blk_size + 4) * s->planewidth[0] + 2, sizeof(**s->org));
+                if (!s->org[t])
+                    return AVERROR(ENOMEM);
+            }
+        }
+
+        ff_xpsnr_init(&s->xpsnr_dsp);
+    }
+
+    if (s->metrics & METRIC_VMAFMOTION) {
+        if (s->is_rgb || (s->depth != 8 && s->depth != 10)) {
+            av_log(ctx, AV_LOG_ERROR, "VMAF motion needs 8 or 10 bit YUV or gray input.\n");
+            return AVERROR(EINVAL);
+        }
+
+        ret = ff_vmafmotion_init(&s->motion, inlink->w, inlink->h, inlink->format);
+        if (ret < 0)
+            return ret;
+
+        s->blur_temp = av_calloc(s->nb_threads, sizeof(*s->blur_temp));
+        if (!s->blur_temp)
+            return AVERROR(ENOMEM);
+
+        for (int t = 0; t < s->nb_threads; t++) {
+            s->blur_temp[t] = av_malloc((MOTION_LINES + 4) * s->motion.stride);
+            if (!s->blur_temp[t])
+                return AVERROR(ENOMEM);
+        }
+    }
+
+    return 0;
+}
+
+static int config_output(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    QualityMetricsContext *s = ctx->priv;
+    AVFilterLink *mainlink = ctx->inputs[0];
+    FilterLink *il = ff_filter_link(mainlink);
+    FilterLink *ol = ff_filter_link(outlink);
+    int ret;
+
+    ret = ff_framesync_init_dualinput(&s->fs, ctx);
+    if (ret < 0)
+        return ret;
+    outlink->w = mainlink->w;
+    outlink->h = mainlink->h;
+    outlink->time_base = mainlink->time_base;
+    outlink->sample_aspect_ratio = mainlink->sample_aspect_ratio;
+    ol->frame_rate = il->frame_rate;
+
+    if ((ret = ff_framesync_configure(&s->fs)) < 0)
+        return ret;
+
+    outlink->time_base = s->fs.time_base;
+
+    if (av_cmp_q(mainlink->time_base, outlink->time_base) ||
+        av_cmp_q(ctx->inputs[1]->time_base, outlink->time_base))
+        av_log(ctx, AV_LOG_WARNING, "not matching timebases found between first input: %d/%d and second input %d/%d, results may be incorrect!\n",
+               mainlink->time_base.num, mainlink->time_base.den,
+               ctx->inputs[1]->time_base.num, ctx->inputs[1]->time_base.den);
+
+    return 0;
+}
+
+static int activate(AVFilterContext *ctx)
+{
+    QualityMetricsContext *s = ctx->priv;
+    return ff_framesync_activate(&s->fs);
+}
+
+static void print_summary(AVFilterContext *ctx, const char *line)
+{
+    QualityMetricsContext *s = ctx->priv;
+
+    av_log(ctx, AV_LOG_INFO, "%s\n", line);
+    if (s->stats_file && s->stats_file != stdout)
+        fprintf(s->stats_file, "%s\n", line);
+}
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    QualityMetricsContext *s = ctx->priv;
+
+    if (s->nb_frames > 0) {
+        char buf[512];
+
+        if (s->metrics & METRIC_PSNR) {
+            av_strlcpy(buf, "PSNR", sizeof(buf));
+            for (int j = 0; j < s->nb_components; j++) {
+                int c = s->is_rgb ? s->rgba_map[j] : j;
+                av_strlcatf(buf, sizeof(buf), " %c:%f", s->comps[j],
+                            get_psnr(s->mse_comp[c], s->nb_frames, s->max[c]));
+            }
+            av_strlcatf(buf, sizeof(buf), " average:%f min:%f max:%f",
+                        get_psnr(s->mse, s->nb_frames, s->average_max),
+                        get_psnr(s->max_mse, 1, s->average_max),
+                        get_psnr(s->min_mse, 1, s->average_max));
+            print_summary(ctx, buf);
+        }
+
+        if (s->metrics & METRIC_SSIM) {
+            av_strlcpy(buf, "SSIM", sizeof(buf));
+            for (int j = 0; j < s->nb_components; j++) {
+                int c = s->is_rgb ? s->rgba_map[j] : j;
+                av_strlcatf(buf, sizeof(buf), " %c:%f (%f)", av_toupper(s->comps[j]),
+                            s->ssim[c] / s->nb_frames, ssim_db(s->ssim[c], s->nb_frames));
+            }
+            av_strlcatf(buf, sizeof(buf), " All:%f (%f)",
+                        s->ssim_total / s->nb_frames, ssim_db(s->ssim_total, s->nb_frames));
+            print_summary(ctx, buf);
+        }
+
+        if (s->metrics & METRIC_XPSNR) {
+            double xpsnr_min = INFINITY;
+
+            av_strlcpy(buf, "XPSNR", sizeof(buf));
+            for (int j = 0; j < s->nb_components; j++) {
+                int c = s->is_rgb ? s->rgba_map[j] : j;
+                double xpsnr = ff_xpsnr_get_avg(s->xpsnr_wdist[c], s->xpsnr_sum[c],
+                                                s->planewidth[c], s->planeheight[c],
+                                                s->max_error, s->nb_frames);
+
+                xpsnr_min = FFMIN(xpsnr_min, xpsnr);
+                av_strlcatf(buf, sizeof(buf), " %c:%f", s->comps[j], xpsnr);
+            }
+            av_strlcatf(buf, sizeof(buf), " minimum:%f", xpsnr_min);
+            print_summary(ctx, buf);
+        }
+
+        if (s->metrics & METRIC_VMAFMOTION) {
+            snprintf(buf, sizeof(buf), "VMAF motion average:%f",
+                     s->motion.motion_sum / s->nb_frames);
+            print_summary(ctx, buf);
+        }
+    }
+
+    ff_framesync_uninit(&s->fs);
+
+    if (s->stats_file && s->stats_file != stdout)
+        fclose(s->stats_file);
+
+    av_freep(&s->score);
+    for (int t = 0; t < s->nb_threads && s->temp; t++)
+        av_freep(&s->temp[t]);
+    av_freep(&s->temp);
+
+    av_freep(&s->xpsnr_sse);
+    av_freep(&s->xpsnr_weights);
+    av_freep(&s->xpsnr_sse_c);
+    av_freep(&s->org_m1);
+    av_freep(&s->org_m2);
+    for (int t = 0; t < s->nb_threads && s->org; t++)
+        av_freep(&s->org[t]);
+    av_freep(&s->org);
+
+    ff_vmafmotion_uninit(&s->motion);
+    for (int t = 0; t < s->nb_threads && s->blur_temp; t++)
+        av_freep(&s->blur_temp[t]);
+    av_freep(&s->blur_temp);
+}
+
+static const AVFilterPad qualitymetrics_inputs[] = {
+    {
+        .name         = "main",
+        .type         = AVMEDIA_TYPE_VIDEO,
+    },{
+        .name         = "reference",
+        .type         = AVMEDIA_TYPE_VIDEO,
+        .config_props = config_input_ref,
+    },
+};
+
+static const AVFilterPad qualitymetrics_outputs[] = {
+    {
+        .name          = "default",
+        .type          = AVMEDIA_TYPE_VIDEO,
+        .config_props  = config_output,
+    },
+};
+
+const FFFilter ff_vf_qualitymetrics = {
+    .p.name        = "qualitymetrics",
+    .p.description = NULL_IF_CONFIG_SMALL("Calculate several quality metrics between two video streams in one pass."),
+    .p.priv_class  = &qualitymetrics_class,
+    .p.flags       = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL |
+                     AVFILTER_FLAG_SLICE_THREADS             |
+                     AVFILTER_FLAG_METADATA_ONLY,
+    .preinit       = qualitymetrics_framesync_preinit,
+    .init          = init,
+    .uninit        = uninit,
+    .activate      = activate,
+    .priv_size     = sizeof(QualityMetricsContext),
+    FILTER_INPUTS(qualitymetrics_inputs),
+    FILTER_OUTPUTS(qualitymetrics_outputs),
+    FILTER_PIXFMTS_ARRAY(pix_fmts),
+};
@@ -21,6 +21,7 @@
 #include "config_components.h"
 
 #include "libavutil/avstring.h"
+#include "libavutil/cpu.h"
 #include "libavutil/imgutils.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
@@ -34,12 +35,21 @@
 #include "framesync.h"
 #include "video.h"
 
+#define MAX_CANVASES 4
+
 typedef struct StackItem {
     int x[4], y[4];
     int linesize[4];
     int height[4];
 } StackItem;
 
+/* An output frame that inputs render into directly, through sub-frames
+ * pointing at their region of it. */
+typedef struct StackCanvas {
+    AVFrame *frame;
+    uint8_t *claimed;   ///< per input, whether its region was handed out
+} StackCanvas;
+
 typedef struct StackContext {
     const AVClass *class;
     const AVPixFmtDescriptor *desc;
@@ -61,6 +71,11 @@ typedef struct StackContext {
     StackItem *items;
     AVFrame **frames;
     FFFrameSync fs;
+
+    int direct_enable;
+    uint8_t *direct;    ///< per input, whether its frame is in the output already
+    StackCanvas canvases[MAX_CANVASES];
+    int nb_canvases;
 } StackContext;
 
 static int query_formats(const AVFilterContext *ctx,
@@ -81,6 +96,105 @@ static int query_formats(const AVFilterContext *ctx,
                                   ff_formats_pixdesc_filter(0, reject_flags));
 }
 
+/* drop the first n canvases, they will not become output frames */
+static void drop_canvases(StackContext *s, int n)
+{
+    for (int i = 0; i < n; i++) {
+        StackCanvas tmp = s->canvases[0];
+
+        av_frame_free(&tmp.frame);
+        memmove(&s->canvases[0], &s->canvases[1],
+                (MAX_CANVASES - 1) * sizeof(*s->canvases));
+        s->canvases[MAX_CANVASES - 1] = tmp;
+        s->nb_canvases--;
+    }
+}
+
+static StackCanvas *get_canvas(AVFilterContext *ctx, int idx)
+{
+    AVFilterLink *outlink = ctx->outputs[0];
+    StackContext *s = ctx->priv;
+    StackCanvas *c;
+
+    for (int i = 0; i < s->nb_canvases; i++)
+        if (!s->canvases[i].claimed[idx])
+            return &s->canvases[i];
+
+    if (s->nb_canvases == MAX_CANVASES)
+        drop_canvases(s, 1);
+
+    c = &s->canvases[s->nb_canvases];
+    c->frame = ff_get_video_buffer(outlink, outlink->w, outlink->h);
+    if (!c->frame)
+        return NULL;
+    if (c->frame->extended_buf) {
+        av_frame_free(&c->frame);
+        return NULL;
+    }
+    memset(c->claimed, 0, s->nb_inputs * sizeof(*c->claimed));
+
+    if (s->fillcolor_enable)
+        ff_fill_rectangle(&s->draw, &s->color, c->frame->data, c->frame->linesize,
+                          0, 0, outlink->w, outlink->h);
+
+    s->nb_canvases++;
+    return c;
+}
+
+static void sub_buffer_free(void *opaque, uint8_t *data)
+{
+    AVBufferRef *buf = opaque;
+    av_buffer_unref(&buf);
+}
+
+static AVFrame *get_video_buffer(AVFilterLink *inlink, int w, int h)
+{
+    AVFilterContext *ctx = inlink->dst;
+    StackContext *s = ctx->priv;
+    const int idx = FF_INLINK_IDX(inlink);
+    const StackItem *item = &s->items[idx];
+    StackCanvas *c;
+    AVFrame *frame;
+
+    if (!s->direct_enable || w != inlink->w || h != inlink->h ||
+        !(c = get_canvas(ctx, idx)))
+        return ff_default_get_video_buffer(inlink, w, h);
+
+    frame = av_frame_alloc();
+    if (!frame)
+        return NULL;
+
+    /* each sub-frame owns its buffers, keeping the canvas alive, so that it
+     * is writable for the filter producing it */
+    for (int i = 0; i < FF_ARRAY_ELEMS(c->frame->buf) && c->frame->buf[i]; i++) {
+        AVBufferRef *ref = av_buffer_ref(c->frame->buf[i]);
+        if (!ref)
+            goto fail;
+        frame->buf[i] = av_buffer_create(ref->data, ref->size, sub_buffer_free, ref, 0);
+        if (!frame->buf[i]) {
+            av_buffer_unref(&ref);
+            goto fail;
+        }
+    }
+
+    for (int p = 0; p < s->nb_planes; p++) {
+        frame->data[p]     = c->frame->data[p] + c->frame->linesize[p] * item->y[p] + item->x[p];
+        frame->linesize[p] = c->frame->linesize[p];
+    }
+    frame->width               = w;
+    frame->height              = h;
+    frame->format              = inlink->format;
+    frame->sample_aspect_ratio = inlink->sample_aspect_ratio;
+    frame->colorspace          = inlink->colorspace;
+    frame->color_range         = inlink->color_range;
+
+    c->claimed[idx] = 1;
+    return frame;
+fail:
+    av_frame_free(&frame);
+    return NULL;
+}
+
 static av_cold int init(AVFilterContext *ctx)
 {
     StackContext *s = ctx->priv;
@@ -128,10 +242,21 @@ static av_cold int init(AVFilterContext *ctx)
     if (!s->items)
         return AVERROR(ENOMEM);
 
+    s->direct = av_calloc(s->nb_inputs, sizeof(*s->direct));
+    if (!s->direct)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < MAX_CANVASES; i++) {
+        s->canvases[i].claimed = av_calloc(s->nb_inputs, sizeof(*s->canvases[i].claimed));
+        if (!s->canvases[i].claimed)
+            return AVERROR(ENOMEM);
+    }
+
     for (i = 0; i < s->nb_inputs; i++) {
         AVFilterPad pad = { 0 };
 
         pad.type = AVMEDIA_TYPE_VIDEO;
+        pad.get_buffer.video = get_video_buffer;
         pad.name = av_asprintf("input%d", i);
         if (!pad.name)
             return AVERROR(ENOMEM);
@@ -154,6 +279,9 @@ static int process_slice(AVFilterContext *ctx, void *arg, int job, int nb_jobs)
     for (int i = start; i < end; i++) {
         StackItem *item = &s->items[i];
 
+        if (s->direct[i])
+            continue;
+
         for (int p = 0; p < s->nb_planes; p++) {
             av_image_copy_plane(out->data[p] + out->linesize[p] * item->y[p] + item->x[p],
                                 out->linesize[p],
@@ -166,6 +294,49 @@ static int process_slice(AVFilterContext *ctx, void *arg, int job, int nb_jobs)
     return 0;
 }
 
+static int in_canvas(const StackContext *s, const StackCanvas *c, int idx,
+                     const AVFrame *in)
+{
+    const StackItem *item = &s->items[idx];
+
+    for (int p = 0; p < s->nb_planes; p++) {
+        if (in->linesize[p] != c->frame->linesize[p] ||
+            in->data[p] != c->frame->data[p] + c->frame->linesize[p] * item->y[p] + item->x[p])
+            return 0;
+    }
+
+    return 1;
+}
+
+/* Find a canvas that the current input frames were rendered into. Inputs
+ * that are not in it are copied into their region, provided it was not
+ * handed out to another frame. */
+static AVFrame *get_direct_output(StackContext *s)
+{
+    for (int n = 0; n < s->nb_canvases; n++) {
+        StackCanvas *c = &s->canvases[n];
+        int usable = 1, nb_direct = 0;
+
+        for (int i = 0; i < s->nb_inputs && usable; i++) {
+            s->direct[i] = in_canvas(s, c, i, s->frames[i]);
+            nb_direct   += s->direct[i];
+            usable       = s->direct[i] || !c->claimed[i];
+        }
+
+        if (usable && nb_direct) {
+            AVFrame *out = c->frame;
+
+            /* the canvas is final now, and the older ones cannot be
+             * completed anymore */
+            c->frame = NULL;
+            drop_canvases(s, n + 1);
+            return out;
+        }
+    }
+
+    return NULL;
+}
+
 static int process_frame(FFFrameSync *fs)
 {
     AVFilterContext *ctx = fs->parent;
@@ -180,16 +351,21 @@ static int process_frame(FFFrameSync *fs)
             return ret;
     }
 
-    out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
-    if (!out)
-        return AVERROR(ENOMEM);
+    out = get_direct_output(s);
+    if (!out) {
+        memset(s->direct, 0, s->nb_inputs * sizeof(*s->direct));
+
+        out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
+        if (!out)
+            return AVERROR(ENOMEM);
+
+        if (s->fillcolor_enable)
+            ff_fill_rectangle(&s->draw, &s->color, out->data, out->linesize,
+                              0, 0, outlink->w, outlink->h);
+    }
     out->pts = av_rescale_q(s->fs.pts, s->fs.time_base, outlink->time_base);
     out->sample_aspect_ratio = outlink->sample_aspect_ratio;
 
-    if (s->fillcolor_enable)
-        ff_fill_rectangle(&s->draw, &s->color, out->data, out->linesize,
-                          0, 0, outlink->w, outlink->h);
-
     ff_filter_execute(ctx, process_slice, out, NULL,
                       FFMIN(s->nb_inputs, ff_filter_get_nb_threads(ctx)));
 
@@ -206,6 +382,8 @@ static int config_output(AVFilterLink *outlink)
     AVRational sar = ctx->inputs[0]->sample_aspect_ratio;
     int height = ctx->inputs[0]->h;
     int width = ctx->inputs[0]->w;
+    const int align = av_cpu_max_align();
+    int linesize[4];
     FFFrameSyncIn *in;
     int i, ret;
 
@@ -391,6 +569,41 @@ static int config_output(AVFilterLink *outlink)
 
     s->nb_planes = av_pix_fmt_count_planes(outlink->format);
 
+    /* Inputs can only render into the output directly if their regions are
+     * aligned, within the output, and do not overlap, also counting what
+     * may be written past the end of a row up to the alignment. */
+    if ((ret = av_image_fill_linesizes(linesize, outlink->format, width)) < 0)
+        return ret;
+    s->direct_enable = 1;
+    for (i = 0; i < s->nb_inputs && s->direct_enable; i++) {
+        const StackItem *a = &s->items[i];
+
+        for (int p = 0; p < s->nb_planes; p++) {
+            int h = (p == 1 || p == 2) ? AV_CEIL_RSHIFT(height, s->desc->log2_chroma_h) : height;
+
+            if (a->x[p] % align || a->x[p] + a->linesize[p] > linesize[p] ||
+                a->y[p] + a->height[p] > h) {
+                s->direct_enable = 0;
+                break;
+            }
+        }
+
+        for (int j = i + 1; j < s->nb_inputs && s->direct_enable; j++) {
+            const StackItem *b = &s->items[j];
+
+            for (int p = 0; p < s->nb_planes; p++) {
+                if (a->x[p] < b->x[p] + FFALIGN(b->linesize[p], align) &&
+                    b->x[p] < a->x[p] + FFALIGN(a->linesize[p], align) &&
+                    a->y[p] < b->y[p] + b->height[p] && b->y[p] < a->y[p] + a->height[p]) {
+                    s->direct_enable = 0;
+                    break;
+                }
+            }
+        }
+    }
+    av_log(ctx, AV_LOG_VERBOSE, "Inputs %s render into the output directly.\n",
+           s->direct_enable ? "can" : "cannot");
+
     outlink->w          = width;
     outlink->h          = height;
     ol->frame_rate      = frame_rate;
@@ -434,8 +647,12 @@ static av_cold void uninit(AVFilterContext *ctx)
     StackContext *s = ctx->priv;
 
     ff_framesync_uninit(&s->fs);
+    drop_canvases(s, s->nb_canvases);
+    for (int i = 0; i < MAX_CANVASES; i++)
+        av_freep(&s->canvases[i].claimed);
     av_freep(&s->frames);
     av_freep(&s->items);
+    av_freep(&s->direct);
 }
 
 static int activate(AVFilterContext *ctx)
@@ -45,6 +45,51 @@
 #include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
 
+/* Feed the samples line[offset] .. line[offset + w - 1] of a horizontally
+ * filtered row through the finite state machines across rows, nb_sc rows
+ * of states, and store the result back into line. */
+static void filter_v(uint32_t *line, uint32_t *const *sc, int nb_sc,
+                     int offset, int w)
+{
+    line += offset;
+
+    /* the states are moved one row at a time across the whole line,
+     * rather than one column at a time, so that the loops vectorize */
+    for (int z = 0; z < nb_sc; z += 2) {
+        uint32_t *sc0 = sc[z + 0] + offset;
+        uint32_t *sc1 = sc[z + 1] + offset;
+
+        for (int x = 0; x < w; x++) {
+            uint32_t tmp1 = line[x];
+            uint32_t tmp2 = sc0[x] + tmp1;
+            sc0[x] = tmp1;
+            line[x] = sc1[x] + tmp2;
+            sc1[x] = tmp2;
+        }
+    }
+}
+
+/* Sharpen or blur w samples of src with the filtered samples blur according
+ * to amount and store them into dst. */
+#define DEF_UNSHARP_APPLY_FUNC(nbits)                                       \
+static void apply_ ## nbits(uint ## nbits ## _t *dst,                      \
+                            const uint ## nbits ## _t *src,                 \
+                            const uint32_t *blur, int w, int amount,        \
+                            int scalebits, int32_t halfscale)               \
+{                                                                           \
+    for (int x = 0; x < w; x++) {                                           \
+        int32_t res = (int32_t)src[x] + ((((int32_t)src[x] -                \
+                      (int32_t)((blur[x] + halfscale) >> scalebits)) *      \
+                      amount) >> (8+nbits));                                \
+        dst[x] = av_clip_uint ## nbits(res);                                \
+    }                                                                       \
+}
+
+DEF_UNSHARP_APPLY_FUNC(8)
+DEF_UNSHARP_APPLY_FUNC(16)
+
+#undef DEF_UNSHARP_APPLY_FUNC
+
 #define MIN_MATRIX_SIZE 3
 #define MAX_MATRIX_SIZE 63
 
@@ -58,6 +103,7 @@ typedef struct UnsharpFilterParam {
     int32_t halfscale;                       ///< amount to add to pixel
     uint32_t *sr;        ///< finite state machine storage within a row
     uint32_t **sc;       ///< finite state machine storage across rows
+    uint32_t *line;      ///< horizontally filtered row
 } UnsharpFilterParam;
 
 typedef struct UnsharpContext {
@@ -113,7 +159,7 @@ static int name##_##nbits(AVFilterContext *ctx, void *arg, int jobnr, int nb_job
     const int slice_start = (height * jobnr) / nb_jobs;                                               \
     const int slice_end = (height * (jobnr+1)) / nb_jobs;                                             \
                                                                                                       \
-    int32_t res;                                                                                      \
+    uint32_t *line = fp->line + jobnr * (width + 2 * steps_x);                                        \
     int x, y, z;                                                                                      \
     uint32_t tmp1, tmp2;                                                                              \
                                                                                                       \
@@ -147,21 +193,13 @@ static int name##_##nbits(AVFilterContext *ctx, void *arg, int jobnr, int nb_job
                 tmp2 = sr[sr_offset + z + 0] + tmp1; sr[sr_offset + z + 0] = tmp1;                    \
                 tmp1 = sr[sr_offset + z + 1] + tmp2; sr[sr_offset + z + 1] = tmp2;                    \
             }                                                                                         \
-            for (z = 0; z < steps_y * 2; z += 2) {                                                    \
-                tmp2 = sc[sc_offset + z + 0][x + steps_x] + tmp1;                                     \
-                sc[sc_offset + z + 0][x + steps_x] = tmp1;                                            \
-                tmp1 = sc[sc_offset + z + 1][x + steps_x] + tmp2;                                     \
-                sc[sc_offset + z + 1][x + steps_x] = tmp2;                                            \
-            }                                                                                         \
-            if (x >= steps_x && y >= (steps_y + slice_start)) {                                       \
-                const uint##nbits##_t *srx = src - steps_y * src_stride + x - steps_x;                \
-                uint##nbits##_t *dsx       = dst - steps_y * dst_stride + x - steps_x;                \
-                                                                                                      \
-                res = (int32_t)*srx + ((((int32_t) * srx -                                            \
-                      (int32_t)((tmp1 + halfscale) >> scalebits)) * amount) >> (8+nbits));            \
-                *dsx = av_clip_uint##nbits(res);                                                      \
-            }                                                                                         \
+            line[x + steps_x] = tmp1;                                                                 \
         }                                                                                             \
+        /* only the columns from 2 * steps_x on produce output pixels */                              \
+        filter_v(line, sc + sc_offset, 2 * steps_y, 2 * steps_x, width);                              \
+        if (y >= (steps_y + slice_start))                                                             \
+            apply_##nbits(dst - steps_y * dst_stride, src - steps_y * src_stride,                     \
+                          line + 2 * steps_x, width, amount, scalebits, halfscale);                   \
         if (y >= 0) {                                                                                 \
             dst += dst_stride;                                                                        \
             src += src_stride;                                                                        \
@@ -274,7 +312,8 @@ static int init_filter_param(AVFilterContext *ctx, UnsharpFilterParam *fp, const
 
     fp->sr = av_malloc_array((MAX_MATRIX_SIZE - 1) * s->nb_threads, sizeof(uint32_t));
     fp->sc = av_calloc(fp->steps_y * s->nb_threads, 2 * sizeof(*fp->sc));
-    if (!fp->sr || !fp->sc)
+    fp->line = av_malloc_array((width + 2 * fp->steps_x) * s->nb_threads, sizeof(*fp->line));
+    if (!fp->sr || !fp->sc || !fp->line)
         return AVERROR(ENOMEM);
 
     for (z = 0; z < 2 * fp->steps_y * s->nb_threads; z++)
@@ -300,8 +339,8 @@ static int config_input(AVFilterLink *inlink)
 
     // ensure (height / nb_threads) > 4 * steps_y,
     // so that we don't have too much overlap between two threads
-    s->nb_threads = FFMIN(ff_filter_get_nb_threads(inlink->dst),
-                          inlink->h / (4 * s->luma.steps_y));
+    s->nb_threads = FFMAX(1, FFMIN(ff_filter_get_nb_threads(inlink->dst),
+                                   inlink->h / (4 * s->luma.steps_y)));
 
     ret = init_filter_param(inlink->dst, &s->luma,   "luma",   inlink->w);
     if (ret < 0)
@@ -309,6 +348,11 @@ static int config_input(AVFilterLink *inlink)
     ret = init_filter_param(inlink->dst, &s->chroma, "chroma", AV_CEIL_RSHIFT(inlink->w, s->hsub));
     if (ret < 0)
         return ret;
+    if (s->nb_planes == 4) {
+        ret = init_filter_param(inlink->dst, &s->alpha, "alpha", inlink->w);
+        if (ret < 0)
+            return ret;
+    }
 
     return 0;
 }
@@ -323,6 +367,7 @@ static void free_filter_param(UnsharpFilterParam *fp, int nb_threads)
         av_freep(&fp->sc);
     }
     av_freep(&fp->sr);
+    av_freep(&fp->line);
 }
 
 static av_cold void uninit(AVFilterContext *ctx)
@@ -331,6 +376,7 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     free_filter_param(&s->luma, s->nb_threads);
     free_filter_param(&s->chroma, s->nb_threads);
+    free_filter_param(&s->alpha, s->nb_threads);
 }
 
 static int filter_frame(AVFilterLink *link, AVFrame *in)
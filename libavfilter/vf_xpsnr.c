@@ -58,8 +58,14 @@ typedef struct XPSNRContext {
     FILE            *stats_file;
     char            *stats_file_str;
     /* XPSNR specific variables */
+    int             nb_threads;
+    uint32_t        blk_size;
+    uint32_t        w_blk,  h_blk;
+    uint32_t        blk_width_c, blk_height_c;
+    uint32_t        w_blk_c,     h_blk_c;
     double          *sse_luma;
     double          *weights;
+    uint64_t        *sse_chroma;
     int16_t         *buf_org_m1;
     int16_t         *buf_org_m2;
     int16_t         *buf_org   [3];
@@ -77,7 +83,6 @@ typedef struct XPSNRContext {
 
 #define FLAGS     AV_OPT_FLAG_FILTERING_PARAM | AV_OPT_FLAG_VIDEO_PARAM
 #define OFFSET(x) offsetof(XPSNRContext, x)
-#define XPSNR_GAMMA 2
 
 static const AVOption xpsnr_options[] = {
     {"stats_file", "Set file where to store per-frame XPSNR information", OFFSET(stats_file_str), AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, FLAGS},
@@ -89,61 +94,6 @@ FRAMESYNC_DEFINE_CLASS(xpsnr, XPSNRContext, fs);
 
 /* XPSNR function definitions */
 
-static uint64_t highds(const int x_act, const int y_act, const int w_act, const int h_act, const int16_t *o_m0, const int o)
-{
-    uint64_t sa_act = 0;
-
-    for (int y = y_act; y < h_act; y += 2) {
-        for (int x = x_act; x < w_act; x += 2) {
-            const int f = 12 * ((int)o_m0[ y   *o + x  ] + (int)o_m0[ y   *o + x+1] + (int)o_m0[(y+1)*o + x  ] + (int)o_m0[(y+1)*o + x+1])
-                         - 3 * ((int)o_m0[(y-1)*o + x  ] + (int)o_m0[(y-1)*o + x+1] + (int)o_m0[(y+2)*o + x  ] + (int)o_m0[(y+2)*o + x+1])
-                         - 3 * ((int)o_m0[ y   *o + x-1] + (int)o_m0[ y   *o + x+2] + (int)o_m0[(y+1)*o + x-1] + (int)o_m0[(y+1)*o + x+2])
-                         - 2 * ((int)o_m0[(y-1)*o + x-1] + (int)o_m0[(y-1)*o + x+2] + (int)o_m0[(y+2)*o + x-1] + (int)o_m0[(y+2)*o + x+2])
-                             - ((int)o_m0[(y-2)*o + x-1] + (int)o_m0[(y-2)*o + x  ] + (int)o_m0[(y-2)*o + x+1] + (int)o_m0[(y-2)*o + x+2]
-                              + (int)o_m0[(y+3)*o + x-1] + (int)o_m0[(y+3)*o + x  ] + (int)o_m0[(y+3)*o + x+1] + (int)o_m0[(y+3)*o + x+2]
-                              + (int)o_m0[(y-1)*o + x-2] + (int)o_m0[ y   *o + x-2] + (int)o_m0[(y+1)*o + x-2] + (int)o_m0[(y+2)*o + x-2]
-                              + (int)o_m0[(y-1)*o + x+3] + (int)o_m0[ y   *o + x+3] + (int)o_m0[(y+1)*o + x+3] + (int)o_m0[(y+2)*o + x+3]);
-            sa_act += (uint64_t) abs(f);
-        }
-    }
-    return sa_act;
-}
-
-static uint64_t diff1st(const uint32_t w_act, const uint32_t h_act, const int16_t *o_m0, int16_t *o_m1, const int o)
-{
-    uint64_t ta_act = 0;
-
-    for (uint32_t y = 0; y < h_act; y += 2) {
-        for (uint32_t x = 0; x < w_act; x += 2) {
-            const int t = (int)o_m0[y*o + x] + (int)o_m0[y*o + x+1] + (int)o_m0[(y+1)*o + x] + (int)o_m0[(y+1)*o + x+1]
-                       - ((int)o_m1[y*o + x] + (int)o_m1[y*o + x+1] + (int)o_m1[(y+1)*o + x] + (int)o_m1[(y+1)*o + x+1]);
-            ta_act += (uint64_t) abs(t);
-            o_m1[y*o + x  ] = o_m0[y*o + x  ];  o_m1[(y+1)*o + x  ] = o_m0[(y+1)*o + x  ];
-            o_m1[y*o + x+1] = o_m0[y*o + x+1];  o_m1[(y+1)*o + x+1] = o_m0[(y+1)*o + x+1];
-        }
-    }
-    return (ta_act * XPSNR_GAMMA);
-}
-
-static uint64_t diff2nd(const uint32_t w_act, const uint32_t h_act, const int16_t *o_m0, int16_t *o_m1, int16_t *o_m2, const int o)
-{
-    uint64_t ta_act = 0;
-
-    for (uint32_t y = 0; y < h_act; y += 2) {
-        for (uint32_t x = 0; x < w_act; x += 2) {
-            const int t = (int)o_m0[y*o + x] + (int)o_m0[y*o + x+1] + (int)o_m0[(y+1)*o + x] + (int)o_m0[(y+1)*o + x+1]
-                   - 2 * ((int)o_m1[y*o + x] + (int)o_m1[y*o + x+1] + (int)o_m1[(y+1)*o + x] + (int)o_m1[(y+1)*o + x+1])
-                        + (int)o_m2[y*o + x] + (int)o_m2[y*o + x+1] + (int)o_m2[(y+1)*o + x] + (int)o_m2[(y+1)*o + x+1];
-            ta_act += (uint64_t) abs(t);
-            o_m2[y*o + x  ] = o_m1[y*o + x  ];  o_m2[(y+1)*o + x  ] = o_m1[(y+1)*o + x  ];
-            o_m2[y*o + x+1] = o_m1[y*o + x+1];  o_m2[(y+1)*o + x+1] = o_m1[(y+1)*o + x+1];
-            o_m1[y*o + x  ] = o_m0[y*o + x  ];  o_m1[(y+1)*o + x  ] = o_m0[(y+1)*o + x  ];
-            o_m1[y*o + x+1] = o_m0[y*o + x+1];  o_m1[(y+1)*o + x+1] = o_m0[(y+1)*o + x+1];
-        }
-    }
-    return (ta_act * XPSNR_GAMMA);
-}
-
 static inline uint64_t calc_squared_error(XPSNRContext const *s,
                                           const int16_t *blk_org,     const uint32_t stride_org,
                                           const int16_t *blk_rec,     const uint32_t stride_rec,
@@ -172,110 +122,119 @@ static inline double calc_squared_error_and_weight (XPSNRContext const *s,
     const int         o = (int) stride_org;
     const int         r = (int) stride_rec;
     const int16_t *o_m0 = pic_org    + offset_y * o + offset_x;
-    int16_t       *o_m1 = pic_org_m1 + offset_y * o + offset_x;
-    int16_t       *o_m2 = pic_org_m2 + offset_y * o + offset_x;
     const int16_t *r_m0 = pic_rec    + offset_y * r + offset_x;
-    const int     b_val = (s->plane_width[0] * s->plane_height[0] > 2048 * 1152 ? 2 : 1); /* threshold is a bit more than HD resolution */
-    const int     x_act = (offset_x > 0 ? 0 : b_val);
-    const int     y_act = (offset_y > 0 ? 0 : b_val);
-    const int     w_act = (offset_x + block_width  < (uint32_t) s->plane_width [0] ? (int) block_width  : (int) block_width  - b_val);
-    const int     h_act = (offset_y + block_height < (uint32_t) s->plane_height[0] ? (int) block_height : (int) block_height - b_val);
-
     const double sse = (double) calc_squared_error (s, o_m0, stride_org,
                                                     r_m0, stride_rec,
                                                     block_width, block_height);
-    uint64_t sa_act = 0;  /* spatial abs. activity */
-    uint64_t ta_act = 0; /* temporal abs. activity */
-
-    if (w_act <= x_act || h_act <= y_act) /* small */
-        return sse;
-
-    if (b_val > 1) { /* highpass with downsampling */
-        if (w_act > 12)
-            sa_act = s->dsp.highds_func(x_act, y_act, w_act, h_act, o_m0, o);
-        else
-            highds(x_act, y_act, w_act, h_act, o_m0, o);
-    } else { /* <=HD highpass without downsampling */
-        for (int y = y_act; y < h_act; y++) {
-            for (int x = x_act; x < w_act; x++) {
-                const int f = 12 * (int)o_m0[y*o + x] - 2 * ((int)o_m0[y*o + x-1] + (int)o_m0[y*o + x+1] + (int)o_m0[(y-1)*o + x] + (int)o_m0[(y+1)*o + x])
-                                 - ((int)o_m0[(y-1)*o + x-1] + (int)o_m0[(y-1)*o + x+1] + (int)o_m0[(y+1)*o + x-1] + (int)o_m0[(y+1)*o + x+1]);
-                sa_act += (uint64_t) abs(f);
-            }
-        }
-    }
 
-    /* calculate weight (average squared activity) */
-    *ms_act = (double) sa_act / ((double) (w_act - x_act) * (double) (h_act - y_act));
-
-    if (b_val > 1) { /* highpass with downsampling */
-        if (int_frame_rate < 32) /* 1st-order diff */
-            ta_act = s->dsp.diff1st_func(block_width, block_height, o_m0, o_m1, o);
-        else /* 2nd-order diff (diff of two diffs) */
-            ta_act = s->dsp.diff2nd_func(block_width, block_height, o_m0, o_m1, o_m2, o);
-    } else { /* <=HD highpass without downsampling */
-        if (int_frame_rate < 32) { /* 1st-order diff */
-            for (uint32_t y = 0; y < block_height; y++) {
-                for (uint32_t x = 0; x < block_width; x++) {
-                    const int t = (int)o_m0[y * o + x] - (int)o_m1[y * o + x];
-
-                    ta_act += XPSNR_GAMMA * (uint64_t) abs(t);
-                    o_m1[y * o + x] = o_m0[y * o + x];
-                }
-            }
-        } else { /* 2nd-order diff (diff of 2 diffs) */
-            for (uint32_t y = 0; y < block_height; y++) {
-                for (uint32_t x = 0; x < block_width; x++) {
-                    const int t = (int)o_m0[y * o + x] - 2 * (int)o_m1[y * o + x] + (int)o_m2[y * o + x];
-
-                    ta_act += XPSNR_GAMMA * (uint64_t) abs(t);
-                    o_m2[y * o + x] = o_m1[y * o + x];
-                    o_m1[y * o + x] = o_m0[y * o + x];
-                }
-            }
-        }
-    }
-
-    /* weight += mean squared temporal activity */
-    *ms_act += (double) ta_act / ((double) block_width * (double) block_height);
-
-    /* lower limit, accounts for high-pass gain */
-    if (*ms_act < (double) (1 << (bit_depth - 6)))
-        *ms_act = (double) (1 << (bit_depth - 6));
-
-    *ms_act *= *ms_act; /* since SSE is squared */
+    *ms_act = ff_xpsnr_block_weight(&s->dsp, o_m0,
+                                    pic_org_m1 + offset_y * o + offset_x,
+                                    pic_org_m2 + offset_y * o + offset_x, o,
+                                    offset_x, offset_y, block_width, block_height,
+                                    s->plane_width[0], s->plane_height[0],
+                                    bit_depth, int_frame_rate);
 
     /* return nonweighted sum of squared errors */
     return sse;
 }
 
-static inline double get_avg_xpsnr (const double sqrt_wsse_val,  const double sum_xpsnr_val,
-                                    const uint32_t image_width,  const uint32_t image_height,
-                                    const uint64_t max_error_64, const uint64_t num_frames_64)
+typedef struct ThreadData {
+    const AVFrame *master;
+    const AVFrame *ref;
+    int16_t **org;
+    int16_t *org_m1;
+    int16_t *org_m2;
+    int16_t **rec;
+} ThreadData;
+
+static int copy_planes(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    if (num_frames_64 == 0)
-        return INFINITY;
+    XPSNRContext *const s = ctx->priv;
+    const ThreadData *td = arg;
+
+    for (int c = 0; c < s->num_comps; c++) {
+        const int m = td->master->linesize[c]; /* master stride */
+        const int r = td->ref->linesize[c];    /* ref/c stride */
+        const int o = s->plane_width[c];      /* XPSNR stride */
+        const int slice_start = (s->plane_height[c] *  jobnr     ) / nb_jobs;
+        const int slice_end   = (s->plane_height[c] * (jobnr + 1)) / nb_jobs;
+
+        for (int y = slice_start; y < slice_end; y++) {
+            const uint8_t *src_org = td->master->data[c] + y * m;
+            const uint8_t *src_rec = td->ref->data[c] + y * r;
+            int16_t *dst_org = td->org[c] + y * o;
+            int16_t *dst_rec = td->rec[c] + y * o;
+
+            for (int x = 0; x < o; x++) {
+                dst_org[x] = (int16_t) src_org[x];
+                dst_rec[x] = (int16_t) src_rec[x];
+            }
+        }
+    }
+
+    return 0;
+}
 
-    if (sqrt_wsse_val >= (double) num_frames_64) { /* square-mean-root average */
-        const double avg_dist = sqrt_wsse_val / (double) num_frames_64;
-        const uint64_t  num64 = (uint64_t) image_width * (uint64_t) image_height * max_error_64;
+/* block SSEs and unsmoothed perceptual weights of a range of block rows */
+static int get_wsse_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    XPSNRContext *const  s = ctx->priv;
+    const ThreadData   *td = arg;
+    const int  *stride_org = (s->bpp == 1 ? s->plane_width : s->line_sizes);
 
-        return 10.0 * log10((double) num64 / ((double) avg_dist * (double) avg_dist));
+    for (int c = 0; c < s->num_comps; c++) {
+        const int16_t *p_org = td->org[c];
+        const uint32_t s_org = stride_org[c] / s->bpp;
+        const int16_t *p_rec = td->rec[c];
+        const uint32_t s_rec = s->plane_width[c];
+        const uint32_t w_pln = s->plane_width[c];
+        const uint32_t h_pln = s->plane_height[c];
+        const uint32_t    bx = (c ? s->blk_width_c  : s->blk_size);
+        const uint32_t    by = (c ? s->blk_height_c : s->blk_size);
+        const uint32_t w_blk = (c ? s->w_blk_c : s->w_blk);
+        const uint32_t h_blk = (c ? s->h_blk_c : s->h_blk);
+        const uint32_t start = (h_blk *  jobnr     ) / nb_jobs;
+        const uint32_t   end = (h_blk * (jobnr + 1)) / nb_jobs;
+        uint64_t *sse_chroma = (c ? s->sse_chroma + (c - 1) * w_blk * h_blk : NULL);
+        uint32_t     idx_blk = start * w_blk;
+
+        for (uint32_t y = start * by; y < end * by; y += by) {
+            const uint32_t block_height = (y + by > h_pln ? h_pln - y : by);
+
+            for (uint32_t x = 0; x < w_pln; x += bx, idx_blk++) {
+                const uint32_t block_width = (x + bx > w_pln ? w_pln - x : bx);
+
+                if (c == 0) {
+                    double ms_act = 1.0;
+
+                    s->sse_luma[idx_blk] = calc_squared_error_and_weight(s, p_org, s_org,
+                                                                         td->org_m1 /* pixel  */,
+                                                                         td->org_m2 /* memory */,
+                                                                         p_rec, s_rec,
+                                                                         x, y,
+                                                                         block_width, block_height,
+                                                                         s->depth, s->frame_rate, &ms_act);
+                    s->weights[idx_blk] = 1.0 / sqrt(ms_act);
+                } else {
+                    sse_chroma[idx_blk] = calc_squared_error(s, p_org + y * s_org + x, s_org,
+                                                             p_rec + y * s_rec + x, s_rec,
+                                                             block_width, block_height);
+                }
+            }
+        }
     }
 
-    return sum_xpsnr_val / (double) num_frames_64; /* older log-domain average */
+    return 0;
 }
 
-static int get_wsse(AVFilterContext *ctx, int16_t **org, int16_t *org_m1,
-                    int16_t *org_m2, int16_t **rec, uint64_t *const wsse64)
+static int get_wsse(AVFilterContext *ctx, ThreadData *td, uint64_t *const wsse64)
 {
     XPSNRContext *const  s = ctx->priv;
     const uint32_t       w = s->plane_width [0]; /* luma image width in pixels */
     const uint32_t       h = s->plane_height[0];/* luma image height in pixels */
     const double         r = (double)(w * h) / (3840.0 * 2160.0); /* UHD ratio */
-    const uint32_t       b = FFMAX(0, 4 * (int32_t) (32.0 * sqrt(r) +
-                                                     0.5)); /* block size, integer multiple of 4 for SIMD */
-    const uint32_t   w_blk = (w + b - 1) / b; /* luma width in units of blocks */
+    const uint32_t       b = s->blk_size;
+    const uint32_t   w_blk = s->w_blk; /* luma width in units of blocks */
     const double   avg_act = sqrt(16.0 * (double) (1 << (2 * s->depth - 9)) / sqrt(FFMAX(0.00001,
                                                                                    r))); /* the sqrt(a_pic) */
     const int  *stride_org = (s->bpp == 1 ? s->plane_width : s->line_sizes);
@@ -289,53 +248,19 @@ static int get_wsse(AVFilterContext *ctx, int16_t **org, int16_t *org_m1,
         av_log(ctx, AV_LOG_ERROR, "Error in XPSNR routine: invalid argument(s).\n");
         return AVERROR(EINVAL);
     }
-    if (!weights || (b >= 4 && !sse_luma)) {
+    if (!weights || (b >= 4 && (!sse_luma || (s->num_comps > 1 && !s->sse_chroma)))) {
         av_log(ctx, AV_LOG_ERROR, "Failed to allocate temporary block memory.\n");
         return AVERROR(ENOMEM);
     }
 
     if (b >= 4) {
-        const int16_t *p_org = org[0];
-        const uint32_t s_org = stride_org[0] / s->bpp;
-        const int16_t *p_rec = rec[0];
-        const uint32_t s_rec = s->plane_width[0];
-        double     wsse_luma = 0.0;
+        double wsse_luma = 0.0;
 
-        for (y = 0; y < h; y += b) { /* calculate block SSE and perceptual weights */
-            const uint32_t block_height = (y + b > h ? h - y : b);
+        /* calculate block SSE and perceptual weights */
+        ff_filter_execute(ctx, get_wsse_slice, td, NULL,
+                          FFMIN(s->h_blk, s->nb_threads));
 
-            for (x = 0; x < w; x += b, idx_blk++) {
-                const uint32_t block_width = (x + b > w ? w - x : b);
-                double ms_act = 1.0, ms_act_prev = 0.0;
-
-                sse_luma[idx_blk] = calc_squared_error_and_weight(s, p_org, s_org,
-                                                                  org_m1 /* pixel  */,
-                                                                  org_m2 /* memory */,
-                                                                  p_rec, s_rec,
-                                                                  x, y,
-                                                                  block_width, block_height,
-                                                                  s->depth, s->frame_rate, &ms_act);
-                weights[idx_blk] = 1.0 / sqrt(ms_act);
-
-                if (w * h <= 640 * 480) { /* in-line "min-smoothing" as in paper */
-                    if (x == 0) /* first column */
-                        ms_act_prev = (idx_blk > 1 ? weights[idx_blk - 2] : 0);
-                    else  /* after first column */
-                        ms_act_prev = (x > b ? FFMAX(weights[idx_blk - 2], weights[idx_blk]) : weights[idx_blk]);
-
-                    if (idx_blk > w_blk) /* after the first row and first column */
-                        ms_act_prev = FFMAX(ms_act_prev, weights[idx_blk - 1 - w_blk]); /* min (L, T) */
-                    if ((idx_blk > 0) && (weights[idx_blk - 1] > ms_act_prev))
-                        weights[idx_blk - 1] = ms_act_prev;
-
-                    if ((x + b >= w) && (y + b >= h) && (idx_blk > w_blk)) { /* last block in picture */
-                        ms_act_prev = FFMAX(weights[idx_blk - 1], weights[idx_blk - w_blk]);
-                        if (weights[idx_blk] > ms_act_prev)
-                            weights[idx_blk] = ms_act_prev;
-                    }
-                }
-            } /* for x */
-        } /* for y */
+        ff_xpsnr_smooth_weights(weights, w, h, b, w_blk);
 
         for (y = idx_blk = 0; y < h; y += b) { /* calculate sum for luma (Y) XPSNR */
             for (x = 0; x < w; x += b, idx_blk++) {
@@ -346,31 +271,20 @@ static int get_wsse(AVFilterContext *ctx, int16_t **org, int16_t *org_m1,
     } /* b >= 4 */
 
     for (c = 0; c < s->num_comps; c++) { /* finalize WSSE value for each component */
-        const int16_t *p_org = org[c];
-        const uint32_t s_org = stride_org[c] / s->bpp;
-        const int16_t *p_rec = rec[c];
-        const uint32_t s_rec = s->plane_width[c];
         const uint32_t w_pln = s->plane_width[c];
         const uint32_t h_pln = s->plane_height[c];
 
         if (b < 4) /* picture is too small for XPSNR, calculate nonweighted PSNR */
-            wsse64[c] = calc_squared_error (s, p_org, s_org,
-                                            p_rec, s_rec,
+            wsse64[c] = calc_squared_error (s, td->org[c], stride_org[c] / s->bpp,
+                                            td->rec[c], s->plane_width[c],
                                             w_pln, h_pln);
         else if (c > 0) { /* b >= 4 so Y XPSNR has already been calculated above */
-            const uint32_t  bx = (b * w_pln) / w;
-            const uint32_t  by = (b * h_pln) / h;  /* up to chroma downsampling by 4 */
+            const uint64_t *sse_chroma = s->sse_chroma + (c - 1) * s->w_blk_c * s->h_blk_c;
             double wsse_chroma = 0.0;
 
-            for (y = idx_blk = 0; y < h_pln; y += by) { /* calc chroma (Cb/Cr) XPSNR */
-                const uint32_t block_height = (y + by > h_pln ? h_pln - y : by);
-
-                for (x = 0; x < w_pln; x += bx, idx_blk++) {
-                    const uint32_t block_width = (x + bx > w_pln ? w_pln - x : bx);
-
-                    wsse_chroma += (double) calc_squared_error (s, p_org + y * s_org + x, s_org,
-                                                                p_rec + y * s_rec + x, s_rec,
-                                                                block_width, block_height) * weights[idx_blk];
+            for (y = idx_blk = 0; y < h_pln; y += s->blk_height_c) { /* calc chroma (Cb/Cr) XPSNR */
+                for (x = 0; x < w_pln; x += s->blk_width_c, idx_blk++) {
+                    wsse_chroma += (double) sse_chroma[idx_blk] * weights[idx_blk];
                 }
             }
             wsse64[c] = (wsse_chroma <= 0.0 ? 0 : (uint64_t) (wsse_chroma * avg_act + 0.5));
@@ -397,11 +311,8 @@ static int do_xpsnr(FFFrameSync *fs)
 {
     AVFilterContext  *ctx = fs->parent;
     XPSNRContext *const s = ctx->priv;
-    const uint32_t      w = s->plane_width [0];  /* luma image width in pixels */
-    const uint32_t      h = s->plane_height[0]; /* luma image height in pixels */
-    const uint32_t      b = FFMAX(0, 4 * (int32_t) (32.0 * sqrt((double) (w * h) / (3840.0 * 2160.0)) + 0.5)); /* block size */
-    const uint32_t  w_blk = (w + b - 1) / b;  /* luma width in units of blocks */
-    const uint32_t  h_blk = (h + b - 1) / b; /* luma height in units of blocks */
+    const uint32_t  w_blk = s->w_blk;  /* luma width in units of blocks */
+    const uint32_t  h_blk = s->h_blk; /* luma height in units of blocks */
     AVFrame *master, *ref = NULL;
     int16_t *porg   [3];
     int16_t *prec   [3];
@@ -409,6 +320,7 @@ static int do_xpsnr(FFFrameSync *fs)
     double cur_xpsnr[3] = {INFINITY, INFINITY, INFINITY};
     int c, ret_value, stride_org_bpp;
     AVDictionary **metadata;
+    ThreadData td;
 
     if ((ret_value = ff_framesync_dualinput_get(fs, &master, &ref)) < 0)
         return ret_value;
@@ -421,6 +333,8 @@ static int do_xpsnr(FFFrameSync *fs)
         s->sse_luma = av_malloc_array(w_blk * h_blk, sizeof(double));
     if (!s->weights)
         s->weights  = av_malloc_array(w_blk * h_blk, sizeof(double));
+    if (!s->sse_chroma && s->num_comps > 1)
+        s->sse_chroma = av_malloc_array(2 * s->w_blk_c * s->h_blk_c, sizeof(uint64_t));
 
     for (c = 0; c < s->num_comps; c++)  /* create temporal org buffer memory */
         s->line_sizes[c] = master->linesize[c];
@@ -431,28 +345,31 @@ static int do_xpsnr(FFFrameSync *fs)
         s->buf_org_m1 = av_calloc(s->plane_height[0], stride_org_bpp * sizeof(int16_t));
     if (!s->buf_org_m2)
         s->buf_org_m2 = av_calloc(s->plane_height[0], stride_org_bpp * sizeof(int16_t));
+    if (!s->buf_org_m1 || !s->buf_org_m2)
+        return AVERROR(ENOMEM);
+
+    td.master = master;
+    td.ref    = ref;
+    td.org    = porg;
+    td.rec    = prec;
+    td.org_m1 = s->buf_org_m1;
+    td.org_m2 = s->buf_org_m2;
 
     if (s->bpp == 1) { /* 8 bit */
         for (c = 0; c < s->num_comps; c++) { /* allocate org/rec buffer memory */
-            const int m = s->line_sizes[c];  /* master stride */
-            const int r = ref->linesize[c];  /* ref/c stride */
-            const int o = s->plane_width[c]; /* XPSNR stride */
-
             if (!s->buf_org[c])
                 s->buf_org[c] = av_calloc(s->plane_width[c], s->plane_height[c] * sizeof(int16_t));
             if (!s->buf_rec[c])
                 s->buf_rec[c] = av_calloc(s->plane_width[c], s->plane_height[c] * sizeof(int16_t));
+            if (!s->buf_org[c] || !s->buf_rec[c])
+                return AVERROR(ENOMEM);
 
             porg[c] = s->buf_org[c];
             prec[c] = s->buf_rec[c];
-
-            for (int y = 0; y < s->plane_height[c]; y++) {
-                for (int x = 0; x < s->plane_width[c]; x++) {
-                    porg[c][y * o + x] = (int16_t) master->data[c][y * m + x];
-                    prec[c][y * o + x] = (int16_t)    ref->data[c][y * r + x];
-                }
-            }
         }
+
+        ff_filter_execute(ctx, copy_planes, &td, NULL,
+                          FFMIN(s->plane_height[1], s->nb_threads));
     } else {  /* 10, 12, 14 bit */
         for (c = 0; c < s->num_comps; c++) {
             porg[c] = (int16_t *) master->data[c];
@@ -461,14 +378,14 @@ static int do_xpsnr(FFFrameSync *fs)
     }
 
     /* extended perceptually weighted peak signal-to-noise ratio (XPSNR) value */
-    ret_value = get_wsse(ctx, porg, s->buf_org_m1, s->buf_org_m2, prec, wsse64);
+    ret_value = get_wsse(ctx, &td, wsse64);
     if ( ret_value < 0 )
         return ret_value; /* an error here means something went wrong earlier! */
 
     for (c = 0; c < s->num_comps; c++) {
         const double sqrt_wsse = sqrt((double) wsse64[c]);
 
-        cur_xpsnr[c] = get_avg_xpsnr (sqrt_wsse, INFINITY,
+        cur_xpsnr[c] = ff_xpsnr_get_avg(sqrt_wsse, INFINITY,
                                       s->plane_width[c], s->plane_height[c],
                                       s->max_error_64, 1 /* single frame */);
         s->sum_wdist[c] += sqrt_wsse;
@@ -586,11 +503,22 @@ static int config_input_ref(AVFilterLink *inlink)
     s->plane_height[1] = s->plane_height[2] = AV_CEIL_RSHIFT(inlink->h, desc->log2_chroma_h);
     s->plane_height[0] = s->plane_height[3] = inlink->h;
 
+    /* block size, integer multiple of 4 for SIMD */
+    s->blk_size = FFMAX(0, 4 * (int32_t) (32.0 * sqrt((double) ((uint32_t) inlink->w * inlink->h) / (3840.0 * 2160.0)) + 0.5));
+    if (s->blk_size >= 4) {
+        s->w_blk = (s->plane_width [0] + s->blk_size - 1) / s->blk_size;
+        s->h_blk = (s->plane_height[0] + s->blk_size - 1) / s->blk_size;
+        /* chroma blocks cover the same area, up to chroma downsampling by 4 */
+        s->blk_width_c  = (s->blk_size * s->plane_width [1]) / s->plane_width [0];
+        s->blk_height_c = (s->blk_size * s->plane_height[1]) / s->plane_height[0];
+        s->w_blk_c = (s->plane_width [1] + s->blk_width_c  - 1) / s->blk_width_c;
+        s->h_blk_c = (s->plane_height[1] + s->blk_height_c - 1) / s->blk_height_c;
+    }
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+
     /* XPSNR always operates with 16-bit internal precision */
     ff_psnr_init(&s->pdsp, 15);
-    s->dsp.highds_func = highds; /* initialize filtering methods */
-    s->dsp.diff1st_func = diff1st;
-    s->dsp.diff2nd_func = diff2nd;
+    ff_xpsnr_init(&s->dsp); /* initialize filtering methods */
 
     return 0;
 }
@@ -640,7 +568,7 @@ static av_cold void uninit(AVFilterContext *ctx)
     int c;
 
     if (s->num_frames_64 > 0) { /* print out overall component-wise mean XPSNR */
-        const double xpsnr_luma = get_avg_xpsnr(s->sum_wdist[0],   s->sum_xpsnr[0],
+        const double xpsnr_luma = ff_xpsnr_get_avg(s->sum_wdist[0],   s->sum_xpsnr[0],
                                                 s->plane_width[0], s->plane_height[0],
                                                 s->max_error_64,   s->num_frames_64);
         double xpsnr_min = xpsnr_luma;
@@ -653,7 +581,7 @@ static av_cold void uninit(AVFilterContext *ctx)
         }
         /* chroma */
         for (c = 1; c < s->num_comps; c++) {
-            const double xpsnr_chroma = get_avg_xpsnr(s->sum_wdist[c],   s->sum_xpsnr[c],
+            const double xpsnr_chroma = ff_xpsnr_get_avg(s->sum_wdist[c],   s->sum_xpsnr[c],
                                                       s->plane_width[c], s->plane_height[c],
                                                       s->max_error_64,   s->num_frames_64);
             if (xpsnr_min > xpsnr_chroma)
@@ -682,6 +610,7 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     av_freep(&s->sse_luma);
     av_freep(&s->weights );
+    av_freep(&s->sse_chroma);
 
     av_freep(&s->buf_org_m1);
     av_freep(&s->buf_org_m2);
@@ -715,7 +644,8 @@ const FFFilter ff_vf_xpsnr = {
     .p.name       = "xpsnr",
     .p.description = NULL_IF_CONFIG_SMALL("Calculate the extended perceptually weighted peak signal-to-noise ratio (XPSNR) between two video streams."),
     .p.priv_class = &xpsnr_class,
-    .p.flags      = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL | AVFILTER_FLAG_METADATA_ONLY,
+    .p.flags      = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL | AVFILTER_FLAG_SLICE_THREADS |
+                    AVFILTER_FLAG_METADATA_ONLY,
     .preinit      = xpsnr_framesync_preinit,
     .init         = init,
     .uninit       = uninit,
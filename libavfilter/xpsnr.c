@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2024 Christian R. Helmrich
+ * Copyright (c) 2024 Christian Lehmann
+ * Copyright (c) 2024 Christian Stoffers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * XPSNR block activity kernels and weighting, shared by the xpsnr and
+ * qualitymetrics filters.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "libavutil/common.h"
+#include "xpsnr.h"
+
+#define XPSNR_GAMMA 2
+
+static uint64_t highds(const int x_act, const int y_act, const int w_act, const int h_act, const int16_t *o_m0, const int o)
+{
+    uint64_t sa_act = 0;
+
+    for (int y = y_act; y < h_act; y += 2) {
+        for (int x = x_act; x < w_act; x += 2) {
+            const int f = 12 * ((int)o_m0[ y   *o + x  ] + (int)o_m0[ y   *o + x+1] + (int)o_m0[(y+1)*o + x  ] + (int)o_m0[(y+1)*o + x+1])
+                         - 3 * ((int)o_m0[(y-1)*o + x  ] + (int)o_m0[(y-1)*o + x+1] + (int)o_m0[(y+2)*o + x  ] + (int)o_m0[(y+2)*o + x+1])
+                         - 3 * ((int)o_m0[ y   *o + x-1] + (int)o_m0[ y   *o + x+2] + (int)o_m0[(y+1)*o + x-1] + (int)o_m0[(y+1)*o + x+2])
+                         - 2 * ((int)o_m0[(y-1)*o + x-1] + (int)o_m0[(y-1)*o + x+2] + (int)o_m0[(y+2)*o + x-1] + (int)o_m0[(y+2)*o + x+2])
+                             - ((int)o_m0[(y-2)*o + x-1] + (int)o_m0[(y-2)*o + x  ] + (int)o_m0[(y-2)*o + x+1] + (int)o_m0[(y-2)*o + x+2]
+                              + (int)o_m0[(y+3)*o + x-1] + (int)o_m0[(y+3)*o + x  ] + (int)o_m0[(y+3)*o + x+1] + (int)o_m0[(y+3)*o + x+2]
+                              + (int)o_m0[(y-1)*o + x-2] + (int)o_m0[ y   *o + x-2] + (int)o_m0[(y+1)*o + x-2] + (int)o_m0[(y+2)*o + x-2]
+                              + (int)o_m0[(y-1)*o + x+3] + (int)o_m0[ y   *o + x+3] + (int)o_m0[(y+1)*o + x+3] + (int)o_m0[(y+2)*o + x+3]);
+            sa_act += (uint64_t) abs(f);
+        }
+    }
+    return sa_act;
+}
+
+static uint64_t diff1st(const uint32_t w_act, const uint32_t h_act, const int16_t *o_m0, int16_t *o_m1, const int o)
+{
+    uint64_t ta_act = 0;
+
+    for (uint32_t y = 0; y < h_act; y += 2) {
+        for (uint32_t x = 0; x < w_act; x += 2) {
+            const int t = (int)o_m0[y*o + x] + (int)o_m0[y*o + x+1] + (int)o_m0[(y+1)*o + x] + (int)o_m0[(y+1)*o + x+1]
+                       - ((int)o_m1[y*o + x] + (int)o_m1[y*o + x+1] + (int)o_m1[(y+1)*o + x] + (int)o_m1[(y+1)*o + x+1]);
+            ta_act += (uint64_t) abs(t);
+            o_m1[y*o + x  ] = o_m0[y*o + x  ];  o_m1[(y+1)*o + x  ] = o_m0[(y+1)*o + x  ];
+            o_m1[y*o + x+1] = o_m0[y*o + x+1];  o_m1[(y+1)*o + x+1] = o_m0[(y+1)*o + x+1];
+        }
+    }
+    return (ta_act * XPSNR_GAMMA);
+}
+
+static uint64_t diff2nd(const uint32_t w_act, const uint32_t h_act, const int16_t *o_m0, int16_t *o_m1, int16_t *o_m2, const int o)
+{
+    uint64_t ta_act = 0;
+
+    for (uint32_t y = 0; y < h_act; y += 2) {
+        for (uint32_t x = 0; x < w_act; x += 2) {
+            const int t = (int)o_m0[y*o + x] + (int)o_m0[y*o + x+1] + (int)o_m0[(y+1)*o + x] + (int)o_m0[(y+1)*o + x+1]
+                   - 2 * ((int)o_m1[y*o + x] + (int)o_m1[y*o + x+1] + (int)o_m1[(y+1)*o + x] + (int)o_m1[(y+1)*o + x+1])
+                        + (int)o_m2[y*o + x] + (int)o_m2[y*o + x+1] + (int)o_m2[(y+1)*o + x] + (int)o_m2[(y+1)*o + x+1];
+            ta_act += (uint64_t) abs(t);
+            o_m2[y*o + x  ] = o_m1[y*o + x  ];  o_m2[(y+1)*o + x  ] = o_m1[(y+1)*o + x  ];
+            o_m2[y*o + x+1] = o_m1[y*o + x+1];  o_m2[(y+1)*o + x+1] = o_m1[(y+1)*o + x+1];
+            o_m1[y*o + x  ] = o_m0[y*o + x  ];  o_m1[(y+1)*o + x  ] = o_m0[(y+1)*o + x  ];
+            o_m1[y*o + x+1] = o_m0[y*o + x+1];  o_m1[(y+1)*o + x+1] = o_m0[(y+1)*o + x+1];
+        }
+    }
+    return (ta_act * XPSNR_GAMMA);
+}
+
+double ff_xpsnr_block_weight(const XPSNRDSPContext *dsp,
+                             const int16_t *o_m0, int16_t *o_m1, int16_t *o_m2, const int o,
+                             const uint32_t offset_x,    const uint32_t offset_y,
+                             const uint32_t block_width, const uint32_t block_height,
+                             const uint32_t width,       const uint32_t height,
+                             const uint32_t bit_depth,   const uint32_t int_frame_rate)
+{
+    const int     b_val = (width * height > 2048 * 1152 ? 2 : 1); /* threshold is a bit more than HD resolution */
+    const int     x_act = (offset_x > 0 ? 0 : b_val);
+    const int     y_act = (offset_y > 0 ? 0 : b_val);
+    const int     w_act = (offset_x + block_width  < width  ? (int) block_width  : (int) block_width  - b_val);
+    const int     h_act = (offset_y + block_height < height ? (int) block_height : (int) block_height - b_val);
+    uint64_t sa_act = 0;  /* spatial abs. activity */
+    uint64_t ta_act = 0; /* temporal abs. activity */
+    double ms_act;
+
+    if (w_act <= x_act || h_act <= y_act) /* small */
+        return 1.0;
+
+    if (b_val > 1) { /* highpass with downsampling */
+        if (w_act > 12)
+            sa_act = dsp->highds_func(x_act, y_act, w_act, h_act, o_m0, o);
+        else
+            highds(x_act, y_act, w_act, h_act, o_m0, o);
+    } else { /* <=HD highpass without downsampling */
+        for (int y = y_act; y < h_act; y++) {
+            for (int x = x_act; x < w_act; x++) {
+                const int f = 12 * (int)o_m0[y*o + x] - 2 * ((int)o_m0[y*o + x-1] + (int)o_m0[y*o + x+1] + (int)o_m0[(y-1)*o + x] + (int)o_m0[(y+1)*o + x])
+                                 - ((int)o_m0[(y-1)*o + x-1] + (int)o_m0[(y-1)*o + x+1] + (int)o_m0[(y+1)*o + x-1] + (int)o_m0[(y+1)*o + x+1]);
+                sa_act += (uint64_t) abs(f);
+            }
+        }
+    }
+
+    /* calculate weight (average squared activity) */
+    ms_act = (double) sa_act / ((double) (w_act - x_act) * (double) (h_act - y_act));
+
+    if (b_val > 1) { /* highpass with downsampling */
+        if (int_frame_rate < 32) /* 1st-order diff */
+            ta_act = dsp->diff1st_func(block_width, block_height, o_m0, o_m1, o);
+        else /* 2nd-order diff (diff of two diffs) */
+            ta_act = dsp->diff2nd_func(block_width, block_height, o_m0, o_m1, o_m2, o);
+    } else { /* <=HD highpass without downsampling */
+        if (int_frame_rate < 32) { /* 1st-order diff */
+            for (uint32_t y = 0; y < block_height; y++) {
+                for (uint32_t x = 0; x < block_width; x++) {
+                    const int t = (int)o_m0[y * o + x] - (int)o_m1[y * o + x];
+
+                    ta_act += XPSNR_GAMMA * (uint64_t) abs(t);
+                    o_m1[y * o + x] = o_m0[y * o + x];
+                }
+            }
+        } else { /* 2nd-order diff (diff of 2 diffs) */
+            for (uint32_t y = 0; y < block_height; y++) {
+                for (uint32_t x = 0; x < block_width; x++) {
+                    const int t = (int)o_m0[y * o + x] - 2 * (int)o_m1[y * o + x] + (int)o_m2[y * o + x];
+
+                    ta_act += XPSNR_GAMMA * (uint64_t) abs(t);
+                    o_m2[y * o + x] = o_m1[y * o + x];
+                    o_m1[y * o + x] = o_m0[y * o + x];
+                }
+            }
+        }
+    }
+
+    /* weight += mean squared temporal activity */
+    ms_act += (double) ta_act / ((double) block_width * (double) block_height);
+
+    /* lower limit, accounts for high-pass gain */
+    if (ms_act < (double) (1 << (bit_depth - 6)))
+        ms_act = (double) (1 << (bit_depth - 6));
+
+    return ms_act * ms_act; /* since SSE is squared */
+}
+
+void ff_xpsnr_smooth_weights(double *weights, const uint32_t w, const uint32_t h,
+                             const uint32_t b, const uint32_t w_blk)
+{
+    uint32_t x, y, idx_blk;
+
+    if (w * h > 640 * 480)
+        return;
+
+    /* "min-smoothing" as in paper, in block order */
+    for (y = idx_blk = 0; y < h; y += b) {
+        for (x = 0; x < w; x += b, idx_blk++) {
+            double ms_act_prev;
+
+            if (x == 0) /* first column */
+                ms_act_prev = (idx_blk > 1 ? weights[idx_blk - 2] : 0);
+            else  /* after first column */
+                ms_act_prev = (x > b ? FFMAX(weights[idx_blk - 2], weights[idx_blk]) : weights[idx_blk]);
+
+            if (idx_blk > w_blk) /* after the first row and first column */
+                ms_act_prev = FFMAX(ms_act_prev, weights[idx_blk - 1 - w_blk]); /* min (L, T) */
+            if ((idx_blk > 0) && (weights[idx_blk - 1] > ms_act_prev))
+                weights[idx_blk - 1] = ms_act_prev;
+
+            if ((x + b >= w) && (y + b >= h) && (idx_blk > w_blk)) { /* last block in picture */
+                ms_act_prev = FFMAX(weights[idx_blk - 1], weights[idx_blk - w_blk]);
+                if (weights[idx_blk] > ms_act_prev)
+                    weights[idx_blk] = ms_act_prev;
+            }
+        } /* for x */
+    } /* for y */
+}
+
+double ff_xpsnr_get_avg(const double sqrt_wsse_val,  const double sum_xpsnr_val,
+                        const uint32_t image_width,  const uint32_t image_height,
+                        const uint64_t max_error_64, const uint64_t num_frames_64)
+{
+    if (num_frames_64 == 0)
+        return INFINITY;
+
+    if (sqrt_wsse_val >= (double) num_frames_64) { /* square-mean-root average */
+        const double avg_dist = sqrt_wsse_val / (double) num_frames_64;
+        const uint64_t  num64 = (uint64_t) image_width * (uint64_t) image_height * max_error_64;
+
+        return 10.0 * log10((double) num64 / ((double) avg_dist * (double) avg_dist));
+    }
+
+    return sum_xpsnr_val / (double) num_frames_64; /* older log-domain average */
+}
+
+void ff_xpsnr_init(XPSNRDSPContext *dsp)
+{
+    dsp->highds_func  = highds;
+    dsp->diff1st_func = diff1st;
+    dsp->diff2nd_func = diff2nd;
+}
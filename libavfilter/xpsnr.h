@@ -42,4 +42,28 @@ typedef struct XPSNRDSPContext {
     uint64_t (*diff2nd_func)(const uint32_t w_act, const uint32_t h_act, const int16_t *o_m0, int16_t *o_m1, int16_t *o_m2, const int o);
 } XPSNRDSPContext;
 
+void ff_xpsnr_init(XPSNRDSPContext *dsp);
+
+/**
+ * Compute the squared perceptual activity of a luma block and update the
+ * temporal memory o_m1 and o_m2 of the block with the original o_m0.
+ * All three pointers point to the top left of the block and use stride o.
+ */
+double ff_xpsnr_block_weight(const XPSNRDSPContext *dsp,
+                             const int16_t *o_m0, int16_t *o_m1, int16_t *o_m2, const int o,
+                             const uint32_t offset_x,    const uint32_t offset_y,
+                             const uint32_t block_width, const uint32_t block_height,
+                             const uint32_t width,       const uint32_t height,
+                             const uint32_t bit_depth,   const uint32_t int_frame_rate);
+
+/**
+ * Apply the min-smoothing of the block weights used for pictures up to 640x480.
+ */
+void ff_xpsnr_smooth_weights(double *weights, const uint32_t w, const uint32_t h,
+                             const uint32_t b, const uint32_t w_blk);
+
+double ff_xpsnr_get_avg(const double sqrt_wsse_val,  const double sum_xpsnr_val,
+                        const uint32_t image_width,  const uint32_t image_height,
+                        const uint64_t max_error_64, const uint64_t num_frames_64);
+
 #endif /* AVFILTER_XPSNR_H */
@@ -65,6 +65,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
     avcodec_free_context(&sti->avctx);
     av_bsf_free(&sti->bsfc);
     av_freep(&sti->index_entries);
+    ff_index_blocks_free(&sti->index_blocks);
     av_freep(&sti->probe_data.buf);
 
     av_bsf_free(&sti->extract_extradata.bsf);
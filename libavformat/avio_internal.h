@@ -214,6 +214,12 @@ unsigned long ff_crcA001_update(unsigned long checksum, const uint8_t *buf,
  */
 int ffio_open_dyn_packet_buf(AVIOContext **s, int max_packet_size);
 
+/**
+ * Return 1 if s was opened with avio_open_dyn_buf() or
+ * ffio_open_dyn_packet_buf(), 0 otherwise.
+ */
+int ffio_is_dyn_buf(const AVIOContext *s);
+
 /**
  * Return the URLContext associated with the AVIOContext
  *
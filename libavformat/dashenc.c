@@ -476,8 +476,10 @@ static void set_http_options(AVDictionary **options, DASHContext *c)
     av_dict_copy(options, c->http_opts, 0);
     if (c->user_agent)
         av_dict_set(options, "user_agent", c->user_agent, 0);
-    if (c->http_persistent)
+    if (c->http_persistent) {
         av_dict_set_int(options, "multiple_requests", 1, 0);
+        av_dict_set_int(options, "connection_pool", 1, 0);
+    }
     if (c->timeout >= 0)
         av_dict_set_int(options, "timeout", c->timeout, 0);
 }
@@ -1539,6 +1541,7 @@ static int dash_init(AVFormatContext *s)
         os->ctx = ctx = avformat_alloc_context();
         if (!ctx)
             return AVERROR(ENOMEM);
+        ffformatcontext(ctx)->nested = 1;
 
         ctx->oformat = av_guess_format(os->format_name, NULL, NULL);
         if (!ctx->oformat)
@@ -27,6 +27,7 @@
 #include "avformat.h"
 
 struct AVDeviceInfoList;
+struct FFIndexBlocks;
 
 /**
  * For an FFInputFormat with this flag set read_close() needs to be called
@@ -39,6 +40,13 @@ struct AVDeviceInfoList;
  */
 #define FF_INFMT_FLAG_PREFER_CODEC_FRAMERATE                   (1 << 1)
 
+/**
+ * The demuxer only accesses the index through the functions in seek.c,
+ * so the index built while demuxing can be kept in block-compressed form,
+ * see FFStream.index_blocks.
+ */
+#define FF_INFMT_FLAG_COMPACT_INDEX                            (1 << 2)
+
 typedef struct FFInputFormat {
     /**
      * The public AVInputFormat. See avformat.h for it.
@@ -245,6 +253,11 @@ void ff_configure_buffers_for_index(AVFormatContext *s, int64_t time_tolerance);
  */
 void ff_reduce_index(AVFormatContext *s, int stream_index);
 
+/**
+ * Free a block-compressed index and set the pointer to NULL.
+ */
+void ff_index_blocks_free(struct FFIndexBlocks **pib);
+
 /**
  * add frame for rfps calculation.
  *
@@ -83,6 +83,14 @@ typedef struct FifoContext {
     atomic_int_least64_t queue_duration;
     int64_t last_sent_dts;
     int64_t timeshift;
+
+    /* Statistics, logged by fifo_write_trailer(). Only nb_dropped
+     * is updated from both threads. */
+    int64_t nb_written;
+    atomic_int_least64_t nb_dropped;
+    int max_queued;
+    int64_t total_latency;
+    int64_t max_latency;
 } FifoContext;
 
 typedef struct FifoThreadContext {
@@ -118,6 +126,8 @@ typedef enum FifoMessageType {
 typedef struct FifoMessage {
     FifoMessageType type;
     AVPacket pkt;
+    /* av_gettime_relative() when the packet was queued */
+    int64_t queued_time;
 } FifoMessage;
 
 static int fifo_thread_write_header(FifoThreadContext *ctx)
@@ -177,11 +187,12 @@ static int64_t next_duration(AVFormatContext *avf, AVPacket *pkt, int64_t *last_
     return duration;
 }
 
-static int fifo_thread_write_packet(FifoThreadContext *ctx, AVPacket *pkt)
+static int fifo_thread_write_packet(FifoThreadContext *ctx, FifoMessage *msg)
 {
     AVFormatContext *avf = ctx->avf;
     FifoContext *fifo = avf->priv_data;
     AVFormatContext *avf2 = fifo->avf;
+    AVPacket *pkt = &msg->pkt;
     AVRational src_tb, dst_tb;
     int ret, s_idx;
     int64_t orig_pts, orig_dts, orig_duration;
@@ -195,6 +206,7 @@ static int fifo_thread_write_packet(FifoThreadContext *ctx, AVPacket *pkt)
             av_log(avf, AV_LOG_VERBOSE, "Keyframe received, recovering...\n");
         } else {
             av_log(avf, AV_LOG_VERBOSE, "Dropping non-keyframe packet\n");
+            atomic_fetch_add_explicit(&fifo->nb_dropped, 1, memory_order_relaxed);
             av_packet_unref(pkt);
             return 0;
         }
@@ -210,6 +222,10 @@ static int fifo_thread_write_packet(FifoThreadContext *ctx, AVPacket *pkt)
 
     ret = av_write_frame(avf2, pkt);
     if (ret >= 0) {
+        int64_t latency = av_gettime_relative() - msg->queued_time;
+        fifo->nb_written++;
+        fifo->total_latency += latency;
+        fifo->max_latency    = FFMAX(fifo->max_latency, latency);
         av_packet_unref(pkt);
     } else {
         // avoid scaling twice
@@ -254,7 +270,7 @@ static int fifo_thread_dispatch_message(FifoThreadContext *ctx, FifoMessage *msg
         av_assert0(ret >= 0);
         return ret;
     case FIFO_WRITE_PACKET:
-        return fifo_thread_write_packet(ctx, &msg->pkt);
+        return fifo_thread_write_packet(ctx, msg);
     case FIFO_FLUSH_OUTPUT:
         return fifo_thread_flush_output(ctx);
     }
@@ -411,8 +427,10 @@ static int fifo_thread_recover(FifoThreadContext *ctx, FifoMessage *msg, int err
     } while (ret == AVERROR(EAGAIN) && !fifo->drop_pkts_on_overflow);
 
     if (ret == AVERROR(EAGAIN) && fifo->drop_pkts_on_overflow) {
-        if (msg->type == FIFO_WRITE_PACKET)
+        if (msg->type == FIFO_WRITE_PACKET) {
+            atomic_fetch_add_explicit(&fifo->nb_dropped, 1, memory_order_relaxed);
             av_packet_unref(&msg->pkt);
+        }
         ret = 0;
     }
 
@@ -455,6 +473,9 @@ static void *fifo_consumer_thread(void *data)
          * set, the queue is flushed and flag cleared. */
         pthread_mutex_lock(&fifo->overflow_flag_lock);
         if (fifo->overflow_flag) {
+            atomic_fetch_add_explicit(&fifo->nb_dropped,
+                                      av_thread_message_queue_nb_elems(queue),
+                                      memory_order_relaxed);
             av_thread_message_flush(queue);
             if (fifo->restart_with_keyframe)
                 fifo_thread_ctx.drop_until_keyframe = 1;
@@ -526,6 +547,7 @@ static int fifo_init(AVFormatContext *avf)
         return AVERROR(EINVAL);
     }
     atomic_init(&fifo->queue_duration, 0);
+    atomic_init(&fifo->nb_dropped, 0);
     fifo->last_sent_dts = AV_NOPTS_VALUE;
 
 #ifdef FIFO_TEST
@@ -585,6 +607,7 @@ static int fifo_write_packet(AVFormatContext *avf, AVPacket *pkt)
         ret = av_packet_ref(&msg.pkt,pkt);
         if (ret < 0)
             return ret;
+        msg.queued_time = av_gettime_relative();
     }
 
     ret = av_thread_message_queue_send(fifo->queue, &msg,
@@ -603,11 +626,15 @@ static int fifo_write_packet(AVFormatContext *avf, AVPacket *pkt)
 
         if (overflow_set)
             av_log(avf, AV_LOG_WARNING, "FIFO queue full\n");
+        if (pkt)
+            atomic_fetch_add_explicit(&fifo->nb_dropped, 1, memory_order_relaxed);
         ret = 0;
         goto fail;
     } else if (ret < 0) {
         goto fail;
     }
+    fifo->max_queued = FFMAX(fifo->max_queued,
+                             av_thread_message_queue_nb_elems(fifo->queue));
 
     if (fifo->timeshift && pkt && pkt->dts != AV_NOPTS_VALUE)
         atomic_fetch_add_explicit(&fifo->queue_duration, next_duration(avf, pkt, &fifo->last_sent_dts), memory_order_relaxed);
@@ -654,6 +681,14 @@ static int fifo_write_trailer(AVFormatContext *avf)
         return AVERROR(ret);
     }
 
+    av_log(avf, AV_LOG_VERBOSE, "%s: %"PRId64" packets written, %"PRId64" dropped, "
+           "up to %d of %d queued, latency %"PRId64" us average, %"PRId64" us max\n",
+           avf->url, fifo->nb_written,
+           (int64_t)atomic_load_explicit(&fifo->nb_dropped, memory_order_relaxed),
+           fifo->max_queued, fifo->queue_size,
+           fifo->nb_written ? fifo->total_latency / fifo->nb_written : 0,
+           fifo->max_latency);
+
     ret = fifo->write_trailer_ret;
     return ret;
 }
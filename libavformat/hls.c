@@ -27,8 +27,11 @@
  * https://www.rfc-editor.org/rfc/rfc8216.txt
  */
 
+#include "config.h"
 #include "config_components.h"
 
+#include <stdatomic.h>
+
 #include "libavformat/http.h"
 #include "libavutil/aes.h"
 #include "libavutil/avstring.h"
@@ -38,6 +41,7 @@
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "libavutil/dict.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "avformat.h"
 #include "demux.h"
@@ -86,6 +90,43 @@ struct segment {
     struct segment *init_section;
 };
 
+enum PrefetchState {
+    PREFETCH_FREE,
+    PREFETCH_QUEUED,
+    PREFETCH_RUNNING,
+    PREFETCH_DONE,
+    PREFETCH_FAILED,
+};
+
+/*
+ * A segment downloaded ahead of the demuxer by the prefetch threads of
+ * its playlist. The request fields are a copy of the segment, as the
+ * playlist may be reloaded while the download runs.
+ */
+struct prefetch_slot {
+    enum PrefetchState state;
+    int64_t seq_no;
+    char *url;
+    int64_t url_offset;
+    int64_t size;
+    uint8_t *buf;
+    unsigned int buf_size;
+    unsigned int buf_allocated_size;
+};
+
+/*
+ * A prefetch thread, with the connection it keeps open for HTTP keepalive
+ * and its copy of the AVIO options, updated with the received cookies.
+ */
+struct prefetch_worker {
+    struct playlist *pls;
+#if HAVE_THREADS
+    pthread_t thread;
+#endif
+    AVIOContext *input;
+    AVDictionary *opts;
+};
+
 struct rendition;
 
 enum PlaylistType {
@@ -173,6 +214,23 @@ struct playlist {
      * playlist, if any. */
     int n_init_sections;
     struct segment **init_sections;
+
+    /* Segment prefetching. The slots are shared with the prefetch threads
+     * and protected by prefetch_lock. */
+    struct prefetch_slot *prefetch;
+    struct prefetch_worker *prefetch_workers;
+    int n_prefetch_workers;
+#if HAVE_THREADS
+    pthread_mutex_t prefetch_lock;
+    pthread_cond_t prefetch_cond;
+#endif
+    atomic_int prefetch_abort;
+    int64_t bytes_prefetched;
+    int64_t bytes_used;
+
+    /* Current segment, if it was taken from a prefetch slot */
+    uint8_t *seg_buf;
+    unsigned int seg_buf_size;
 };
 
 /*
@@ -229,10 +287,14 @@ typedef struct HLSContext {
     int http_multiple;
     int http_seekable;
     int seg_max_retry;
+    int prefetch_segments;
+    int prefetch_connections;
     AVIOContext *playlist_pb;
     HLSCryptoContext  crypto_ctx;
 } HLSContext;
 
+static void prefetch_stop(HLSContext *c, struct playlist *pls);
+
 static void free_segment_dynarray(struct segment **segments, int n_segments)
 {
     int i;
@@ -267,6 +329,7 @@ static void free_playlist_list(HLSContext *c)
     int i;
     for (i = 0; i < c->n_playlists; i++) {
         struct playlist *pls = c->playlists[i];
+        prefetch_stop(c, pls);
         free_segment_list(pls);
         free_init_section_list(pls);
         av_freep(&pls->main_streams);
@@ -645,13 +708,13 @@ static int open_url_keepalive(AVFormatContext *s, AVIOContext **pb,
 #endif
 }
 
-static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
-                    AVDictionary **opts, AVDictionary *opts2, int *is_http_out)
+/**
+ * Check that url uses one of the protocols and extensions hls may access.
+ */
+static int check_url(AVFormatContext *s, const char *url, int *is_http_out)
 {
     HLSContext *c = s->priv_data;
-    AVDictionary *tmp = NULL;
     const char *proto_name = NULL;
-    int ret;
     int is_http = 0;
 
     if (av_strstart(url, "crypto", NULL)) {
@@ -693,6 +756,21 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
     else if (strcmp(proto_name, "file") || !strncmp(url, "file,", 5))
         return AVERROR_INVALIDDATA;
 
+    *is_http_out = is_http;
+    return 0;
+}
+
+static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
+                    AVDictionary **opts, AVDictionary *opts2, int *is_http_out)
+{
+    HLSContext *c = s->priv_data;
+    AVDictionary *tmp = NULL;
+    int ret;
+    int is_http = 0;
+
+    if ((ret = check_url(s, url, &is_http)) < 0)
+        return ret;
+
     av_dict_copy(&tmp, *opts, 0);
     av_dict_copy(&tmp, opts2, 0);
 
@@ -1121,6 +1199,16 @@ static int read_from_url(struct playlist *pls, struct segment *seg,
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, seg->size - pls->cur_seg_offset);
 
+    if (pls->seg_buf) {
+        ret = FFMIN(buf_size, pls->seg_buf_size - pls->cur_seg_offset);
+        if (ret <= 0)
+            return AVERROR_EOF;
+        memcpy(buf, pls->seg_buf + pls->cur_seg_offset, ret);
+        pls->cur_seg_offset += ret;
+        pls->bytes_used     += ret;
+        return ret;
+    }
+
     ret = avio_read(pls->input, buf, buf_size);
     if (ret > 0)
         pls->cur_seg_offset += ret;
@@ -1412,6 +1500,347 @@ cleanup:
     return ret;
 }
 
+#if HAVE_THREADS
+static int prefetch_interrupt_cb(void *opaque)
+{
+    struct playlist *pls = opaque;
+    HLSContext *c = pls->parent->priv_data;
+
+    return atomic_load(&pls->prefetch_abort) ||
+           ff_check_interrupt(c->interrupt_callback);
+}
+
+/**
+ * Download the segment described by slot into slot->buf, reusing the
+ * connection of the worker's previous download if HTTP keepalive is
+ * possible. Called without holding the lock; the main thread does not
+ * touch a slot while it is PREFETCH_RUNNING.
+ */
+static int prefetch_fetch(struct prefetch_worker *w, struct prefetch_slot *slot)
+{
+    struct playlist *pls = w->pls;
+    AVFormatContext *s = pls->parent;
+    HLSContext *c = s->priv_data;
+    const AVIOInterruptCB cb = { prefetch_interrupt_cb, pls };
+    AVDictionary *opts = NULL;
+    char *new_cookies = NULL;
+    int is_http, ret;
+
+    if ((ret = check_url(s, slot->url, &is_http)) < 0)
+        return ret;
+
+    av_dict_copy(&opts, w->opts, 0);
+    if (c->http_persistent)
+        av_dict_set(&opts, "multiple_requests", "1", 0);
+    if (slot->size >= 0) {
+        av_dict_set_int(&opts, "offset", slot->url_offset, 0);
+        av_dict_set_int(&opts, "end_offset", slot->url_offset + slot->size, 0);
+    }
+
+    if (w->input && !(is_http && c->http_persistent))
+        avio_closep(&w->input);
+#if CONFIG_HTTP_PROTOCOL
+    if (w->input) {
+        AVDictionary *tmp = NULL;
+        av_dict_copy(&tmp, opts, 0);
+        w->input->eof_reached = 0;
+        ret = ff_http_do_new_request2(ffio_geturlcontext(w->input),
+                                      slot->url, &tmp);
+        av_dict_free(&tmp);
+        if (ret < 0)
+            avio_closep(&w->input);
+    }
+#endif
+    if (!w->input) {
+        av_log(s, AV_LOG_VERBOSE, "HLS prefetch of url '%s', offset %"PRId64", playlist %d\n",
+               slot->url, slot->url_offset, pls->index);
+        ret = ffio_open_whitelist(&w->input, slot->url, AVIO_FLAG_READ, &cb,
+                                  &opts, s->protocol_whitelist, s->protocol_blacklist);
+    }
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+
+    av_opt_get(w->input, "cookies", AV_OPT_SEARCH_CHILDREN, (uint8_t**)&new_cookies);
+    if (new_cookies)
+        av_dict_set(&w->opts, "cookies", new_cookies, AV_DICT_DONT_STRDUP_VAL);
+
+    if (!is_http && slot->url_offset &&
+        (ret = avio_seek(w->input, slot->url_offset, SEEK_SET)) < 0)
+        goto fail;
+
+    slot->buf_size = 0;
+    for (;;) {
+        int64_t len = INT_MAX - slot->buf_size;
+        uint8_t *buf;
+
+        if (slot->size >= 0)
+            len = FFMIN(len, slot->size - slot->buf_size);
+        len = FFMIN(len, 1 << 16);
+        if (len <= 0)
+            break;
+
+        buf = av_fast_realloc(slot->buf, &slot->buf_allocated_size,
+                              slot->buf_size + len);
+        if (!buf) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        slot->buf = buf;
+
+        ret = avio_read(w->input, slot->buf + slot->buf_size, len);
+        if (ret == AVERROR_EOF || !ret)
+            break;
+        if (ret < 0)
+            goto fail;
+        slot->buf_size += ret;
+    }
+
+    if (!is_http || !c->http_persistent)
+        avio_closep(&w->input);
+    return 0;
+fail:
+    avio_closep(&w->input);
+    return ret;
+}
+
+static void *prefetch_thread(void *arg)
+{
+    struct prefetch_worker *w = arg;
+    struct playlist *pls = w->pls;
+    HLSContext *c = pls->parent->priv_data;
+
+    pthread_mutex_lock(&pls->prefetch_lock);
+    while (!atomic_load(&pls->prefetch_abort)) {
+        struct prefetch_slot *slot = NULL;
+        int ret;
+
+        for (int i = 0; i < c->prefetch_segments; i++)
+            if (pls->prefetch[i].state == PREFETCH_QUEUED &&
+                (!slot || pls->prefetch[i].seq_no < slot->seq_no))
+                slot = &pls->prefetch[i];
+        if (!slot) {
+            pthread_cond_wait(&pls->prefetch_cond, &pls->prefetch_lock);
+            continue;
+        }
+
+        slot->state = PREFETCH_RUNNING;
+        pthread_mutex_unlock(&pls->prefetch_lock);
+
+        ret = prefetch_fetch(w, slot);
+        if (ret < 0 && ret != AVERROR_EXIT)
+            av_log(pls->parent, AV_LOG_WARNING, "Failed to prefetch segment %"PRId64" of playlist %d: %s\n",
+                   slot->seq_no, pls->index, av_err2str(ret));
+
+        pthread_mutex_lock(&pls->prefetch_lock);
+        slot->state = ret < 0 ? PREFETCH_FAILED : PREFETCH_DONE;
+        if (ret >= 0)
+            pls->bytes_prefetched += slot->buf_size;
+        pthread_cond_broadcast(&pls->prefetch_cond);
+    }
+    pthread_mutex_unlock(&pls->prefetch_lock);
+
+    return NULL;
+}
+
+static void prefetch_stop(HLSContext *c, struct playlist *pls)
+{
+    if (pls->prefetch) {
+        pthread_mutex_lock(&pls->prefetch_lock);
+        atomic_store(&pls->prefetch_abort, 1);
+        pthread_cond_broadcast(&pls->prefetch_cond);
+        pthread_mutex_unlock(&pls->prefetch_lock);
+        for (int i = 0; i < pls->n_prefetch_workers; i++) {
+            struct prefetch_worker *w = &pls->prefetch_workers[i];
+            pthread_join(w->thread, NULL);
+            avio_closep(&w->input);
+            av_dict_free(&w->opts);
+        }
+        pthread_cond_destroy(&pls->prefetch_cond);
+        pthread_mutex_destroy(&pls->prefetch_lock);
+        av_freep(&pls->prefetch_workers);
+        pls->n_prefetch_workers = 0;
+
+        for (int i = 0; i < c->prefetch_segments; i++) {
+            av_freep(&pls->prefetch[i].url);
+            av_freep(&pls->prefetch[i].buf);
+        }
+        av_freep(&pls->prefetch);
+
+        av_log(pls->parent, AV_LOG_VERBOSE,
+               "Playlist %d: %"PRId64" bytes prefetched, %"PRId64" bytes used\n",
+               pls->index, pls->bytes_prefetched, pls->bytes_used);
+    }
+    av_freep(&pls->seg_buf);
+}
+
+static int prefetch_start(HLSContext *c, struct playlist *pls)
+{
+    int nb_workers = FFMIN(c->prefetch_connections, c->prefetch_segments);
+    int ret;
+
+    pls->prefetch_workers = av_calloc(nb_workers, sizeof(*pls->prefetch_workers));
+    if (!pls->prefetch_workers)
+        return AVERROR(ENOMEM);
+    pls->prefetch = av_calloc(c->prefetch_segments, sizeof(*pls->prefetch));
+    if (!pls->prefetch) {
+        av_freep(&pls->prefetch_workers);
+        return AVERROR(ENOMEM);
+    }
+
+    if ((ret = pthread_mutex_init(&pls->prefetch_lock, NULL))) {
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    if ((ret = pthread_cond_init(&pls->prefetch_cond, NULL))) {
+        pthread_mutex_destroy(&pls->prefetch_lock);
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    atomic_init(&pls->prefetch_abort, 0);
+
+    for (int i = 0; i < nb_workers; i++) {
+        struct prefetch_worker *w = &pls->prefetch_workers[i];
+
+        w->pls = pls;
+        if ((ret = av_dict_copy(&w->opts, c->avio_opts, 0)) < 0 ||
+            (ret = AVERROR(pthread_create(&w->thread, NULL, prefetch_thread, w)))) {
+            av_dict_free(&w->opts);
+            prefetch_stop(c, pls);
+            return ret;
+        }
+        pls->n_prefetch_workers++;
+    }
+    return 0;
+fail:
+    av_freep(&pls->prefetch);
+    av_freep(&pls->prefetch_workers);
+    return ret;
+}
+
+static void prefetch_release(struct prefetch_slot *slot)
+{
+    av_freep(&slot->url);
+    av_freep(&slot->buf);
+    slot->buf_size           = 0;
+    slot->buf_allocated_size = 0;
+    slot->state              = PREFETCH_FREE;
+}
+
+/**
+ * Queue the segments following the current one for prefetching and
+ * release the slots outside of that window which are not being fetched.
+ */
+static int prefetch_schedule(HLSContext *c, struct playlist *pls)
+{
+    int ret = 0;
+
+    if (!pls->prefetch && (ret = prefetch_start(c, pls)) < 0)
+        return ret;
+
+    pthread_mutex_lock(&pls->prefetch_lock);
+    for (int i = 0; i < c->prefetch_segments; i++) {
+        struct prefetch_slot *slot = &pls->prefetch[i];
+        if (slot->state != PREFETCH_FREE && slot->state != PREFETCH_RUNNING &&
+            (slot->seq_no <= pls->cur_seq_no ||
+             slot->seq_no >  pls->cur_seq_no + c->prefetch_segments))
+            prefetch_release(slot);
+    }
+
+    for (int64_t seq_no = pls->cur_seq_no + 1;
+         seq_no <= pls->cur_seq_no + c->prefetch_segments; seq_no++) {
+        int64_t n = seq_no - pls->start_seq_no;
+        struct prefetch_slot *slot = NULL;
+        struct segment *seg;
+        int queued = 0;
+
+        if (n < 0 || n >= pls->n_segments)
+            break;
+        seg = pls->segments[n];
+        if (seg->key_type != KEY_NONE)
+            continue;
+
+        for (int i = 0; i < c->prefetch_segments; i++) {
+            if (pls->prefetch[i].state != PREFETCH_FREE &&
+                pls->prefetch[i].seq_no == seq_no)
+                queued = 1;
+            else if (pls->prefetch[i].state == PREFETCH_FREE && !slot)
+                slot = &pls->prefetch[i];
+        }
+        if (queued)
+            continue;
+        if (!slot)
+            break;
+
+        slot->url = av_strdup(seg->url);
+        if (!slot->url) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        slot->seq_no     = seq_no;
+        slot->url_offset = seg->url_offset;
+        slot->size       = seg->size;
+        slot->state      = PREFETCH_QUEUED;
+    }
+    pthread_cond_broadcast(&pls->prefetch_cond);
+    pthread_mutex_unlock(&pls->prefetch_lock);
+
+    return ret;
+}
+
+/**
+ * Take the current segment from its prefetch slot, waiting for the
+ * download to finish if it is still queued or running.
+ *
+ * @return 1 if pls->seg_buf now holds the segment, 0 if it has to be
+ *         opened normally
+ */
+static int prefetch_take(HLSContext *c, struct playlist *pls)
+{
+    struct prefetch_slot *slot = NULL;
+    int ret = 0;
+
+    if (!pls->prefetch)
+        return 0;
+
+    pthread_mutex_lock(&pls->prefetch_lock);
+    for (int i = 0; i < c->prefetch_segments; i++)
+        if (pls->prefetch[i].state != PREFETCH_FREE &&
+            pls->prefetch[i].seq_no == pls->cur_seq_no)
+            slot = &pls->prefetch[i];
+    if (slot) {
+        while (slot->state == PREFETCH_QUEUED || slot->state == PREFETCH_RUNNING)
+            pthread_cond_wait(&pls->prefetch_cond, &pls->prefetch_lock);
+        if (slot->state == PREFETCH_DONE) {
+            av_freep(&pls->seg_buf);
+            pls->seg_buf      = slot->buf;
+            pls->seg_buf_size = slot->buf_size;
+            slot->buf         = NULL;
+            ret = 1;
+        }
+        prefetch_release(slot);
+    }
+    pthread_mutex_unlock(&pls->prefetch_lock);
+
+    return ret;
+}
+
+#else
+static int prefetch_schedule(HLSContext *c, struct playlist *pls)
+{
+    return 0;
+}
+
+static int prefetch_take(HLSContext *c, struct playlist *pls)
+{
+    return 0;
+}
+
+static void prefetch_stop(HLSContext *c, struct playlist *pls)
+{
+}
+#endif
+
 static int update_init_section(struct playlist *pls, struct segment *seg)
 {
     static const int max_init_section_size = 1024*1024;
@@ -1536,7 +1965,7 @@ restart:
     if (!v->needed)
         return AVERROR_EOF;
 
-    if (!v->input || (c->http_persistent && v->input_read_done)) {
+    if (!v->seg_buf && (!v->input || (c->http_persistent && v->input_read_done))) {
         int64_t reload_interval;
 
         /* Check that the playlist is still needed before opening a new
@@ -1599,7 +2028,6 @@ reload:
             goto reload;
         }
 
-        v->input_read_done = 0;
         seg = current_segment(v);
 
         /* load/update Media Initialization Section, if any */
@@ -1607,12 +2035,17 @@ reload:
         if (ret)
             return ret;
 
-        if (c->http_multiple == 1 && v->input_next_requested) {
+        if (c->prefetch_segments && (ret = prefetch_take(c, v)) > 0) {
+            v->cur_seg_offset = 0;
+            ret = 0;
+        } else if (c->http_multiple == 1 && v->input_next_requested) {
             FFSWAP(AVIOContext *, v->input, v->input_next);
+            v->input_read_done = 0;
             v->cur_seg_offset = 0;
             v->input_next_requested = 0;
             ret = 0;
         } else {
+            v->input_read_done = 0;
             ret = open_input(c, v, seg, &v->input);
         }
         if (ret < 0) {
@@ -1634,9 +2067,12 @@ reload:
         }
         segment_retries = 0;
         just_opened = 1;
+
+        if (c->prefetch_segments && (ret = prefetch_schedule(c, v)) < 0)
+            return ret;
     }
 
-    if (c->http_multiple == -1) {
+    if (c->http_multiple == -1 && v->input) {
         uint8_t *http_version_opt = NULL;
         int r = av_opt_get(v->input, "http_version", AV_OPT_SEARCH_CHILDREN, &http_version_opt);
         if (r >= 0) {
@@ -1646,7 +2082,7 @@ reload:
     }
 
     seg = next_segment(v);
-    if (c->http_multiple == 1 && !v->input_next_requested &&
+    if (c->http_multiple == 1 && !c->prefetch_segments && !v->input_next_requested &&
         seg && seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         ret = open_input(c, v, seg, &v->input_next);
         if (ret < 0) {
@@ -1679,7 +2115,9 @@ reload:
 
         return ret;
     }
-    if (c->http_persistent &&
+    if (v->seg_buf) {
+        av_freep(&v->seg_buf);
+    } else if (c->http_persistent &&
         seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         v->input_read_done = 1;
     } else {
@@ -2134,6 +2572,7 @@ static int hls_read_header(AVFormatContext *s)
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next = NULL;
             pls->input_next_requested = 0;
+            av_freep(&pls->seg_buf);
             pls->cur_seg_offset = 0;
             pls->cur_init_section = NULL;
             /* Reset EOF flag */
@@ -2296,6 +2735,7 @@ static int recheck_discard_flags(AVFormatContext *s, int first)
             pls->input_read_done = 0;
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next_requested = 0;
+            av_freep(&pls->seg_buf);
             pls->needed = 0;
             changed = 1;
             av_log(s, AV_LOG_INFO, "No longer receiving playlist %d\n", i);
@@ -2552,6 +2992,7 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
         pls->input_read_done = 0;
         ff_format_io_close(pls->parent, &pls->input_next);
         pls->input_next_requested = 0;
+        av_freep(&pls->seg_buf);
         av_packet_unref(pls->pkt);
         pb->eof_reached = 0;
         /* Clear any buffered data */
@@ -2646,6 +3087,10 @@ static const AVOption hls_options[] = {
         OFFSET(seg_format_opts), AV_OPT_TYPE_DICT, {.str = NULL}, 0, 0, FLAGS},
     {"seg_max_retry", "Maximum number of times to reload a segment on error.",
      OFFSET(seg_max_retry), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, FLAGS},
+    {"prefetch_segments", "Number of upcoming segments to download into memory ahead of the demuxer",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, FLAGS},
+    {"prefetch_connections", "Maximum number of segments of a playlist prefetched in parallel",
+        OFFSET(prefetch_connections), AV_OPT_TYPE_INT, {.i64 = 2}, 1, 64, FLAGS},
     {NULL}
 };
 
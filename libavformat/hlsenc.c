@@ -340,8 +340,10 @@ static void set_http_options(AVFormatContext *s, AVDictionary **options, HLSCont
     }
     if (c->user_agent)
         av_dict_set(options, "user_agent", c->user_agent, 0);
-    if (c->http_persistent)
+    if (c->http_persistent) {
         av_dict_set_int(options, "multiple_requests", 1, 0);
+        av_dict_set_int(options, "connection_pool", 1, 0);
+    }
     if (c->timeout >= 0)
         av_dict_set_int(options, "timeout", c->timeout, 0);
     if (c->headers)
@@ -857,6 +859,7 @@ static int hls_mux_init(AVFormatContext *s, VariantStream *vs)
     if (ret < 0)
         return ret;
     oc = vs->avf;
+    ffformatcontext(oc)->nested = 1;
 
     oc->url                = av_strdup("");
     if (!oc->url)
@@ -36,6 +36,7 @@
 #include "libavutil/macros.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "libavutil/parseutils.h"
 
@@ -60,6 +61,7 @@
 #define HTTP_SINGLE   1
 #define HTTP_MUTLI    2
 #define MAX_DATE_LEN  19
+#define HTTP_POOL_SIZE 64
 #define WHITESPACES " \n\t\r"
 typedef enum {
     LOWER_PROTO,
@@ -145,6 +147,13 @@ typedef struct HTTPContext {
     unsigned int retry_after;
     int reconnect_max_retries;
     int reconnect_delay_total_max;
+    int connection_pool;
+    int pool_idle_timeout;
+    int pool_max_idle;
+    /* Pool bookkeeping of the lower connection, see HTTPPoolConn. */
+    struct HTTPPoolConn *pool_conn;
+    /* Set if s->hd was taken from the pool rather than freshly opened. */
+    int pool_reused;
 } HTTPContext;
 
 #define OFFSET(x) offsetof(HTTPContext, x)
@@ -190,6 +199,9 @@ static const AVOption options[] = {
     { "resource", "The resource requested by a client", OFFSET(resource), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, E },
     { "reply_code", "The http status code to return to a client", OFFSET(reply_code), AV_OPT_TYPE_INT, { .i64 = 200}, INT_MIN, 599, E},
     { "short_seek_size", "Threshold to favor readahead over seek.", OFFSET(short_seek_size), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, D },
+    { "connection_pool", "keep idle connections in a process-wide pool shared by all HTTP contexts", OFFSET(connection_pool), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, D | E },
+    { "pool_idle_timeout", "time in seconds an idle pooled connection is kept", OFFSET(pool_idle_timeout), AV_OPT_TYPE_INT, { .i64 = 15 }, 0, INT_MAX / 1000000, D | E },
+    { "pool_max_idle", "max number of idle pooled connections per host", OFFSET(pool_max_idle), AV_OPT_TYPE_INT, { .i64 = 4 }, 1, HTTP_POOL_SIZE, D | E },
     { NULL }
 };
 
@@ -197,7 +209,9 @@ static int http_connect(URLContext *h, const char *path, const char *local_path,
                         const char *hoststr, const char *auth,
                         const char *proxyauth);
 static int http_read_header(URLContext *h);
+static int http_buf_read(URLContext *h, uint8_t *buf, int size);
 static int http_shutdown(URLContext *h, int flags);
+static int http_finish_reply(URLContext *h);
 
 void ff_http_init_auth_state(URLContext *dest, const URLContext *src)
 {
@@ -209,6 +223,222 @@ void ff_http_init_auth_state(URLContext *dest, const URLContext *src)
            sizeof(HTTPAuthState));
 }
 
+/**
+ * A lower-level (tcp/tls) connection usable by the process-wide pool.
+ *
+ * The lower URLContext keeps a copy of the interrupt callback it was opened
+ * with, which would dangle once the owning context is gone. Pooled
+ * connections are therefore opened with http_pool_interrupt_cb(), which
+ * forwards to whichever HTTP context currently owns the connection.
+ */
+typedef struct HTTPPoolConn {
+    URLContext *hd;           ///< set only while the connection is idle in the pool
+    AVIOInterruptCB int_cb;   ///< interrupt callback of the current owner
+    char *key;                ///< lower protocol URL and the options it was opened with
+    int64_t expires;          ///< av_gettime_relative() after which the idle connection is dropped
+} HTTPPoolConn;
+
+static AVMutex pool_mutex = AV_MUTEX_INITIALIZER;
+static HTTPPoolConn *pool[HTTP_POOL_SIZE];
+static int pool_nb;
+
+static int http_pool_interrupt_cb(void *opaque)
+{
+    HTTPPoolConn *c = opaque;
+    return ff_check_interrupt(&c->int_cb);
+}
+
+static void http_pool_conn_free(HTTPPoolConn **pc)
+{
+    HTTPPoolConn *c = *pc;
+
+    if (!c)
+        return;
+    ffurl_closep(&c->hd);
+    av_freep(&c->key);
+    av_freep(pc);
+}
+
+/* Remove the idle connections which expired, returning them in dropped.
+ * Must be called with pool_mutex held. */
+static int http_pool_prune(int64_t now, HTTPPoolConn **dropped)
+{
+    int nb_dropped = 0, j = 0;
+
+    for (int i = 0; i < pool_nb; i++) {
+        if (pool[i]->expires <= now)
+            dropped[nb_dropped++] = pool[i];
+        else
+            pool[j++] = pool[i];
+    }
+    pool_nb = j;
+    return nb_dropped;
+}
+
+/* Take the most recently released idle connection matching key. */
+static HTTPPoolConn *http_pool_get(const char *key)
+{
+    HTTPPoolConn *dropped[HTTP_POOL_SIZE], *c = NULL;
+    int nb_dropped;
+
+    ff_mutex_lock(&pool_mutex);
+    nb_dropped = http_pool_prune(av_gettime_relative(), dropped);
+    for (int i = pool_nb - 1; i >= 0; i--) {
+        if (!strcmp(pool[i]->key, key)) {
+            c = pool[i];
+            memmove(&pool[i], &pool[i + 1], (pool_nb - i - 1) * sizeof(*pool));
+            pool_nb--;
+            break;
+        }
+    }
+    ff_mutex_unlock(&pool_mutex);
+
+    for (int i = 0; i < nb_dropped; i++)
+        http_pool_conn_free(&dropped[i]);
+    return c;
+}
+
+static void http_pool_put(URLContext *h)
+{
+    HTTPContext *s = h->priv_data;
+    HTTPPoolConn *dropped[HTTP_POOL_SIZE + 1], *c = s->pool_conn;
+    int64_t now = av_gettime_relative();
+    int nb_dropped, nb_host = 0, oldest_host = -1;
+
+    c->hd      = s->hd;
+    c->int_cb  = (AVIOInterruptCB){ NULL, NULL };
+    c->expires = now + s->pool_idle_timeout * 1000000LL;
+    s->hd        = NULL;
+    s->pool_conn = NULL;
+
+    ff_mutex_lock(&pool_mutex);
+    nb_dropped = http_pool_prune(now, dropped);
+    for (int i = 0; i < pool_nb; i++) {
+        if (!strcmp(pool[i]->key, c->key) && !nb_host++)
+            oldest_host = i;
+    }
+    /* Evict the least recently released connection, of the same host if
+     * that one is over its limit, so the newest ones stay available. */
+    if (nb_host >= s->pool_max_idle || pool_nb == HTTP_POOL_SIZE) {
+        int i = nb_host >= s->pool_max_idle ? oldest_host : 0;
+        dropped[nb_dropped++] = pool[i];
+        memmove(&pool[i], &pool[i + 1], (pool_nb - i - 1) * sizeof(*pool));
+        pool_nb--;
+    }
+    pool[pool_nb++] = c;
+    ff_mutex_unlock(&pool_mutex);
+
+    for (int i = 0; i < nb_dropped; i++)
+        http_pool_conn_free(&dropped[i]);
+}
+
+/* The options given to the lower protocol are part of the key, so that
+ * a connection is only reused with the settings it was opened with
+ * (e.g. TLS verification). Options consumed by HTTP itself are not. */
+static char *http_pool_key(HTTPContext *s, const char *url, AVDictionary *options)
+{
+    const AVDictionaryEntry *e = NULL;
+    AVBPrint bp;
+    char *key;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&bp, "%s", url);
+    while ((e = av_dict_iterate(options, e))) {
+        if (strcmp(e->key, "http_proxy") && av_opt_find(s, e->key, NULL, 0, 0))
+            continue;
+        av_bprintf(&bp, "|%s=%s", e->key, e->value);
+    }
+    if (av_bprint_finalize(&bp, &key) < 0)
+        return NULL;
+    return key;
+}
+
+/**
+ * Open the lower connection for url, taking an idle one from the pool if
+ * allowed and available.
+ */
+static int http_pool_open(URLContext *h, const char *lower_proto, const char *url,
+                          AVDictionary **options, int allow_reuse)
+{
+    HTTPContext *s = h->priv_data;
+    AVIOInterruptCB int_cb;
+    HTTPPoolConn *c;
+    char *key = http_pool_key(s, url, *options);
+
+    if (!key)
+        return AVERROR(ENOMEM);
+
+    if (allow_reuse &&
+        (!h->protocol_whitelist || av_match_list(lower_proto, h->protocol_whitelist, ',') > 0) &&
+        (!h->protocol_blacklist || av_match_list(lower_proto, h->protocol_blacklist, ',') <= 0)) {
+        while ((c = http_pool_get(key))) {
+            uint8_t probe;
+            int ret;
+
+            /* An idle connection must have nothing to read; EOF or stray
+             * data means the server closed it or it is out of sync. */
+            c->hd->flags |= AVIO_FLAG_NONBLOCK;
+            ret = ffurl_read(c->hd, &probe, 1);
+            c->hd->flags &= ~AVIO_FLAG_NONBLOCK;
+            if (ret != AVERROR(EAGAIN)) {
+                http_pool_conn_free(&c);
+                continue;
+            }
+
+            av_log(h, AV_LOG_DEBUG, "Reusing pooled connection to %s\n", url);
+            http_pool_conn_free(&s->pool_conn);
+            av_free(key);
+            c->int_cb    = h->interrupt_callback;
+            s->hd        = c->hd;
+            c->hd        = NULL;
+            s->pool_conn = c;
+            s->pool_reused = 1;
+            return 0;
+        }
+    }
+
+    if (!s->pool_conn) {
+        s->pool_conn = av_mallocz(sizeof(*s->pool_conn));
+        if (!s->pool_conn) {
+            av_free(key);
+            return AVERROR(ENOMEM);
+        }
+    }
+    av_free(s->pool_conn->key);
+    s->pool_conn->key    = key;
+    s->pool_conn->int_cb = h->interrupt_callback;
+    s->pool_reused = 0;
+
+    int_cb = (AVIOInterruptCB){ http_pool_interrupt_cb, s->pool_conn };
+    return ffurl_open_whitelist(&s->hd, url, AVIO_FLAG_READ_WRITE,
+                                &int_cb, options,
+                                h->protocol_whitelist, h->protocol_blacklist, h);
+}
+
+/**
+ * Check whether the connection is at a request boundary and may be handed
+ * to the pool, reading the reply to an upload if it is still pending.
+ */
+static int http_pool_reusable(URLContext *h)
+{
+    HTTPContext *s = h->priv_data;
+    uint64_t target_end;
+
+    if (!s->connection_pool || !s->pool_conn || s->listen)
+        return 0;
+    if ((h->flags & AVIO_FLAG_WRITE) && !s->end_header &&
+        http_finish_reply(h) < 0)
+        return 0;
+    if (s->willclose || s->buf_ptr != s->buf_end)
+        return 0;
+    if (s->chunksize != UINT64_MAX)
+        return s->chunkend;
+    if (s->http_code == 204 || s->http_code == 304)
+        return 1;
+    target_end = s->end_off ? s->end_off : s->filesize;
+    return s->filesize != UINT64_MAX && s->off >= target_end;
+}
+
 static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
 {
     const char *path, *proxy_path, *lower_proto = "tcp", *local_path;
@@ -219,6 +449,7 @@ static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
     char path1[MAX_URL_SIZE], sanitized_path[MAX_URL_SIZE + 1];
     char buf[1024], urlbuf[MAX_URL_SIZE];
     int port, use_proxy, err = 0;
+    uint64_t off;
     HTTPContext *s = h->priv_data;
 
     av_url_split(proto, sizeof(proto), auth, sizeof(auth),
@@ -274,16 +505,40 @@ static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
 
     ff_url_join(buf, sizeof(buf), lower_proto, NULL, hostname, port, NULL);
 
-    if (!s->hd) {
+    if (!s->hd && s->connection_pool) {
+        err = http_pool_open(h, lower_proto, buf, options, 1);
+    } else if (!s->hd) {
         err = ffurl_open_whitelist(&s->hd, buf, AVIO_FLAG_READ_WRITE,
                                    &h->interrupt_callback, options,
                                    h->protocol_whitelist, h->protocol_blacklist, h);
     }
+    if (err < 0)
+        goto end;
+
+    off = s->off;
+    err = http_connect(h, path, local_path, hoststr, auth, proxyauth);
+    if (s->pool_reused && (err == AVERROR_EOF || err == AVERROR(EPIPE) ||
+                           err == AVERROR(ECONNRESET))) {
+        /* The server may have dropped the idle connection just as it was
+         * taken from the pool, try once more with a fresh one. */
+        AVDictionary *opts = NULL;
+
+        av_log(h, AV_LOG_DEBUG, "Pooled connection failed, reconnecting\n");
+        ffurl_closep(&s->hd);
+        s->off = off;
+        err = av_dict_copy(&opts, s->chained_options, 0);
+        if (err >= 0 && s->http_proxy && !strcmp(lower_proto, "tls"))
+            err = av_dict_set(&opts, "http_proxy", s->http_proxy, 0);
+        if (err >= 0)
+            err = http_pool_open(h, lower_proto, buf, &opts, 0);
+        av_dict_free(&opts);
+        if (err >= 0)
+            err = http_connect(h, path, local_path, hoststr, auth, proxyauth);
+    }
 
 end:
     freeenv_utf8(env_http_proxy);
-    return err < 0 ? err : http_connect(
-        h, path, local_path, hoststr, auth, proxyauth);
+    return err;
 }
 
 static int http_should_reconnect(HTTPContext *s, int err)
@@ -1534,7 +1789,8 @@ static int http_connect(URLContext *h, const char *path, const char *local_path,
         av_bprintf(&request, "Expect: 100-continue\r\n");
 
     if (!has_header(s->headers, "\r\nConnection: "))
-        av_bprintf(&request, "Connection: %s\r\n", s->multiple_requests ? "keep-alive" : "close");
+        av_bprintf(&request, "Connection: %s\r\n",
+                   s->multiple_requests || s->connection_pool ? "keep-alive" : "close");
 
     if (!has_header(s->headers, "\r\nHost: "))
         av_bprintf(&request, "Host: %s\r\n", hoststr);
@@ -1639,7 +1895,7 @@ static int http_buf_read(URLContext *h, uint8_t *buf, int size)
                    "Chunked encoding data size: %"PRIu64"\n",
                     s->chunksize);
 
-            if (!s->chunksize && s->multiple_requests) {
+            if (!s->chunksize && (s->multiple_requests || s->connection_pool)) {
                 http_get_line(s, line, sizeof(line)); // read empty chunk
                 s->chunkend = 1;
                 return 0;
@@ -1922,8 +2178,12 @@ static int http_shutdown(URLContext *h, int flags)
         ((flags & AVIO_FLAG_READ) && s->chunked_post && s->listen)) {
         ret = ffurl_write(s->hd, footer, sizeof(footer) - 1);
         ret = ret > 0 ? 0 : ret;
-        /* flush the receive buffer when it is write only mode */
-        if (!(flags & AVIO_FLAG_READ)) {
+        if (!(flags & AVIO_FLAG_READ) && s->connection_pool) {
+            /* Read the reply, so the connection can carry another request. */
+            if (ret < 0 || http_finish_reply(h) < 0)
+                s->willclose = 1;
+        } else if (!(flags & AVIO_FLAG_READ)) {
+            /* flush the receive buffer when it is write only mode */
             char buf[1024];
             int read_ret;
             s->hd->flags |= AVIO_FLAG_NONBLOCK;
@@ -1940,6 +2200,31 @@ static int http_shutdown(URLContext *h, int flags)
     return ret;
 }
 
+/**
+ * Read the reply to an upload including its body, leaving the connection
+ * at a request boundary.
+ */
+static int http_finish_reply(URLContext *h)
+{
+    HTTPContext *s = h->priv_data;
+    uint8_t buf[1024];
+    int ret;
+
+    if (!s->end_header) {
+        s->off = 0;
+        if ((ret = http_read_header(h)) < 0)
+            return ret;
+    }
+    if (s->http_code == 204 || s->http_code == 304)
+        return 0;
+    /* A body delimited by the end of the connection cannot be skipped. */
+    if (s->chunksize == UINT64_MAX && s->filesize == UINT64_MAX)
+        return AVERROR(EINVAL);
+    while ((ret = http_buf_read(h, buf, sizeof(buf))) > 0)
+        ;
+    return ret == AVERROR_EOF ? 0 : ret;
+}
+
 static int http_close(URLContext *h)
 {
     int ret = 0;
@@ -1954,8 +2239,11 @@ static int http_close(URLContext *h)
         /* Close the write direction by sending the end of chunked encoding. */
         ret = http_shutdown(h, h->flags);
 
+    if (s->hd && ret >= 0 && http_pool_reusable(h))
+        http_pool_put(h);
     if (s->hd)
         ffurl_closep(&s->hd);
+    http_pool_conn_free(&s->pool_conn);
     av_dict_free(&s->chained_options);
     av_dict_free(&s->cookie_dict);
     av_dict_free(&s->redirect_cache);
@@ -1968,7 +2256,16 @@ static int64_t http_seek_internal(URLContext *h, int64_t off, int whence, int fo
 {
     HTTPContext *s = h->priv_data;
     URLContext *old_hd = s->hd;
+    struct HTTPPoolConn *old_pool_conn = s->pool_conn;
+    int old_pool_reused = s->pool_reused;
     uint64_t old_off = s->off;
+    uint64_t old_filesize      = s->filesize;
+    uint64_t old_chunksize     = s->chunksize;
+    uint64_t old_icy_data_read = s->icy_data_read;
+    int old_chunkend   = s->chunkend;
+    int old_willclose  = s->willclose;
+    int old_http_code  = s->http_code;
+    int old_end_header = s->end_header;
     uint8_t old_buf[BUFFER_SIZE];
     int old_buf_size, ret;
     AVDictionary *options = NULL;
@@ -2016,6 +2313,9 @@ static int64_t http_seek_internal(URLContext *h, int64_t off, int whence, int fo
     old_buf_size = s->buf_end - s->buf_ptr;
     memcpy(old_buf, s->buf_ptr, old_buf_size);
     s->hd = NULL;
+    /* the interrupt callback of a pooled old_hd refers to its HTTPPoolConn,
+     * which must stay valid until old_hd is closed */
+    s->pool_conn = NULL;
 
     /* if it fails, continue on old connection */
     if ((ret = http_open_cnx(h, &options)) < 0) {
@@ -2023,12 +2323,24 @@ static int64_t http_seek_internal(URLContext *h, int64_t off, int whence, int fo
         memcpy(s->buffer, old_buf, old_buf_size);
         s->buf_ptr = s->buffer;
         s->buf_end = s->buffer + old_buf_size;
-        s->hd      = old_hd;
-        s->off     = old_off;
+        http_pool_conn_free(&s->pool_conn);
+        s->hd          = old_hd;
+        s->pool_conn   = old_pool_conn;
+        s->pool_reused = old_pool_reused;
+        s->off         = old_off;
+        /* the failed request overwrote the state of the old response */
+        s->filesize      = old_filesize;
+        s->chunksize     = old_chunksize;
+        s->chunkend      = old_chunkend;
+        s->willclose     = old_willclose;
+        s->http_code     = old_http_code;
+        s->icy_data_read = old_icy_data_read;
+        s->end_header    = old_end_header;
         return ret;
     }
     av_dict_free(&options);
     ffurl_close(old_hd);
+    http_pool_conn_free(&old_pool_conn);
     return off;
 }
 
@@ -122,6 +122,12 @@ typedef struct FFFormatContext {
     AVDictionary *id3v2_meta;
 
     int missing_streams;
+
+    /**
+     * Set on the context of a muxer that is used by another muxer, which
+     * may close or replace its AVIOContext without writing the trailer.
+     */
+    int nested;
 } FFFormatContext;
 
 static av_always_inline FFFormatContext *ffformatcontext(AVFormatContext *s)
@@ -190,6 +196,12 @@ typedef struct FFStream {
     int nb_index_entries;
     unsigned int index_entries_allocated_size;
 
+    /**
+     * Block-compressed index, used instead of index_entries for demuxers
+     * with FF_INFMT_FLAG_COMPACT_INDEX. Only accessed through seek.c.
+     */
+    struct FFIndexBlocks *index_blocks;
+
     int64_t interleaver_chunk_size;
     int64_t interleaver_chunk_duration;
 
@@ -170,6 +170,47 @@ typedef struct MOVIndexRange {
     int64_t end;
 } MOVIndexRange;
 
+/**
+ * Checkpoint of a MOVSampleIndex cursor, kept every MOV_SAMPLE_INDEX_STEP
+ * stsc or tts entries so that seeking does not walk the tables linearly.
+ */
+typedef struct MOVSampleIndexPoint {
+    unsigned int sample;        ///< first sample of the entry
+    int64_t dts;                ///< dts of that sample, for tts entries
+} MOVSampleIndexPoint;
+
+#define MOV_SAMPLE_INDEX_STEP 64
+
+/**
+ * Sample index of a track resolved on demand from the sample tables
+ * (stsc/stco/stsz/stss and the run-length time-to-sample table) instead of
+ * being expanded into AVIndexEntry, see the lazy_index option.
+ * The cursor fields cache where the last lookup ended, so sequential and
+ * nearby accesses do not rescan the tables.
+ */
+typedef struct MOVSampleIndex {
+    int enabled;
+    unsigned int nb_samples;
+    int64_t start_dts;          ///< dts of the first sample
+    int key_off;                ///< offset between sample numbers and stss/stps entries
+
+    unsigned int stsc_index;    ///< stsc entry the cursor is in
+    unsigned int stsc_sample;   ///< first sample of that stsc entry
+    unsigned int tts_index;     ///< tts entry the cursor is in
+    unsigned int tts_sample;    ///< first sample of that tts entry
+    int64_t tts_dts;            ///< dts of the first sample of that tts entry
+    unsigned int chunk;         ///< chunk of the last resolved sample
+    unsigned int sample;        ///< last resolved sample
+    int64_t pos;                ///< position of the last resolved sample
+
+    MOVSampleIndexPoint *stsc_points; ///< checkpoint of every MOV_SAMPLE_INDEX_STEP-th stsc entry
+    unsigned int nb_stsc_points;
+    MOVSampleIndexPoint *tts_points;  ///< checkpoint of every MOV_SAMPLE_INDEX_STEP-th tts entry
+    unsigned int nb_tts_points;
+
+    AVIndexEntry entry;         ///< storage for the next sample to be read
+} MOVSampleIndex;
+
 typedef struct MOVStreamContext {
     AVIOContext *pb;
     int refcount;
@@ -214,6 +255,7 @@ typedef struct MOVStreamContext {
     int64_t current_index;
     MOVIndexRange* index_ranges;
     MOVIndexRange* current_index_range;
+    MOVSampleIndex lazy;
     unsigned int bytes_per_frame;
     unsigned int samples_per_frame;
     int dv_audio_container;
@@ -379,6 +421,7 @@ typedef struct MOVContext {
     int thmb_item_id;
     int64_t idat_offset;
     int interleaved_read;
+    int lazy_index;
 } MOVContext;
 
 int ff_mp4_read_descr_len(AVIOContext *pb);
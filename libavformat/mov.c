@@ -4059,16 +4059,470 @@ static int add_tts_entry(MOVTimeToSample **tts_data, unsigned int *tts_count, un
     return 0;
 }
 
+/**
+ * Build a run-length time-to-sample table from stts and ctts, equivalent to
+ * the per-sample one created by mov_merge_tts_data(). The last sample is kept
+ * in an entry of its own like in the per-sample table.
+ */
+static int mov_merge_tts_runs(const MOVStreamContext *sc, MOVTimeToSample **tts_data,
+                              unsigned int *tts_count, unsigned int *allocated_size)
+{
+    uint64_t stts_total = 0, ctts_total = 0;
+    unsigned int total, pos = 0, si = 0, ci = 0, s_used = 0, c_used = 0;
+
+    for (unsigned int i = 0; i < sc->stts_count; i++)
+        stts_total += sc->stts_data[i].count;
+    for (unsigned int i = 0; sc->ctts_data && i < sc->ctts_count; i++)
+        ctts_total += sc->ctts_data[i].count;
+    stts_total = FFMIN(stts_total, sc->sample_count);
+    ctts_total = FFMIN(ctts_total, sc->sample_count);
+    total      = FFMAX(stts_total, ctts_total);
+
+    while (pos < total) {
+        unsigned int count = total - pos, duration = 0;
+        int offset = 0;
+
+        if (pos < stts_total) {
+            while (s_used == sc->stts_data[si].count) {
+                si++;
+                s_used = 0;
+            }
+            duration = sc->stts_data[si].duration;
+            count    = FFMIN(count, sc->stts_data[si].count - s_used);
+        }
+        if (pos < ctts_total) {
+            while (c_used == sc->ctts_data[ci].count) {
+                ci++;
+                c_used = 0;
+            }
+            offset = sc->ctts_data[ci].offset;
+            count  = FFMIN(count, sc->ctts_data[ci].count - c_used);
+        }
+        if (pos + count == total && count > 1)
+            count--;
+
+        if (add_tts_entry(tts_data, tts_count, allocated_size, count, offset, duration) < 0)
+            return AVERROR(ENOMEM);
+
+        if (pos < stts_total)
+            s_used += count;
+        if (pos < ctts_total)
+            c_used += count;
+        pos += count;
+    }
+
+    return 0;
+}
+
+/* Check whether n is in the strictly increasing stss/stps style table list. */
+static int mov_sample_listed(const unsigned int *list, unsigned int count, unsigned int n)
+{
+    unsigned int lo = 0, hi = count;
+
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if (list[mid] < n)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < count && list[lo] == n;
+}
+
+/* Same decision as the keyframe logic in mov_build_index(). */
+static int mov_sample_index_keyframe(AVStream *st, unsigned int n)
+{
+    MOVStreamContext *sc = st->priv_data;
+    unsigned int key = n + sc->lazy.key_off;
+
+    if (!sc->keyframe_absent &&
+        (!sc->keyframe_count ||
+         mov_sample_listed((const unsigned int *)sc->keyframes, sc->keyframe_count, key)))
+        return 1;
+    if (sc->stps_count && mov_sample_listed(sc->stps_data, sc->stps_count, key))
+        return 1;
+    return sc->keyframe_absent && !sc->stps_count &&
+           (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO ||
+            (!n && sc->stsc_data[0].count));
+}
+
+/**
+ * @return the last of the nb_points checkpoints at or before sample n
+ */
+static const MOVSampleIndexPoint *mov_sample_index_find_point(const MOVSampleIndexPoint *points,
+                                                              unsigned int nb_points,
+                                                              unsigned int n)
+{
+    unsigned int lo = 0, hi = nb_points - 1;
+
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo + 1) / 2;
+        if (points[mid].sample <= n)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return &points[lo];
+}
+
+/**
+ * Resolve sample n of a lazily indexed track into e.
+ * @return e, or NULL if n is out of range
+ */
+static AVIndexEntry *mov_sample_index_get(AVStream *st, unsigned int n, AVIndexEntry *e)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVSampleIndex *si = &sc->lazy;
+    const MOVTimeToSample *tts;
+    unsigned int count, chunk, chunk_sample;
+    int64_t pos;
+
+    if (n >= si->nb_samples)
+        return NULL;
+
+    /* Move the cursors forward from where they are, or from the closest
+     * checkpoint if that is closer to n, so that at most
+     * MOV_SAMPLE_INDEX_STEP entries are walked. */
+    if (n < si->stsc_sample ||
+        n - si->stsc_sample >= mov_get_stsc_samples(sc, si->stsc_index)) {
+        const MOVSampleIndexPoint *p = mov_sample_index_find_point(si->stsc_points,
+                                                                   si->nb_stsc_points, n);
+        unsigned int index = (p - si->stsc_points) * MOV_SAMPLE_INDEX_STEP;
+
+        if (n < si->stsc_sample || index > si->stsc_index) {
+            si->stsc_index  = index;
+            si->stsc_sample = p->sample;
+        }
+        while (n - si->stsc_sample >= mov_get_stsc_samples(sc, si->stsc_index))
+            si->stsc_sample += mov_get_stsc_samples(sc, si->stsc_index++);
+    }
+
+    count        = sc->stsc_data[si->stsc_index].count;
+    chunk        = sc->stsc_data[si->stsc_index].first - 1 + (n - si->stsc_sample) / count;
+    chunk_sample = n - (n - si->stsc_sample) % count;
+
+    if (sc->stsz_sample_size) {
+        pos = sc->chunk_offsets[chunk] + (int64_t)(n - chunk_sample) * sc->stsz_sample_size;
+    } else {
+        unsigned int i = chunk_sample;
+
+        pos = sc->chunk_offsets[chunk];
+        if (chunk == si->chunk && si->sample <= n) {
+            i   = si->sample;
+            pos = si->pos;
+        } else if (chunk == si->chunk && si->sample - n < n - chunk_sample) {
+            /* stepping back, e.g. to the previous keyframe */
+            i   = si->sample;
+            pos = si->pos;
+            while (i > n)
+                pos -= sc->sample_sizes[--i];
+        }
+        for (; i < n; i++)
+            pos += sc->sample_sizes[i];
+    }
+    si->chunk  = chunk;
+    si->sample = n;
+    si->pos    = pos;
+
+    if (n < si->tts_sample ||
+        (si->tts_index + 1 < sc->tts_count &&
+         n - si->tts_sample >= sc->tts_data[si->tts_index].count)) {
+        const MOVSampleIndexPoint *p = mov_sample_index_find_point(si->tts_points,
+                                                                   si->nb_tts_points, n);
+        unsigned int index = (p - si->tts_points) * MOV_SAMPLE_INDEX_STEP;
+
+        if (n < si->tts_sample || index > si->tts_index) {
+            si->tts_index  = index;
+            si->tts_sample = p->sample;
+            si->tts_dts    = p->dts;
+        }
+        while (si->tts_index + 1 < sc->tts_count &&
+               n - si->tts_sample >= sc->tts_data[si->tts_index].count) {
+            tts = &sc->tts_data[si->tts_index++];
+            si->tts_sample += tts->count;
+            si->tts_dts    += tts->count * (int64_t)tts->duration;
+        }
+    }
+    tts = &sc->tts_data[si->tts_index];
+
+    e->pos          = pos;
+    e->timestamp    = si->tts_dts + (n - si->tts_sample) * (int64_t)tts->duration;
+    e->size         = sc->stsz_sample_size ? sc->stsz_sample_size : sc->sample_sizes[n];
+    e->min_distance = 0;
+    e->flags        = mov_sample_index_keyframe(st, n) ? AVINDEX_KEYFRAME : 0;
+    return e;
+}
+
+/**
+ * Set up on-demand sample lookup for a track instead of building its index.
+ * @return 0 on success, a negative value if the track has to be indexed
+ *         the regular way
+ */
+static int mov_sample_index_init(MOVContext *mov, AVStream *st, int64_t start_dts, int key_off)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVSampleIndex *si = &sc->lazy;
+    MOVTimeToSample *tts_data = NULL;
+    MOVSampleIndexPoint *stsc_points, *tts_points;
+    unsigned int tts_count = 0, tts_allocated_size = 0;
+    unsigned int stsz_sample_size = sc->stsz_sample_size;
+    uint64_t total = 0, stream_size = 0;
+    int64_t dts = start_dts;
+    AVIndexEntry e;
+
+    if ((st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO &&
+         st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO) ||
+        sc->iamf || sc->rap_group_count ||
+        !sc->stts_data || !sc->chunk_count || !sc->stsc_count ||
+        sc->stsc_data[0].first != 1 ||
+        sc->sample_count >= UINT_MAX / sizeof(AVIndexEntry) ||
+        (sc->sample_size > 0 && sc->sample_size < sc->stsz_sample_size))
+        return AVERROR(ENOSYS);
+
+    if (stsz_sample_size > 0 && stsz_sample_size < sc->sample_size)
+        stsz_sample_size = sc->sample_size;
+    if (stsz_sample_size > 0x3FFFFFFF || (!stsz_sample_size && !sc->sample_sizes))
+        return AVERROR(ENOSYS);
+
+    for (unsigned int i = 0; i < sc->stsc_count; i++) {
+        if ((i && sc->stsc_data[i].first <= sc->stsc_data[i - 1].first) ||
+            (sc->pseudo_stream_id != -1 && sc->stsc_data[i].id - 1 != sc->pseudo_stream_id))
+            return AVERROR(ENOSYS);
+        total += mov_get_stsc_samples(sc, i);
+    }
+    if (total != sc->sample_count)
+        return AVERROR(ENOSYS);
+
+    for (unsigned int i = 1; i < sc->keyframe_count; i++)
+        if ((unsigned)sc->keyframes[i] <= (unsigned)sc->keyframes[i - 1])
+            return AVERROR(ENOSYS);
+    for (unsigned int i = 1; i < sc->stps_count; i++)
+        if (sc->stps_data[i] <= sc->stps_data[i - 1])
+            return AVERROR(ENOSYS);
+
+    /* keeps every sample position representable, see mov_sample_index_get() */
+    for (unsigned int i = 0; i < sc->chunk_count; i++)
+        if (sc->chunk_offsets[i] > INT64_MAX >> 2)
+            return AVERROR(ENOSYS);
+
+    if (stsz_sample_size) {
+        stream_size = (uint64_t)stsz_sample_size * sc->sample_count;
+    } else {
+        for (unsigned int i = 0; i < sc->sample_count; i++) {
+            if (sc->sample_sizes[i] > 0x3FFFFFFF)
+                return AVERROR(ENOSYS);
+            stream_size += sc->sample_sizes[i];
+        }
+    }
+
+    if (mov_merge_tts_runs(sc, &tts_data, &tts_count, &tts_allocated_size) < 0 || !tts_count) {
+        av_free(tts_data);
+        return AVERROR(ENOSYS);
+    }
+
+    stsc_points = av_malloc_array((sc->stsc_count + MOV_SAMPLE_INDEX_STEP - 1) / MOV_SAMPLE_INDEX_STEP,
+                                  sizeof(*stsc_points));
+    tts_points  = av_malloc_array((tts_count + MOV_SAMPLE_INDEX_STEP - 1) / MOV_SAMPLE_INDEX_STEP,
+                                  sizeof(*tts_points));
+    if (!stsc_points || !tts_points) {
+        av_free(stsc_points);
+        av_free(tts_points);
+        av_free(tts_data);
+        return AVERROR(ENOMEM);
+    }
+    total = 0;
+    for (unsigned int i = 0; i < sc->stsc_count; i++) {
+        if (!(i % MOV_SAMPLE_INDEX_STEP)) {
+            stsc_points[i / MOV_SAMPLE_INDEX_STEP].sample = total;
+            stsc_points[i / MOV_SAMPLE_INDEX_STEP].dts    = 0;
+        }
+        total += mov_get_stsc_samples(sc, i);
+    }
+    total = 0;
+    for (unsigned int i = 0; i < tts_count; i++) {
+        if (!(i % MOV_SAMPLE_INDEX_STEP)) {
+            tts_points[i / MOV_SAMPLE_INDEX_STEP].sample = total;
+            tts_points[i / MOV_SAMPLE_INDEX_STEP].dts    = dts;
+        }
+        total += tts_data[i].count;
+        dts   += tts_data[i].count * (int64_t)tts_data[i].duration;
+    }
+
+    if (stsz_sample_size != sc->stsz_sample_size) {
+        av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too small), ignoring\n", sc->stsz_sample_size);
+        sc->stsz_sample_size = stsz_sample_size;
+    }
+
+    if (!sc->ctts_data)
+        sc->ctts_count = 0;
+    av_freep(&sc->ctts_data);
+    sc->ctts_allocated_size = 0;
+    av_freep(&sc->stts_data);
+    sc->stts_allocated_size = 0;
+    sc->tts_data           = tts_data;
+    sc->tts_count          = tts_count;
+    sc->tts_allocated_size = tts_allocated_size;
+
+    si->enabled     = 1;
+    si->nb_samples  = sc->sample_count;
+    si->start_dts   = start_dts;
+    si->key_off     = key_off;
+    si->stsc_index  = 0;
+    si->stsc_sample = 0;
+    si->tts_index   = 0;
+    si->tts_sample  = 0;
+    si->tts_dts     = start_dts;
+    si->chunk       = UINT_MAX;
+    si->stsc_points    = stsc_points;
+    si->nb_stsc_points = (sc->stsc_count + MOV_SAMPLE_INDEX_STEP - 1) / MOV_SAMPLE_INDEX_STEP;
+    si->tts_points     = tts_points;
+    si->nb_tts_points  = (tts_count + MOV_SAMPLE_INDEX_STEP - 1) / MOV_SAMPLE_INDEX_STEP;
+
+    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        for (unsigned int i = 0; i < FFMIN(si->nb_samples, 99); i++)
+            ff_rfps_add_frame(mov->fc, st, mov_sample_index_get(st, i, &e)->timestamp);
+
+    if (st->duration > 0)
+        st->codecpar->bit_rate = stream_size*8*sc->time_scale/st->duration;
+
+    return 0;
+}
+
+/**
+ * Replace the on-demand sample lookup of a track by a regular index, for
+ * code which edits the index in place (fragments).
+ */
+static int mov_sample_index_expand(AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    FFStream *const sti = ffstream(st);
+    MOVSampleIndex *si = &sc->lazy;
+    AVIndexEntry *entries;
+    MOVTimeToSample *tts_data;
+    unsigned int distance = 0, tts_count = 0;
+
+    if (!si->enabled)
+        return 0;
+
+    entries  = av_malloc_array(si->nb_samples, sizeof(*entries));
+    tts_data = av_calloc(si->nb_samples, sizeof(*tts_data));
+    if (!entries || !tts_data) {
+        av_free(entries);
+        av_free(tts_data);
+        return AVERROR(ENOMEM);
+    }
+
+    for (unsigned int i = 0; i < si->nb_samples; i++) {
+        AVIndexEntry *e = mov_sample_index_get(st, i, &entries[i]);
+        if (e->flags & AVINDEX_KEYFRAME)
+            distance = 0;
+        e->min_distance = distance++;
+    }
+    for (unsigned int i = 0; i < sc->tts_count; i++)
+        for (unsigned int j = 0; j < sc->tts_data[i].count; j++) {
+            tts_data[tts_count]       = sc->tts_data[i];
+            tts_data[tts_count].count = 1;
+            tts_count++;
+        }
+
+    av_free(sti->index_entries);
+    sti->index_entries                = entries;
+    sti->nb_index_entries             = si->nb_samples;
+    sti->index_entries_allocated_size = si->nb_samples * sizeof(*entries);
+
+    av_free(sc->tts_data);
+    sc->tts_data           = tts_data;
+    sc->tts_count          = tts_count;
+    sc->tts_allocated_size = si->nb_samples * sizeof(*tts_data);
+    sc->tts_index          = FFMIN(sc->current_sample, tts_count);
+    sc->tts_sample         = 0;
+
+    av_freep(&sc->chunk_offsets);
+    av_freep(&sc->sample_sizes);
+    av_freep(&sc->keyframes);
+    av_freep(&sc->stps_data);
+    av_freep(&si->stsc_points);
+    av_freep(&si->tts_points);
+    si->enabled = 0;
+
+    return 0;
+}
+
+/**
+ * Get sample number sample of a track, from the index or, for lazily
+ * indexed tracks, resolved into buf.
+ */
+static AVIndexEntry *mov_get_sample(AVStream *st, int sample, AVIndexEntry *buf)
+{
+    MOVStreamContext *sc = st->priv_data;
+    FFStream *const sti = ffstream(st);
+
+    if (sample < 0)
+        return NULL;
+    if (sc->lazy.enabled)
+        return mov_sample_index_get(st, sample, buf);
+    if (sample >= sti->nb_index_entries)
+        return NULL;
+    return &sti->index_entries[sample];
+}
+
+static int mov_get_nb_samples(AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    return sc->lazy.enabled ? sc->lazy.nb_samples : ffstream(st)->nb_index_entries;
+}
+
+/* av_index_search_timestamp() working on lazily indexed tracks as well. */
+static int mov_search_timestamp(AVStream *st, int64_t wanted_timestamp, int flags)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int nb = sc->lazy.nb_samples;
+    AVIndexEntry e;
+    int a, b, m;
+
+    if (!sc->lazy.enabled)
+        return av_index_search_timestamp(st, wanted_timestamp, flags);
+
+    a = -1;
+    b = nb;
+
+    if (b && mov_sample_index_get(st, b - 1, &e)->timestamp < wanted_timestamp)
+        a = b - 1;
+
+    while (b - a > 1) {
+        int64_t timestamp;
+
+        m         = (a + b) >> 1;
+        timestamp = mov_sample_index_get(st, m, &e)->timestamp;
+        if (timestamp >= wanted_timestamp)
+            b = m;
+        if (timestamp <= wanted_timestamp)
+            a = m;
+    }
+    m = (flags & AVSEEK_FLAG_BACKWARD) ? a : b;
+
+    if (!(flags & AVSEEK_FLAG_ANY))
+        while (m >= 0 && m < nb &&
+               !(mov_sample_index_get(st, m, &e)->flags & AVINDEX_KEYFRAME))
+            m += (flags & AVSEEK_FLAG_BACKWARD) ? -1 : 1;
+
+    if (m == nb)
+        return -1;
+    return m;
+}
+
 #define MAX_REORDER_DELAY 16
 static void mov_estimate_video_delay(MOVContext *c, AVStream* st)
 {
     MOVStreamContext *msc = st->priv_data;
-    FFStream *const sti = ffstream(st);
+    int nb_samples = mov_get_nb_samples(st);
     int ctts_ind = 0;
     int ctts_sample = 0;
     int64_t pts_buf[MAX_REORDER_DELAY + 1]; // Circular buffer to sort pts.
     int buf_start = 0;
     int j, r, num_swaps;
+    AVIndexEntry e;
 
     for (j = 0; j < MAX_REORDER_DELAY + 1; j++)
         pts_buf[j] = INT64_MIN;
@@ -4076,14 +4530,14 @@ static void mov_estimate_video_delay(MOVContext *c, AVStream* st)
     if (st->codecpar->video_delay <= 0 && msc->ctts_count &&
         st->codecpar->codec_id == AV_CODEC_ID_H264) {
         st->codecpar->video_delay = 0;
-        for (int ind = 0; ind < sti->nb_index_entries && ctts_ind < msc->tts_count; ++ind) {
+        for (int ind = 0; ind < nb_samples && ctts_ind < msc->tts_count; ++ind) {
             // Point j to the last elem of the buffer and insert the current pts there.
             j = buf_start;
             buf_start = (buf_start + 1);
             if (buf_start == MAX_REORDER_DELAY + 1)
                 buf_start = 0;
 
-            pts_buf[j] = sti->index_entries[ind].timestamp + msc->tts_data[ctts_ind].offset;
+            pts_buf[j] = mov_get_sample(st, ind, &e)->timestamp + msc->tts_data[ctts_ind].offset;
 
             // The timestamps that are already in the sorted buffer, and are greater than the
             // current pts, are exactly the timestamps that need to be buffered to output PTS
@@ -4695,6 +5149,12 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
 
         if (!sc->sample_count || sti->nb_index_entries || sc->tts_count)
             return;
+        if (mov->lazy_index) {
+            if (mov_sample_index_init(mov, st, current_dts, key_off) >= 0)
+                goto index_done;
+            av_log(mov->fc, AV_LOG_VERBOSE, "stream %d: sample tables not suited "
+                   "for lazy_index, building the full index\n", st->index);
+        }
         if (sc->sample_count >= UINT_MAX / sizeof(*sti->index_entries) - sti->nb_index_entries)
             return;
         if (av_reallocp_array(&sti->index_entries,
@@ -4912,9 +5372,11 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
         mov_fix_index(mov, st);
     }
 
+index_done:
     // Update start time of the stream.
-    if (st->start_time == AV_NOPTS_VALUE && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && sti->nb_index_entries > 0) {
-        st->start_time = sti->index_entries[0].timestamp + sc->dts_shift;
+    if (st->start_time == AV_NOPTS_VALUE && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && mov_get_nb_samples(st) > 0) {
+        AVIndexEntry e;
+        st->start_time = mov_get_sample(st, 0, &e)->timestamp + sc->dts_shift;
         if (sc->tts_data) {
             st->start_time += sc->tts_data[0].offset;
         }
@@ -5244,11 +5706,13 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         if (!stts_constant)
             ffstream(st)->need_parsing = AVSTREAM_PARSE_FULL;
     }
-    /* Do not need those anymore. */
-    av_freep(&sc->chunk_offsets);
-    av_freep(&sc->sample_sizes);
-    av_freep(&sc->keyframes);
-    av_freep(&sc->stps_data);
+    /* Do not need those anymore, unless samples are looked up on demand. */
+    if (!sc->lazy.enabled) {
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->sample_sizes);
+        av_freep(&sc->keyframes);
+        av_freep(&sc->stps_data);
+    }
     av_freep(&sc->elst_data);
     av_freep(&sc->rap_group);
     av_freep(&sc->sync_group);
@@ -5725,7 +6189,7 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     int64_t dts, pts = AV_NOPTS_VALUE;
     int data_offset = 0;
     unsigned entries, first_sample_flags = frag->flags;
-    int flags, distance, i;
+    int flags, distance, i, ret;
     int64_t prev_dts = AV_NOPTS_VALUE;
     int next_frag_index = -1, index_entry_pos;
     size_t requested_size;
@@ -5754,6 +6218,9 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     if (sc->pseudo_stream_id+1 != frag->stsd_id && sc->pseudo_stream_id != -1)
         return 0;
 
+    if ((ret = mov_sample_index_expand(st)) < 0)
+        return ret;
+
     // Find the next frag_index index that has a valid index_entry for
     // the current track_id.
     //
@@ -9568,9 +10035,9 @@ static void mov_read_chapters(AVFormatContext *s)
 
         if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
             st->disposition |= AV_DISPOSITION_ATTACHED_PIC | AV_DISPOSITION_TIMED_THUMBNAILS;
-            if (!st->attached_pic.data && sti->nb_index_entries) {
+            if (!st->attached_pic.data && mov_get_nb_samples(st)) {
                 // Retrieve the first frame, if possible
-                AVIndexEntry *sample = &sti->index_entries[0];
+                AVIndexEntry e, *sample = mov_get_sample(st, 0, &e);
                 if (avio_seek(sc->pb, sample->pos, SEEK_SET) != sample->pos) {
                     av_log(s, AV_LOG_ERROR, "Failed to retrieve first frame\n");
                     goto finish;
@@ -9746,6 +10213,8 @@ static void mov_free_stream_context(AVFormatContext *s, AVStream *st)
     }
 
     av_freep(&sc->tts_data);
+    av_freep(&sc->lazy.stsc_points);
+    av_freep(&sc->lazy.tts_points);
     for (int i = 0; i < sc->drefs_count; i++) {
         av_freep(&sc->drefs[i].path);
         av_freep(&sc->drefs[i].dir);
@@ -10466,6 +10935,9 @@ static int mov_read_header(AVFormatContext *s)
     mov->fc = s;
     mov->trak_index = -1;
     mov->thmb_item_id = -1;
+    /* Edit lists can only be applied by rewriting the index. */
+    if (mov->lazy_index)
+        mov->advanced_editlist = 0;
     mov->primary_item_id = -1;
     mov->cur_item_id = -1;
     /* .mov and .mp4 aren't streamable anyway (only progressive download if moov is before mdat) */
@@ -10693,10 +11165,9 @@ static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
     int no_interleave = !mov->interleaved_read || !(s->pb->seekable & AVIO_SEEKABLE_NORMAL);
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *avst = s->streams[i];
-        FFStream *const avsti = ffstream(avst);
         MOVStreamContext *msc = avst->priv_data;
-        if (msc->pb && msc->current_sample < avsti->nb_index_entries) {
-            AVIndexEntry *current_sample = &avsti->index_entries[msc->current_sample];
+        if (msc->pb && msc->current_sample < mov_get_nb_samples(avst)) {
+            AVIndexEntry *current_sample = mov_get_sample(avst, msc->current_sample, &msc->lazy.entry);
             int64_t dts = av_rescale(current_sample->timestamp, AV_TIME_BASE, msc->time_scale);
             uint64_t dtsdiff = best_dts > dts ? best_dts - (uint64_t)dts : ((uint64_t)dts - best_dts);
             av_log(s, AV_LOG_TRACE, "stream %d, sample %d, dts %"PRId64"\n", i, msc->current_sample, dts);
@@ -10866,8 +11337,9 @@ static int mov_finalize_packet(AVFormatContext *s, AVStream *st, AVIndexEntry *s
         pkt->pts = av_sat_add64(pkt->dts, av_sat_add64(sc->dts_shift, sc->tts_data[sc->tts_index].offset));
     } else {
         if (pkt->duration == 0) {
-            int64_t next_dts = (sc->current_sample < ffstream(st)->nb_index_entries) ?
-                ffstream(st)->index_entries[sc->current_sample].timestamp : st->duration;
+            AVIndexEntry e;
+            int64_t next_dts = (sc->current_sample < mov_get_nb_samples(st)) ?
+                mov_get_sample(st, sc->current_sample, &e)->timestamp : st->duration;
             if (next_dts >= pkt->dts)
                 pkt->duration = next_dts - pkt->dts;
         }
@@ -11116,8 +11588,8 @@ static int is_open_key_sample(const MOVStreamContext *sc, int sample)
 static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pts)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     int64_t key_sample_dts, key_sample_pts;
+    AVIndexEntry e;
 
     if (st->codecpar->codec_id != AV_CODEC_ID_HEVC)
         return 1;
@@ -11125,7 +11597,7 @@ static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pt
     if (sample >= sc->sample_offsets_count)
         return 1;
 
-    key_sample_dts = sti->index_entries[sample].timestamp;
+    key_sample_dts = mov_get_sample(st, sample, &e)->timestamp;
     key_sample_pts = key_sample_dts + sc->sample_offsets[sample] + sc->dts_shift;
 
     /*
@@ -11142,9 +11614,9 @@ static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pt
 static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp, int flags)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     int sample, time_sample, ret, next_ts, requested_sample;
     unsigned int i;
+    AVIndexEntry e;
 
     // Here we consider timestamp to be PTS, hence try to offset it so that we
     // can search over the DTS timeline.
@@ -11155,9 +11627,9 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
         return ret;
 
     for (;;) {
-        sample = av_index_search_timestamp(st, timestamp, flags);
+        sample = mov_search_timestamp(st, timestamp, flags);
         av_log(s, AV_LOG_TRACE, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
-        if (sample < 0 && sti->nb_index_entries && timestamp < sti->index_entries[0].timestamp)
+        if (sample < 0 && mov_get_nb_samples(st) && timestamp < mov_get_sample(st, 0, &e)->timestamp)
             sample = 0;
         if (sample < 0) /* not sure what to do */
             return AVERROR_INVALIDDATA;
@@ -11166,7 +11638,7 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
             break;
 
         next_ts = timestamp - FFMAX(sc->min_sample_duration, 1);
-        requested_sample = av_index_search_timestamp(st, next_ts, flags);
+        requested_sample = mov_search_timestamp(st, next_ts, flags);
 
         // If we've reached a different sample trying to find a good pts to
         // seek to, give up searching because we'll end up seeking back to
@@ -11182,7 +11654,15 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
     /* adjust time to sample index */
     if (sc->tts_data) {
         time_sample = 0;
-        for (i = 0; i < sc->tts_count; i++) {
+        i = 0;
+        if (sc->lazy.enabled) {
+            const MOVSampleIndexPoint *p = mov_sample_index_find_point(sc->lazy.tts_points,
+                                                                       sc->lazy.nb_tts_points,
+                                                                       sc->current_sample);
+            i           = (p - sc->lazy.tts_points) * MOV_SAMPLE_INDEX_STEP;
+            time_sample = p->sample;
+        }
+        for (; i < sc->tts_count; i++) {
             int next = time_sample + sc->tts_data[i].count;
             if (next > sc->current_sample) {
                 sc->tts_index = i;
@@ -11196,7 +11676,15 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
     /* adjust stsd index */
     if (sc->chunk_count) {
         time_sample = 0;
-        for (i = 0; i < sc->stsc_count; i++) {
+        i = 0;
+        if (sc->lazy.enabled) {
+            const MOVSampleIndexPoint *p = mov_sample_index_find_point(sc->lazy.stsc_points,
+                                                                       sc->lazy.nb_stsc_points,
+                                                                       sc->current_sample);
+            i           = (p - sc->lazy.stsc_points) * MOV_SAMPLE_INDEX_STEP;
+            time_sample = p->sample;
+        }
+        for (; i < sc->stsc_count; i++) {
             int64_t next = time_sample + mov_get_stsc_samples(sc, i);
             if (next > sc->current_sample) {
                 sc->stsc_index = i;
@@ -11214,9 +11702,9 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
 static int64_t mov_get_skip_samples(AVStream *st, int sample)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
-    int64_t first_ts = sti->index_entries[0].timestamp;
-    int64_t ts = sti->index_entries[sample].timestamp;
+    AVIndexEntry e;
+    int64_t first_ts = mov_get_sample(st, 0, &e)->timestamp;
+    int64_t ts = mov_get_sample(st, sample, &e)->timestamp;
     int64_t off;
 
     if (st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
@@ -11247,7 +11735,8 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
 
     if (mc->seek_individually) {
         /* adjust seek timestamp to found sample timestamp */
-        int64_t seek_timestamp = sti->index_entries[sample].timestamp;
+        AVIndexEntry e;
+        int64_t seek_timestamp = mov_get_sample(st, sample, &e)->timestamp;
         sti->skip_samples = mov_get_skip_samples(st, sample);
 
         for (i = 0; i < s->nb_streams; i++) {
@@ -11303,6 +11792,10 @@ static const AVOption mov_options[] = {
         0, 1, FLAGS},
     {"ignore_chapters", "", OFFSET(ignore_chapters), AV_OPT_TYPE_BOOL, {.i64 = 0},
         0, 1, FLAGS},
+    {"lazy_index",
+        "Look samples up in the sample tables on demand instead of building the full index. Implies advanced_editlist=0.",
+        OFFSET(lazy_index), AV_OPT_TYPE_BOOL, {.i64 = 0},
+        0, 1, FLAGS},
     {"use_mfra_for",
         "use mfra for fragment timestamps",
         OFFSET(use_mfra_for), AV_OPT_TYPE_INT, {.i64 = FF_MOV_FLAG_MFRA_AUTO},
@@ -65,6 +65,7 @@
 #include "rtpenc.h"
 #include "nal.h"
 #include "mov_chan.h"
+#include "movenc_async.h"
 #include "movenc_ttml.h"
 #include "mux.h"
 #include "rawutils.h"
@@ -74,6 +75,7 @@
 #include "vvc.h"
 
 static const AVOption options[] = {
+    { "async_fragments", "Write fragments from a background thread, allowing this many completed fragments to be queued (0 = write synchronously)", offsetof(MOVMuxContext, async_fragments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, AV_OPT_FLAG_ENCODING_PARAM},
     { "brand",    "Override major brand", offsetof(MOVMuxContext, major_brand),   AV_OPT_TYPE_STRING, {.str = NULL}, .flags = AV_OPT_FLAG_ENCODING_PARAM },
     { "empty_hdlr_name", "write zero-length name string in hdlr atoms within mdia and minf atoms", offsetof(MOVMuxContext, empty_hdlr_name), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, AV_OPT_FLAG_ENCODING_PARAM},
     { "encryption_key", "The media encryption key (hex)", offsetof(MOVMuxContext, encryption_key), AV_OPT_TYPE_BINARY, .flags = AV_OPT_FLAG_ENCODING_PARAM },
@@ -100,7 +102,8 @@ static const AVOption options[] = {
       { "frag_keyframe", "Fragment at video keyframes", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_FRAG_KEYFRAME}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "global_sidx", "Write a global sidx index at the start of the file", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_GLOBAL_SIDX}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "isml", "Create a live smooth streaming feed (for pushing to a publishing point)", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_ISML}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
-      { "moov_size", "maximum moov size so it can be placed at the begin", offsetof(MOVMuxContext, reserved_moov_size), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = 0 },
+      { "moov_size", "maximum moov size so it can be placed at the begin", offsetof(MOVMuxContext, reserved_moov_size), AV_OPT_TYPE_INT, {.i64 = 0}, MOV_MOOV_SIZE_AUTO, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "moov_size" },
+      { "auto", "estimate the moov size from the stream durations", 0, AV_OPT_TYPE_CONST, {.i64 = MOV_MOOV_SIZE_AUTO}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "moov_size" },
       { "negative_cts_offsets", "Use negative CTS offsets (reducing the need for edit lists)", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_NEGATIVE_CTS_OFFSETS}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "omit_tfhd_offset", "Omit the base data offset in tfhd atoms", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_OMIT_TFHD_OFFSET}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "prefer_icc", "If writing colr atom prioritise usage of ICC profile if it exists in stream packet side data", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_PREFER_ICC}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
@@ -6341,6 +6344,7 @@ static int mov_finish_fragment(MOVMuxContext *mov, MOVTrack *track,
 static int mov_flush_fragment(AVFormatContext *s, int force)
 {
     MOVMuxContext *mov = s->priv_data;
+    AVIOContext *pb = s->pb;
     int i, first_track = -1;
     int64_t mdat_size = 0, mdat_start = 0;
     int ret;
@@ -6491,7 +6495,13 @@ static int mov_flush_fragment(AVFormatContext *s, int force)
     if (!mdat_size)
         return 0;
 
-    avio_write_marker(s->pb,
+    /* With async_fragments, the fragment is written to a memory context
+     * and queued to the writer thread. */
+    if (mov->async &&
+        (ret = ff_mov_async_fragment_begin(mov->async, s->pb, &pb)) < 0)
+        return ret;
+
+    avio_write_marker(pb,
                       av_rescale(mov->tracks[first_track].cluster[0].dts, AV_TIME_BASE, mov->tracks[first_track].timescale),
                       (has_video ? starts_with_key : mov->tracks[first_track].cluster[0].flags & MOV_SYNC_SAMPLE) ? AVIO_DATA_MARKER_SYNC_POINT : AVIO_DATA_MARKER_BOUNDARY_POINT);
 
@@ -6510,14 +6520,14 @@ static int mov_flush_fragment(AVFormatContext *s, int force)
         }
 
         if (write_moof) {
-            avio_write_marker(s->pb, AV_NOPTS_VALUE, AVIO_DATA_MARKER_FLUSH_POINT);
+            avio_write_marker(pb, AV_NOPTS_VALUE, AVIO_DATA_MARKER_FLUSH_POINT);
 
-            mov_write_moof_tag(s->pb, mov, moof_tracks, mdat_size);
+            mov_write_moof_tag(pb, mov, moof_tracks, mdat_size);
             mov->fragments++;
 
-            avio_wb32(s->pb, mdat_size + 8);
-            ffio_wfourcc(s->pb, "mdat");
-            mdat_start = avio_tell(s->pb);
+            avio_wb32(pb, mdat_size + 8);
+            ffio_wfourcc(pb, "mdat");
+            mdat_start = avio_tell(pb);
         }
 
         mov_finish_fragment(mov, &mov->tracks[i], mdat_start);
@@ -6533,13 +6543,15 @@ static int mov_flush_fragment(AVFormatContext *s, int force)
             mov->mdat_buf = NULL;
         }
 
-        avio_write(s->pb, buf, buf_size);
+        avio_write(pb, buf, buf_size);
         av_free(buf);
     }
 
     mov->mdat_size = 0;
 
-    avio_write_marker(s->pb, AV_NOPTS_VALUE, AVIO_DATA_MARKER_FLUSH_POINT);
+    avio_write_marker(pb, AV_NOPTS_VALUE, AVIO_DATA_MARKER_FLUSH_POINT);
+    if (mov->async)
+        return ff_mov_async_fragment_end(mov->async, s->pb, &pb);
     return 0;
 }
 
@@ -7159,10 +7171,21 @@ static int mov_write_packet(AVFormatContext *s, AVPacket *pkt)
 
     if (!pkt) {
         mov_flush_fragment(s, 1);
+        /* The caller may close or replace the output after a flush. */
+        if (mov->async) {
+            int ret = ff_mov_async_drain(mov->async);
+            if (ret < 0)
+                return ret;
+        }
         return 1;
     }
 
     if (s->streams[pkt->stream_index]->codecpar->codec_id == AV_CODEC_ID_TIMED_ID3) {
+        if (mov->async) {
+            int ret = ff_mov_async_drain(mov->async);
+            if (ret < 0)
+                return ret;
+        }
         mov_write_emsg_tag(s->pb, s->streams[pkt->stream_index], pkt);
         return 0;
     }
@@ -7488,6 +7511,8 @@ static void mov_free(AVFormatContext *s)
 {
     MOVMuxContext *mov = s->priv_data;
 
+    ff_mov_async_stop(&mov->async);
+
     for (int i = 0; i < s->nb_streams; i++)
         s->streams[i]->priv_data = NULL;
 
@@ -7739,7 +7764,15 @@ static int mov_init(AVFormatContext *s)
         mov->flags &= ~FF_MOV_FLAG_SKIP_SIDX;
     }
 
-    if (mov->flags & FF_MOV_FLAG_FASTSTART) {
+    if (mov->reserved_moov_size == MOV_MOOV_SIZE_AUTO &&
+        !(mov->flags & FF_MOV_FLAG_FASTSTART)) {
+        av_log(s, AV_LOG_WARNING, "moov_size auto requires faststart, ignoring\n");
+        mov->reserved_moov_size = 0;
+    }
+
+    /* With faststart, a reserved moov size is used as long as the moov
+     * fits, and the data is only shifted by the missing amount otherwise. */
+    if (mov->flags & FF_MOV_FLAG_FASTSTART && !mov->reserved_moov_size) {
         mov->reserved_moov_size = -1;
     }
 
@@ -7778,6 +7811,17 @@ static int mov_init(AVFormatContext *s)
         return AVERROR(EINVAL);
     }
 
+    if (mov->async_fragments && !(mov->flags & FF_MOV_FLAG_FRAGMENT)) {
+        av_log(s, AV_LOG_WARNING, "async_fragments requires fragmented output, ignoring\n");
+        mov->async_fragments = 0;
+    }
+    if (mov->async_fragments &&
+        (ffformatcontext(s)->nested || (s->pb && ffio_is_dyn_buf(s->pb)))) {
+        av_log(s, AV_LOG_ERROR, "async_fragments is not supported when writing "
+               "to a dynamic buffer or within another muxer\n");
+        return AVERROR(EINVAL);
+    }
+
     /* Non-seekable output is ok if using fragmentation. If ism_lookahead
      * is enabled, we don't support non-seekable output at all. */
     if (!(s->pb->seekable & AVIO_SEEKABLE_NORMAL) &&
@@ -8146,12 +8190,62 @@ static int mov_init(AVFormatContext *s)
     return 0;
 }
 
+/*
+ * Estimate the moov size from the stream durations, generously enough
+ * for any sample table layout. Returns 0 if a duration is unknown.
+ */
+static int estimate_moov_size(AVFormatContext *s)
+{
+    MOVMuxContext *mov = s->priv_data;
+    double size = 4096;
+
+    for (int i = 0; i < mov->nb_streams; i++) {
+        const AVStream *st = mov->tracks[i].st;
+        const AVCodecParameters *par = st->codecpar;
+        int64_t duration = s->duration;
+        double rate;
+        int sample_size;
+
+        if (st->duration > 0)
+            duration = av_rescale_q(st->duration, st->time_base, AV_TIME_BASE_Q);
+        if (duration <= 0)
+            return 0;
+
+        switch (par->codec_type) {
+        case AVMEDIA_TYPE_VIDEO:
+            /* stsz, stts and ctts entries for every frame */
+            rate = st->avg_frame_rate.num > 0 && st->avg_frame_rate.den > 0 ?
+                   av_q2d(st->avg_frame_rate) : 60;
+            sample_size = 20;
+            break;
+        case AVMEDIA_TYPE_AUDIO:
+            rate = par->sample_rate / (double)(par->frame_size > 0 ? par->frame_size : 1024);
+            sample_size = 8;
+            break;
+        default:
+            rate = 10;
+            sample_size = 12;
+            break;
+        }
+        size += 1024 + duration / (double)AV_TIME_BASE * FFMAX(rate, 1) * sample_size;
+    }
+
+    size *= 1.125;
+    return size < INT_MAX ? (int)size : INT_MAX;
+}
+
 static int mov_write_header(AVFormatContext *s)
 {
     AVIOContext *pb = s->pb;
     MOVMuxContext *mov = s->priv_data;
     int ret, hint_track = 0, tmcd_track = 0, nb_tracks = mov->nb_streams;
 
+    if (mov->async_fragments &&
+        (ret = ff_mov_async_start(&mov->async, mov->async_fragments)) < 0) {
+        av_log(s, AV_LOG_ERROR, "Could not start the fragment writer thread\n");
+        return ret;
+    }
+
     if (mov->mode & (MODE_MP4|MODE_MOV|MODE_IPOD) && s->nb_chapters)
         nb_tracks++;
 
@@ -8226,6 +8320,13 @@ static int mov_write_header(AVFormatContext *s)
             return ret;
     }
 
+    if (mov->reserved_moov_size == MOV_MOOV_SIZE_AUTO) {
+        int size = estimate_moov_size(s);
+        if (size > 0)
+            av_log(s, AV_LOG_VERBOSE, "Reserving %d bytes for the moov atom\n", size);
+        mov->reserved_moov_size = size > 0 ? size : -1;
+    }
+
     if (mov->reserved_moov_size){
         mov->reserved_header_pos = avio_tell(pb);
         if (mov->reserved_moov_size > 0)
@@ -8245,7 +8346,7 @@ static int mov_write_header(AVFormatContext *s)
             mov->mdat_pos = avio_tell(pb);
         }
     } else if (mov->mode != MODE_AVIF) {
-        if (mov->flags & FF_MOV_FLAG_FASTSTART)
+        if (mov->flags & FF_MOV_FLAG_FASTSTART && mov->reserved_moov_size < 0)
             mov->reserved_header_pos = avio_tell(pb);
         mov_write_mdat_tag(pb, mov);
     }
@@ -8364,6 +8465,34 @@ static int compute_moov_size(AVFormatContext *s)
     return moov_size2;
 }
 
+/*
+ * Compute by how much the data following a reserved moov space has to be
+ * shifted for the moov to fit, 0 if it fits. The chunk offset tables are
+ * updated for the shift.
+ */
+static int compute_moov_shift(AVFormatContext *s)
+{
+    MOVMuxContext *mov = s->priv_data;
+    int shift = 0;
+
+    /* Loops at most twice more, if the shift switches stco to co64. */
+    for (;;) {
+        int moov_size = get_moov_size(s), avail, extra;
+        if (moov_size < 0)
+            return moov_size;
+
+        /* Any remaining space needs room for a free atom. */
+        avail = mov->reserved_moov_size + shift;
+        if (moov_size == avail || moov_size + 8 <= avail)
+            return shift;
+        extra = moov_size < avail ? moov_size + 8 - avail : moov_size - avail;
+
+        for (int i = 0; i < mov->nb_tracks; i++)
+            mov->tracks[i].data_offset += extra;
+        shift += extra;
+    }
+}
+
 static int compute_sidx_size(AVFormatContext *s)
 {
     int i, sidx_size;
@@ -8402,6 +8531,9 @@ static int mov_write_trailer(AVFormatContext *s)
     int i;
     int64_t moov_pos;
 
+    if ((res = ff_mov_async_stop(&mov->async)) < 0)
+        return res;
+
     if (mov->need_rewrite_extradata) {
         for (i = 0; i < mov->nb_streams; i++) {
             MOVTrack *track = &mov->tracks[i];
@@ -8486,7 +8618,25 @@ static int mov_write_trailer(AVFormatContext *s)
         }
         avio_seek(pb, mov->reserved_moov_size > 0 ? mov->reserved_header_pos : moov_pos, SEEK_SET);
 
-        if (mov->flags & FF_MOV_FLAG_FASTSTART) {
+        if (mov->flags & FF_MOV_FLAG_FASTSTART && mov->reserved_moov_size > 0) {
+            int shift = compute_moov_shift(s);
+            if (shift < 0)
+                return shift;
+            if (shift > 0) {
+                av_log(s, AV_LOG_INFO, "Reserved moov space is %d bytes too small, "
+                       "shifting the data\n", shift);
+                avio_seek(pb, moov_pos, SEEK_SET);
+                res = ff_format_shift_data(s, mov->reserved_header_pos + mov->reserved_moov_size,
+                                           shift);
+                if (res < 0)
+                    return res;
+                mov->reserved_moov_size += shift;
+                moov_pos += shift;
+                avio_seek(pb, mov->reserved_header_pos, SEEK_SET);
+            }
+        }
+
+        if (mov->flags & FF_MOV_FLAG_FASTSTART && mov->reserved_moov_size < 0) {
             av_log(s, AV_LOG_INFO, "Starting second pass: moving the moov atom to the beginning of the file\n");
             res = shift_data(s);
             if (res < 0)
@@ -8499,13 +8649,15 @@ static int mov_write_trailer(AVFormatContext *s)
             if ((res = mov_write_moov_tag(pb, mov, s)) < 0)
                 return res;
             size = mov->reserved_moov_size - (avio_tell(pb) - mov->reserved_header_pos);
-            if (size < 8){
+            if (size < 8 && size != 0) {
                 av_log(s, AV_LOG_ERROR, "reserved_moov_size is too small, needed %"PRId64" additional\n", 8-size);
                 return AVERROR(EINVAL);
             }
-            avio_wb32(pb, size);
-            ffio_wfourcc(pb, "free");
-            ffio_fill(pb, 0, size - 8);
+            if (size) {
+                avio_wb32(pb, size);
+                ffio_wfourcc(pb, "free");
+                ffio_fill(pb, 0, size - 8);
+            }
             avio_seek(pb, moov_pos, SEEK_SET);
         } else {
             if ((res = mov_write_moov_tag(pb, mov, s)) < 0)
@@ -31,6 +31,7 @@
 #define MOV_FRAG_INFO_ALLOC_INCREMENT 64
 #define MOV_INDEX_CLUSTER_SIZE 1024
 #define MOV_TIMESCALE 1000
+#define MOV_MOOV_SIZE_AUTO (-2)
 
 #define RTP_MAX_PACKET_SIZE 1450
 
@@ -220,7 +221,7 @@ typedef struct MOVMuxContext {
 
     int video_track_timescale;
 
-    int reserved_moov_size; ///< 0 for disabled, -1 for automatic, size otherwise
+    int reserved_moov_size; ///< 0 for disabled, -1 for automatic, MOV_MOOV_SIZE_AUTO to estimate, size otherwise
     int64_t reserved_header_pos;
 
     char *major_brand;
@@ -236,6 +237,9 @@ typedef struct MOVMuxContext {
     int frag_interleave;
     int missing_duration_warned;
 
+    int async_fragments;
+    struct MOVAsyncWriter *async;
+
     char *encryption_scheme_str;
     MOVEncryptionScheme encryption_scheme;
     uint8_t *encryption_key;
@@ -0,0 +1,394 @@
+/*
+ * MP4, ISMV Muxer asynchronous output
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <limits.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "libavutil/avutil.h"
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/fifo.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "avio.h"
+#include "avio_internal.h"
+#include "movenc_async.h"
+
+#if HAVE_THREADS
+
+typedef struct MOVAsyncOp {
+    int64_t seek;                   ///< position to seek to, or -1 to write
+    int size;                       ///< size of the data to write
+    enum AVIODataMarkerType type;
+    int64_t time;
+} MOVAsyncOp;
+
+/* The writes and seeks of one fragment, and the callbacks of the output
+ * they are made with. */
+typedef struct MOVAsyncFragment {
+    MOVAsyncOp *ops;
+    unsigned ops_alloc;
+    int nb_ops;
+    uint8_t *data;
+    unsigned data_alloc;
+    int data_size;
+
+    void *opaque;
+    int (*write_packet)(void *opaque, const uint8_t *buf, int buf_size);
+    int (*write_data_type)(void *opaque, const uint8_t *buf, int buf_size,
+                           enum AVIODataMarkerType type, int64_t time);
+    int64_t (*seek)(void *opaque, int64_t offset, int whence);
+} MOVAsyncFragment;
+
+struct MOVAsyncWriter {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    AVFifo *queue;
+    int max_pending;
+    int pending;                    ///< fragments queued or being written
+    int stop;
+    int error;
+};
+
+static void fragment_free(MOVAsyncFragment **pf)
+{
+    MOVAsyncFragment *f = *pf;
+
+    if (!f)
+        return;
+    av_free(f->ops);
+    av_free(f->data);
+    av_freep(pf);
+}
+
+static int fragment_add_op(MOVAsyncFragment *f, int64_t seek, const uint8_t *buf,
+                           int size, enum AVIODataMarkerType type, int64_t time)
+{
+    MOVAsyncOp *ops;
+    uint8_t *data;
+
+    if (f->nb_ops >= INT_MAX / sizeof(*f->ops) || size > INT_MAX - f->data_size)
+        return AVERROR(ERANGE);
+    ops = av_fast_realloc(f->ops, &f->ops_alloc, (f->nb_ops + 1) * sizeof(*f->ops));
+    if (!ops)
+        return AVERROR(ENOMEM);
+    f->ops = ops;
+    if (size) {
+        data = av_fast_realloc(f->data, &f->data_alloc, f->data_size + size);
+        if (!data)
+            return AVERROR(ENOMEM);
+        memcpy(data + f->data_size, buf, size);
+        f->data       = data;
+        f->data_size += size;
+    }
+    f->ops[f->nb_ops++] = (MOVAsyncOp){ seek, size, type, time };
+    return 0;
+}
+
+static int fragment_write_data_type(void *opaque, const uint8_t *buf, int buf_size,
+                                    enum AVIODataMarkerType type, int64_t time)
+{
+    int ret = fragment_add_op(opaque, -1, buf, buf_size, type, time);
+    return ret < 0 ? ret : buf_size;
+}
+
+static int fragment_write_packet(void *opaque, const uint8_t *buf, int buf_size)
+{
+    return fragment_write_data_type(opaque, buf, buf_size,
+                                    AVIO_DATA_MARKER_UNKNOWN, AV_NOPTS_VALUE);
+}
+
+static int64_t fragment_seek(void *opaque, int64_t offset, int whence)
+{
+    int ret;
+
+    if (whence != SEEK_SET)
+        return AVERROR(ENOSYS);
+    if ((ret = fragment_add_op(opaque, offset, NULL, 0,
+                               AVIO_DATA_MARKER_UNKNOWN, AV_NOPTS_VALUE)) < 0)
+        return ret;
+    return offset;
+}
+
+static int fragment_write(MOVAsyncFragment *f)
+{
+    const uint8_t *data = f->data;
+
+    for (int i = 0; i < f->nb_ops; i++) {
+        const MOVAsyncOp *op = &f->ops[i];
+        int64_t ret;
+
+        if (op->seek >= 0)
+            ret = f->seek(f->opaque, op->seek, SEEK_SET);
+        else if (f->write_data_type)
+            ret = f->write_data_type(f->opaque, data, op->size, op->type, op->time);
+        else
+            ret = f->write_packet(f->opaque, data, op->size);
+        if (ret < 0)
+            return ret;
+        data += op->size;
+    }
+    return 0;
+}
+
+static void *async_writer_thread(void *arg)
+{
+    MOVAsyncWriter *w = arg;
+    MOVAsyncFragment *f;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        int ret = 0;
+
+        while (!av_fifo_can_read(w->queue) && !w->stop)
+            pthread_cond_wait(&w->cond, &w->lock);
+        if (av_fifo_read(w->queue, &f, 1) < 0)
+            break;
+        pthread_mutex_unlock(&w->lock);
+
+        /* error is only set by this thread; like aviobuf, nothing is
+         * written after the first error */
+        if (!w->error)
+            ret = fragment_write(f);
+        fragment_free(&f);
+
+        pthread_mutex_lock(&w->lock);
+        if (ret < 0)
+            w->error = ret;
+        w->pending--;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    return NULL;
+}
+
+int ff_mov_async_start(MOVAsyncWriter **pw, int max_pending)
+{
+    MOVAsyncWriter *w;
+    int ret;
+
+    w = av_mallocz(sizeof(*w));
+    if (!w)
+        return AVERROR(ENOMEM);
+    w->queue = av_fifo_alloc2(max_pending + 1, sizeof(MOVAsyncFragment *),
+                              AV_FIFO_FLAG_AUTO_GROW);
+    if (!w->queue) {
+        av_free(w);
+        return AVERROR(ENOMEM);
+    }
+    if ((ret = pthread_mutex_init(&w->lock, NULL))) {
+        av_fifo_freep2(&w->queue);
+        av_free(w);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&w->cond, NULL))) {
+        pthread_mutex_destroy(&w->lock);
+        av_fifo_freep2(&w->queue);
+        av_free(w);
+        return AVERROR(ret);
+    }
+    w->max_pending = max_pending;
+
+    if ((ret = pthread_create(&w->thread, NULL, async_writer_thread, w))) {
+        pthread_cond_destroy(&w->cond);
+        pthread_mutex_destroy(&w->lock);
+        av_fifo_freep2(&w->queue);
+        av_free(w);
+        return AVERROR(ret);
+    }
+
+    *pw = w;
+    return 0;
+}
+
+int ff_mov_async_drain(MOVAsyncWriter *w)
+{
+    int ret;
+
+    pthread_mutex_lock(&w->lock);
+    while (w->pending)
+        pthread_cond_wait(&w->cond, &w->lock);
+    ret = w->error;
+    pthread_mutex_unlock(&w->lock);
+    return ret;
+}
+
+int ff_mov_async_fragment_begin(MOVAsyncWriter *w, AVIOContext *pb,
+                                AVIOContext **pfrag)
+{
+    FFIOContext *const ctx = ffiocontext(pb);
+    MOVAsyncFragment *f;
+    AVIOContext *frag;
+    uint8_t *buf;
+    int ret;
+
+    /* Data written to pb directly goes out first, while nothing else
+     * uses its callbacks. */
+    if (pb->buf_ptr > pb->buffer || pb->buf_ptr_max > pb->buffer) {
+        if ((ret = ff_mov_async_drain(w)) < 0) {
+            pb->error = ret;
+            return ret;
+        }
+        avio_flush(pb);
+    }
+    if (pb->error < 0)
+        return pb->error;
+
+    f   = av_mallocz(sizeof(*f));
+    buf = av_malloc(pb->buffer_size);
+    if (!f || !buf) {
+        av_free(f);
+        av_free(buf);
+        return AVERROR(ENOMEM);
+    }
+    frag = avio_alloc_context(buf, pb->buffer_size, 1, f, NULL,
+                              fragment_write_packet,
+                              pb->seek ? fragment_seek : NULL);
+    if (!frag) {
+        av_free(f);
+        av_free(buf);
+        return AVERROR(ENOMEM);
+    }
+    f->opaque          = pb->opaque;
+    f->write_packet    = pb->write_packet;
+    f->write_data_type = pb->write_data_type;
+    f->seek            = pb->seek;
+
+    if (pb->write_data_type)
+        frag->write_data_type = fragment_write_data_type;
+    frag->pos                   = pb->pos;
+    frag->seekable              = pb->seekable;
+    frag->direct                = pb->direct;
+    frag->max_packet_size       = pb->max_packet_size;
+    frag->min_packet_size       = pb->min_packet_size;
+    frag->ignore_boundary_point = pb->ignore_boundary_point;
+    ffiocontext(frag)->current_type = ctx->current_type;
+    ffiocontext(frag)->last_time    = ctx->last_time;
+
+    *pfrag = frag;
+    return 0;
+}
+
+int ff_mov_async_fragment_end(MOVAsyncWriter *w, AVIOContext *pb,
+                              AVIOContext **pfrag)
+{
+    FFIOContext *const ctx   = ffiocontext(pb);
+    FFIOContext *const fctx  = ffiocontext(*pfrag);
+    AVIOContext *frag        = *pfrag;
+    MOVAsyncFragment *f      = frag->opaque;
+    int ret;
+
+    avio_flush(frag);
+    ret = frag->error;
+
+    /* Continue pb at the end of the fragment, as if it had been written
+     * through it. */
+    pb->pos                  = avio_tell(frag);
+    ctx->bytes_written      += fctx->bytes_written;
+    pb->bytes_written        = ctx->bytes_written;
+    ctx->written_output_size = FFMAX(ctx->written_output_size,
+                                     fctx->written_output_size);
+    ctx->writeout_count     += fctx->writeout_count;
+    ctx->seek_count         += fctx->seek_count;
+    ctx->current_type        = fctx->current_type;
+    ctx->last_time           = fctx->last_time;
+
+    av_freep(&frag->buffer);
+    avio_context_free(pfrag);
+
+    if (ret < 0) {
+        fragment_free(&f);
+        pb->error = ret;
+        return ret;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    ret = av_fifo_write(w->queue, &f, 1);
+    if (ret >= 0) {
+        w->pending++;
+        pthread_cond_broadcast(&w->cond);
+        while (w->pending > w->max_pending && !w->error)
+            pthread_cond_wait(&w->cond, &w->lock);
+        ret = w->error;
+    } else {
+        fragment_free(&f);
+    }
+    pthread_mutex_unlock(&w->lock);
+    if (ret < 0)
+        pb->error = ret;
+    return ret;
+}
+
+int ff_mov_async_stop(MOVAsyncWriter **pw)
+{
+    MOVAsyncWriter *w = *pw;
+    int ret;
+
+    if (!w)
+        return 0;
+
+    pthread_mutex_lock(&w->lock);
+    w->stop = 1;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+    ret = w->error;
+
+    av_fifo_freep2(&w->queue);
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+    av_freep(pw);
+    return ret;
+}
+
+#else
+
+int ff_mov_async_start(MOVAsyncWriter **pw, int max_pending)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_mov_async_fragment_begin(MOVAsyncWriter *w, AVIOContext *pb,
+                                AVIOContext **frag)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_mov_async_fragment_end(MOVAsyncWriter *w, AVIOContext *pb,
+                              AVIOContext **frag)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_mov_async_drain(MOVAsyncWriter *w)
+{
+    return 0;
+}
+
+int ff_mov_async_stop(MOVAsyncWriter **pw)
+{
+    return 0;
+}
+
+#endif /* HAVE_THREADS */
@@ -0,0 +1,71 @@
+/*
+ * MP4, ISMV Muxer asynchronous output
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_MOVENC_ASYNC_H
+#define AVFORMAT_MOVENC_ASYNC_H
+
+#include "avio.h"
+
+typedef struct MOVAsyncWriter MOVAsyncWriter;
+
+/**
+ * Start the thread that writes the queued fragments.
+ *
+ * @param max_pending number of completed fragments that may be queued
+ *                    before ff_mov_async_fragment_end() blocks
+ */
+int ff_mov_async_start(MOVAsyncWriter **pw, int max_pending);
+
+/**
+ * Open a memory AVIOContext that stands in for pb while a fragment is
+ * written. It continues at the current position of pb, and buffers and
+ * marks data like pb, so that the writes and seeks it records are the
+ * ones pb would have made. pb must not be used until the fragment ends.
+ */
+int ff_mov_async_fragment_begin(MOVAsyncWriter *w, AVIOContext *pb,
+                                AVIOContext **frag);
+
+/**
+ * Queue the writes and seeks recorded by frag to be made with the
+ * callbacks of pb, free frag and move pb to the end of the fragment.
+ * Waits while more than max_pending fragments are queued.
+ *
+ * @return 0 or the first error returned by the callbacks of pb
+ */
+int ff_mov_async_fragment_end(MOVAsyncWriter *w, AVIOContext *pb,
+                              AVIOContext **frag);
+
+/**
+ * Wait until all queued fragments have been written. This must be called
+ * before pb is written to, closed or replaced.
+ *
+ * @return 0 or the first error returned by the callbacks of pb
+ */
+int ff_mov_async_drain(MOVAsyncWriter *w);
+
+/**
+ * Write out all queued fragments and stop the thread. Does nothing if *pw
+ * is NULL.
+ *
+ * @return 0 or the first error returned by the callbacks of pb
+ */
+int ff_mov_async_stop(MOVAsyncWriter **pw);
+
+#endif /* AVFORMAT_MOVENC_ASYNC_H */
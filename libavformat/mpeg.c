@@ -706,6 +706,7 @@ const FFInputFormat ff_mpegps_demuxer = {
     .p.long_name    = NULL_IF_CONFIG_SMALL("MPEG-PS (MPEG-2 Program Stream)"),
     .p.flags        = AVFMT_SHOW_IDS | AVFMT_TS_DISCONT,
     .priv_data_size = sizeof(MpegDemuxContext),
+    .flags_internal = FF_INFMT_FLAG_COMPACT_INDEX,
     .read_probe     = mpegps_probe,
     .read_header    = mpegps_read_header,
     .read_packet    = mpegps_read_packet,
@@ -178,6 +178,9 @@ struct MpegTSContext {
     int8_t crc_validity[NB_PID_MAX];
     /** filters for various streams specified by PMT + for the PAT and PMT */
     MpegTSFilter *pids[NB_PID_MAX];
+    /** PIDs with a filter that is not discarded. Packets of other PIDs are
+     *  skipped in the I/O buffer, unless they start a payload unit. */
+    uint64_t pid_active[NB_PID_MAX / 64];
     int current_pid;
 
     AVStream *epg_stream;
@@ -488,6 +491,14 @@ static void write_section_data(MpegTSContext *ts, MpegTSFilter *tss1,
     }
 }
 
+static void set_pid_active(MpegTSContext *ts, unsigned int pid, int active)
+{
+    if (active)
+        ts->pid_active[pid >> 6] |=   UINT64_C(1) << (pid & 63);
+    else
+        ts->pid_active[pid >> 6] &= ~(UINT64_C(1) << (pid & 63));
+}
+
 static MpegTSFilter *mpegts_open_filter(MpegTSContext *ts, unsigned int pid,
                                         enum MpegTSFilterType type)
 {
@@ -501,6 +512,7 @@ static MpegTSFilter *mpegts_open_filter(MpegTSContext *ts, unsigned int pid,
     if (!filter)
         return NULL;
     ts->pids[pid] = filter;
+    set_pid_active(ts, pid, 1);
 
     filter->type    = type;
     filter->pid     = pid;
@@ -578,6 +590,7 @@ static void mpegts_close_filter(MpegTSContext *ts, MpegTSFilter *filter)
 
     av_free(filter);
     ts->pids[pid] = NULL;
+    set_pid_active(ts, pid, 0);
 }
 
 static int analyze(const uint8_t *buf, int size, int packet_size,
@@ -2799,8 +2812,10 @@ static int handle_packet(MpegTSContext *ts, const uint8_t *packet, int64_t pos)
     }
     if (!tss)
         return 0;
-    if (is_start)
+    if (is_start) {
         tss->discard = discard_pid(ts, pid);
+        set_pid_active(ts, pid, !tss->discard);
+    }
     if (tss->discard)
         return 0;
     ts->current_pid = pid;
@@ -2930,6 +2945,19 @@ static int mpegts_resync(AVFormatContext *s, int seekback, const uint8_t *curren
     avio_seek(pb, -back, SEEK_CUR);
 
     for (i = 0; i < ts->resync_size; i++) {
+        /* Scan what is buffered at once, reading byte-wise only to refill. */
+        int len = FFMIN(pb->buf_end - pb->buf_ptr, ts->resync_size - i);
+        if (len > 1) {
+            const uint8_t *sync = memchr(pb->buf_ptr, SYNC_BYTE, len);
+            if (!sync) {
+                avio_skip(pb, len);
+                i += len - 1;
+                continue;
+            }
+            len = sync - pb->buf_ptr;
+            avio_skip(pb, len);
+            i += len;
+        }
         c = avio_r8(pb);
         if (avio_feof(pb))
             return AVERROR_EOF;
@@ -2999,12 +3027,40 @@ static void finished_reading_packet(AVFormatContext *s, int raw_packet_size)
         avio_skip(pb, skip);
 }
 
+/**
+ * Skip packets directly in the I/O buffer as long as they would be ignored
+ * by handle_packet(), i.e. they are of a PID without active filter and do
+ * not start a payload unit (which may open or undiscard a filter).
+ *
+ * @param max maximum number of packets to skip
+ * @return number of packets skipped
+ */
+static int64_t skip_inactive_packets(MpegTSContext *ts, int64_t max)
+{
+    AVIOContext *pb = ts->stream->pb;
+    const uint8_t *p = pb->buf_ptr;
+    int size   = ts->raw_packet_size;
+    int offset = size == TS_DVHS_PACKET_SIZE ? 4 : 0;
+    int64_t n;
+
+    for (n = 0; n < max && pb->buf_end - p >= size; n++, p += size) {
+        const uint8_t *packet = p + offset;
+        int pid = AV_RB16(packet + 1) & 0x1fff;
+
+        if (packet[0] != SYNC_BYTE || packet[1] & 0x40 ||
+            ts->pid_active[pid >> 6] & (UINT64_C(1) << (pid & 63)))
+            break;
+    }
+    pb->buf_ptr = (uint8_t *)p;
+    return n;
+}
+
 static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
 {
     AVFormatContext *s = ts->stream;
     uint8_t packet[TS_PACKET_SIZE + AV_INPUT_BUFFER_PADDING_SIZE];
     const uint8_t *data;
-    int64_t packet_num;
+    int64_t packet_num, n;
     int ret = 0;
 
     if (avio_tell(s->pb) != ts->last_pos) {
@@ -3040,6 +3096,11 @@ static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
         if (ts->stop_parse > 0)
             break;
 
+        n = skip_inactive_packets(ts, nb_packets ? nb_packets - packet_num : INT64_MAX);
+        if (n) {
+            packet_num += n - 1;
+            continue;
+        }
         ret = read_packet(s, packet, ts->raw_packet_size, &data);
         if (ret != 0)
             break;
@@ -3468,7 +3529,7 @@ const FFInputFormat ff_mpegts_demuxer = {
     .read_packet    = mpegts_read_packet,
     .read_close     = mpegts_read_close,
     .read_timestamp = mpegts_get_dts,
-    .flags_internal  = FF_INFMT_FLAG_PREFER_CODEC_FRAMERATE,
+    .flags_internal  = FF_INFMT_FLAG_PREFER_CODEC_FRAMERATE | FF_INFMT_FLAG_COMPACT_INDEX,
 };
 
 const FFInputFormat ff_mpegtsraw_demuxer = {
@@ -3481,5 +3542,5 @@ const FFInputFormat ff_mpegtsraw_demuxer = {
     .read_packet    = mpegts_raw_read_packet,
     .read_close     = mpegts_read_close,
     .read_timestamp = mpegts_get_dts,
-    .flags_internal  = FF_INFMT_FLAG_PREFER_CODEC_FRAMERATE,
+    .flags_internal  = FF_INFMT_FLAG_PREFER_CODEC_FRAMERATE | FF_INFMT_FLAG_COMPACT_INDEX,
 };
@@ -76,13 +76,17 @@ int ff_format_shift_data(AVFormatContext *s, int64_t read_start, int shift_size)
     uint8_t *buf, *read_buf[2];
     int read_buf_id = 0;
     int read_size[2];
+    /* Any block size not smaller than shift_size works, as the next block
+     * is always read before the current one is written back. Use large
+     * blocks, so that small shifts don't end up in tiny reads and writes. */
+    int block_size = FFMAX(shift_size, 1 << 20);
     AVIOContext *read_pb;
 
-    buf = av_malloc_array(shift_size, 2);
+    buf = av_malloc_array(block_size, 2);
     if (!buf)
         return AVERROR(ENOMEM);
     read_buf[0] = buf;
-    read_buf[1] = buf + shift_size;
+    read_buf[1] = buf + block_size;
 
     /* Shift the data: the AVIO context of the output can only be used for
      * writing, so we re-open the same output, but for reading. It also avoids
@@ -103,11 +107,11 @@ int ff_format_shift_data(AVFormatContext *s, int64_t read_start, int shift_size)
     pos = avio_tell(read_pb);
 
 #define READ_BLOCK do {                                                             \
-    read_size[read_buf_id] = avio_read(read_pb, read_buf[read_buf_id], shift_size);  \
+    read_size[read_buf_id] = avio_read(read_pb, read_buf[read_buf_id], block_size);  \
     read_buf_id ^= 1;                                                               \
 } while (0)
 
-    /* shift data by chunk of at most shift_size */
+    /* shift data by chunk of at most block_size */
     READ_BLOCK;
     do {
         int n;
@@ -47,12 +47,568 @@ void avpriv_update_cur_dts(AVFormatContext *s, AVStream *ref_st, int64_t timesta
     }
 }
 
+/*
+ * Block-compressed index storage.
+ *
+ * Entries are grouped into blocks of about INDEX_BLOCK_SIZE entries. Each
+ * entry is coded relative to its predecessor as four variable length
+ * integers: the timestamp increment, the zigzag coded position difference,
+ * size << 2 | flags and the zigzag coded min_distance. The newest entries
+ * are kept uncoded in a tail array until a full block has been collected,
+ * and the last block accessed is kept decoded in a cache.
+ */
+
+#define INDEX_BLOCK_SIZE 256
+
+typedef struct FFIndexBlock {
+    int64_t  timestamp;         ///< timestamp of the first entry
+    int64_t  pos;               ///< position of the first entry
+    int      first;             ///< index of the first entry
+    int      nb_entries;
+    int      size;
+    uint8_t *data;
+} FFIndexBlock;
+
+typedef struct FFIndexBlocks {
+    FFIndexBlock *blocks;
+    int           nb_blocks;
+    unsigned int  blocks_allocated_size;
+    size_t        data_size;    ///< total size of the coded block data
+
+    AVIndexEntry *tail;         ///< newest entries, not coded yet
+    int           nb_tail;
+    unsigned int  tail_allocated_size;
+
+    AVIndexEntry *cache;        ///< decoded entries of blocks[cache_block]
+    unsigned int  cache_allocated_size;
+    int           cache_block;
+} FFIndexBlocks;
+
+static uint64_t zigzag(uint64_t v)
+{
+    return v << 1 ^ -(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+    return v >> 1 ^ -(v & 1);
+}
+
+static int code_entry(uint8_t *buf, const AVIndexEntry *e,
+                      int64_t prev_timestamp, int64_t prev_pos)
+{
+    const uint64_t v[4] = {
+        e->timestamp - (uint64_t)prev_timestamp,
+        zigzag(e->pos - (uint64_t)prev_pos),
+        (uint64_t)e->size << 2 | (e->flags & 3),
+        zigzag(e->min_distance),
+    };
+    int len = 0;
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(v); i++) {
+        uint64_t x = v[i];
+        for (; x > 0x7F; x >>= 7, len++)
+            if (buf)
+                buf[len] = x | 0x80;
+        if (buf)
+            buf[len] = x;
+        len++;
+    }
+    return len;
+}
+
+static const uint8_t *get_v(const uint8_t *p, uint64_t *v)
+{
+    unsigned shift = 0;
+
+    *v = 0;
+    do {
+        *v |= (uint64_t)(*p & 0x7F) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+    return p;
+}
+
+static int blocks_tail_first(const FFIndexBlocks *ib)
+{
+    const FFIndexBlock *b;
+
+    if (!ib->nb_blocks)
+        return 0;
+    b = &ib->blocks[ib->nb_blocks - 1];
+    return b->first + b->nb_entries;
+}
+
+static int blocks_nb_entries(const FFIndexBlocks *ib)
+{
+    return blocks_tail_first(ib) + ib->nb_tail;
+}
+
+static size_t blocks_memory(const FFIndexBlocks *ib)
+{
+    return ib->data_size + ib->blocks_allocated_size +
+           ib->tail_allocated_size + ib->cache_allocated_size;
+}
+
+static void blocks_uninit(FFIndexBlocks *ib)
+{
+    for (int i = 0; i < ib->nb_blocks; i++)
+        av_freep(&ib->blocks[i].data);
+    av_freep(&ib->blocks);
+    av_freep(&ib->tail);
+    av_freep(&ib->cache);
+}
+
+void ff_index_blocks_free(FFIndexBlocks **pib)
+{
+    if (!*pib)
+        return;
+    blocks_uninit(*pib);
+    av_freep(pib);
+}
+
+/**
+ * (Re)code the block b from nb_entries entries.
+ * b is left untouched on failure.
+ */
+static int code_block(FFIndexBlocks *ib, FFIndexBlock *b,
+                      const AVIndexEntry *entries, int nb_entries)
+{
+    int64_t timestamp = entries[0].timestamp;
+    int64_t pos       = entries[0].pos;
+    uint8_t *data;
+    int size = 0;
+
+    for (int i = 0; i < nb_entries; i++) {
+        size     += code_entry(NULL, &entries[i], timestamp, pos);
+        timestamp = entries[i].timestamp;
+        pos       = entries[i].pos;
+    }
+
+    data = av_malloc(size);
+    if (!data)
+        return AVERROR(ENOMEM);
+
+    b->timestamp = timestamp = entries[0].timestamp;
+    b->pos       = pos       = entries[0].pos;
+    for (int i = 0, len = 0; i < nb_entries; i++) {
+        len      += code_entry(data + len, &entries[i], timestamp, pos);
+        timestamp = entries[i].timestamp;
+        pos       = entries[i].pos;
+    }
+
+    ib->data_size += size - b->size;
+    av_free(b->data);
+    b->data       = data;
+    b->size       = size;
+    b->nb_entries = nb_entries;
+    return 0;
+}
+
+static int decode_block(FFIndexBlocks *ib, int k)
+{
+    const FFIndexBlock *b = &ib->blocks[k];
+    const uint8_t *p = b->data;
+    uint64_t timestamp = b->timestamp, pos = b->pos;
+    AVIndexEntry *entries;
+
+    if (ib->cache_block == k)
+        return 0;
+
+    entries = av_fast_realloc(ib->cache, &ib->cache_allocated_size,
+                              b->nb_entries * sizeof(*entries));
+    if (!entries)
+        return AVERROR(ENOMEM);
+    ib->cache = entries;
+
+    for (int i = 0; i < b->nb_entries; i++) {
+        AVIndexEntry *const e = &entries[i];
+        uint64_t v[4];
+
+        for (int j = 0; j < FF_ARRAY_ELEMS(v); j++)
+            p = get_v(p, &v[j]);
+        timestamp      += v[0];
+        pos            += unzigzag(v[1]);
+        e->timestamp    = timestamp;
+        e->pos          = pos;
+        e->flags        = v[2] & 3;
+        e->size         = v[2] >> 2;
+        e->min_distance = unzigzag(v[3]);
+    }
+    ib->cache_block = k;
+    return 0;
+}
+
+/**
+ * Find the block holding the entry idx, which must not be in the tail.
+ */
+static int find_block(const FFIndexBlocks *ib, int idx)
+{
+    int lo = 0, hi = ib->nb_blocks - 1;
+
+    while (lo < hi) {
+        int mid = (lo + hi + 1) >> 1;
+        if (ib->blocks[mid].first <= idx)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+static const AVIndexEntry *blocks_get_entry(FFIndexBlocks *ib, int idx)
+{
+    int tail_first = blocks_tail_first(ib);
+    int k;
+
+    if (idx >= tail_first)
+        return &ib->tail[idx - tail_first];
+
+    k = find_block(ib, idx);
+    if (decode_block(ib, k) < 0)
+        return NULL;
+    return &ib->cache[idx - ib->blocks[k].first];
+}
+
+#if defined(ASSERT_LEVEL) && ASSERT_LEVEL > 1
+/**
+ * Check that the blocks k - 1, k and k + 1 and the tail are in order: the
+ * timestamps increase across block boundaries and the block entry numbers
+ * match the block sizes.
+ */
+static void blocks_check(FFIndexBlocks *ib, int k)
+{
+    for (int i = FFMAX(k, 1); i <= FFMIN(k + 1, ib->nb_blocks); i++) {
+        const FFIndexBlock *prev = &ib->blocks[i - 1];
+        int64_t next_timestamp;
+
+        if (i < ib->nb_blocks) {
+            av_assert2(ib->blocks[i].first == prev->first + prev->nb_entries);
+            next_timestamp = ib->blocks[i].timestamp;
+        } else if (ib->nb_tail) {
+            next_timestamp = ib->tail[0].timestamp;
+        } else
+            continue;
+
+        if (decode_block(ib, i - 1) < 0)
+            continue;
+        for (int j = 1; j < prev->nb_entries; j++)
+            av_assert2(ib->cache[j - 1].timestamp < ib->cache[j].timestamp);
+        av_assert2(ib->cache[prev->nb_entries - 1].timestamp < next_timestamp);
+    }
+}
+#else
+#define blocks_check(ib, k) do { } while (0)
+#endif
+
+static int blocks_seal_tail(FFIndexBlocks *ib)
+{
+    FFIndexBlock *b;
+    int ret;
+
+    b = av_fast_realloc(ib->blocks, &ib->blocks_allocated_size,
+                        (ib->nb_blocks + 1) * sizeof(*b));
+    if (!b)
+        return AVERROR(ENOMEM);
+    ib->blocks = b;
+
+    b = &ib->blocks[ib->nb_blocks];
+    memset(b, 0, sizeof(*b));
+    b->first = blocks_tail_first(ib);
+    if ((ret = code_block(ib, b, ib->tail, ib->nb_tail)) < 0)
+        return ret;
+
+    ib->nb_blocks++;
+    ib->nb_tail = 0;
+    blocks_check(ib, ib->nb_blocks - 1);
+    return 0;
+}
+
+static int blocks_append(FFIndexBlocks *ib, const AVIndexEntry *e)
+{
+    AVIndexEntry *entries;
+
+    entries = av_fast_realloc(ib->tail, &ib->tail_allocated_size,
+                              (ib->nb_tail + 1) * sizeof(*entries));
+    if (!entries)
+        return AVERROR(ENOMEM);
+    ib->tail = entries;
+
+    entries[ib->nb_tail++] = *e;
+    if (ib->nb_tail >= INDEX_BLOCK_SIZE)
+        return blocks_seal_tail(ib);
+    return 0;
+}
+
+/**
+ * Recode the cached block k after nb_entries entries have been stored in
+ * the cache, splitting it once it grew to twice the nominal block size.
+ */
+static int blocks_update(FFIndexBlocks *ib, int k, int nb_entries)
+{
+    int grown = nb_entries - ib->blocks[k].nb_entries;
+    int ret;
+
+    if (nb_entries > 2 * INDEX_BLOCK_SIZE) {
+        FFIndexBlock next = { 0 }, *b;
+        int half = nb_entries >> 1;
+
+        b = av_fast_realloc(ib->blocks, &ib->blocks_allocated_size,
+                            (ib->nb_blocks + 1) * sizeof(*b));
+        if (!b)
+            goto fail;
+        ib->blocks = b;
+
+        if (code_block(ib, &next, ib->cache + half, nb_entries - half) < 0)
+            goto fail;
+        if (code_block(ib, &ib->blocks[k], ib->cache, half) < 0) {
+            ib->data_size -= next.size;
+            av_free(next.data);
+            goto fail;
+        }
+        next.first = ib->blocks[k].first + half;
+        memmove(&ib->blocks[k + 2], &ib->blocks[k + 1],
+                (ib->nb_blocks - k - 1) * sizeof(*ib->blocks));
+        ib->blocks[++k] = next;
+        ib->nb_blocks++;
+        ib->cache_block = -1;
+    } else if ((ret = code_block(ib, &ib->blocks[k], ib->cache, nb_entries)) < 0) {
+        ib->cache_block = -1;
+        return ret;
+    }
+
+    for (int i = k + 1; i < ib->nb_blocks; i++)
+        ib->blocks[i].first += grown;
+    blocks_check(ib, k);
+    return 0;
+fail:
+    ib->cache_block = -1;
+    return AVERROR(ENOMEM);
+}
+
+/**
+ * Same as ff_index_search_timestamp(), first narrowing the search to the
+ * block that may hold the wanted timestamp.
+ */
+static int blocks_search_timestamp(FFIndexBlocks *ib,
+                                   int64_t wanted_timestamp, int flags)
+{
+    int nb_entries = blocks_nb_entries(ib);
+    int tail_first = blocks_tail_first(ib);
+    const AVIndexEntry *e;
+    int a, b, m;
+    int64_t timestamp;
+
+    a = -1;
+    b = nb_entries;
+
+    if (ib->nb_tail && ib->tail[0].timestamp < wanted_timestamp) {
+        a = tail_first - 1;
+    } else if (ib->nb_blocks) {
+        int lo = -1, hi = ib->nb_blocks - 1;
+
+        while (lo < hi) {
+            int mid = (lo + hi + 1) >> 1;
+            if (ib->blocks[mid].timestamp < wanted_timestamp)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        if (lo >= 0) {
+            a = ib->blocks[lo].first - 1;
+            b = lo + 1 < ib->nb_blocks ? ib->blocks[lo + 1].first : tail_first;
+        } else
+            b = 0;
+    }
+
+    while (b - a > 1) {
+        m = (a + b) >> 1;
+
+        // Search for the next non-discarded packet.
+        if (!(e = blocks_get_entry(ib, m)))
+            return -1;
+        while ((e->flags & AVINDEX_DISCARD_FRAME) && m < b && m < nb_entries - 1) {
+            m++;
+            if (!(e = blocks_get_entry(ib, m)))
+                return -1;
+            if (m == b && e->timestamp >= wanted_timestamp) {
+                m = b - 1;
+                break;
+            }
+        }
+
+        if (!(e = blocks_get_entry(ib, m)))
+            return -1;
+        timestamp = e->timestamp;
+        if (timestamp >= wanted_timestamp)
+            b = m;
+        if (timestamp <= wanted_timestamp)
+            a = m;
+    }
+    m = (flags & AVSEEK_FLAG_BACKWARD) ? a : b;
+
+    if (!(flags & AVSEEK_FLAG_ANY))
+        while (m >= 0 && m < nb_entries) {
+            if (!(e = blocks_get_entry(ib, m)))
+                return -1;
+            if (e->flags & AVINDEX_KEYFRAME)
+                break;
+            m += (flags & AVSEEK_FLAG_BACKWARD) ? -1 : 1;
+        }
+
+    if (m == nb_entries)
+        return -1;
+    return m;
+}
+
+static int blocks_add_entry(FFIndexBlocks *ib, int64_t pos, int64_t timestamp,
+                            int size, int distance, int flags)
+{
+    int nb_entries = blocks_nb_entries(ib);
+    int tail_first = blocks_tail_first(ib);
+    AVIndexEntry *entries, *ie;
+    int index, first, count, k = -1, ret;
+
+    if ((unsigned) nb_entries + 1 >= INT_MAX)
+        return -1;
+
+    index = blocks_search_timestamp(ib, timestamp, AVSEEK_FLAG_ANY);
+    if (index < 0)
+        index = nb_entries;
+
+    if (index >= tail_first) {
+        entries = av_fast_realloc(ib->tail, &ib->tail_allocated_size,
+                                  (ib->nb_tail + 1) * sizeof(*entries));
+        if (!entries)
+            return AVERROR(ENOMEM);
+        ib->tail  = entries;
+        first     = tail_first;
+        count     = ib->nb_tail;
+    } else {
+        k = find_block(ib, index);
+        if ((ret = decode_block(ib, k)) < 0)
+            return ret;
+        count   = ib->blocks[k].nb_entries;
+        entries = av_fast_realloc(ib->cache, &ib->cache_allocated_size,
+                                  (count + 1) * sizeof(*entries));
+        if (!entries)
+            return AVERROR(ENOMEM);
+        ib->cache = entries;
+        first     = ib->blocks[k].first;
+    }
+
+    ie = &entries[index - first];
+    if (index == nb_entries) {
+        count++;
+    } else if (ie->timestamp != timestamp) {
+        if (ie->timestamp <= timestamp)
+            return -1;
+        memmove(ie + 1, ie, sizeof(*ie) * (count - (index - first)));
+        count++;
+    } else if (ie->pos == pos && distance < ie->min_distance)
+        // do not reduce the distance
+        distance = ie->min_distance;
+
+    ie->pos          = pos;
+    ie->timestamp    = timestamp;
+    ie->min_distance = distance;
+    ie->size         = size;
+    ie->flags        = flags;
+
+    if (k >= 0)
+        ret = blocks_update(ib, k, count);
+    else if ((ib->nb_tail = count) >= INDEX_BLOCK_SIZE)
+        ret = blocks_seal_tail(ib);
+    else
+        ret = 0;
+
+    return ret < 0 ? ret : index;
+}
+
+/**
+ * Keep every other entry, like ff_reduce_index() does for flat indexes.
+ */
+static int blocks_reduce(FFIndexBlocks *ib)
+{
+    FFIndexBlocks reduced = { .cache_block = -1 };
+    int nb_entries = blocks_nb_entries(ib);
+
+    for (int i = 0; i < nb_entries; i += 2) {
+        const AVIndexEntry *e = blocks_get_entry(ib, i);
+        int ret;
+
+        if (!e || (ret = blocks_append(&reduced, e)) < 0) {
+            blocks_uninit(&reduced);
+            return e ? ret : AVERROR(ENOMEM);
+        }
+    }
+
+    blocks_uninit(ib);
+    *ib = reduced;
+    return 0;
+}
+
+/**
+ * Drop every other coded block. This is used when the index cannot be
+ * reduced with blocks_reduce(): it needs no allocation and keeps the index
+ * sorted, if coarser in places.
+ */
+static void blocks_drop(FFIndexBlocks *ib)
+{
+    int nb_blocks = 0, first = 0;
+
+    for (int i = 0; i < ib->nb_blocks; i++) {
+        FFIndexBlock *const b = &ib->blocks[i];
+
+        if (i & 1) {
+            ib->data_size -= b->size;
+            av_freep(&b->data);
+            continue;
+        }
+        b->first = first;
+        first   += b->nb_entries;
+        ib->blocks[nb_blocks++] = *b;
+    }
+    ib->nb_blocks   = nb_blocks;
+    ib->cache_block = -1;
+    blocks_check(ib, nb_blocks - 1);
+}
+
+static int index_nb_entries(const FFStream *sti)
+{
+    return sti->index_blocks ? blocks_nb_entries(sti->index_blocks)
+                             : sti->nb_index_entries;
+}
+
+/**
+ * @return the entry idx of the stream index, NULL if it does not exist or
+ *         cannot be decoded; only valid until the index is accessed again
+ */
+static const AVIndexEntry *index_get_entry(FFStream *sti, int idx)
+{
+    if (idx < 0 || idx >= index_nb_entries(sti))
+        return NULL;
+    if (sti->index_blocks)
+        return blocks_get_entry(sti->index_blocks, idx);
+    return &sti->index_entries[idx];
+}
+
 void ff_reduce_index(AVFormatContext *s, int stream_index)
 {
     AVStream *const st  = s->streams[stream_index];
     FFStream *const sti = ffstream(st);
     unsigned int max_entries = s->max_index_size / sizeof(AVIndexEntry);
 
+    if (sti->index_blocks) {
+        if (blocks_memory(sti->index_blocks) >= s->max_index_size &&
+            blocks_reduce(sti->index_blocks) < 0) {
+            av_log(s, AV_LOG_WARNING, "Failed to reduce the index of stream %d, "
+                   "dropping parts of it\n", stream_index);
+            blocks_drop(sti->index_blocks);
+        }
+        return;
+    }
+
     if ((unsigned) sti->nb_index_entries >= max_entries) {
         int i;
         for (i = 0; 2 * i < sti->nb_index_entries; i++)
@@ -61,6 +617,20 @@ void ff_reduce_index(AVFormatContext *s, int stream_index)
     }
 }
 
+static int check_index_entry(int64_t *timestamp, int size)
+{
+    if (*timestamp == AV_NOPTS_VALUE)
+        return AVERROR(EINVAL);
+
+    if (size < 0 || size > 0x3FFFFFFF)
+        return AVERROR(EINVAL);
+
+    if (is_relative(*timestamp)) //FIXME this maintains previous behavior but we should shift by the correct offset once known
+        *timestamp -= RELATIVE_TS_BASE;
+
+    return 0;
+}
+
 int ff_add_index_entry(AVIndexEntry **index_entries,
                        int *nb_index_entries,
                        unsigned int *index_entries_allocated_size,
@@ -68,19 +638,13 @@ int ff_add_index_entry(AVIndexEntry **index_entries,
                        int size, int distance, int flags)
 {
     AVIndexEntry *entries, *ie;
-    int index;
+    int index, ret;
 
     if ((unsigned) *nb_index_entries + 1 >= UINT_MAX / sizeof(AVIndexEntry))
         return -1;
 
-    if (timestamp == AV_NOPTS_VALUE)
-        return AVERROR(EINVAL);
-
-    if (size < 0 || size > 0x3FFFFFFF)
-        return AVERROR(EINVAL);
-
-    if (is_relative(timestamp)) //FIXME this maintains previous behavior but we should shift by the correct offset once known
-        timestamp -= RELATIVE_TS_BASE;
+    if ((ret = check_index_entry(&timestamp, size)) < 0)
+        return ret;
 
     entries = av_fast_realloc(*index_entries,
                               index_entries_allocated_size,
@@ -123,7 +687,26 @@ int av_add_index_entry(AVStream *st, int64_t pos, int64_t timestamp,
                        int size, int distance, int flags)
 {
     FFStream *const sti = ffstream(st);
+    const AVFormatContext *const s = sti->fmtctx;
+    int ret;
+
     timestamp = ff_wrap_timestamp(st, timestamp);
+
+    if (!sti->index_blocks && !sti->nb_index_entries &&
+        s && s->iformat && (ffifmt(s->iformat)->flags_internal & FF_INFMT_FLAG_COMPACT_INDEX)) {
+        sti->index_blocks = av_mallocz(sizeof(*sti->index_blocks));
+        if (!sti->index_blocks)
+            return AVERROR(ENOMEM);
+        sti->index_blocks->cache_block = -1;
+    }
+
+    if (sti->index_blocks) {
+        if ((ret = check_index_entry(&timestamp, size)) < 0)
+            return ret;
+        return blocks_add_entry(sti->index_blocks, pos, timestamp,
+                                size, distance, flags);
+    }
+
     return ff_add_index_entry(&sti->index_entries, &sti->nb_index_entries,
                               &sti->index_entries_allocated_size, pos,
                               timestamp, size, distance, flags);
@@ -244,38 +827,33 @@ void ff_configure_buffers_for_index(AVFormatContext *s, int64_t time_tolerance)
 
 int av_index_search_timestamp(AVStream *st, int64_t wanted_timestamp, int flags)
 {
-    const FFStream *const sti = ffstream(st);
+    FFStream *const sti = ffstream(st);
+    if (sti->index_blocks)
+        return blocks_search_timestamp(sti->index_blocks, wanted_timestamp, flags);
     return ff_index_search_timestamp(sti->index_entries, sti->nb_index_entries,
                                      wanted_timestamp, flags);
 }
 
 int avformat_index_get_entries_count(const AVStream *st)
 {
-    return cffstream(st)->nb_index_entries;
+    return index_nb_entries(cffstream(st));
 }
 
 const AVIndexEntry *avformat_index_get_entry(AVStream *st, int idx)
 {
-    const FFStream *const sti = ffstream(st);
-    if (idx < 0 || idx >= sti->nb_index_entries)
-        return NULL;
-
-    return &sti->index_entries[idx];
+    return index_get_entry(ffstream(st), idx);
 }
 
 const AVIndexEntry *avformat_index_get_entry_from_timestamp(AVStream *st,
                                                             int64_t wanted_timestamp,
                                                             int flags)
 {
-    const FFStream *const sti = ffstream(st);
-    int idx = ff_index_search_timestamp(sti->index_entries,
-                                        sti->nb_index_entries,
-                                        wanted_timestamp, flags);
+    int idx = av_index_search_timestamp(st, wanted_timestamp, flags);
 
     if (idx < 0)
         return NULL;
 
-    return &sti->index_entries[idx];
+    return index_get_entry(ffstream(st), idx);
 }
 
 static int64_t read_timestamp(AVFormatContext *s, int stream_index, int64_t *ppos, int64_t pos_limit,
@@ -309,7 +887,7 @@ int ff_seek_frame_binary(AVFormatContext *s, int stream_index,
 
     st  = s->streams[stream_index];
     sti = ffstream(st);
-    if (sti->index_entries) {
+    if (index_nb_entries(sti)) {
         const AVIndexEntry *e;
 
         /* FIXME: Whole function must be checked for non-keyframe entries in
@@ -317,7 +895,9 @@ int ff_seek_frame_binary(AVFormatContext *s, int stream_index,
         index = av_index_search_timestamp(st, target_ts,
                                           flags | AVSEEK_FLAG_BACKWARD);
         index = FFMAX(index, 0);
-        e     = &sti->index_entries[index];
+        e     = index_get_entry(sti, index);
+        if (!e)
+            return AVERROR(ENOMEM);
 
         if (e->timestamp <= target_ts || e->pos == e->min_distance) {
             pos_min = e->pos;
@@ -330,9 +910,11 @@ int ff_seek_frame_binary(AVFormatContext *s, int stream_index,
 
         index = av_index_search_timestamp(st, target_ts,
                                           flags & ~AVSEEK_FLAG_BACKWARD);
-        av_assert0(index < sti->nb_index_entries);
+        av_assert0(index < index_nb_entries(sti));
         if (index >= 0) {
-            e = &sti->index_entries[index];
+            e = index_get_entry(sti, index);
+            if (!e)
+                return AVERROR(ENOMEM);
             av_assert1(e->timestamp >= target_ts);
             pos_max   = e->pos;
             ts_max    = e->timestamp;
@@ -535,17 +1117,18 @@ static int seek_frame_generic(AVFormatContext *s, int stream_index,
 
     index = av_index_search_timestamp(st, timestamp, flags);
 
-    if (index < 0 && sti->nb_index_entries &&
-        timestamp < sti->index_entries[0].timestamp)
+    if (index < 0 && (ie = index_get_entry(sti, 0)) &&
+        timestamp < ie->timestamp)
         return -1;
 
-    if (index < 0 || index == sti->nb_index_entries - 1) {
+    if (index < 0 || index == index_nb_entries(sti) - 1) {
         AVPacket *const pkt = si->pkt;
         int nonkey = 0;
 
-        if (sti->nb_index_entries) {
-            av_assert0(sti->index_entries);
-            ie = &sti->index_entries[sti->nb_index_entries - 1];
+        if (index_nb_entries(sti)) {
+            ie = index_get_entry(sti, index_nb_entries(sti) - 1);
+            if (!ie)
+                return AVERROR(ENOMEM);
             if ((ret = avio_seek(s->pb, ie->pos, SEEK_SET)) < 0)
                 return ret;
             s->io_repositioned = 1;
@@ -585,7 +1168,9 @@ static int seek_frame_generic(AVFormatContext *s, int stream_index,
     if (ffifmt(s->iformat)->read_seek)
         if (ffifmt(s->iformat)->read_seek(s, stream_index, timestamp, flags) >= 0)
             return 0;
-    ie = &sti->index_entries[index];
+    ie = index_get_entry(sti, index);
+    if (!ie)
+        return AVERROR(ENOMEM);
     if ((ret = avio_seek(s->pb, ie->pos, SEEK_SET)) < 0)
         return ret;
     s->io_repositioned = 1;
@@ -156,6 +156,7 @@ static int segment_mux_init(AVFormatContext *s)
     if (ret < 0)
         return ret;
     oc = seg->avf;
+    ffformatcontext(oc)->nested = 1;
 
     oc->interrupt_callback = s->interrupt_callback;
     oc->max_delay          = s->max_delay;
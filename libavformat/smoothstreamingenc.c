@@ -323,6 +323,7 @@ static int ism_write_header(AVFormatContext *s)
         if (!ctx) {
             return AVERROR(ENOMEM);
         }
+        ffformatcontext(ctx)->nested = 1;
         if ((ret = ff_copy_whiteblacklists(ctx, s)) < 0)
             return ret;
         ctx->oformat = oformat;
@@ -536,6 +536,10 @@ static int tee_write_packet(AVFormatContext *avf, AVPacket *pkt)
     unsigned s;
     int s2;
 
+    /* Make the slaves share one reference instead of each copying the data. */
+    if (pkt && (ret = av_packet_make_refcounted(pkt)) < 0)
+        return ret;
+
     for (unsigned i = 0; i < tee->nb_slaves; i++) {
         AVFormatContext *avf2 = tee->slaves[i].avf;
         AVBSFContext *bsfs;
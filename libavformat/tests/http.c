@@ -0,0 +1,284 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Read and seek in a file served by a minimal keep-alive HTTP server on the
+ * loopback interface, with the connection pool enabled, so that seeks take
+ * idle connections from the pool.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/dict.h"
+#include "libavutil/time.h"
+#include "libavformat/avformat.h"
+#include "libavformat/network.h"
+#include "libavformat/url.h"
+
+#define FILE_SIZE   100000
+#define FAIL_OFFSET 77777   ///< requests from this offset get an error reply
+#define SLOW_OFFSET 50000   ///< replies from this offset pause after PAUSE_SIZE bytes
+#define PAUSE_SIZE  4096
+#define MAX_CONNS   32
+
+typedef struct Server {
+    int fd;
+    int port;
+    volatile int quit;
+    int nb_conns;
+    int conn_fds[MAX_CONNS];
+    pthread_t conn_threads[MAX_CONNS];
+} Server;
+
+static uint8_t file_data[FILE_SIZE];
+
+static int send_all(int fd, const void *buf, int size)
+{
+    const uint8_t *p = buf;
+
+    while (size > 0) {
+        int ret = send(fd, p, size, 0);
+        if (ret <= 0)
+            return -1;
+        p    += ret;
+        size -= ret;
+    }
+    return 0;
+}
+
+static void *conn_thread(void *arg)
+{
+    int fd = *(int *)arg;
+    char req[2048], hdr[256];
+
+    for (;;) {
+        const char *range;
+        int len = 0, start = 0, hdr_len;
+
+        do {
+            int ret = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+            if (ret <= 0)
+                return NULL;
+            len += ret;
+            req[len] = 0;
+        } while (!strstr(req, "\r\n\r\n") && len < sizeof(req) - 1);
+
+        if ((range = strstr(req, "\r\nRange: bytes=")))
+            start = atoi(range + 15);
+
+        if (start == FAIL_OFFSET) {
+            hdr_len = snprintf(hdr, sizeof(hdr),
+                               "HTTP/1.1 500 Internal Server Error\r\n"
+                               "Content-Length: 0\r\n\r\n");
+        } else if (start >= FILE_SIZE) {
+            hdr_len = snprintf(hdr, sizeof(hdr),
+                               "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                               "Content-Length: 0\r\n\r\n");
+            start = FILE_SIZE;
+        } else {
+            hdr_len = snprintf(hdr, sizeof(hdr),
+                               "HTTP/1.1 206 Partial Content\r\n"
+                               "Accept-Ranges: bytes\r\n"
+                               "Content-Range: bytes %d-%d/%d\r\n"
+                               "Content-Length: %d\r\n\r\n",
+                               start, FILE_SIZE - 1, FILE_SIZE, FILE_SIZE - start);
+        }
+        if (send_all(fd, hdr, hdr_len) < 0)
+            return NULL;
+        if (start == FAIL_OFFSET)
+            continue;
+        /* make the client wait for the data, so that it checks the
+         * interrupt callback of the connection */
+        if (start == SLOW_OFFSET) {
+            if (send_all(fd, file_data + start, PAUSE_SIZE) < 0)
+                return NULL;
+            start += PAUSE_SIZE;
+            av_usleep(300000);
+        }
+        if (send_all(fd, file_data + start, FILE_SIZE - start) < 0)
+            return NULL;
+    }
+}
+
+static void *server_thread(void *arg)
+{
+    Server *s = arg;
+
+    while (!s->quit) {
+        struct pollfd p = { s->fd, POLLIN, 0 };
+        int fd;
+
+        if (poll(&p, 1, 50) <= 0)
+            continue;
+        fd = accept(s->fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+        if (s->nb_conns == MAX_CONNS) {
+            closesocket(fd);
+            continue;
+        }
+        s->conn_fds[s->nb_conns] = fd;
+        if (pthread_create(&s->conn_threads[s->nb_conns], NULL, conn_thread,
+                           &s->conn_fds[s->nb_conns])) {
+            closesocket(fd);
+            continue;
+        }
+        s->nb_conns++;
+    }
+    return NULL;
+}
+
+static int check(URLContext *h, int pos, int size)
+{
+    uint8_t buf[2 * PAUSE_SIZE];
+    int ret = ffurl_read_complete(h, buf, size);
+
+    if (ret != size) {
+        printf("read %d bytes at %d: got %d\n", size, pos, ret);
+        return 1;
+    }
+    if (memcmp(buf, file_data + pos, size)) {
+        printf("read %d bytes at %d: mismatch\n", size, pos);
+        return 1;
+    }
+    printf("read %d bytes at %d: ok\n", size, pos);
+    return 0;
+}
+
+static int open_url(URLContext **h, const char *url)
+{
+    AVDictionary *opts = NULL;
+    int ret;
+
+    av_dict_set(&opts, "connection_pool", "1", 0);
+    ret = ffurl_open_whitelist(h, url, AVIO_FLAG_READ, NULL, &opts,
+                               NULL, NULL, NULL);
+    av_dict_free(&opts);
+    return ret;
+}
+
+static int read_to_end(URLContext *h)
+{
+    uint8_t buf[4096];
+    int ret, size = 0;
+
+    while ((ret = ffurl_read(h, buf, sizeof(buf))) > 0)
+        size += ret;
+    return ret == AVERROR_EOF ? size : ret;
+}
+
+static int seek(URLContext *h, int pos)
+{
+    int64_t ret = ffurl_seek(h, pos, SEEK_SET);
+
+    printf("seek to %d: %s\n", pos, ret == pos ? "ok" : "failed");
+    return ret;
+}
+
+int main(void)
+{
+    Server server = { 0 };
+    struct sockaddr_in addr = { 0 };
+    socklen_t addr_len = sizeof(addr);
+    pthread_t thread;
+    URLContext *h[3] = { NULL }, *h1 = NULL;
+    char url[64];
+    int err = 0;
+
+    for (int i = 0; i < FILE_SIZE; i++)
+        file_data[i] = i * 31 + (i >> 8);
+
+#ifdef SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    avformat_network_init();
+
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    server.fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server.fd < 0 ||
+        bind(server.fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(server.fd, 8) ||
+        getsockname(server.fd, (struct sockaddr *)&addr, &addr_len)) {
+        fprintf(stderr, "Cannot create the server socket\n");
+        return 1;
+    }
+    server.port = ntohs(addr.sin_port);
+    if (pthread_create(&thread, NULL, server_thread, &server)) {
+        closesocket(server.fd);
+        return 1;
+    }
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/file", server.port);
+
+    /* leave idle connections in the pool for the open and the first two seeks */
+    for (int i = 0; i < 3; i++) {
+        if (open_url(&h[i], url) < 0) {
+            printf("opening failed\n");
+            err = 1;
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        if (!err && read_to_end(h[i]) != FILE_SIZE) {
+            printf("reading the whole file failed\n");
+            err = 1;
+        }
+        ffurl_closep(&h[i]);
+    }
+
+    /* the seeks replace a pooled connection while it is still open */
+    if (!err && open_url(&h1, url) < 0) {
+        printf("opening failed\n");
+        err = 1;
+    }
+    if (!err) {
+        err |= check(h1, 0, 1000);
+        if (seek(h1, SLOW_OFFSET) == SLOW_OFFSET)
+            err |= check(h1, SLOW_OFFSET, 1000);
+        else
+            err = 1;
+        /* a failed seek keeps reading the previous connection */
+        if (seek(h1, FAIL_OFFSET) >= 0)
+            err = 1;
+        err |= check(h1, SLOW_OFFSET + 1000, 2 * PAUSE_SIZE);
+        if (seek(h1, 20000) == 20000)
+            err |= check(h1, 20000, 4000);
+        else
+            err = 1;
+        if (seek(h1, 1000) == 1000)
+            err |= check(h1, 1000, 2000);
+        else
+            err = 1;
+    }
+    ffurl_closep(&h1);
+
+    server.quit = 1;
+    pthread_join(thread, NULL);
+    for (int i = 0; i < server.nb_conns; i++) {
+        shutdown(server.conn_fds[i], SHUT_RDWR);
+        pthread_join(server.conn_threads[i], NULL);
+        closesocket(server.conn_fds[i]);
+    }
+    closesocket(server.fd);
+    printf("connections: %d\n", server.nb_conns);
+
+    avformat_network_deinit();
+    return err;
+}
@@ -0,0 +1,182 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+
+#include "libavutil/lfg.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+#include "libavformat/avformat.h"
+#include "libavformat/demux.h"
+
+static const FFInputFormat compact_format = {
+    .p.name         = "compact",
+    .flags_internal = FF_INFMT_FLAG_COMPACT_INDEX,
+};
+
+static int compare_entries(AVStream *ref, AVStream *st, int step)
+{
+    int nb = avformat_index_get_entries_count(ref);
+
+    if (avformat_index_get_entries_count(st) != nb) {
+        printf("step %d: %d entries, expected %d\n",
+               step, avformat_index_get_entries_count(st), nb);
+        return 1;
+    }
+    for (int i = 0; i < nb; i++) {
+        AVIndexEntry a = *avformat_index_get_entry(ref, i);
+        const AVIndexEntry *b = avformat_index_get_entry(st, i);
+
+        if (!b || a.pos != b->pos || a.timestamp != b->timestamp ||
+            a.flags != b->flags || a.size != b->size ||
+            a.min_distance != b->min_distance) {
+            printf("step %d: entry %d mismatch\n", step, i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static const int search_flags[] = {
+        0, AVSEEK_FLAG_BACKWARD, AVSEEK_FLAG_ANY,
+        AVSEEK_FLAG_ANY | AVSEEK_FLAG_BACKWARD,
+    };
+    AVFormatContext *ref_ctx = avformat_alloc_context();
+    AVFormatContext *ctx     = avformat_alloc_context();
+    AVStream *ref, *st;
+    AVLFG lfg;
+    int64_t ts = 0, last_ts;
+    int ret = 1;
+
+    if (!ref_ctx || !ctx)
+        goto end;
+    ctx->iformat = &compact_format.p;
+    ref = avformat_new_stream(ref_ctx, NULL);
+    st  = avformat_new_stream(ctx, NULL);
+    if (!ref || !st)
+        goto end;
+
+    av_lfg_init(&lfg, 0xdeadbeef);
+
+    /* Mostly appended entries, with inserts and replacements in between,
+     * compared against the flat index. */
+    for (int i = 0; i < 20000; i++) {
+        unsigned r = av_lfg_get(&lfg);
+        int64_t t, pos;
+        int size  = r >> 12 & 0xFFFF;
+        int flags = r & 7 ? AVINDEX_KEYFRAME : r & 8 ? AVINDEX_DISCARD_FRAME : 0;
+        int dist  = r >> 28;
+
+        if (r % 10) {
+            ts += 1 + (r >> 4) % 3000;
+            t   = ts;
+        } else {
+            /* Half of the inserts go to the start, to get blocks split. */
+            t = ts ? av_lfg_get(&lfg) % (r & 16 ? FFMIN(ts, 300000) : ts) : 0;
+        }
+        pos = t * 37 - (r & 0xFF);
+
+        if (av_add_index_entry(ref, pos, t, size, dist, flags) !=
+            av_add_index_entry(st,  pos, t, size, dist, flags)) {
+            printf("step %d: add mismatch\n", i);
+            goto end;
+        }
+        if (!(i % 2000) && compare_entries(ref, st, i))
+            goto end;
+    }
+    if (compare_entries(ref, st, -1))
+        goto end;
+    printf("%d entries\n", avformat_index_get_entries_count(st));
+
+    for (int i = 0; i < 20000; i++) {
+        int64_t t     = av_lfg_get(&lfg) % (ts + 2000) - 1000;
+        int     flags = search_flags[i & 3];
+        const AVIndexEntry *e;
+        int idx = av_index_search_timestamp(ref, t, flags);
+
+        if (av_index_search_timestamp(st, t, flags) != idx) {
+            printf("search %"PRId64" flags %d mismatch\n", t, flags);
+            goto end;
+        }
+        e = avformat_index_get_entry_from_timestamp(st, t, flags);
+        if (idx < 0 ? !!e : !e || e->timestamp != avformat_index_get_entry(ref, idx)->timestamp) {
+            printf("entry from timestamp %"PRId64" flags %d mismatch\n", t, flags);
+            goto end;
+        }
+    }
+    printf("searches match\n");
+
+    /* The compact index must stay within max_index_size while retaining
+     * more entries than a flat one could. */
+    avformat_free_context(ctx);
+    ctx = avformat_alloc_context();
+    if (!ctx)
+        goto end;
+    ctx->iformat        = &compact_format.p;
+    ctx->max_index_size = 1 << 16;
+    st = avformat_new_stream(ctx, NULL);
+    if (!st)
+        goto end;
+    for (int i = 0; i < 1000000; i++) {
+        ff_reduce_index(ctx, 0);
+        if (av_add_index_entry(st, 188LL * 90 * i, 3600LL * i, 0, 0, AVINDEX_KEYFRAME) < 0) {
+            printf("add %d failed\n", i);
+            goto end;
+        }
+    }
+    if (avformat_index_get_entries_count(st) <= ctx->max_index_size / sizeof(AVIndexEntry) ||
+        avformat_index_get_entries_count(st) >  ctx->max_index_size / 4) {
+        printf("%d entries left\n", avformat_index_get_entries_count(st));
+        goto end;
+    }
+    last_ts = -1;
+    for (int i = 0; i < avformat_index_get_entries_count(st); i++) {
+        const AVIndexEntry *e = avformat_index_get_entry(st, i);
+        if (e->timestamp <= last_ts || e->pos != e->timestamp / 3600 * 188 * 90) {
+            printf("reduced entry %d mismatch\n", i);
+            goto end;
+        }
+        last_ts = e->timestamp;
+    }
+    printf("%d entries after reduction\n", avformat_index_get_entries_count(st));
+
+    /* If the index cannot be reduced for lack of memory, parts of it are
+     * dropped instead, leaving it sorted. */
+    ctx->max_index_size = 0;
+    av_max_alloc(1024);
+    ff_reduce_index(ctx, 0);
+    av_max_alloc(INT_MAX);
+    last_ts = -1;
+    for (int i = 0; i < avformat_index_get_entries_count(st); i++) {
+        const AVIndexEntry *e = avformat_index_get_entry(st, i);
+        if (!e || e->timestamp <= last_ts || e->pos != e->timestamp / 3600 * 188 * 90) {
+            printf("dropped entry %d mismatch\n", i);
+            goto end;
+        }
+        last_ts = e->timestamp;
+    }
+    printf("%d entries after dropping\n", avformat_index_get_entries_count(st));
+
+    ret = 0;
+end:
+    avformat_free_context(ref_ctx);
+    avformat_free_context(ctx);
+    return ret;
+}
@@ -470,6 +470,17 @@ int main(int argc, char **argv)
     close_out();
     memcpy(content, hash, HASH_SIZE);
 
+    // The same file, written from a background thread.
+    init_out("empty-moov-async");
+    av_dict_set(&opts, "movflags", "+frag_keyframe+empty_moov", 0);
+    av_dict_set(&opts, "use_editlist", "0", 0);
+    av_dict_set(&opts, "async_fragments", "1", 0);
+    init(0, 0);
+    mux_gops(2);
+    finish();
+    close_out();
+    check(!memcmp(hash, content, HASH_SIZE), "async_fragments output differs");
+
     // Similar to the previous one, but with input that doesn't start at
     // pts/dts 0. avoid_negative_ts behaves in the same way as
     // in non-empty-moov-no-elst above.
@@ -595,6 +606,25 @@ int main(int argc, char **argv)
     check(!memcmp(hash, content, HASH_SIZE), "delay_moov content differs from empty_moov");
     finish();
 
+    // A manual flush with async_fragments returns once the fragment has
+    // been written, so that the caller may close or replace the output.
+    init_out("empty-moov-async-header");
+    av_dict_set(&opts, "movflags", "+frag_custom+empty_moov", 0);
+    av_dict_set(&opts, "use_editlist", "0", 0);
+    av_dict_set(&opts, "async_fragments", "1", 0);
+    init(0, 0);
+    close_out();
+    check(!memcmp(hash, header, HASH_SIZE), "async_fragments header differs from empty_moov");
+    init_out("empty-moov-async-content");
+    mux_gops(1);
+    av_write_frame(ctx, NULL); // Flush the first fragment
+    check(out_size == empty_moov_pos, "Flushed fragment not written with async_fragments, %d vs %d", out_size, empty_moov_pos);
+    mux_gops(1);
+    av_write_frame(ctx, NULL); // Flush the second fragment
+    close_out();
+    check(!memcmp(hash, content, HASH_SIZE), "async_fragments content differs from empty_moov");
+    finish();
+
 
     // Verify that we can produce an identical second fragment without
     // writing the first one. First write the reference fragments that
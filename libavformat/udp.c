@@ -26,6 +26,7 @@
 
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE     /* Needed for using struct ip_mreq with recent glibc */
+#define _GNU_SOURCE     /* Needed for recvmmsg() and sendmmsg() */
 
 #include "avformat.h"
 #include "libavutil/avassert.h"
@@ -45,6 +46,10 @@
 #include "TargetConditionals.h"
 #endif
 
+#if HAVE_SENDMMSG
+#include <netinet/udp.h>
+#endif
+
 #if HAVE_UDPLITE_H
 #include "udplite.h"
 #else
@@ -77,6 +82,9 @@
 #define UDP_RX_BUF_SIZE 393216
 #define UDP_MAX_PKT_SIZE 65536
 #define UDP_HEADER_SIZE 8
+#define UDP_MAX_BATCH 64
+/* Largest UDP payload over IPv4, also the limit for segmentation offload. */
+#define UDP_MAX_GSO_SIZE 65507
 
 typedef struct UDPContext {
     const AVClass *class;
@@ -115,6 +123,16 @@ typedef struct UDPContext {
     char *sources;
     char *block;
     IPSourceFilters filters;
+
+    int recv_batch;
+    int send_batch;
+    int gso;
+    uint8_t *recv_buf;
+    /* statistics, logged when closing */
+    uint64_t nb_reads, nb_full_reads, nb_received;
+    uint64_t nb_overrun_drops;
+    uint32_t nb_kernel_drops;
+    uint64_t nb_sends, nb_sent;
 } UDPContext;
 
 #define OFFSET(x) offsetof(UDPContext, x)
@@ -139,6 +157,9 @@ static const AVOption options[] = {
     { "timeout",        "set raise error timeout, in microseconds (only in read mode)",OFFSET(timeout),         AV_OPT_TYPE_INT,  {.i64 = 0}, 0, INT_MAX, D },
     { "sources",        "Source list",                                     OFFSET(sources),        AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
     { "block",          "Block list",                                      OFFSET(block),          AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
+    { "recv_batch",     "max number of datagrams read per system call by the receiving thread", OFFSET(recv_batch), AV_OPT_TYPE_INT, { .i64 = 16 }, 1, UDP_MAX_BATCH, D },
+    { "send_batch",     "number of pkt_size datagrams sent per system call", OFFSET(send_batch), AV_OPT_TYPE_INT,   { .i64 = 1 },      1, UDP_MAX_BATCH, E },
+    { "gso",            "use UDP segmentation offload to send batches",    OFFSET(gso),            AV_OPT_TYPE_BOOL,   { .i64 = 1 },      0, 1,       E },
     { NULL }
 };
 
@@ -478,12 +499,141 @@ static int udp_get_file_handle(URLContext *h)
     return s->udp_fd;
 }
 
+/**
+ * Send buf as datagrams of pkt_size bytes if batching, or as a single one.
+ * @return the number of bytes sent, ending on a datagram boundary, or a
+ *         negative error code
+ */
+static int udp_send(UDPContext *s, const uint8_t *buf, int size)
+{
+    struct sockaddr *dest = s->is_connected ? NULL : (struct sockaddr *)&s->dest_addr;
+    socklen_t dest_len    = s->is_connected ? 0    : s->dest_addr_len;
+    int seg = s->send_batch > 1 ? FFMIN(s->pkt_size, size) : size;
+    int ret;
+
+#if HAVE_SENDMMSG
+    if (size > seg) {
+        struct mmsghdr msgs[UDP_MAX_BATCH] = { 0 };
+        struct iovec iov[UDP_MAX_BATCH];
+        int n;
+
+#ifdef UDP_SEGMENT
+        if (s->gso && size <= UDP_MAX_GSO_SIZE &&
+            (size + seg - 1) / seg <= UDP_MAX_BATCH) {
+            union {
+                char buf[CMSG_SPACE(sizeof(uint16_t))];
+                struct cmsghdr align;
+            } control = { 0 };
+            struct msghdr *msg = &msgs[0].msg_hdr;
+            struct cmsghdr *cmsg;
+            uint16_t gso_size = seg;
+
+            iov[0].iov_base     = (uint8_t *)buf;
+            iov[0].iov_len      = size;
+            msg->msg_name       = dest;
+            msg->msg_namelen    = dest_len;
+            msg->msg_iov        = iov;
+            msg->msg_iovlen     = 1;
+            msg->msg_control    = control.buf;
+            msg->msg_controllen = sizeof(control.buf);
+            cmsg = CMSG_FIRSTHDR(msg);
+            cmsg->cmsg_level = IPPROTO_UDP;
+            cmsg->cmsg_type  = UDP_SEGMENT;
+            cmsg->cmsg_len   = CMSG_LEN(sizeof(gso_size));
+            memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+
+            ret = sendmsg(s->udp_fd, msg, 0);
+            if (ret >= 0) {
+                s->nb_sends++;
+                s->nb_sent += (size + seg - 1) / seg;
+                return size;
+            }
+            ret = ff_neterrno();
+            if (ret != AVERROR(EINVAL) && ret != AVERROR(EIO) &&
+                ret != AVERROR(ENOPROTOOPT) && ret != AVERROR(EOPNOTSUPP))
+                return ret;
+            av_log(s, AV_LOG_VERBOSE, "UDP segmentation offload not available, "
+                   "falling back to sendmmsg()\n");
+            s->gso = 0;
+        }
+#endif
+        for (n = 0; n < UDP_MAX_BATCH && n * seg < size; n++) {
+            iov[n].iov_base = (uint8_t *)buf + n * seg;
+            iov[n].iov_len  = FFMIN(seg, size - n * seg);
+            msgs[n].msg_hdr = (struct msghdr){
+                .msg_name    = dest,
+                .msg_namelen = dest_len,
+                .msg_iov     = &iov[n],
+                .msg_iovlen  = 1,
+            };
+        }
+        ret = sendmmsg(s->udp_fd, msgs, n, 0);
+        if (ret < 0)
+            return ff_neterrno();
+        s->nb_sends++;
+        s->nb_sent += ret;
+        return FFMIN(ret * seg, size);
+    }
+#endif
+
+    if (dest)
+        ret = sendto (s->udp_fd, buf, seg, 0, dest, dest_len);
+    else
+        ret = send(s->udp_fd, buf, seg, 0);
+    if (ret < 0)
+        return ff_neterrno();
+    s->nb_sends++;
+    s->nb_sent++;
+    return ret;
+}
+
 #if HAVE_PTHREAD_CANCEL
+#if HAVE_RECVMMSG
+static void udp_update_kernel_drops(URLContext *h, struct msghdr *msg)
+{
+#ifdef SO_RXQ_OVFL
+    UDPContext *s = h->priv_data;
+    struct cmsghdr *cmsg;
+
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t drops;
+            memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            if (drops != s->nb_kernel_drops && !s->nb_kernel_drops)
+                av_log(h, AV_LOG_WARNING, "Datagrams dropped by the kernel. "
+                       "To avoid, increase buffer_size URL option.\n");
+            s->nb_kernel_drops = drops;
+        }
+    }
+#endif
+}
+#endif
+
 static void *circular_buffer_task_rx( void *_URLContext)
 {
     URLContext *h = _URLContext;
     UDPContext *s = h->priv_data;
+    struct sockaddr_storage addr[UDP_MAX_BATCH];
     int old_cancelstate;
+#if HAVE_RECVMMSG
+    struct mmsghdr msgs[UDP_MAX_BATCH];
+    struct iovec iov[UDP_MAX_BATCH];
+    union {
+        char buf[CMSG_SPACE(sizeof(uint32_t))];
+        struct cmsghdr align;
+    } control[UDP_MAX_BATCH];
+
+    for (int i = 0; i < s->recv_batch; i++) {
+        iov[i].iov_base = s->recv_buf + i * UDP_MAX_PKT_SIZE;
+        iov[i].iov_len  = UDP_MAX_PKT_SIZE;
+        msgs[i].msg_hdr = (struct msghdr){
+            .msg_name    = &addr[i],
+            .msg_iov     = &iov[i],
+            .msg_iovlen  = 1,
+            .msg_control = control[i].buf,
+        };
+    }
+#endif
 
     ff_thread_setname("udp-rx");
 
@@ -495,44 +645,71 @@ static void *circular_buffer_task_rx( void *_URLContext)
         goto end;
     }
     while(1) {
+        int n;
+#if HAVE_RECVMMSG
+        for (int i = 0; i < s->recv_batch; i++) {
+            msgs[i].msg_hdr.msg_namelen    = sizeof(addr[i]);
+            msgs[i].msg_hdr.msg_controllen = sizeof(control[i].buf);
+        }
+#else
+        socklen_t addr_len = sizeof(addr[0]);
         int len;
-        struct sockaddr_storage addr;
-        socklen_t addr_len = sizeof(addr);
+#endif
 
         pthread_mutex_unlock(&s->mutex);
         /* Blocking operations are always cancellation points;
            see "General Information" / "Thread Cancelation Overview"
            in Single Unix. */
         pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_cancelstate);
-        len = recvfrom(s->udp_fd, s->tmp+4, sizeof(s->tmp)-4, 0, (struct sockaddr *)&addr, &addr_len);
+#if HAVE_RECVMMSG
+        n = recvmmsg(s->udp_fd, msgs, s->recv_batch, MSG_WAITFORONE, NULL);
+#else
+        n = len = recvfrom(s->udp_fd, s->recv_buf, UDP_MAX_PKT_SIZE, 0, (struct sockaddr *)&addr[0], &addr_len);
+        if (len >= 0)
+            n = 1;
+#endif
         pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancelstate);
         pthread_mutex_lock(&s->mutex);
-        if (len < 0) {
+        if (n < 0) {
             if (ff_neterrno() != AVERROR(EAGAIN) && ff_neterrno() != AVERROR(EINTR)) {
                 s->circular_buffer_error = ff_neterrno();
                 goto end;
             }
             continue;
         }
-        if (ff_ip_check_source_lists(&addr, &s->filters))
-            continue;
-        AV_WL32(s->tmp, len);
+        s->nb_reads++;
+        s->nb_full_reads += n == s->recv_batch;
+        s->nb_received   += n;
+
+        for (int i = 0; i < n; i++) {
+            uint8_t tmp[4];
+#if HAVE_RECVMMSG
+            int len = msgs[i].msg_len;
 
-        if (av_fifo_can_write(s->fifo) < len + 4) {
-            /* No Space left */
-            if (s->overrun_nonfatal) {
-                av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
-                        "Surviving due to overrun_nonfatal option\n");
+            udp_update_kernel_drops(h, &msgs[i].msg_hdr);
+#endif
+            if (ff_ip_check_source_lists(&addr[i], &s->filters))
                 continue;
-            } else {
-                av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
-                        "To avoid, increase fifo_size URL option. "
-                        "To survive in such case, use overrun_nonfatal option\n");
-                s->circular_buffer_error = AVERROR(EIO);
-                goto end;
+            AV_WL32(tmp, len);
+
+            if (av_fifo_can_write(s->fifo) < len + 4) {
+                /* No Space left */
+                if (s->overrun_nonfatal) {
+                    av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
+                            "Surviving due to overrun_nonfatal option\n");
+                    s->nb_overrun_drops++;
+                    continue;
+                } else {
+                    av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
+                            "To avoid, increase fifo_size URL option. "
+                            "To survive in such case, use overrun_nonfatal option\n");
+                    s->circular_buffer_error = AVERROR(EIO);
+                    goto end;
+                }
             }
+            av_fifo_write(s->fifo, tmp, 4);
+            av_fifo_write(s->fifo, s->recv_buf + i * UDP_MAX_PKT_SIZE, len);
         }
-        av_fifo_write(s->fifo, s->tmp, len + 4);
         pthread_cond_signal(&s->cond);
     }
 
@@ -611,17 +788,11 @@ static void *circular_buffer_task_tx( void *_URLContext)
         while (len) {
             int ret;
             av_assert0(len > 0);
-            if (!s->is_connected) {
-                ret = sendto (s->udp_fd, p, len, 0,
-                            (struct sockaddr *) &s->dest_addr,
-                            s->dest_addr_len);
-            } else
-                ret = send(s->udp_fd, p, len, 0);
+            ret = udp_send(s, p, len);
             if (ret >= 0) {
                 len -= ret;
                 p   += ret;
             } else {
-                ret = ff_neterrno();
                 if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR)) {
                     pthread_mutex_lock(&s->mutex);
                     s->circular_buffer_error = ret;
@@ -709,6 +880,12 @@ static int udp_open(URLContext *h, const char *uri, int flags)
         if (av_find_info_tag(buf, sizeof(buf), "pkt_size", p)) {
             s->pkt_size = strtol(buf, NULL, 10);
         }
+        if (av_find_info_tag(buf, sizeof(buf), "recv_batch", p)) {
+            s->recv_batch = av_clip(strtol(buf, NULL, 10), 1, UDP_MAX_BATCH);
+        }
+        if (av_find_info_tag(buf, sizeof(buf), "send_batch", p)) {
+            s->send_batch = av_clip(strtol(buf, NULL, 10), 1, UDP_MAX_BATCH);
+        }
         if (av_find_info_tag(buf, sizeof(buf), "buffer_size", p)) {
             s->buffer_size = strtol(buf, NULL, 10);
         }
@@ -759,7 +936,13 @@ static int udp_open(URLContext *h, const char *uri, int flags)
     /* handling needed to support options picking from both AVOption and URL */
     s->circular_buffer_size *= 188;
     if (flags & AVIO_FLAG_WRITE) {
-        h->max_packet_size = s->pkt_size;
+        /* Batches are limited to what fits into one segmentation offload
+         * send, and into the buffer of the sending thread. */
+        if (s->pkt_size > 0)
+            s->send_batch = av_clip(UDP_MAX_GSO_SIZE / s->pkt_size, 1, s->send_batch);
+        else
+            s->send_batch = 1;
+        h->max_packet_size = s->pkt_size * s->send_batch;
     } else {
         h->max_packet_size = UDP_MAX_PKT_SIZE;
     }
@@ -940,6 +1123,20 @@ static int udp_open(URLContext *h, const char *uri, int flags)
             ret = AVERROR(ENOMEM);
             goto fail;
         }
+        if (!is_output) {
+            if (!HAVE_RECVMMSG)
+                s->recv_batch = 1;
+            s->recv_buf = av_malloc((size_t)s->recv_batch * UDP_MAX_PKT_SIZE);
+            if (!s->recv_buf) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
+#if HAVE_RECVMMSG && defined(SO_RXQ_OVFL)
+            /* Have the kernel report how many datagrams it dropped. */
+            tmp = 1;
+            setsockopt(udp_fd, SOL_SOCKET, SO_RXQ_OVFL, &tmp, sizeof(tmp));
+#endif
+        }
         ret = pthread_mutex_init(&s->mutex, NULL);
         if (ret != 0) {
             av_log(h, AV_LOG_ERROR, "pthread_mutex_init failed : %s\n", strerror(ret));
@@ -973,6 +1170,7 @@ static int udp_open(URLContext *h, const char *uri, int flags)
     if (udp_fd >= 0)
         closesocket(udp_fd);
     av_fifo_freep2(&s->fifo);
+    av_freep(&s->recv_buf);
     ff_ip_reset_filters(&s->filters);
     return ret;
 }
@@ -1046,6 +1244,8 @@ static int udp_read(URLContext *h, uint8_t *buf, int size)
     ret = recvfrom(s->udp_fd, buf, size, 0, (struct sockaddr *)&addr, &addr_len);
     if (ret < 0)
         return ff_neterrno();
+    s->nb_reads++;
+    s->nb_received++;
     if (ff_ip_check_source_lists(&addr, &s->filters))
         return AVERROR(EINTR);
     return ret;
@@ -1091,14 +1291,7 @@ static int udp_write(URLContext *h, const uint8_t *buf, int size)
             return ret;
     }
 
-    if (!s->is_connected) {
-        ret = sendto (s->udp_fd, buf, size, 0,
-                      (struct sockaddr *) &s->dest_addr,
-                      s->dest_addr_len);
-    } else
-        ret = send(s->udp_fd, buf, size, 0);
-
-    return ret < 0 ? ff_neterrno() : ret;
+    return udp_send(s, buf, size);
 }
 
 static int udp_close(URLContext *h)
@@ -1142,7 +1335,19 @@ static int udp_close(URLContext *h)
 #endif
     closesocket(s->udp_fd);
     av_fifo_freep2(&s->fifo);
+    av_freep(&s->recv_buf);
     ff_ip_reset_filters(&s->filters);
+
+    if (s->nb_reads)
+        av_log(h, s->nb_kernel_drops || s->nb_overrun_drops ? AV_LOG_WARNING : AV_LOG_VERBOSE,
+               "%"PRIu64" datagrams received in %"PRIu64" reads (%.1f per read, "
+               "%"PRIu64" full batches), %"PRIu32" dropped by the kernel, "
+               "%"PRIu64" dropped on buffer overrun\n",
+               s->nb_received, s->nb_reads, (double)s->nb_received / s->nb_reads,
+               s->nb_full_reads, s->nb_kernel_drops, s->nb_overrun_drops);
+    if (s->nb_sends)
+        av_log(h, AV_LOG_VERBOSE, "%"PRIu64" datagrams sent in %"PRIu64" calls\n",
+               s->nb_sent, s->nb_sends);
     return 0;
 }
 
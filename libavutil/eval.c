@@ -176,6 +176,7 @@ struct AVExpr {
     struct AVExpr *param[3];
     double *var;
     FFSFC64 *prng_state;
+    struct ExprProgram *prog;
 };
 
 static double etime(double v)
@@ -354,6 +355,7 @@ static double eval_expr(Parser *p, AVExpr *e)
 }
 
 static int parse_expr(AVExpr **e, Parser *p);
+static void free_program(struct ExprProgram **pprog);
 
 void av_expr_free(AVExpr *e)
 {
@@ -363,6 +365,7 @@ void av_expr_free(AVExpr *e)
     av_expr_free(e->param[2]);
     av_freep(&e->var);
     av_freep(&e->prng_state);
+    free_program(&e->prog);
     av_freep(&e);
 }
 
@@ -802,6 +805,434 @@ double av_expr_eval(AVExpr *e, const double *const_values, void *opaque)
     return eval_expr(&p, e);
 }
 
+/* Expressions evaluated over arrays of values are lowered to a flat
+ * program of instructions working on registers of BATCH_SIZE lanes, one
+ * per evaluation. Each instruction runs over all the lanes before the
+ * next one, so the tree walk and the dispatch on the node type are paid
+ * once per BATCH_SIZE values, and the lanes are plain arrays suitable
+ * for SIMD. */
+#define BATCH_SIZE 64
+
+enum {
+    op_scale = e_randomi + 1,   ///< value * src[0]
+    op_mask,                    ///< lanes of src[1] (or all) where src[0] is non zero, or zero if !value
+    op_select,                  ///< src[0] ? src[1] : src[2] (or 0), times value
+};
+
+typedef struct ExprInsn {
+    int type;                   ///< e_* type of the node, or op_*
+    int dst;
+    int src[3];
+    int mask;                   ///< register of the lanes to evaluate for calls, or -1 for all
+    double value;               ///< factor applied to the result, as AVExpr.value
+    union {
+        double (*func0)(double);
+        double (*func1)(void *, double);
+        double (*func2)(void *, double, double);
+    } a;
+} ExprInsn;
+
+typedef struct ExprFixedReg {
+    int const_index;            ///< constant loaded in the register, or -1
+    double value;               ///< immediate value if const_index < 0
+} ExprFixedReg;
+
+typedef struct ExprProgram {
+    int sequential;             ///< the expression has state and cannot be batched
+    ExprInsn *insns;
+    int nb_insns;
+    ExprFixedReg *fixed;        ///< registers loaded before running the program
+    int nb_fixed;
+    int nb_temps;
+    int result;
+    double *regs;
+    const double **src;         ///< per register pointer to the lanes to read
+    double *values;             ///< constant values for sequential evaluation
+    int nb_values;
+} ExprProgram;
+
+#define TEMP_REG(n) ((1 << 24) + (n))
+
+static void free_program(ExprProgram **pprog)
+{
+    ExprProgram *prog = *pprog;
+
+    if (!prog)
+        return;
+    av_freep(&prog->insns);
+    av_freep(&prog->fixed);
+    av_freep(&prog->regs);
+    av_freep(&prog->src);
+    av_freep(&prog->values);
+    av_freep(pprog);
+}
+
+static int expr_is_sequential(const AVExpr *e)
+{
+    if (!e)
+        return 0;
+    switch (e->type) {
+    case e_ld:
+    case e_st:
+    case e_random:
+    case e_randomi:
+    case e_while:
+    case e_taylor:
+    case e_root:
+    case e_print:
+        return 1;
+    }
+    return expr_is_sequential(e->param[0]) ||
+           expr_is_sequential(e->param[1]) ||
+           expr_is_sequential(e->param[2]);
+}
+
+/* only valid for expressions without state */
+static int expr_is_constant(const AVExpr *e)
+{
+    switch (e->type) {
+    case e_value:
+        return 1;
+    case e_const:
+    case e_func1:
+    case e_func2:
+        return 0;
+    case e_func0:
+        if (e->a.func0 == etime)
+            return 0;
+    }
+    for (int i = 0; i < 3; i++)
+        if (e->param[i] && !expr_is_constant(e->param[i]))
+            return 0;
+    return 1;
+}
+
+static int add_fixed(ExprProgram *prog, int const_index, double value)
+{
+    ExprFixedReg *fixed;
+
+    for (int i = 0; const_index >= 0 && i < prog->nb_fixed; i++)
+        if (prog->fixed[i].const_index == const_index)
+            return i;
+
+    fixed = av_realloc_array(prog->fixed, prog->nb_fixed + 1, sizeof(*fixed));
+    if (!fixed)
+        return AVERROR(ENOMEM);
+    prog->fixed = fixed;
+    fixed[prog->nb_fixed].const_index = const_index;
+    fixed[prog->nb_fixed].value       = value;
+    if (const_index >= prog->nb_values)
+        prog->nb_values = const_index + 1;
+    return prog->nb_fixed++;
+}
+
+static int add_insn(ExprProgram *prog, int type, int dst, const int src[3],
+                    int mask, double value, const AVExpr *e)
+{
+    ExprInsn *insn;
+
+    if (!(prog->nb_insns & (prog->nb_insns - 1))) {
+        insn = av_realloc_array(prog->insns, FFMAX(2 * prog->nb_insns, 1), sizeof(*insn));
+        if (!insn)
+            return AVERROR(ENOMEM);
+        prog->insns = insn;
+    }
+    insn = &prog->insns[prog->nb_insns++];
+    insn->type   = type;
+    insn->dst    = dst;
+    memcpy(insn->src, src, sizeof(insn->src));
+    insn->mask   = mask;
+    insn->value  = value;
+    if (e)
+        insn->a.func2 = e->a.func2;
+    return dst;
+}
+
+static int alloc_temp(ExprProgram *prog, int *sp)
+{
+    prog->nb_temps = FFMAX(prog->nb_temps, *sp + 1);
+    return TEMP_REG((*sp)++);
+}
+
+/**
+ * Emit the instructions computing e into a register and return it.
+ * Temporaries are allocated as a stack, the ones of the operands are
+ * released once the node consuming them is emitted.
+ */
+static int compile_expr(ExprProgram *prog, Parser *p, AVExpr *e, int mask, int *sp)
+{
+    int top = *sp, src[3] = { -1, -1, -1 }, dst, ret;
+
+    if (e->type == e_value || expr_is_constant(e))
+        return add_fixed(prog, -1, eval_expr(p, e));
+
+    switch (e->type) {
+    case e_const:
+        if ((ret = add_fixed(prog, e->const_index, 0)) < 0 || e->value == 1)
+            return ret;
+        src[0] = ret;
+        return add_insn(prog, op_scale, alloc_temp(prog, sp), src, -1, e->value, NULL);
+    case e_last:
+        /* the result of the first operand is dropped, but it is evaluated
+         * for the user functions it may call */
+        if ((ret = compile_expr(prog, p, e->param[0], mask, sp)) < 0)
+            return ret;
+        *sp = top;
+        if ((ret = compile_expr(prog, p, e->param[1], mask, sp)) < 0 || e->value == 1)
+            return ret;
+        src[0] = ret;
+        *sp = top;
+        return add_insn(prog, op_scale, alloc_temp(prog, sp), src, -1, e->value, NULL);
+    case e_if:
+    case e_ifnot: {
+        int cond, mask_true;
+
+        /* both branches are evaluated, the calls to user functions
+         * only for the lanes taking them */
+        if ((cond = compile_expr(prog, p, e->param[0], mask, sp)) < 0)
+            return cond;
+        src[0] = cond;
+        src[1] = mask;
+        mask_true = add_insn(prog, op_mask, alloc_temp(prog, sp), src, -1, e->type == e_if, NULL);
+        if (mask_true < 0)
+            return mask_true;
+        if ((src[1] = compile_expr(prog, p, e->param[1], mask_true, sp)) < 0)
+            return src[1];
+        if (e->param[2]) {
+            const int src_false[3] = { cond, mask, -1 };
+            int mask_false = add_insn(prog, op_mask, alloc_temp(prog, sp), src_false, -1,
+                                      e->type != e_if, NULL);
+            if (mask_false < 0)
+                return mask_false;
+            if ((src[2] = compile_expr(prog, p, e->param[2], mask_false, sp)) < 0)
+                return src[2];
+        }
+        src[0] = mask_true;
+        *sp = top;
+        return add_insn(prog, op_select, alloc_temp(prog, sp), src, -1, e->value, NULL);
+    }
+    }
+
+    for (int i = 0; i < 3 && e->param[i]; i++)
+        if ((src[i] = compile_expr(prog, p, e->param[i], mask, sp)) < 0)
+            return src[i];
+    *sp = top;
+    dst = alloc_temp(prog, sp);
+
+    switch (e->type) {
+    case e_squish:
+    case e_gauss:
+    case e_lerp:
+        return add_insn(prog, e->type, dst, src, -1, 1, e);
+    case e_func1:
+    case e_func2:
+    case e_gcd:
+    case e_bitand:
+    case e_bitor:
+        /* user functions and integer conversions must not see the
+         * values of the lanes an if() did not select */
+        return add_insn(prog, e->type, dst, src, mask, e->value, e);
+    default:
+        return add_insn(prog, e->type, dst, src, -1, e->value, e);
+    }
+}
+
+static int add_consts(ExprProgram *prog, const AVExpr *e)
+{
+    int ret;
+
+    if (e->type == e_const && (ret = add_fixed(prog, e->const_index, 0)) < 0)
+        return ret;
+    for (int i = 0; i < 3; i++)
+        if (e->param[i] && (ret = add_consts(prog, e->param[i])) < 0)
+            return ret;
+    return 0;
+}
+
+static int compile_program(AVExpr *e)
+{
+    Parser p = { .class = &eval_class };
+    ExprProgram *prog;
+    int sp = 0, ret;
+
+    prog = av_mallocz(sizeof(*prog));
+    if (!prog)
+        return AVERROR(ENOMEM);
+    e->prog = prog;
+
+    if (expr_is_sequential(e)) {
+        prog->sequential = 1;
+        if ((ret = add_consts(prog, e)) < 0)
+            return ret;
+    } else {
+        if ((ret = compile_expr(prog, &p, e, -1, &sp)) < 0)
+            return ret;
+        prog->result = ret;
+
+        /* move the temporaries after the fixed registers */
+        for (int i = 0; i < prog->nb_insns; i++) {
+            ExprInsn *insn = &prog->insns[i];
+            insn->dst -= TEMP_REG(0) - prog->nb_fixed;
+            for (int j = 0; j < 3; j++)
+                if (insn->src[j] >= TEMP_REG(0))
+                    insn->src[j] -= TEMP_REG(0) - prog->nb_fixed;
+            if (insn->mask >= TEMP_REG(0))
+                insn->mask -= TEMP_REG(0) - prog->nb_fixed;
+        }
+        if (prog->result >= TEMP_REG(0))
+            prog->result -= TEMP_REG(0) - prog->nb_fixed;
+
+        prog->regs = av_malloc_array((prog->nb_fixed + prog->nb_temps) * BATCH_SIZE,
+                                     sizeof(*prog->regs));
+        prog->src  = av_malloc_array(prog->nb_fixed + prog->nb_temps, sizeof(*prog->src));
+        if (!prog->regs || !prog->src)
+            return AVERROR(ENOMEM);
+        for (int i = 0; i < prog->nb_fixed + prog->nb_temps; i++)
+            prog->src[i] = prog->regs + i * BATCH_SIZE;
+    }
+
+    prog->values = av_malloc_array(FFMAX(prog->nb_values, 1), sizeof(*prog->values));
+    if (!prog->values)
+        return AVERROR(ENOMEM);
+
+    return 0;
+}
+
+static void run_program(const ExprProgram *prog, int n, void *opaque)
+{
+    for (int k = 0; k < prog->nb_insns; k++) {
+        const ExprInsn *insn = &prog->insns[k];
+        double *dst = prog->regs + insn->dst * BATCH_SIZE;
+        const double *a = insn->src[0] >= 0 ? prog->src[insn->src[0]] : NULL;
+        const double *b = insn->src[1] >= 0 ? prog->src[insn->src[1]] : NULL;
+        const double *c = insn->src[2] >= 0 ? prog->src[insn->src[2]] : NULL;
+        const double *m = insn->mask   >= 0 ? prog->src[insn->mask]   : NULL;
+        const double value = insn->value;
+
+#define LOOP(expr)                                                          \
+        for (int i = 0; i < n; i++)                                         \
+            dst[i] = (expr);                                                \
+        break
+#define MASKED_LOOP(expr)                                                   \
+        for (int i = 0; i < n; i++)                                         \
+            dst[i] = !m || m[i] ? (expr) : 0;                               \
+        break
+
+        switch (insn->type) {
+        case op_scale:  LOOP(a[i]);
+        case op_mask:   LOOP((!b || b[i]) && (a[i] != 0) == (value != 0));
+        case op_select: LOOP(a[i] ? b[i] : c ? c[i] : 0);
+        case e_func0:   LOOP(insn->a.func0(a[i]));
+        case e_func1:   MASKED_LOOP(insn->a.func1(opaque, a[i]));
+        case e_func2:   MASKED_LOOP(insn->a.func2(opaque, a[i], b[i]));
+        case e_squish:  LOOP(1/(1+exp(4*a[i])));
+        case e_gauss:   LOOP(exp(-a[i]*a[i]/2)/sqrt(2*M_PI));
+        case e_isnan:   LOOP(!!isnan(a[i]));
+        case e_isinf:   LOOP(!!isinf(a[i]));
+        case e_floor:   LOOP(floor(a[i]));
+        case e_ceil:    LOOP(ceil (a[i]));
+        case e_trunc:   LOOP(trunc(a[i]));
+        case e_round:   LOOP(round(a[i]));
+        case e_sgn:     LOOP(FFDIFFSIGN(a[i], 0));
+        case e_sqrt:    LOOP(sqrt (a[i]));
+        case e_not:     LOOP(a[i] == 0);
+        case e_clip:    LOOP(isnan(b[i]) || isnan(c[i]) || isnan(a[i]) || b[i] > c[i] ? NAN :
+                             av_clipd(a[i], b[i], c[i]));
+        case e_between: LOOP(a[i] >= b[i] && a[i] <= c[i]);
+        case e_lerp:    LOOP(a[i] + (b[i] - a[i]) * c[i]);
+        case e_mod:     LOOP(a[i] - floor(b[i] ? a[i] / b[i] : a[i] * INFINITY) * b[i]);
+        case e_gcd:     MASKED_LOOP(av_gcd(a[i], b[i]));
+        case e_max:     LOOP(a[i] >  b[i] ? a[i] : b[i]);
+        case e_min:     LOOP(a[i] <  b[i] ? a[i] : b[i]);
+        case e_eq:      LOOP(a[i] == b[i] ? 1.0 : 0.0);
+        case e_gt:      LOOP(a[i] >  b[i] ? 1.0 : 0.0);
+        case e_gte:     LOOP(a[i] >= b[i] ? 1.0 : 0.0);
+        case e_lt:      LOOP(a[i] <  b[i] ? 1.0 : 0.0);
+        case e_lte:     LOOP(a[i] <= b[i] ? 1.0 : 0.0);
+        case e_pow:     LOOP(pow(a[i], b[i]));
+        case e_mul:     LOOP(a[i] * b[i]);
+        case e_div:     LOOP(b[i] ? (a[i] / b[i]) : a[i] * INFINITY);
+        case e_add:     LOOP(a[i] + b[i]);
+        case e_hypot:   LOOP(hypot(a[i], b[i]));
+        case e_atan2:   LOOP(atan2(a[i], b[i]));
+        case e_bitand:  MASKED_LOOP(isnan(a[i]) || isnan(b[i]) ? NAN : (long int)a[i] & (long int)b[i]);
+        case e_bitor:   MASKED_LOOP(isnan(a[i]) || isnan(b[i]) ? NAN : (long int)a[i] | (long int)b[i]);
+        }
+#undef LOOP
+#undef MASKED_LOOP
+
+        if (value != 1 && insn->type != op_mask)
+            for (int i = 0; i < n; i++)
+                dst[i] *= value;
+    }
+}
+
+int av_expr_eval_batch(AVExpr *e, double *res, int nb,
+                       const double *const_values, const double *const *const_arrays,
+                       void *opaque)
+{
+    ExprProgram *prog = e->prog;
+    int ret;
+
+    if (!prog) {
+        if ((ret = compile_program(e)) < 0) {
+            free_program(&e->prog);
+            return ret;
+        }
+        prog = e->prog;
+    }
+
+    for (int i = 0; i < prog->nb_fixed; i++) {
+        const ExprFixedReg *fixed = &prog->fixed[i];
+        if (fixed->const_index >= 0)
+            prog->values[fixed->const_index] = const_values ? const_values[fixed->const_index] : NAN;
+    }
+
+    if (prog->sequential) {
+        Parser p = {
+            .class        = &eval_class,
+            .const_values = prog->values,
+            .opaque       = opaque,
+            .var          = e->var,
+            .prng_state   = e->prng_state,
+        };
+
+        for (int i = 0; i < nb; i++) {
+            for (int j = 0; const_arrays && j < prog->nb_fixed; j++) {
+                const int idx = prog->fixed[j].const_index;
+                if (idx >= 0 && const_arrays[idx])
+                    prog->values[idx] = const_arrays[idx][i];
+            }
+            res[i] = eval_expr(&p, e);
+        }
+        return 0;
+    }
+
+    /* the registers of constant lanes are filled once */
+    for (int i = 0; i < prog->nb_fixed; i++) {
+        const ExprFixedReg *fixed = &prog->fixed[i];
+        const double v = fixed->const_index >= 0 ? prog->values[fixed->const_index] : fixed->value;
+        for (int j = 0; j < BATCH_SIZE; j++)
+            prog->regs[i * BATCH_SIZE + j] = v;
+        prog->src[i] = prog->regs + i * BATCH_SIZE;
+    }
+
+    for (int off = 0; off < nb; off += BATCH_SIZE) {
+        const int n = FFMIN(nb - off, BATCH_SIZE);
+
+        /* the lanes of varying constants are read in place */
+        for (int i = 0; const_arrays && i < prog->nb_fixed; i++) {
+            const int idx = prog->fixed[i].const_index;
+            if (idx >= 0 && const_arrays[idx])
+                prog->src[i] = const_arrays[idx] + off;
+        }
+        run_program(prog, n, opaque);
+        memcpy(res + off, prog->src[prog->result], n * sizeof(*res));
+    }
+
+    return 0;
+}
+
 int av_expr_parse_and_eval(double *d, const char *s,
                            const char * const *const_names, const double *const_values,
                            const char * const *func1_names, double (* const *funcs1)(void *, double),
@@ -87,6 +87,34 @@ int av_expr_parse(AVExpr **expr, const char *s,
  */
 double av_expr_eval(AVExpr *e, const double *const_values, void *opaque);
 
+/**
+ * Evaluate a previously parsed expression for several sets of values.
+ *
+ * This gives the same results as calling av_expr_eval() nb times in a row,
+ * but is significantly faster: unless the expression uses functions which
+ * keep state between evaluations, such as st() or random(), it is compiled
+ * on the first call to a program processing many values at once.
+ * The functions passed to av_expr_parse() must then not depend on the
+ * order in which they are called; they are only called for the values
+ * which would have been passed to them by av_expr_eval().
+ *
+ * @param e the AVExpr to evaluate
+ * @param res array of nb values where the results are stored
+ * @param nb number of evaluations, may be 0 to only prepare e for later calls
+ * @param const_values array of values for the identifiers from av_expr_parse()
+ *                     const_names which do not change between evaluations
+ * @param const_arrays NULL, or an array of pointers for each identifier from
+ *                     av_expr_parse() const_names, either NULL if the value of
+ *                     the identifier is const_values[i] for all evaluations,
+ *                     or pointing to nb values of the identifier, one per
+ *                     evaluation
+ * @param opaque a pointer which will be passed to all functions from funcs1 and funcs2
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int av_expr_eval_batch(AVExpr *e, double *res, int nb,
+                       const double *const_values, const double *const *const_arrays,
+                       void *opaque);
+
 /**
  * Track the presence of variables and their number of occurrences in a parsed expression
  *
@@ -37,6 +37,69 @@ static const char *const const_names[] = {
     0
 };
 
+static const char *const batch_const_names[] = {
+    "X",
+    "Y",
+    "N",
+    0
+};
+
+/* counts its calls, which must be the same for both evaluation paths */
+static double half(void *opaque, double x)
+{
+    (*(int *)opaque)++;
+    return x / 2;
+}
+
+static double (* const batch_funcs1[])(void *, double) = { half, NULL };
+static const char *const batch_funcs1_names[] = { "half", NULL };
+
+#define BATCH_NB 150
+
+static void check_batch(const char *s)
+{
+    const double values[] = { NAN, NAN, 42 };
+    double x[BATCH_NB], y[BATCH_NB], ref[BATCH_NB], res[BATCH_NB];
+    const double *arrays[] = { x, y, NULL };
+    AVExpr *e_ref = NULL, *e_batch = NULL;
+    int i, calls_ref = 0, calls_batch = 0;
+
+    for (i = 0; i < BATCH_NB; i++) {
+        x[i] = i - 20;
+        y[i] = (i * 37) % 101 / 4.0;
+    }
+
+    if (av_expr_parse(&e_ref, s, batch_const_names, batch_funcs1_names, batch_funcs1,
+                      NULL, NULL, 0, NULL) < 0 ||
+        av_expr_parse(&e_batch, s, batch_const_names, batch_funcs1_names, batch_funcs1,
+                      NULL, NULL, 0, NULL) < 0) {
+        printf("'%s' failed to parse\n", s);
+        goto end;
+    }
+
+    for (i = 0; i < BATCH_NB; i++) {
+        double v[3] = { x[i], y[i], values[2] };
+        ref[i] = av_expr_eval(e_ref, v, &calls_ref);
+    }
+    if (av_expr_eval_batch(e_batch, res, BATCH_NB, values, arrays, &calls_batch) < 0) {
+        printf("'%s' batch evaluation failed\n", s);
+        goto end;
+    }
+    for (i = 0; i < BATCH_NB; i++)
+        if (memcmp(&ref[i], &res[i], sizeof(ref[i])) && !(isnan(ref[i]) && isnan(res[i])))
+            break;
+    if (i < BATCH_NB)
+        printf("'%s' batch mismatch at %d: %f != %f\n", s, i, res[i], ref[i]);
+    else if (calls_batch != calls_ref)
+        printf("'%s' batch calls mismatch: %d != %d\n", s, calls_batch, calls_ref);
+    else
+        printf("'%s' batch -> %f\n", s, res[BATCH_NB - 1]);
+
+end:
+    av_expr_free(e_ref);
+    av_expr_free(e_batch);
+}
+
 int main(int argc, char **argv)
 {
     int i;
@@ -168,6 +231,34 @@ int main(int argc, char **argv)
     if (ret < 0)
         printf("av_expr_parse_and_eval failed\n");
 
+    printf("\n");
+    {
+        static const char *const batch_exprs[] = {
+            "42",
+            "Y",
+            "-X",
+            "X*2+Y-N",
+            "sin(PI/4)*X",
+            "if(gt(X,Y), X-Y, sqrt(X))",
+            "ifnot(mod(X,3), -X, hypot(X,Y)^0.5)",
+            "-clip(X-50, -10, 10)*between(X, 10, 90)",
+            "clip(X, Y, 20)",
+            "lerp(X, Y, 0.25)+squish(X/100)-gauss(X/50)",
+            "if(gte(X, 0), bitand(X, 5)+bitor(X, 2)+gcd(X, 12))",
+            "-(X;Y)+sgn(X-50)+round(X/7)+floor(-X/3)+ceil(X/3)+trunc(X/9)",
+            "atan2(X, Y)+isnan(X/0-X/0)+isinf(Y/X)+not(X)+pow(2, X/16)",
+            "max(X, Y)-min(X, N)+eq(X, 4)+lte(X, Y)+lt(X, Y)",
+            "half(X)*if(lt(X, 20), half(100-X), -half(Y))",
+            "st(0, ld(0)+X); ld(0)",
+            "half(X); Y",
+            "if(lt(X, 10), half(Y)); half(X); X*Y",
+            NULL
+        };
+
+        for (expr = batch_exprs; *expr; expr++)
+            check_batch(*expr);
+    }
+
     if (argc > 1 && !strcmp(argv[1], "-t")) {
         for (i = 0; i < 1050; i++) {
             START_TIMER;
@@ -0,0 +1,238 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * Buffer source border hint test: frames allocated with the border
+ * reported by av_buffersrc_get_video_border() must be padded in place,
+ * with the same output as frames that have to be copied.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersink.h"
+#include "libavfilter/buffersrc.h"
+#include "libavutil/frame.h"
+#include "libavutil/pixdesc.h"
+
+#define WIDTH  64
+#define HEIGHT 48
+#define FORMAT AV_PIX_FMT_YUV420P
+
+static const int expected_border[4] = { 8, 4, 24, 12 };
+
+static int init_graph(AVFilterGraph **graph, AVFilterContext **src,
+                      AVFilterContext **sink)
+{
+    AVFilterContext *null, *pad;
+    int ret;
+
+    *graph = avfilter_graph_alloc();
+    if (!*graph)
+        return AVERROR(ENOMEM);
+
+    ret = avfilter_graph_create_filter(src, avfilter_get_by_name("buffer"), "src",
+                                       "video_size=64x48:pix_fmt=yuv420p:time_base=1/25",
+                                       NULL, *graph);
+    if (ret < 0)
+        return ret;
+    /* the border must be reported through metadata-only filters */
+    ret = avfilter_graph_create_filter(&null, avfilter_get_by_name("null"), "null",
+                                       NULL, NULL, *graph);
+    if (ret < 0)
+        return ret;
+    ret = avfilter_graph_create_filter(&pad, avfilter_get_by_name("pad"), "pad",
+                                       "w=96:h=64:x=8:y=4:color=red", NULL, *graph);
+    if (ret < 0)
+        return ret;
+    ret = avfilter_graph_create_filter(sink, avfilter_get_by_name("buffersink"), "sink",
+                                       NULL, NULL, *graph);
+    if (ret < 0)
+        return ret;
+
+    if ((ret = avfilter_link(*src, 0, null, 0))  < 0 ||
+        (ret = avfilter_link(null, 0, pad, 0))   < 0 ||
+        (ret = avfilter_link(pad, 0, *sink, 0))  < 0)
+        return ret;
+
+    return avfilter_graph_config(*graph, NULL);
+}
+
+/* allocate a frame with the given room around the picture, in pixels */
+static AVFrame *alloc_frame(const int border[4])
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(FORMAT);
+    AVFrame *frame = av_frame_alloc();
+
+    if (!frame)
+        return NULL;
+
+    frame->format = FORMAT;
+    frame->width  = WIDTH  + border[0] + border[2];
+    frame->height = HEIGHT + border[1] + border[3];
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+    frame->width  = WIDTH;
+    frame->height = HEIGHT;
+
+    for (int i = 0; i < desc->nb_components; i++) {
+        int hsub = (i == 1 || i == 2) ? desc->log2_chroma_w : 0;
+        int vsub = (i == 1 || i == 2) ? desc->log2_chroma_h : 0;
+        frame->data[i] += (border[1] >> vsub) * frame->linesize[i] +
+                          (border[0] >> hsub);
+    }
+
+    return frame;
+}
+
+static void fill_frame(AVFrame *frame, int n)
+{
+    for (int i = 0; i < 3; i++) {
+        int w = i ? WIDTH  >> 1 : WIDTH;
+        int h = i ? HEIGHT >> 1 : HEIGHT;
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++)
+                frame->data[i][y * frame->linesize[i] + x] = x * 3 + y * 7 + n * 11 + i * 50;
+    }
+}
+
+static int compare_frames(const AVFrame *a, const AVFrame *b)
+{
+    if (a->width != b->width || a->height != b->height || a->format != b->format)
+        return 1;
+
+    for (int i = 0; i < 3; i++) {
+        int w = i ? a->width  >> 1 : a->width;
+        int h = i ? a->height >> 1 : a->height;
+        for (int y = 0; y < h; y++)
+            if (memcmp(a->data[i] + y * a->linesize[i],
+                       b->data[i] + y * b->linesize[i], w))
+                return 1;
+    }
+
+    return 0;
+}
+
+/* filter one frame, returning whether pad worked in place */
+static int filter_frame(AVFilterContext *src, AVFilterContext *sink,
+                        AVFrame *in, AVFrame *out)
+{
+    const uint8_t *buf_start = in->buf[0]->data;
+    const uint8_t *buf_end   = buf_start + in->buf[0]->size;
+    int ret;
+
+    ret = av_buffersrc_add_frame(src, in);
+    if (ret < 0)
+        return ret;
+    ret = av_buffersink_get_frame(sink, out);
+    if (ret < 0)
+        return ret;
+
+    return out->data[0] >= buf_start && out->data[0] < buf_end;
+}
+
+int main(void)
+{
+    static const int no_border[4] = { 0 };
+    AVFilterGraph *graph = NULL;
+    AVFilterContext *src, *sink;
+    AVFrame *in, *out_border = NULL, *out_copy = NULL;
+    int border[4], ret;
+
+    ret = init_graph(&graph, &src, &sink);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to create the filtergraph\n");
+        goto end;
+    }
+
+    ret = av_buffersrc_get_video_border(src, border);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to get the border\n");
+        goto end;
+    }
+    if (memcmp(border, expected_border, sizeof(border))) {
+        fprintf(stderr, "Unexpected border %d %d %d %d\n",
+                border[0], border[1], border[2], border[3]);
+        ret = 1;
+        goto end;
+    }
+
+    out_border = av_frame_alloc();
+    out_copy   = av_frame_alloc();
+    if (!out_border || !out_copy) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    for (int n = 0; n < 4; n++) {
+        in = alloc_frame(border);
+        if (!in) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        fill_frame(in, n);
+        in->pts = 2 * n;
+        ret = filter_frame(src, sink, in, out_border);
+        av_frame_free(&in);
+        if (ret < 0)
+            goto end;
+        if (!ret) {
+            fprintf(stderr, "Frame %d with border was copied\n", n);
+            ret = 1;
+            goto end;
+        }
+
+        in = alloc_frame(no_border);
+        if (!in) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        fill_frame(in, n);
+        in->pts = 2 * n + 1;
+        ret = filter_frame(src, sink, in, out_copy);
+        av_frame_free(&in);
+        if (ret < 0)
+            goto end;
+        if (ret) {
+            fprintf(stderr, "Frame %d without border was padded in place\n", n);
+            ret = 1;
+            goto end;
+        }
+
+        if (compare_frames(out_border, out_copy)) {
+            fprintf(stderr, "Frame %d differs between in place and copy\n", n);
+            ret = 1;
+            goto end;
+        }
+        av_frame_unref(out_border);
+        av_frame_unref(out_copy);
+    }
+
+    ret = 0;
+
+end:
+    av_frame_free(&out_border);
+    av_frame_free(&out_copy);
+    avfilter_graph_free(&graph);
+    return ret ? 1 : 0;
+}
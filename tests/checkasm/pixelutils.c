@@ -0,0 +1,80 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "libavutil/mem_internal.h"
+#include "libavutil/pixelutils.h"
+
+#include "checkasm.h"
+
+#define MAX_BLOCK 32
+#define STRIDE    (MAX_BLOCK * 3)
+#define BUF_SIZE  (STRIDE * (MAX_BLOCK + 1))
+
+static void check_sad(int n, int aligned, const uint8_t *src1, const uint8_t *src2)
+{
+    static const char *const align_names[] = { "", "_u", "_a" };
+    const int size = 1 << n;
+    av_pixelutils_sad_fn sad = av_pixelutils_get_sad_fn(n, n, aligned, NULL);
+
+    declare_func(int, const uint8_t *src1, ptrdiff_t stride1,
+                 const uint8_t *src2, ptrdiff_t stride2);
+
+    if (!sad)
+        return;
+
+    if (check_func(sad, "sad%s_%dx%d", align_names[aligned], size, size)) {
+        for (int i = 0; i < 8; i++) {
+            /* Only the aligned sources must stay on a block boundary. */
+            int off1 = aligned >= 1 ? (rnd() % 3) * size : rnd() % (STRIDE - size);
+            int off2 = aligned >= 2 ? (rnd() % 3) * size : rnd() % (STRIDE - size);
+            int ref, new;
+
+            ref = call_ref(src1 + off1, STRIDE, src2 + off2, STRIDE);
+            new = call_new(src1 + off1, STRIDE, src2 + off2, STRIDE);
+
+            if (ref != new) {
+                fprintf(stderr, "sad%s_%dx%d: %d != %d (offsets %d, %d)\n",
+                        align_names[aligned], size, size, ref, new, off1, off2);
+                fail();
+                break;
+            }
+        }
+        bench_new(src1, STRIDE, src2 + (aligned >= 2 ? 0 : 1), STRIDE);
+    }
+}
+
+void checkasm_check_pixelutils(void)
+{
+    LOCAL_ALIGNED_32(uint8_t, src1, [BUF_SIZE]);
+    LOCAL_ALIGNED_32(uint8_t, src2, [BUF_SIZE]);
+
+    for (int i = 0; i < BUF_SIZE; i++) {
+        src1[i] = rnd();
+        src2[i] = rnd();
+    }
+    /* Saturate a few rows to catch overflows in the accumulators. */
+    memset(src1, 0xFF, STRIDE * 4);
+    memset(src2, 0x00, STRIDE * 4);
+
+    for (int n = 1; n <= 5; n++)
+        for (int aligned = 0; aligned <= 2; aligned++)
+            check_sad(n, aligned, src1, src2);
+    report("sad");
+}
@@ -248,6 +248,29 @@ enc_dec(){
         run ffprobe${PROGSUF}${EXECSUF} -bitexact $ffprobe_opts $tencfile || return
 }
 
+# Encode and fail unless the output is within tolerance percent of the
+# target size in bytes, for checking rate control.
+enc_size(){
+    enc_fmt_in=$1
+    srcfile=$2
+    enc_fmt_out=$3
+    enc_opt_out=$4
+    target=$5
+    tolerance=$6
+    encfile="${outdir}/${test}.${enc_fmt_out}"
+    cleanfiles="$cleanfiles $encfile"
+    tsrcfile=$(target_path $srcfile)
+    tencfile=$(target_path $encfile)
+
+    ffmpeg -auto_conversion_filters -f $enc_fmt_in $DEC_OPTS -i $tsrcfile $ENC_OPTS $enc_opt_out $FLAGS \
+        -f $enc_fmt_out -y $tencfile || return
+    size=$(wc -c < $encfile)
+    if [ "$(compare $size $target $(($target * $tolerance / 100)))" != 0 ]; then
+        echo "size: |$size - $target| > $tolerance%"
+        return 1
+    fi
+}
+
 transcode(){
     src_fmt=$1
     srcfile=$2
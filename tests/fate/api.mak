@@ -27,6 +27,11 @@ fate-api-threadmessage: $(APITESTSDIR)/api-threadmessage-test$(EXESUF)
 fate-api-threadmessage: CMD = run $(APITESTSDIR)/api-threadmessage-test$(EXESUF) 3 10 30 50 2 20 40
 fate-api-threadmessage: CMP = null
 
+FATE_API-$(call ALLYES, NULL_FILTER PAD_FILTER) += fate-api-pad-border
+fate-api-pad-border: $(APITESTSDIR)/api-pad-border-test$(EXESUF)
+fate-api-pad-border: CMD = run $(APITESTSDIR)/api-pad-border-test$(EXESUF)
+fate-api-pad-border: CMP = null
+
 FATE_API_SAMPLES-$(CONFIG_AVFORMAT) += $(FATE_API_SAMPLES_LIBAVFORMAT-yes)
 
 ifdef SAMPLES
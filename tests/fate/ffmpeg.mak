@@ -23,6 +23,24 @@ fate-force_key_frames: CMD = enc_dec \
   avi "-c mpeg4 -g 240 -qscale 10 -force_key_frames 0.5,0:00:01.5" \
   framecrc "" "-skip_frame nokey"
 
+# MJPEG with a bitrate target, with frame threads sharing one rate control;
+# the 50 frames at 25 fps must come within 5% of the 1000000 bytes targeted
+FATE_FFMPEG-$(call ENCDEC2, MJPEG, RAWVIDEO, AVI, RAWVIDEO_DEMUXER RAWVIDEO_MUXER SCALE_FILTER) += fate-mjpeg-threaded-rc
+fate-mjpeg-threaded-rc: tests/data/vsynth1.yuv
+fate-mjpeg-threaded-rc: CMD = enc_dec \
+  "rawvideo -s 352x288 -pix_fmt yuv420p" tests/data/vsynth1.yuv \
+  avi "-c mjpeg -pix_fmt yuvj420p -b:v 4M -threads 4 -thread_type frame -threaded_rc 1" \
+  rawvideo "-pix_fmt yuv420p"
+fate-mjpeg-threaded-rc: CMP_UNIT = 1
+
+FATE_FFMPEG-$(call ENCDEC, MJPEG, MJPEG, RAWVIDEO_DEMUXER SCALE_FILTER) += fate-mjpeg-threaded-rc-size
+fate-mjpeg-threaded-rc-size: tests/data/vsynth1.yuv
+fate-mjpeg-threaded-rc-size: CMD = enc_size \
+  "rawvideo -s 352x288 -pix_fmt yuv420p" tests/data/vsynth1.yuv \
+  mjpeg "-c mjpeg -pix_fmt yuvj420p -b:v 4M -threads 4 -thread_type frame -threaded_rc 1" \
+  1000000 5
+fate-mjpeg-threaded-rc-size: CMP = null
+
 # test -force_key_frames source with and without framerate conversion
 # * we don't care about the actual video content, so replace it with
 #   a 2x2 black square to speed up encoding
@@ -85,6 +85,9 @@ fate-filter-lavd-testsrc: CMD = framecrc -f lavfi -i testsrc=r=7:n=2:d=10
 FATE_FILTER-$(call FILTERFRAMECRC, TESTSRC2) += $(addprefix fate-filter-testsrc2-, yuv420p yuv444p rgb24 rgba)
 fate-filter-testsrc2-%: CMD = framecrc -lavfi testsrc2=r=7:d=10 -pix_fmt $(word 4, $(subst -, ,$(@)))
 
+FATE_FILTER-$(call FILTERFRAMECRC, TESTSRC2 SPLIT HFLIP VFLIP NEGATE XSTACK) += fate-filter-xstack-grid
+fate-filter-xstack-grid: CMD = framecrc -lavfi "testsrc2=s=256x144:r=7:d=2,split=4[a][b][c][d];[b]hflip[b1];[c]vflip[c1];[d]negate[d1];[a][b1][c1][d1]xstack=grid=2x2"
+
 FATE_FILTER-$(call FILTERFRAMECRC, ALLRGB) += fate-filter-allrgb
 fate-filter-allrgb: CMD = framecrc -lavfi allrgb=rate=5:duration=1 -pix_fmt rgb24
 
@@ -173,6 +176,10 @@ fate-filter-minterpolate-down: CMD = framecrc -lavfi testsrc2=r=2:d=10,minterpol
 FATE_FILTER_VSYNTH_PGMYUV-$(CONFIG_BOXBLUR_FILTER) += fate-filter-boxblur
 fate-filter-boxblur: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf boxblur=2:1
 
+FATE_FILTER_VSYNTH_PGMYUV-$(CONFIG_BOXBLUR_FILTER) += fate-filter-boxblur-threads
+fate-filter-boxblur-threads: CMD = framecrc -filter_threads 3 -c:v pgmyuv -i $(SRC) -vf boxblur=2:1
+fate-filter-boxblur-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-boxblur
+
 FATE_FILTER_VSYNTH_PGMYUV-$(call ALLYES, COLORCHANNELMIXER_FILTER SCALE_FILTER FORMAT_FILTER PERMS_FILTER) += fate-filter-colorchannelmixer
 fate-filter-colorchannelmixer: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf scale,format=rgb24,perms=random,colorchannelmixer=.31415927:.4:.31415927:0:.27182818:.8:.27182818:0:.2:.6:.2:0 -flags +bitexact -sws_flags +accurate_rnd+bitexact
 
@@ -375,6 +382,10 @@ fate-filter-unsharp: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf unsharp=11:11:-1.5
 FATE_FILTER_VSYNTH-$(call FILTERFRAMECRC, TESTSRC2 SCALE UNSHARP) += fate-filter-unsharp-yuv420p10
 fate-filter-unsharp-yuv420p10: CMD = framecrc -lavfi testsrc2=r=2:d=10,scale,format=yuv420p10,unsharp=11:11:-1.5:11:11:-1.5,scale -pix_fmt yuv420p10le -flags +bitexact -sws_flags +accurate_rnd+bitexact
 
+FATE_FILTER_VSYNTH-$(call FILTERFRAMECRC, TESTSRC2 SCALE UNSHARP) += fate-filter-unsharp-yuv420p10-threads
+fate-filter-unsharp-yuv420p10-threads: CMD = framecrc -filter_threads 8 -lavfi testsrc2=r=2:d=10,scale,format=yuv420p10,unsharp=11:11:-1.5:11:11:-1.5,scale -pix_fmt yuv420p10le -flags +bitexact -sws_flags +accurate_rnd+bitexact
+fate-filter-unsharp-yuv420p10-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-unsharp-yuv420p10
+
 FATE_FILTER_SAMPLES-$(call FILTERDEMDEC, PERMS HQDN3D, SMJPEG, MJPEG) += fate-filter-hqdn3d-sample
 fate-filter-hqdn3d-sample: tests/data/filtergraphs/hqdn3d
 fate-filter-hqdn3d-sample: CMD = framecrc -idct simple -i $(TARGET_SAMPLES)/smjpeg/scenwin.mjpg -/filter_complex $(TARGET_PATH)/tests/data/filtergraphs/hqdn3d -an
@@ -735,6 +746,10 @@ FREEZEDETECT_DEPS = LAVFI_INDEV MPTESTSRC_FILTER SCALE_FILTER FREEZEDETECT_FILTE
 FATE_METADATA_FILTER-$(call ALLYES, $(FREEZEDETECT_DEPS)) += fate-filter-metadata-freezedetect
 fate-filter-metadata-freezedetect: CMD = run $(FILTER_METADATA_COMMAND) "sws_flags=+accurate_rnd+bitexact;mptestsrc=r=25:d=10:m=51,freezedetect"
 
+QCDETECT_DEPS = LAVFI_INDEV TESTSRC2_FILTER PAD_FILTER FADE_FILTER LOOP_FILTER SCALE_FILTER QCDETECT_FILTER
+FATE_METADATA_FILTER-$(call ALLYES, $(QCDETECT_DEPS)) += fate-filter-metadata-qcdetect
+fate-filter-metadata-qcdetect: CMD = run $(FILTER_METADATA_COMMAND) "sws_flags=+accurate_rnd+bitexact;testsrc2=s=320x180:r=25:d=2,pad=320:240:0:30,fade=in:0:10,loop=loop=30:size=1:start=20,qcdetect=black_min_duration=0.1:freeze_duration=0.5"
+
 SIGNALSTATS_DEPS = LAVFI_INDEV COLOR_FILTER SCALE_FILTER SIGNALSTATS_FILTER
 FATE_METADATA_FILTER-$(call ALLYES, $(SIGNALSTATS_DEPS)) += fate-filter-metadata-signalstats-yuv420p fate-filter-metadata-signalstats-yuv420p10
 fate-filter-metadata-signalstats-yuv420p: CMD = run $(FILTER_METADATA_COMMAND) "sws_flags=+accurate_rnd+bitexact;color=white:duration=1:r=1,signalstats"
@@ -789,6 +804,12 @@ fate-filter-refcmp-psnr-rgb: CMD = refcmp_metadata psnr rgb24 0.002
 FATE_FILTER_REFCMP_METADATA-$(CONFIG_PSNR_FILTER) += fate-filter-refcmp-psnr-yuv
 fate-filter-refcmp-psnr-yuv: CMD = refcmp_metadata psnr yuv422p 0.0015
 
+FATE_FILTER_REFCMP_METADATA-$(CONFIG_QUALITYMETRICS_FILTER) += fate-filter-refcmp-qualitymetrics-yuv
+fate-filter-refcmp-qualitymetrics-yuv: CMD = refcmp_metadata qualitymetrics yuv422p 0.0015
+
+FATE_FILTER_REFCMP_METADATA-$(CONFIG_QUALITYMETRICS_FILTER) += fate-filter-refcmp-qualitymetrics-all-yuv
+fate-filter-refcmp-qualitymetrics-all-yuv: CMD = refcmp_metadata qualitymetrics=metrics=psnr+ssim+xpsnr+vmafmotion yuv422p 0.0015
+
 FATE_FILTER_REFCMP_METADATA-$(call ALLYES, SSIM_FILTER SCALE_FILTER) += fate-filter-refcmp-ssim-rgb
 fate-filter-refcmp-ssim-rgb: CMD = refcmp_metadata ssim rgb24 0.015
 
@@ -242,6 +242,20 @@ FATE_H264-$(call FRAMECRC, MPEGTS, H264, H264_PARSER MP3_DECODER SCALE_FILTER AR
 FATE_H264_FFPROBE-$(call DEMDEC, MATROSKA, H264) += fate-h264-dts_5frames
 FATE_H264_FFPROBE-$(call PARSERDEMDEC, H264, H264, H264) += fate-h264-afd
 
+# decoded with slice threads: multi-slice pictures deblocked across slice
+# boundaries, so that some pictures end in a batch made of a single slice,
+# and single-slice pictures, whose deblocking is pipelined behind the
+# entropy decoder
+FATE_H264_SLICE_THREADS := ba1_ft_c ba3_sva_c ci1_ft_b caba3_sony_c sva_ba1_b
+FATE_H264-$(call FRAMECRC, H264, H264, H264_PARSER) += $(FATE_H264_SLICE_THREADS:%=fate-h264-slice-threads-%)
+
+fate-h264-slice-threads-ba1_ft_c: CMD = threads=3 thread_type=slice framecrc -framerate 19 -i $(TARGET_SAMPLES)/h264-conformance/BA1_FT_C.264
+fate-h264-slice-threads-ba3_sva_c: CMD = threads=3 thread_type=slice framecrc -i $(TARGET_SAMPLES)/h264-conformance/BA3_SVA_C.264
+fate-h264-slice-threads-ci1_ft_b: CMD = threads=3 thread_type=slice framecrc -i $(TARGET_SAMPLES)/h264-conformance/CI1_FT_B.264
+fate-h264-slice-threads-caba3_sony_c: CMD = threads=3 thread_type=slice framecrc -i $(TARGET_SAMPLES)/h264-conformance/CABA3_Sony_C.jsv
+fate-h264-slice-threads-sva_ba1_b: CMD = threads=3 thread_type=slice framecrc -i $(TARGET_SAMPLES)/h264-conformance/SVA_BA1_B.264
+$(FATE_H264_SLICE_THREADS:%=fate-h264-slice-threads-%): REF = $(SRC_PATH)/tests/ref/fate/$(@:fate-h264-slice-threads-%=h264-conformance-%)
+
 FATE_SAMPLES_AVCONV += $(FATE_H264-yes)
 FATE_SAMPLES_FFPROBE += $(FATE_H264_FFPROBE-yes)
 fate-h264: $(FATE_H264-yes) $(FATE_H264_FFPROBE-yes)
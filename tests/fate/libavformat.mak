@@ -2,6 +2,11 @@
 #fate-async: libavformat/tests/async$(EXESUF)
 #fate-async: CMD = run libavformat/tests/async
 
+FATE_LIBAVFORMAT_HTTP-$(CONFIG_HTTP_PROTOCOL) += fate-http
+FATE_LIBAVFORMAT-$(HAVE_PTHREADS) += $(FATE_LIBAVFORMAT_HTTP-yes)
+fate-http: libavformat/tests/http$(EXESUF)
+fate-http: CMD = run libavformat/tests/http$(EXESUF)
+
 FATE_LIBAVFORMAT-$(CONFIG_NETWORK) += fate-noproxy
 fate-noproxy: libavformat/tests/noproxy$(EXESUF)
 fate-noproxy: CMD = run libavformat/tests/noproxy$(EXESUF)
@@ -26,6 +31,10 @@ FATE_LIBAVFORMAT-$(CONFIG_IMF_DEMUXER) += fate-imf
 fate-imf: libavformat/tests/imf$(EXESUF)
 fate-imf: CMD = run libavformat/tests/imf$(EXESUF)
 
+FATE_LIBAVFORMAT += fate-index
+fate-index: libavformat/tests/index$(EXESUF)
+fate-index: CMD = run libavformat/tests/index$(EXESUF)
+
 FATE_LIBAVFORMAT += fate-seek_utils
 fate-seek_utils: libavformat/tests/seek_utils$(EXESUF)
 fate-seek_utils: CMD = run libavformat/tests/seek_utils$(EXESUF)
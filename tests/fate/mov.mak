@@ -229,6 +229,21 @@ fate-mov-vfr: CMD = md5 -filter_complex testsrc=size=2x2:duration=1,setpts=N*N:s
 fate-mov-vfr: CMP = oneline
 fate-mov-vfr: REF = 1558b4a9398d8635783c93f84eb5a60d
 
+# Test on-demand sample lookup and seeking with the lazy_index option,
+# which must give the same results as the full index
+tests/data/mov-lazy-index.mov: TAG = GEN
+tests/data/mov-lazy-index.mov: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin -threads 1 -filter_threads 1 \
+        -filter_complex "testsrc2=size=64x48:rate=25:duration=16[v];sine=duration=16[a]" \
+        -map "[v]" -map "[a]" -c:v mpeg4 -q:v 5 -bf 2 -g 10 -c:a pcm_s16le \
+        -flags +bitexact -fflags +bitexact -y $(TARGET_PATH)/$@ 2>/dev/null
+
+FATE_MOV_FFMPEG-$(call ALLYES, MPEG4_ENCODER PCM_S16LE_ENCODER MOV_MUXER MOV_DEMUXER TESTSRC2_FILTER SINE_FILTER) += fate-mov-lazy-index-off fate-mov-lazy-index-on
+fate-mov-lazy-index-off fate-mov-lazy-index-on: tests/data/mov-lazy-index.mov libavformat/tests/seek$(EXESUF)
+fate-mov-lazy-index-off: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/mov-lazy-index.mov -lazy_index 0
+fate-mov-lazy-index-on:  CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/mov-lazy-index.mov -lazy_index 1
+fate-mov-lazy-index-off fate-mov-lazy-index-on: REF = $(SRC_PATH)/tests/ref/fate/mov-lazy-index
+
 FATE_MOV_FFMPEG_FFPROBE-$(call TRANSCODE, FLAC, MOV, WAV_DEMUXER PCM_S16LE_DECODER) += fate-mov-mp4-iamf-stereo
 fate-mov-mp4-iamf-stereo: tests/data/asynth-44100-2.wav tests/data/streamgroups/audio_element-stereo tests/data/streamgroups/mix_presentation-stereo
 fate-mov-mp4-iamf-stereo: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav